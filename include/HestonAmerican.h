@@ -0,0 +1,95 @@
+/**
+ *       @file  HestonAmerican.h
+ *      @brief  The HestonFour BarbequeRTRM application
+ *
+ * Description: Longstaff-Schwartz pricing of an American (Bermudan) put. The spot and the variance of every
+ *		training path at every exercise date are kept in a single arena allocation, stored as floats in
+ *		[date][path] layout so that the regression of a date streams over contiguous memory. The
+ *		continuation value is regressed backward in time on polynomials of spot and variance, the
+ *		exercise rule is then applied to an independent path set for a low-biased price.
+ *
+ *     @author  Luca Napoletano, luca.napoletano@mail.polimi.it, Claudio Montanari, claudio1.montanari@mail.polimi.it
+ *
+ *     Company  Politecnico di Milano
+ *   Copyright  Copyright (c) 2017, Luca Napoletano, Claudio Montanari
+ *
+ * This source code is released for free distribution under the terms of the
+ * GNU General Public License as published by the Free Software Foundation.
+ * =====================================================================================
+ */
+
+#ifndef HESTONAMERICAN_H_
+#define HESTONAMERICAN_H_
+
+#include <stddef.h>
+#include <vector>
+
+/**
+ * Number of basis functions of the regression: 1, S, S^2, v, v^2, S v (normalized by K and theta)
+ */
+#define LSM_BASIS 6
+
+/**
+ * Size of the partial sums of a path range: the normal equations (LSM_BASIS x LSM_BASIS), the right hand
+ * side (LSM_BASIS) and the number of in the money paths
+ */
+#define LSM_SUMS (LSM_BASIS * LSM_BASIS + LSM_BASIS + 1)
+
+class HestonAmerican {
+
+public:
+
+	HestonAmerican(long paths, int dates, double K, double r, double T, double theta);
+	~HestonAmerican();
+
+	long getPaths() const;
+	int getDates() const;
+	size_t getBytes() const;
+	double exerciseTime(int date) const;
+
+	void store(long path, int date, double spot, double variance);
+	void setCashflow(long path, double value);
+	double payoff(int date, double spot) const;
+
+	void accumulate(int date, long first, long count, double * sums) const;
+	void regress(int date, double const * sums);
+	void exercise(int date, long first, long count);
+	bool exercises(int date, double spot, double variance) const;
+	double price() const;
+
+private:
+
+	long PATHS;
+	int DATES;
+
+	double K;
+	double r;
+	double T;
+	double theta;
+
+	/**
+	 * The arena: spots and variances as [date][path] floats, then the cashflow of every path discounted to 0
+	 */
+	char * arena;
+	size_t BYTES;
+	float * spots;
+	float * variances;
+	double * cashflows;
+
+	/**
+	 * Regression coefficients of the continuation value, [date][basis], and whether a date has enough in the
+	 * money paths to be regressed (otherwise it is never an exercise date)
+	 */
+	std::vector<double> coefficients;
+	std::vector<char> regressed;
+
+	/**
+	 * Discount factor of every exercise date
+	 */
+	std::vector<double> discounts;
+
+	void basis(double spot, double variance, double * phi) const;
+
+};
+
+#endif // HESTONAMERICAN_H_
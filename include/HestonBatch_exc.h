@@ -0,0 +1,125 @@
+/**
+ *       @file  HestonBatch_exc.h
+ *      @brief  The HestonFour BarbequeRTRM application
+ *
+ * Description: The batch pricing EXC: a long running application which prices a stream of requests with one
+ *		pool of workers, registered once to the BarbequeRTRM. Every cycle takes the queued requests,
+ *		splits their paths in chunks which the workers steal from each other, and replies to each
+ *		request as soon as its chunks are reduced, in the order of arrival. With a result cache, a
+ *		request only simulates the paths its cached entry does not have.
+ *
+ *     @author  Luca Napoletano, luca.napoletano@mail.polimi.it, Claudio Montanari, claudio1.montanari@mail.polimi.it
+ *
+ *     Company  Politecnico di Milano
+ *   Copyright  Copyright (c) 2017, Luca Napoletano, Claudio Montanari
+ *
+ * This source code is released for free distribution under the terms of the
+ * GNU General Public License as published by the Free Software Foundation.
+ * =====================================================================================
+ */
+
+#ifndef HESTONBATCH_EXC_H_
+#define HESTONBATCH_EXC_H_
+
+#include <bbque/bbque_exc.h>
+
+#include "HestonCache.h"
+#include "HestonMetrics.h"
+#include "HestonPool.h"
+#include "HestonScheduler.h"
+#include "HestonServer.h"
+#include "HestonSettings.h"
+#include "HestonStats.h"
+#include "HestonWorker.h"
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+using bbque::rtlib::BbqueEXC;
+
+class HestonBatch : public BbqueEXC {
+
+public:
+
+	HestonBatch(std::string const & name,
+			std::string const & recipe,
+			RTLIB_Services_t *rtlib, HestonSettings const & settings, HestonServer* server, int batch);
+
+	long getRequestsDone() const;
+
+private:
+
+	HestonSettings settings;
+	HestonServer* server;
+	HestonPool* pool;
+	HestonWorker** workers;
+	HestonScheduler* scheduler;
+	int WORKERS;
+	int NUM_PROC;
+	/**
+	 * Requests taken by a cycle, and the wait for the first one (ms)
+	 */
+	int BATCH;
+	const double IDLE_WAIT = 100.0;
+	/**
+	 * A request of N paths simulates the first N paths of a run of hestonfour with the same seed: blocks
+	 * of WORKERS_SIM paths in chunks of CHUNK_SIM
+	 */
+	const int WORKERS_SIM = 10000;
+	const int CHUNK_SIM = 400;
+
+	/**
+	 * A chunk of a request, with its results
+	 */
+	struct Chunk {
+		int job;
+		int block;
+		int first;
+		HestonPartial partial;
+	};
+
+	/**
+	 * The requests of the cycle with their statistics, and their chunks
+	 */
+	std::vector<HestonJob> jobs;
+	std::vector<HestonStats> jobStats;
+	std::vector<long> jobLast;
+	std::vector<Chunk> chunks;
+	HestonPartial empty;
+
+	long DONE_REQUESTS;
+	long DONE_SIMULATIONS;
+	HestonStats batchStats;
+
+	/**
+	 * Result cache: the key of every request of the cycle, and the requests answered from the cache, the
+	 * ones refined from a cached entry with the simulations they saved, and the last save of the cache
+	 */
+	HestonCache* cache;
+	std::vector<std::string> jobKeys;
+	long CACHE_HITS;
+	long CACHE_REFINED;
+	long CACHE_SAVED;
+	std::chrono::steady_clock::time_point cacheTime;
+
+	/**
+	 * Metrics of the workers and of the cycles, and the last write of their file
+	 */
+	HestonMetrics* metrics;
+	std::chrono::steady_clock::time_point metricsTime;
+
+	RTLIB_ExitCode_t onSetup();
+	RTLIB_ExitCode_t onConfigure(int8_t awm_id);
+	RTLIB_ExitCode_t onRun();
+	RTLIB_ExitCode_t onMonitor();
+	RTLIB_ExitCode_t onRelease();
+
+	void finish(int job);
+	std::string cacheKey(HestonJob const & job);
+	void saveCache();
+	void writeMetrics();
+
+};
+
+#endif // HESTONBATCH_EXC_H_
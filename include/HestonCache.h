@@ -0,0 +1,63 @@
+/**
+ *       @file  HestonCache.h
+ *      @brief  The HestonFour BarbequeRTRM application
+ *
+ * Description: Persistent cache of the Monte Carlo results, keyed on everything which selects the paths:
+ *		option, model, discretization, scheme, kernel and seed. An entry holds the statistics of the
+ *		first paths of the run, reduced in chunk order, so that a request for more paths goes on from
+ *		them and gives the same result as a run from scratch. The least recently used entries are
+ *		dropped beyond the capacity. The cache lives in a state file (see HestonCheckpoint).
+ *
+ *     @author  Luca Napoletano, luca.napoletano@mail.polimi.it, Claudio Montanari, claudio1.montanari@mail.polimi.it
+ *
+ *     Company  Politecnico di Milano
+ *   Copyright  Copyright (c) 2017, Luca Napoletano, Claudio Montanari
+ *
+ * This source code is released for free distribution under the terms of the
+ * GNU General Public License as published by the Free Software Foundation.
+ * =====================================================================================
+ */
+
+#ifndef HESTONCACHE_H_
+#define HESTONCACHE_H_
+
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+#include "HestonCheckpoint.h"
+#include "HestonStats.h"
+
+class HestonCache {
+
+public:
+
+	HestonCache(std::string const & path, size_t capacity);
+
+	int load();
+	bool save();
+
+	bool find(std::string const & key, HestonStats & stats);
+	void store(std::string const & key, HestonStats const & stats);
+
+	size_t size() const;
+	bool isDirty() const;
+	std::string const & getPath() const;
+
+private:
+
+	/**
+	 * The entries, the most recently used first, and their index
+	 */
+	typedef std::list<std::pair<std::string, HestonStats> > Entries;
+	Entries entries;
+	std::unordered_map<std::string, Entries::iterator> index;
+
+	size_t CAPACITY;
+	bool DIRTY;
+	HestonCheckpoint file;
+
+};
+
+#endif // HESTONCACHE_H_
@@ -0,0 +1,108 @@
+/**
+ *       @file  HestonCalibration.h
+ *      @brief  The HestonFour BarbequeRTRM application
+ *
+ * Description: Calibration of the Heston parameters to a market implied volatility surface. The weighted
+ *		price (or implied volatility) error is minimized with Levenberg-Marquardt, the Jacobian comes
+ *		from the analytic gradient of the Fourier pricer. The characteristic function of a maturity is
+ *		shared by all its strikes, the strikes are split in chunks evaluated in parallel on the pool.
+ *
+ *     @author  Luca Napoletano, luca.napoletano@mail.polimi.it, Claudio Montanari, claudio1.montanari@mail.polimi.it
+ *
+ *     Company  Politecnico di Milano
+ *   Copyright  Copyright (c) 2017, Luca Napoletano, Claudio Montanari
+ *
+ * This source code is released for free distribution under the terms of the
+ * GNU General Public License as published by the Free Software Foundation.
+ * =====================================================================================
+ */
+
+#ifndef HESTONCALIBRATION_H_
+#define HESTONCALIBRATION_H_
+
+#include <string>
+#include <vector>
+
+#include "HestonFourier.h"
+#include "HestonPool.h"
+
+/**
+ * Minimum number of strikes of a chunk, smaller chunks do not pay the characteristic function they recompute
+ */
+#define CALIBRATION_MIN_CHUNK 4
+
+class HestonCalibration {
+
+public:
+
+	/**
+	 * The calibration error: the weighted price error, or the weighted implied volatility error (the price
+	 * error divided by the Black-Scholes vega of the quote, its first order approximation)
+	 */
+	enum Error { PRICE_ERROR = 0, VOLATILITY_ERROR };
+
+	HestonCalibration(double S0, double r, HestonPool * pool);
+
+	int load(std::string const & path);
+	size_t size() const;
+
+	double calibrate(double * parameters, Error error, int maxIterations);
+	int getIterations() const;
+	double getPriceRmse() const;
+	double getVolatilityRmse() const;
+
+	static Error parseError(std::string const & name);
+	static const char* errorName(Error error);
+
+private:
+
+	/**
+	 * A quote of the surface: maturity, strike, implied volatility, weight, and the market price and the
+	 * Black-Scholes vega derived from the implied volatility
+	 */
+	struct Quote {
+		double T;
+		double K;
+		double volatility;
+		double weight;
+		double price;
+		double vega;
+	};
+
+	/**
+	 * A chunk of consecutive strikes of one maturity, the unit of work of a pool slot
+	 */
+	struct Chunk {
+		double T;
+		size_t first;
+		int count;
+	};
+
+	double S0;
+	double r;
+
+	HestonPool * pool;
+	std::vector<HestonFourier> pricers;
+
+	std::vector<Quote> quotes;
+	std::vector<double> strikes;
+	std::vector<Chunk> chunks;
+
+	/**
+	 * Model prices and their gradients, [quote][parameter], of the last evaluation
+	 */
+	std::vector<double> prices;
+	std::vector<double> gradients;
+
+	int ITERATIONS;
+	double PRICE_RMSE;
+	double VOLATILITY_RMSE;
+
+	void split();
+	void evaluate(double const * parameters);
+	double residuals(Error error, std::vector<double> & residual, std::vector<double> * jacobian);
+	void errors();
+
+};
+
+#endif // HESTONCALIBRATION_H_
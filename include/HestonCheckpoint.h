@@ -0,0 +1,141 @@
+/**
+ *       @file  HestonCheckpoint.h
+ *      @brief  The HestonFour BarbequeRTRM application
+ *
+ * Description: Crash-consistent state file of a run. The file is memory mapped and holds two slots: a save
+ *		writes the record in the slot not holding the last one, then seals it with its sequence number
+ *		and checksum. A process killed during a save leaves a torn slot, which fails its checksum, and
+ *		the previous record in the other slot. The pages are flushed asynchronously, the save only
+ *		costs the copy of the record.
+ *
+ *     @author  Luca Napoletano, luca.napoletano@mail.polimi.it, Claudio Montanari, claudio1.montanari@mail.polimi.it
+ *
+ *     Company  Politecnico di Milano
+ *   Copyright  Copyright (c) 2017, Luca Napoletano, Claudio Montanari
+ *
+ * This source code is released for free distribution under the terms of the
+ * GNU General Public License as published by the Free Software Foundation.
+ * =====================================================================================
+ */
+
+#ifndef HESTONCHECKPOINT_H_
+#define HESTONCHECKPOINT_H_
+
+#include <stdint.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+/**
+ * A record of the state file: trivially copyable values appended one after the other and read back in the
+ * same order. A read past the end fails and leaves the value untouched
+ */
+struct HestonRecord {
+	std::vector<char> data;
+	size_t offset;
+
+	HestonRecord() :
+		offset(0) {
+	}
+
+	template <typename T>
+	void put(T const & value) {
+		put(&value, 1);
+	}
+
+	template <typename T>
+	void put(T const * values, size_t count) {
+		char const * bytes = reinterpret_cast<char const *>(values);
+		data.insert(data.end(), bytes, bytes + count * sizeof(T));
+	}
+
+	template <typename T>
+	bool get(T & value) {
+		return get(&value, 1);
+	}
+
+	template <typename T>
+	bool get(T * values, size_t count) {
+		if (offset + count * sizeof(T) > data.size())
+			return false;
+		memcpy(values, data.data() + offset, count * sizeof(T));
+		offset += count * sizeof(T);
+		return true;
+	}
+
+	/**
+	 * @brief		A vector, preceded by its size
+	 */
+	template <typename T>
+	void putVector(std::vector<T> const & values) {
+		put((uint64_t) values.size());
+		put(values.data(), values.size());
+	}
+
+	template <typename T>
+	bool getVector(std::vector<T> & values) {
+		uint64_t size;
+		if (!get(size) || offset + size * sizeof(T) > data.size())
+			return false;
+		values.resize(size);
+		return get(values.data(), size);
+	}
+};
+
+class HestonCheckpoint {
+
+public:
+
+	HestonCheckpoint(std::string const & path);
+	~HestonCheckpoint();
+
+	bool load(HestonRecord & record);
+	bool save(HestonRecord const & record);
+
+	std::string const & getPath() const;
+	uint64_t getSequence() const;
+	size_t getBytes() const;
+
+private:
+
+	/**
+	 * The head of the file, the slots follow it
+	 */
+	struct Header {
+		char magic[8];
+		uint32_t version;
+		uint32_t reserved;
+		uint64_t capacity;	/**<Bytes of a slot, without its head*/
+	};
+
+	/**
+	 * The head of a slot: a record is valid when its sequence is not 0 and its checksum matches
+	 */
+	struct Slot {
+		uint64_t sequence;
+		uint64_t bytes;
+		uint64_t checksum;
+		uint64_t reserved;
+	};
+
+	std::string path;
+	char * map;
+	size_t mapped;
+	uint64_t capacity;
+
+	/**
+	 * The sequence number and the slot of the last record
+	 */
+	uint64_t sequence;
+	int last;
+
+	bool create(HestonRecord const & record);
+	void unmap();
+	Slot * slot(char * base, uint64_t capacity, int index) const;
+
+	static uint64_t checksum(char const * data, uint64_t bytes);
+
+};
+
+#endif // HESTONCHECKPOINT_H_
@@ -0,0 +1,148 @@
+/**
+ *       @file  HestonControl.h
+ *      @brief  The HestonFour BarbequeRTRM application
+ *
+ * Description: Control variate estimator. The payoff Y of every path is regressed on a few controls X with a
+ *		known expectation, the price is mean(Y) - beta (mean(X) - E[X]) with the least squares beta. Only
+ *		plain sums are kept, so the workers fill them in their inner loop and the EXC merges them in
+ *		block order: beta is re-estimated on all the blocks done at every onRun() cycle.
+ *
+ *     @author  Luca Napoletano, luca.napoletano@mail.polimi.it, Claudio Montanari, claudio1.montanari@mail.polimi.it
+ *
+ *     Company  Politecnico di Milano
+ *   Copyright  Copyright (c) 2017, Luca Napoletano, Claudio Montanari
+ *
+ * This source code is released for free distribution under the terms of the
+ * GNU General Public License as published by the Free Software Foundation.
+ * =====================================================================================
+ */
+
+#ifndef HESTONCONTROL_H_
+#define HESTONCONTROL_H_
+
+#include <math.h>
+
+#define HESTON_MAX_CONTROLS 3
+
+struct HestonControl {
+
+	int controls;
+	long count;
+	double sumY;
+	double sumYY;
+	double sumX[HESTON_MAX_CONTROLS];
+	double sumXY[HESTON_MAX_CONTROLS];
+	double sumXX[HESTON_MAX_CONTROLS][HESTON_MAX_CONTROLS];
+
+	HestonControl() :
+		controls(0) {
+		reset();
+	}
+
+	void reset() {
+		count = 0;
+		sumY = 0.0;
+		sumYY = 0.0;
+		for (int j = 0; j < HESTON_MAX_CONTROLS; j++) {
+			sumX[j] = 0.0;
+			sumXY[j] = 0.0;
+			for (int k = 0; k < HESTON_MAX_CONTROLS; k++)
+				sumXX[j][k] = 0.0;
+		}
+	}
+
+	/**
+	 * @brief		Add a sample: the payoff and the values of the controls on the same path
+	 */
+	void add(double y, double const * x) {
+		count++;
+		sumY += y;
+		sumYY += y * y;
+		for (int j = 0; j < controls; j++) {
+			sumX[j] += x[j];
+			sumXY[j] += x[j] * y;
+			for (int k = 0; k < controls; k++)
+				sumXX[j][k] += x[j] * x[k];
+		}
+	}
+
+	/**
+	 * @brief		Add all the samples summarized by another accumulator
+	 */
+	void merge(HestonControl const & other) {
+		controls = other.controls;
+		count += other.count;
+		sumY += other.sumY;
+		sumYY += other.sumYY;
+		for (int j = 0; j < controls; j++) {
+			sumX[j] += other.sumX[j];
+			sumXY[j] += other.sumXY[j];
+			for (int k = 0; k < controls; k++)
+				sumXX[j][k] += other.sumXX[j][k];
+		}
+	}
+
+	/**
+	 * @brief		The controlled mean and its standard error (from the variance of the regression
+	 *			residuals). Controls which are collinear with the previous ones are dropped
+	 * @param[in] expected	The known expectations of the controls
+	 * @param[out] mean	The controlled estimate of E[Y]
+	 * @param[out] error	Its standard error, 0 when it cannot be estimated yet
+	 */
+	void estimate(double const * expected, double & mean, double & error) const {
+
+		mean = 0.0;
+		error = 0.0;
+		if (count == 0)
+			return;
+
+		double n = (double) count;
+		double a[HESTON_MAX_CONTROLS][HESTON_MAX_CONTROLS + 1];
+		double beta[HESTON_MAX_CONTROLS];
+
+		// Centered normal equations, C_xx beta = C_xy
+		for (int j = 0; j < controls; j++) {
+			for (int k = 0; k < controls; k++)
+				a[j][k] = sumXX[j][k] - sumX[j] * sumX[k] / n;
+			a[j][controls] = sumXY[j] - sumX[j] * sumY / n;
+		}
+
+		// Gaussian elimination, without pivoting since C_xx is positive semi-definite
+		bool used[HESTON_MAX_CONTROLS];
+		for (int j = 0; j < controls; j++) {
+			used[j] = a[j][j] > 1e-12 * (sumXX[j][j] + 1e-300);
+			if (!used[j])
+				continue;
+			for (int i = j + 1; i < controls; i++) {
+				double factor = a[i][j] / a[j][j];
+				for (int k = j; k <= controls; k++)
+					a[i][k] -= factor * a[j][k];
+			}
+		}
+
+		int p = 0;
+		for (int j = controls - 1; j >= 0; j--) {
+			beta[j] = 0.0;
+			if (!used[j])
+				continue;
+			double rest = a[j][controls];
+			for (int k = j + 1; k < controls; k++)
+				rest -= a[j][k] * beta[k];
+			beta[j] = rest / a[j][j];
+			p++;
+		}
+
+		mean = sumY / n;
+		double residual = sumYY - sumY * sumY / n;
+		for (int j = 0; j < controls; j++) {
+			mean -= beta[j] * (sumX[j] / n - expected[j]);
+			residual -= beta[j] * (sumXY[j] - sumX[j] * sumY / n);
+		}
+
+		if (count > p + 1 && residual > 0.0)
+			error = sqrt(residual / (n - p - 1) / n);
+	}
+
+};
+
+#endif // HESTONCONTROL_H_
@@ -17,8 +17,18 @@
 
 #include <bbque/bbque_exc.h>
 
+#include "HestonAmerican.h"
+#include "HestonCheckpoint.h"
+#include "HestonControl.h"
+#include "HestonMetrics.h"
+#include "HestonPool.h"
+#include "HestonScheduler.h"
+#include "HestonSettings.h"
+#include "HestonStats.h"
 #include "HestonWorker.h"
 
+#include <chrono>
+#include <deque>
 #include <iostream>
 #include <random>
 #include <time.h>
@@ -32,11 +42,16 @@ public:
 
 	HestonFour(std::string const & name,
 			std::string const & recipe,
-			RTLIB_Services_t *rtlib, double, double, double, double, double, double, double, double, double, int, int);
+			RTLIB_Services_t *rtlib, double, double, double, double, double, double, double, double, double, int, int,
+			HestonSettings const & settings);
+
+	int getSimulationsDone() const;
 
 
 private:
 	
+	HestonSettings settings;
+	HestonPool* pool;
 	HestonWorker** workers;
 	int WORKERS;
 	int DONE_SIMULATIONS;
@@ -44,6 +59,13 @@ private:
 	int DISCRETIZATION;
 	int NUM_PROC;
 	const int WORKERS_SIM = 10000;
+	/**
+	 * Paths of a chunk, a block has WORKERS_SIM / CHUNK_SIM chunks. It divides WORKERS_SIM and is a multiple
+	 * of the double lanes of every kernel (16 at most). The 32 float lanes of AVX-512 leave the last 16 paths
+	 * of a chunk to the double kernel, a preempted chunk is resumed on the same split
+	 */
+	const int CHUNK_SIM = 400;
+	const int MLMC_MIN_BLOCK = 500;
 
 	double finalPrice;
 	int pricesToCompute;
@@ -54,6 +76,107 @@ private:
 	 */
 	double workersFinalSum;
 	double threadFinalPrice;
+	/**
+	 * Running statistics of all the blocks, used for the standard error and the adaptive stopping
+	 */
+	HestonStats workersStats;
+	double zScore;
+	/**
+	 * Running statistics of the grid nodes, stored as [maturity][strike]
+	 */
+	std::vector<HestonStats> gridStats;
+	/**
+	 * Control variate sums of all the blocks and the known expectations of the controls
+	 */
+	HestonControl controlStats;
+	double controlExpected[HESTON_MAX_CONTROLS];
+	/**
+	 * Multilevel Monte Carlo: statistics, target number of paths and started blocks of each level, and the
+	 * number of step evaluations done
+	 */
+	std::vector<HestonStats> levelStats;
+	std::vector<long> levelTarget;
+	std::vector<int> levelBlocks;
+	double levelSteps;
+	/**
+	 * Greeks mode: running statistics of the discounted samples of each sensitivity
+	 */
+	HestonStats greekStats[HESTON_GREEKS];
+	/**
+	 * Longstaff-Schwartz: the training path store, the next block of the running phase, the statistics of
+	 * the independent (lower bound) paths and the wall time of the backward regression
+	 */
+	HestonAmerican* american;
+	bool americanTrained;
+	int americanBlock;
+	HestonStats americanStats;
+	double regressionTime;
+	/**
+	 * Work-stealing scheduler of the chunks, and the load imbalance and the steals of all the cycles
+	 */
+	HestonScheduler* scheduler;
+	HestonStats imbalanceStats;
+	long steals;
+	/**
+	 * A chunk of a block, with its partial results. task is its index in the cycle which ran it last. A
+	 * chunk keeps the discretization, the scheme and the precision of the AWM which opened it until it is done
+	 */
+	struct Chunk {
+		int block;
+		int first;
+		long task;
+		int discretization;
+		int scheme;
+		int precision;
+		HestonPartial partial;
+
+		Chunk() :
+			block(0),
+			first(0),
+			task(-1),
+			discretization(1),
+			scheme(HestonKernel::FULL_TRUNCATION),
+			precision(HestonKernel::DOUBLE) {
+		}
+	};
+	/**
+	 * Cooperative preemption: the chunks opened and not reduced yet, in chunk order, the next chunk to open
+	 * and the sum of the block being reduced. The stop latency (ms from the stop of the workers to their
+	 * return) of the preempted cycles and of the last cycle, negative if it was not preempted
+	 */
+	std::deque<Chunk> window;
+	long nextChunk;
+	double blockSum;
+	HestonStats preemptionStats;
+	double preemptionMax;
+	double lastLatency;
+	/**
+	 * The state file of the run, the time of its last save and the duration of the saves (ms)
+	 */
+	HestonCheckpoint* checkpoint;
+	std::chrono::steady_clock::time_point checkpointTime;
+	HestonStats checkpointStats;
+	/**
+	 * Metrics of the workers and of the cycles, and the last write of their file
+	 */
+	HestonMetrics* metrics;
+	std::chrono::steady_clock::time_point metricsTime;
+	/**
+	 * Mixed precision: the comparison of the kernels on a sample of FLOAT_CHECK_SIM paths, whether it
+	 * accepted the single precision kernel, whether the current AWM uses it and the cycles it ran
+	 */
+	const int FLOAT_CHECK_SIM = 4096;
+	HestonPrecisionCheck precisionCheck;
+	bool FLOAT_ACCEPTED;
+	bool FLOAT_ACTIVE;
+	long floatCycles;
+	/**
+	 * The knobs of the current AWM: discretization and scheme of the chunks it opens, and the half-width
+	 * of the confidence interval at which the run stops
+	 */
+	int pointDiscretization;
+	HestonKernel::Scheme pointScheme;
+	double pointError;
 	/**
 	 *  Variables used to setup the heston simulation
 	 */
@@ -80,6 +203,30 @@ private:
 	RTLIB_ExitCode_t onMonitor();
 	RTLIB_ExitCode_t onRelease();
 
+	void estimate(double & price, double & error);
+	void reduceWindow(long confirmed);
+
+	void putSignature(HestonRecord & record);
+	void saveState(HestonRecord & record);
+	bool restoreState(HestonRecord & record);
+	void writeCheckpoint();
+	void writeMetrics();
+
+	void checkPrecision();
+	void printPrecision(double error);
+
+	RTLIB_ExitCode_t runLevels();
+	void updateLevelTargets();
+	int levelBlockSize(int level);
+	int levelDiscretization(int level);
+	double levelCost(int level);
+	void printLevels();
+	RTLIB_ExitCode_t runAmerican();
+	int americanBlocks();
+	void regressAmerican();
+	void printGrid(bool full);
+	void printGreeks(bool full);
+
 };
 
 #endif // HESTONFOUR_EXC_H_
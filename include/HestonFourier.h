@@ -0,0 +1,72 @@
+/**
+ *       @file  HestonFourier.h
+ *      @brief  The HestonFour BarbequeRTRM application
+ *
+ * Description: Semi-analytic pricing of European calls under the Heston model. The characteristic function of
+ *		the log spot is known in closed form, thus a single price is a one dimensional Fourier integral
+ *		(Gauss-Laguerre quadrature) and a whole strike chain is a single FFT (Carr-Madan). It is the fast
+ *		path of the application, the Monte Carlo workers remain for the validation and for the payoffs
+ *		which have no closed form.
+ *
+ *     @author  Luca Napoletano, luca.napoletano@mail.polimi.it, Claudio Montanari, claudio1.montanari@mail.polimi.it
+ *
+ *     Company  Politecnico di Milano
+ *   Copyright  Copyright (c) 2017, Luca Napoletano, Claudio Montanari
+ *
+ * This source code is released for free distribution under the terms of the
+ * GNU General Public License as published by the Free Software Foundation.
+ * =====================================================================================
+ */
+
+#ifndef HESTONFOURIER_H_
+#define HESTONFOURIER_H_
+
+#include <complex>
+#include <vector>
+
+/**
+ * Number of model parameters of the gradients, in the order V0, kappa, theta, xi, rho
+ */
+#define HESTON_PARAMETERS 5
+
+class HestonFourier {
+
+public:
+
+	HestonFourier(double S0, double r, double V0, double rho, double kappa, double theta, double xi);
+
+	void setParameters(double const * parameters);
+
+	std::complex<double> characteristic(std::complex<double> u, double T) const;
+	std::complex<double> characteristic(std::complex<double> u, double T, std::complex<double> * gradient) const;
+
+	double call(double K, double T) const;
+	void callGrid(double T, std::vector<double> const & strikes, std::vector<double> & prices) const;
+	void callGreeks(double K, double T, double * greeks) const;
+	void callGradients(double T, double const * strikes, int count, double * prices, double * gradients) const;
+
+	static double blackScholesCall(double S0, double K, double r, double T, double variance);
+	static double blackScholesVega(double S0, double K, double r, double T, double variance);
+	static double meanVariance(double V0, double kappa, double theta, double T);
+
+private:
+
+	double S0;
+	double r;
+	double V0;
+	double rho;
+	double kappa;
+	double theta;
+	double xi;
+
+	/**
+	 * Gauss-Laguerre nodes and weights, the weights are multiplied by exp(node) to integrate plain functions
+	 */
+	std::vector<double> nodes;
+	std::vector<double> weights;
+
+	void initQuadrature(int n);
+
+};
+
+#endif // HESTONFOURIER_H_
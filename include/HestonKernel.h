@@ -0,0 +1,152 @@
+/**
+ *       @file  HestonKernel.h
+ *      @brief  The HestonFour BarbequeRTRM application
+ *
+ * Description: Batched path kernels and normal transforms. A kernel advances a whole lane group of paths (and
+ *		their antithetic twins) in structure-of-arrays layout. One kernel is built for each supported
+ *		instruction set and the fastest one available on the host is selected at startup from cpuid.
+ *		Every instruction set also has a single precision kernel, which evolves twice as many paths in
+ *		the same registers.
+ *
+ *     @author  Luca Napoletano, luca.napoletano@mail.polimi.it, Claudio Montanari, claudio1.montanari@mail.polimi.it
+ *
+ *     Company  Politecnico di Milano
+ *   Copyright  Copyright (c) 2017, Luca Napoletano, Claudio Montanari
+ *
+ * This source code is released for free distribution under the terms of the
+ * GNU General Public License as published by the Free Software Foundation.
+ * =====================================================================================
+ */
+
+#ifndef HESTONKERNEL_H_
+#define HESTONKERNEL_H_
+
+#include <string>
+
+/**
+ * Threshold of psi = s^2 / m^2 between the quadratic and the exponential branch of the QE scheme
+ */
+#define QE_CRITICAL_PSI 1.5
+
+/**
+ * Model, option and discretization parameters used by a kernel
+ */
+struct HestonKernelArgs {
+	double S0;
+	double K;
+	double r;
+	double T;
+	double V0;
+	double rho;
+	double kappa;
+	double theta;
+	double xi;
+	int discretization;
+	/**
+	 * Observation dates (grid mode): the spot of every path and of its antithetic twin is recorded at the
+	 * end of each step in observationSteps (increasing) into observed[observation][spot, antithetic][lane]
+	 */
+	int observations;
+	int const * observationSteps;
+	double * observed;
+	/**
+	 * Control variates: when controls is not NULL it receives the sum over each path and its antithetic
+	 * twin of the terminal spot, of the call payoff of a Black-Scholes companion path, driven by the same
+	 * spot draws with the constant variance companionVariance, and of the European call payoff (a control
+	 * of the path-dependent payoffs), stored as [control][lane]
+	 */
+	double companionVariance;
+	double * controls;
+	/**
+	 * Variance discretization scheme and the per-step constants of the Quadratic-Exponential scheme, filled
+	 * by HestonKernel::prepare(): conditional variance s^2 = qeSlope v + qeConstant, log spot increment
+	 * K0* + qeK1 v + qeK2 v' + sqrt(qeK3 v + qeK4 v') Z
+	 */
+	int scheme;
+	double qeDecay;
+	double qeSlope;
+	double qeConstant;
+	double qeK1;
+	double qeK2;
+	double qeK3;
+	double qeK4;
+	/**
+	 * Payoff parameters which are not in the option: the barrier level of the barrier calls
+	 */
+	double barrier;
+};
+
+class HestonKernel {
+
+public:
+
+	/**
+	 * The instruction sets a kernel is built for, SCALAR is the reference HestonWorker code
+	 */
+	enum Isa { SCALAR = 0, SSE2, AVX2, AVX512 };
+
+	/**
+	 * The variance discretization schemes: full-truncation Euler, a lognormal variance step matched to the
+	 * conditional moments of the CIR process (LOG_EULER, Euler spot on a positive variance) and the
+	 * Quadratic-Exponential scheme of Andersen (2008) with martingale correction
+	 */
+	enum Scheme { FULL_TRUNCATION = 0, LOG_EULER, QUADRATIC_EXPONENTIAL };
+
+	/**
+	 * The payoffs, each one has its own kernel built on a policy of HestonPayoff.h
+	 */
+	enum Payoff { EUROPEAN = 0, ASIAN_ARITHMETIC, ASIAN_GEOMETRIC, UP_AND_OUT, UP_AND_IN, DOWN_AND_OUT, DOWN_AND_IN, LOOKBACK };
+
+	/**
+	 * The precision of the path evolution. The FLOAT kernels take the same arguments and normals, and give
+	 * the payoffs in double, but evolve the paths in single precision. They support the full-truncation
+	 * and the LOG_EULER schemes
+	 */
+	enum Precision { DOUBLE = 0, FLOAT };
+
+	/**
+	 * A kernel simulates lanes(isa) paths of one payoff. The normals are stored as [step][spot, volatility][lane]
+	 * and the sum of the payoffs of each path and of its antithetic twin is written in payoffs[lane]
+	 */
+	typedef void (*Function)(HestonKernelArgs const & args, double const * normals, double * payoffs);
+
+	/**
+	 * A transform turns a buffer of uniforms into N(0,1) draws in place, see HestonNormal
+	 */
+	typedef void (*Transform)(double * buffer, int n);
+
+	static Isa detect();
+	static Isa parse(std::string const & name);
+	static Function select(Isa isa, Payoff payoff, Precision precision = DOUBLE);
+	static Transform boxMuller(Isa isa);
+	static int lanes(Isa isa, Precision precision = DOUBLE);
+	static const char* name(Isa isa);
+
+	static Precision parsePrecision(std::string const & name);
+	static const char* precisionName(Precision precision);
+
+	static Scheme parseScheme(std::string const & name);
+	static const char* schemeName(Scheme scheme);
+	static void prepare(HestonKernelArgs & args, Scheme scheme);
+
+	static Payoff parsePayoff(std::string const & name);
+	static const char* payoffName(Payoff payoff);
+
+};
+
+/**
+ * Kernels built in HestonKernel_<isa>.cc with the matching compiler flags, one for each payoff
+ */
+HestonKernel::Function hestonKernelSse2(HestonKernel::Payoff payoff);
+HestonKernel::Function hestonKernelAvx2(HestonKernel::Payoff payoff);
+HestonKernel::Function hestonKernelAvx512(HestonKernel::Payoff payoff);
+
+HestonKernel::Function hestonKernelFloatSse2(HestonKernel::Payoff payoff);
+HestonKernel::Function hestonKernelFloatAvx2(HestonKernel::Payoff payoff);
+HestonKernel::Function hestonKernelFloatAvx512(HestonKernel::Payoff payoff);
+
+void hestonBoxMullerSse2(double * buffer, int n);
+void hestonBoxMullerAvx2(double * buffer, int n);
+void hestonBoxMullerAvx512(double * buffer, int n);
+
+#endif // HESTONKERNEL_H_
@@ -0,0 +1,440 @@
+/**
+ *       @file  HestonKernel_simd.h
+ *      @brief  The HestonFour BarbequeRTRM application
+ *
+ * Description: Body of the batched path kernel. This file is included by each HestonKernel_<isa>.cc after
+ *		defining HESTON_KERNEL_LANES and the names of the functions to build, the translation unit is then compiled with
+ *		the flags of its instruction set. Do not include it anywhere else: code emitted here may use
+ *		instructions the host does not support.
+ *
+ *     @author  Luca Napoletano, luca.napoletano@mail.polimi.it, Claudio Montanari, claudio1.montanari@mail.polimi.it
+ *
+ *     Company  Politecnico di Milano
+ *   Copyright  Copyright (c) 2017, Luca Napoletano, Claudio Montanari
+ *
+ * This source code is released for free distribution under the terms of the
+ * GNU General Public License as published by the Free Software Foundation.
+ * =====================================================================================
+ */
+
+#include "HestonKernel.h"
+#include "HestonPayoff.h"
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+#if !defined(HESTON_KERNEL_LANES) || !defined(HESTON_KERNEL_NAME) || !defined(HESTON_BOXMULLER_NAME)
+#error "HESTON_KERNEL_LANES, HESTON_KERNEL_NAME and HESTON_BOXMULLER_NAME must be defined"
+#endif
+
+namespace {
+
+/**
+ * A lane group: the compiler maps it onto two registers of the target instruction set
+ */
+typedef double vdouble __attribute__((vector_size(HESTON_KERNEL_LANES * sizeof(double))));
+typedef int64_t vlong __attribute__((vector_size(HESTON_KERNEL_LANES * sizeof(double))));
+
+inline vdouble vsplat(double x){
+	vdouble v;
+	for (int l = 0; l < HESTON_KERNEL_LANES; l++)
+		v[l] = x;
+	return v;
+}
+
+inline vdouble vload(double const * p){
+	vdouble v;
+	memcpy(&v, p, sizeof(vdouble));
+	return v;
+}
+
+inline vdouble vmax(vdouble x, vdouble y){
+	return x > y ? x : y;
+}
+
+inline vdouble vmin(vdouble x, vdouble y){
+	return x < y ? x : y;
+}
+
+/**
+ * @brief		Lane-wise square root, it is mapped onto the packed sqrt instruction (needs -fno-math-errno)
+ */
+inline vdouble vsqrt(vdouble x){
+	vdouble v;
+	for (int l = 0; l < HESTON_KERNEL_LANES; l++)
+		v[l] = sqrt(x[l]);
+	return v;
+}
+
+/**
+ * @brief		Lane-wise exponential. The argument is reduced as x = n ln2 + f with |f| <= ln2/2, exp(f) is
+ *			evaluated by its degree 12 Taylor polynomial and 2^n is built in the exponent field. The relative
+ *			error is below 2e-16 in [-700, 700]
+ */
+inline vdouble vexp(vdouble x){
+
+	const double shifter = 6755399441055744.0;	/**<1.5 * 2^52, rounds to nearest integer*/
+
+	x = vmin(vmax(x, vsplat(-700.0)), vsplat(700.0));
+
+	vdouble t = x * 1.4426950408889634 + shifter;
+	vdouble n = t - shifter;
+	vdouble f = x - n * 6.93147180369123816490e-01 - n * 1.90821492927058770002e-10;
+
+	vdouble p = vsplat(1.0 / 479001600.0);
+	p = p * f + 1.0 / 39916800.0;
+	p = p * f + 1.0 / 3628800.0;
+	p = p * f + 1.0 / 362880.0;
+	p = p * f + 1.0 / 40320.0;
+	p = p * f + 1.0 / 5040.0;
+	p = p * f + 1.0 / 720.0;
+	p = p * f + 1.0 / 120.0;
+	p = p * f + 1.0 / 24.0;
+	p = p * f + 1.0 / 6.0;
+	p = p * f + 0.5;
+	p = p * f + 1.0;
+	p = p * f + 1.0;
+
+	// The low bits of t hold n, move n + 1023 into the exponent field
+	vlong bits = (vlong) t;
+	bits = (bits + 1023) << 52;
+
+	return p * (vdouble) bits;
+}
+
+/**
+ * @brief		Lane-wise natural logarithm of a positive normal number. The argument is split as m 2^e with
+ *			m in [sqrt(1/2), sqrt(2)) and log(m) = 2 atanh((m - 1) / (m + 1)) is evaluated by its series
+ */
+inline vdouble vlog(vdouble x){
+
+	const double shifter = 6755399441055744.0;
+	const int64_t shifterBits = 0x4338000000000000LL;
+
+	vlong bits = (vlong) x;
+	vlong exponent = ((bits >> 52) & 0x7ff) - 1023;
+	vdouble m = (vdouble) ((bits & 0x000fffffffffffffLL) | 0x3ff0000000000000LL);
+	vdouble e = (vdouble) (exponent + shifterBits) - shifter;
+
+	vdouble large = m * 0.5;
+	e = m > 1.4142135623730951 ? e + 1.0 : e;
+	m = m > 1.4142135623730951 ? large : m;
+
+	vdouble s = (m - 1.0) / (m + 1.0);
+	vdouble s2 = s * s;
+
+	vdouble p = vsplat(1.0 / 23.0);
+	p = p * s2 + 1.0 / 21.0;
+	p = p * s2 + 1.0 / 19.0;
+	p = p * s2 + 1.0 / 17.0;
+	p = p * s2 + 1.0 / 15.0;
+	p = p * s2 + 1.0 / 13.0;
+	p = p * s2 + 1.0 / 11.0;
+	p = p * s2 + 1.0 / 9.0;
+	p = p * s2 + 1.0 / 7.0;
+	p = p * s2 + 1.0 / 5.0;
+	p = p * s2 + 1.0 / 3.0;
+	p = p * s2 + 1.0;
+
+	return e * 6.93147180369123816490e-01 + (2.0 * s * p + e * 1.90821492927058770002e-10);
+}
+
+/**
+ * @brief		Lane-wise sin(2 pi t) and cos(2 pi t) for t in [0, 1]. The angle is reduced to [-pi/4, pi/4] plus a
+ *			quadrant, both functions are evaluated by their Taylor polynomials and then swapped and negated
+ *			according to the quadrant
+ */
+inline void vsincos2pi(vdouble t, vdouble & sine, vdouble & cosine){
+
+	const double shifter = 6755399441055744.0;
+
+	vdouble q = (4.0 * t + shifter) - shifter;
+	vdouble x = (t - 0.25 * q) * 6.283185307179586;
+	vdouble x2 = x * x;
+
+	vdouble s = vsplat(-1.0 / 1307674368000.0);
+	s = s * x2 + 1.0 / 6227020800.0;
+	s = s * x2 - 1.0 / 39916800.0;
+	s = s * x2 + 1.0 / 362880.0;
+	s = s * x2 - 1.0 / 5040.0;
+	s = s * x2 + 1.0 / 120.0;
+	s = s * x2 - 1.0 / 6.0;
+	s = s * x2 * x + x;
+
+	vdouble c = vsplat(1.0 / 20922789888000.0);
+	c = c * x2 - 1.0 / 87178291200.0;
+	c = c * x2 + 1.0 / 479001600.0;
+	c = c * x2 - 1.0 / 3628800.0;
+	c = c * x2 + 1.0 / 40320.0;
+	c = c * x2 - 1.0 / 720.0;
+	c = c * x2 + 1.0 / 24.0;
+	c = c * x2 - 0.5;
+	c = c * x2 + 1.0;
+
+	q = q == 4.0 ? vsplat(0.0) : q;
+
+	vdouble ns = -s;
+	vdouble nc = -c;
+	sine = q == 0.0 ? s : (q == 1.0 ? c : (q == 2.0 ? ns : nc));
+	cosine = q == 0.0 ? c : (q == 1.0 ? ns : (q == 2.0 ? nc : s));
+}
+
+/**
+ * @brief		One step of the Quadratic-Exponential scheme with martingale correction. Both branches are
+ *			evaluated on all the lanes and blended by psi, the uniform of the exponential branch (a lane
+ *			loop on erfc) is only computed when at least one lane needs it
+ * @param[in] args		The kernel arguments, with the constants of HestonKernel::prepare()
+ * @param[in,out] volatility	The variance of the lanes
+ * @param[in,out] log_spot	The log spot of the lanes (relative to S0)
+ * @param[in] random_spot	The N(0,1) draws of the spot, independent of the variance ones
+ * @param[in] random_volatility	The N(0,1) draws of the variance
+ */
+inline void qeStep(HestonKernelArgs const & args, vdouble & volatility, vdouble & log_spot, vdouble random_spot, vdouble random_volatility){
+
+	const int L = HESTON_KERNEL_LANES;
+	double deltaT = args.T / ((double) args.discretization);
+	double A = args.qeK2 + 0.5 * args.qeK4;
+
+	vdouble m = args.theta + (volatility - args.theta) * args.qeDecay;
+	vdouble s2 = args.qeSlope * volatility + args.qeConstant;
+	vdouble psi = s2 / (m * m);
+
+	// Quadratic branch, psi <= QE_CRITICAL_PSI
+	vdouble inverse = 2.0 / psi;
+	vdouble b2 = inverse - 1.0 + vsqrt(inverse) * vsqrt(vmax(inverse - 1.0, vsplat(0.0)));
+	vdouble a = m / (1.0 + b2);
+	vdouble b = vsqrt(b2);
+	vdouble shifted = b + random_volatility;
+	vdouble quadratic = a * shifted * shifted;
+	vdouble denominator = vmax(1.0 - 2.0 * A * a, vsplat(1e-300));
+	vdouble quadratic_log_martingale = A * b2 * a / denominator - 0.5 * vlog(denominator);
+
+	vdouble next = quadratic;
+	vdouble log_martingale = quadratic_log_martingale;
+
+	bool exponential = false;
+	for (int l = 0; l < L; l++)
+		exponential = exponential || psi[l] > QE_CRITICAL_PSI;
+
+	// Exponential branch, psi > QE_CRITICAL_PSI
+	if (exponential) {
+		vdouble p = (psi - 1.0) / (psi + 1.0);
+		vdouble beta = (1.0 - p) / m;
+		vdouble u;
+		for (int l = 0; l < L; l++)
+			u[l] = 0.5 * erfc(-random_volatility[l] * M_SQRT1_2);
+
+		vdouble tail = vlog(vmax((1.0 - p) / (1.0 - u), vsplat(1.0))) / beta;
+		vdouble sampled = u <= p ? vsplat(0.0) : tail;
+
+		next = psi <= QE_CRITICAL_PSI ? quadratic : sampled;
+		log_martingale = psi <= QE_CRITICAL_PSI ? quadratic_log_martingale : vlog(p + beta * (1.0 - p) / (beta - A));
+	}
+
+	vdouble K0 = -log_martingale - (args.qeK1 + 0.5 * args.qeK3) * volatility;
+	log_spot += args.r * deltaT + K0 + args.qeK1 * volatility + args.qeK2 * next
+		+ vsqrt(args.qeK3 * volatility + args.qeK4 * next) * random_spot;
+	volatility = next;
+}
+
+/**
+ * Math traits of a lane group, for the payoff policies
+ */
+struct VectorMath {
+
+	typedef vdouble type;
+	typedef double scalar;
+
+	static double tiny() {
+		return 1e-300;
+	}
+
+	static vdouble splat(double x) {
+		return vsplat(x);
+	}
+
+	static vdouble max(vdouble x, vdouble y) {
+		return vmax(x, y);
+	}
+
+	static vdouble min(vdouble x, vdouble y) {
+		return vmin(x, y);
+	}
+
+	static vdouble exp(vdouble x) {
+		return vexp(x);
+	}
+
+};
+
+}
+
+
+/**
+ * @brief		Box-Muller transform of a buffer of uniforms in (0, 1), done in place. Every 2 * HESTON_KERNEL_LANES
+ *			values are a lane group of radii followed by a lane group of angles, they are replaced by the
+ *			cosine and the sine normals. Values after the last full group are left untouched
+ * @param[in] buffer	The uniforms in input, the N(0,1) draws in output
+ * @param[in] n		The number of values in the buffer
+ */
+void HESTON_BOXMULLER_NAME(double * buffer, int n){
+
+	const int L = HESTON_KERNEL_LANES;
+
+	for (int i = 0; i + 2 * L <= n; i += 2 * L) {
+
+		vdouble radius = vsqrt(-2.0 * vlog(vload(buffer + i)));
+		vdouble sine, cosine;
+		vsincos2pi(vload(buffer + i + L), sine, cosine);
+
+		vdouble z0 = radius * cosine;
+		vdouble z1 = radius * sine;
+		memcpy(buffer + i, &z0, sizeof(vdouble));
+		memcpy(buffer + i + L, &z1, sizeof(vdouble));
+	}
+}
+
+/**
+ * @brief		Variance step of the LOG_EULER scheme: a lognormal draw with the exact conditional mean m and
+ *			variance s^2 of the CIR process (the constants of qeStep), log(v') ~ N(log(m) - l/2, l) with
+ *			l = log(1 + s^2 / m^2). The variance stays positive and, unlike an Euler step on log(v), it is not
+ *			absorbed near 0 when 2 kappa theta < xi^2
+ * @param[in] args		The parameters of the simulation, prepared by HestonKernel::prepare()
+ * @param[in] volatility	The variance at the start of the step
+ * @param[in] random_volatility	The N(0,1) draws of the variance
+ */
+inline vdouble lognormalStep(HestonKernelArgs const & args, vdouble volatility, vdouble random_volatility){
+
+	vdouble mean = args.theta + (volatility - args.theta) * args.qeDecay;
+	vdouble spread = vlog(1.0 + (args.qeSlope * volatility + args.qeConstant) / (mean * mean));
+
+	return mean * vexp(-0.5 * spread + vsqrt(spread) * random_volatility);
+}
+
+/**
+ * @brief		Simulate HESTON_KERNEL_LANES paths and their antithetic twins. The spot is evolved in log space,
+ *			which is the same Euler update of the scalar kernel (the product of the exponentials is the
+ *			exponential of the sum) with a single exp at maturity, unless the payoff policy reads the spot
+ *			at every step
+ * @param P		The payoff policy, instantiated on the lane group
+ * @param[in] args	The parameters of the simulation
+ * @param[in] normals	The N(0,1) draws, stored as [step][spot, volatility][lane]
+ * @param[out] payoffs	The sum of the payoffs of each path and of its antithetic twin
+ */
+template <class P>
+void pathKernel(HestonKernelArgs const & args, double const * normals, double * payoffs){
+
+	const int L = HESTON_KERNEL_LANES;
+
+	double deltaT = args.T / ((double) args.discretization);
+	double rhoComplement = sqrt(1 - args.rho * args.rho);
+	double kappaDeltaT = args.kappa * deltaT;
+
+	vdouble volatility = vsplat(args.V0);
+	vdouble log_spot = vsplat(0.0);
+	vdouble antithetic_volatility = volatility;
+	vdouble antithetic_log_spot = log_spot;
+	int observation = 0;
+
+	P payoff(args);
+	P antithetic_payoff(args);
+
+	double companionDrift = (args.r - 0.5 * args.companionVariance) * deltaT;
+	double companionDiffusion = sqrt(args.companionVariance * deltaT);
+	vdouble log_companion = vsplat(0.0);
+	vdouble antithetic_log_companion = log_companion;
+
+	for (int j = 0; j < args.discretization; j++) {
+
+		vdouble random_spot = vload(normals + (2 * j) * L);
+		vdouble random_volatility = vload(normals + (2 * j + 1) * L);
+		vdouble correlated_random_spot = args.rho * random_volatility + rhoComplement * random_spot;
+
+		vdouble step_variance = vmax(volatility, vsplat(0.0));
+		vdouble antithetic_step_variance = vmax(antithetic_volatility, vsplat(0.0));
+
+		if (args.scheme == HestonKernel::QUADRATIC_EXPONENTIAL) {
+			qeStep(args, volatility, log_spot, random_spot, random_volatility);
+			qeStep(args, antithetic_volatility, antithetic_log_spot, -random_spot, -random_volatility);
+		}
+		else if (args.scheme == HestonKernel::LOG_EULER) {
+			vdouble diffusion = vsqrt(volatility * deltaT);
+			vdouble antithetic_diffusion = vsqrt(antithetic_volatility * deltaT);
+
+			log_spot += (args.r - 0.5 * volatility) * deltaT + diffusion * correlated_random_spot;
+			antithetic_log_spot += (args.r - 0.5 * antithetic_volatility) * deltaT - antithetic_diffusion * correlated_random_spot;
+
+			volatility = lognormalStep(args, volatility, random_volatility);
+			antithetic_volatility = lognormalStep(args, antithetic_volatility, -random_volatility);
+		}
+		else {
+			vdouble correct_volatility = vmax(volatility, vsplat(0.0));
+			vdouble antithetic_correct_volatility = vmax(antithetic_volatility, vsplat(0.0));
+
+			vdouble diffusion = vsqrt(correct_volatility * deltaT);
+			vdouble antithetic_diffusion = vsqrt(antithetic_correct_volatility * deltaT);
+
+			log_spot += (args.r - 0.5 * correct_volatility) * deltaT + diffusion * correlated_random_spot;
+			antithetic_log_spot += (args.r - 0.5 * antithetic_correct_volatility) * deltaT - antithetic_diffusion * correlated_random_spot;
+
+			volatility += kappaDeltaT * (args.theta - correct_volatility) + args.xi * diffusion * random_volatility;
+			antithetic_volatility += kappaDeltaT * (args.theta - antithetic_correct_volatility) - args.xi * antithetic_diffusion * random_volatility;
+		}
+
+		payoff.step(log_spot, args.S0 * vexp(log_spot), step_variance);
+		antithetic_payoff.step(antithetic_log_spot, args.S0 * vexp(antithetic_log_spot), antithetic_step_variance);
+
+		log_companion += companionDrift + companionDiffusion * correlated_random_spot;
+		antithetic_log_companion += companionDrift - companionDiffusion * correlated_random_spot;
+
+		while (observation < args.observations && args.observationSteps[observation] == j + 1) {
+			vdouble spot = args.S0 * vexp(log_spot);
+			vdouble antithetic_spot = args.S0 * vexp(antithetic_log_spot);
+			memcpy(args.observed + (2 * observation) * L, &spot, sizeof(vdouble));
+			memcpy(args.observed + (2 * observation + 1) * L, &antithetic_spot, sizeof(vdouble));
+			observation++;
+		}
+	}
+
+	vdouble spot = args.S0 * vexp(log_spot);
+	vdouble antithetic_spot = args.S0 * vexp(antithetic_log_spot);
+	vdouble payoff_sum = payoff.payoff(log_spot, spot) + antithetic_payoff.payoff(antithetic_log_spot, antithetic_spot);
+
+	memcpy(payoffs, &payoff_sum, sizeof(vdouble));
+
+	if (args.controls != NULL) {
+		vdouble spots = spot + antithetic_spot;
+		vdouble companion = vmax(args.S0 * vexp(log_companion) - args.K, vsplat(0.0))
+			+ vmax(args.S0 * vexp(antithetic_log_companion) - args.K, vsplat(0.0));
+		vdouble call = vmax(spot - args.K, vsplat(0.0)) + vmax(antithetic_spot - args.K, vsplat(0.0));
+		memcpy(args.controls, &spots, sizeof(vdouble));
+		memcpy(args.controls + L, &companion, sizeof(vdouble));
+		memcpy(args.controls + 2 * L, &call, sizeof(vdouble));
+	}
+}
+
+/**
+ * @brief		Return the kernel of a payoff, every one is a separate instantiation of pathKernel
+ */
+HestonKernel::Function HESTON_KERNEL_NAME(HestonKernel::Payoff payoff){
+
+	switch (payoff) {
+	case HestonKernel::ASIAN_ARITHMETIC:
+		return pathKernel<HestonAsianArithmetic<VectorMath> >;
+	case HestonKernel::ASIAN_GEOMETRIC:
+		return pathKernel<HestonAsianGeometric<VectorMath> >;
+	case HestonKernel::UP_AND_OUT:
+		return pathKernel<HestonBarrierCall<VectorMath, true, false> >;
+	case HestonKernel::UP_AND_IN:
+		return pathKernel<HestonBarrierCall<VectorMath, true, true> >;
+	case HestonKernel::DOWN_AND_OUT:
+		return pathKernel<HestonBarrierCall<VectorMath, false, false> >;
+	case HestonKernel::DOWN_AND_IN:
+		return pathKernel<HestonBarrierCall<VectorMath, false, true> >;
+	case HestonKernel::LOOKBACK:
+		return pathKernel<HestonLookbackCall<VectorMath> >;
+	default:
+		return pathKernel<HestonEuropeanCall<VectorMath> >;
+	}
+}
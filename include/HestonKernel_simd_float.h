@@ -0,0 +1,318 @@
+/**
+ *       @file  HestonKernel_simd_float.h
+ *      @brief  The HestonFour BarbequeRTRM application
+ *
+ * Description: Body of the single precision batched path kernel. It is included by each HestonKernel_<isa>.cc
+ *		after HestonKernel_simd.h, with HESTON_KERNEL_FLOAT_NAME defined: a lane group is made of twice
+ *		HESTON_KERNEL_LANES floats, thus it takes the registers of a double lane group and evolves twice
+ *		as many paths. The normals are read in double and rounded, the payoff of a path and the one of
+ *		its antithetic twin are widened to double before they are added, so that all the sums of the
+ *		caller stay in double. Do not include it anywhere else.
+ *
+ *		Accuracy: exp is evaluated to about 1 ulp of float, the log spot then carries a relative
+ *		rounding error of about 6e-8 per step. On the same normals a payoff differs from the double one
+ *		by a few 1e-7 of the spot with full truncation, by more with log-Euler on the paths whose variance
+ *		drops to the floor (the drift of log(v) is divided by v), and by the whole payoff on the paths
+ *		which a rounding moves across a barrier. The price moves far less, since these differences have
+ *		both signs: HestonWorker::checkPrecision() measures the bias on a sample of the run before the
+ *		float kernel is used.
+ *
+ *     @author  Luca Napoletano, luca.napoletano@mail.polimi.it, Claudio Montanari, claudio1.montanari@mail.polimi.it
+ *
+ *     Company  Politecnico di Milano
+ *   Copyright  Copyright (c) 2017, Luca Napoletano, Claudio Montanari
+ *
+ * This source code is released for free distribution under the terms of the
+ * GNU General Public License as published by the Free Software Foundation.
+ * =====================================================================================
+ */
+
+#include "HestonKernel.h"
+#include "HestonPayoff.h"
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+#if !defined(HESTON_KERNEL_LANES) || !defined(HESTON_KERNEL_FLOAT_NAME)
+#error "HESTON_KERNEL_LANES and HESTON_KERNEL_FLOAT_NAME must be defined"
+#endif
+
+namespace {
+
+/**
+ * A single precision lane group, as wide as a double lane group
+ */
+const int FLOAT_LANES = 2 * HESTON_KERNEL_LANES;
+
+typedef float vfloat __attribute__((vector_size(HESTON_KERNEL_LANES * sizeof(double))));
+typedef int32_t vint __attribute__((vector_size(HESTON_KERNEL_LANES * sizeof(double))));
+
+inline vfloat fsplat(float x){
+	vfloat v;
+	for (int l = 0; l < FLOAT_LANES; l++)
+		v[l] = x;
+	return v;
+}
+
+/**
+ * @brief		Load a lane group of doubles rounded to float, it is mapped onto the packed conversion
+ */
+inline vfloat fload(double const * p){
+	vfloat v;
+	for (int l = 0; l < FLOAT_LANES; l++)
+		v[l] = (float) p[l];
+	return v;
+}
+
+inline void fstore(double * p, vfloat v){
+	for (int l = 0; l < FLOAT_LANES; l++)
+		p[l] = v[l];
+}
+
+inline vfloat fmax(vfloat x, vfloat y){
+	return x > y ? x : y;
+}
+
+inline vfloat fmin(vfloat x, vfloat y){
+	return x < y ? x : y;
+}
+
+inline vfloat fsqrt(vfloat x){
+	vfloat v;
+	for (int l = 0; l < FLOAT_LANES; l++)
+		v[l] = sqrtf(x[l]);
+	return v;
+}
+
+/**
+ * @brief		Lane-wise exponential, as vexp() with the float exponent field: x = n ln2 + f with |f| <= ln2/2
+ *			and the degree 7 Taylor polynomial of exp(f). The relative error is below 2e-7 in [-87, 88]
+ */
+inline vfloat fexp(vfloat x){
+
+	const float shifter = 12582912.0f;		/**<1.5 * 2^23, rounds to nearest integer*/
+
+	x = fmin(fmax(x, fsplat(-87.0f)), fsplat(88.0f));
+
+	vfloat t = x * 1.44269504f + shifter;
+	vfloat n = t - shifter;
+	vfloat f = x - n * 0.693359375f - n * -2.12194440e-4f;
+
+	vfloat p = fsplat(1.0f / 5040.0f);
+	p = p * f + 1.0f / 720.0f;
+	p = p * f + 1.0f / 120.0f;
+	p = p * f + 1.0f / 24.0f;
+	p = p * f + 1.0f / 6.0f;
+	p = p * f + 0.5f;
+	p = p * f + 1.0f;
+	p = p * f + 1.0f;
+
+	// The low bits of t hold n, move n + 127 into the exponent field
+	vint bits = (vint) t;
+	bits = (bits + 127) << 23;
+
+	return p * (vfloat) bits;
+}
+
+/**
+ * @brief		Lane-wise natural logarithm of a positive normal number, as vlog() with the float exponent field
+ *			and the series of atanh truncated for single precision
+ */
+inline vfloat flog(vfloat x){
+
+	const float shifter = 12582912.0f;
+	const int32_t shifterBits = 0x4b400000;
+
+	vint bits = (vint) x;
+	vint exponent = ((bits >> 23) & 0xff) - 127;
+	vfloat m = (vfloat) ((bits & 0x007fffff) | 0x3f800000);
+	vfloat e = (vfloat) (exponent + shifterBits) - shifter;
+
+	vfloat large = m * 0.5f;
+	e = m > 1.41421356f ? e + 1.0f : e;
+	m = m > 1.41421356f ? large : m;
+
+	vfloat s = (m - 1.0f) / (m + 1.0f);
+	vfloat s2 = s * s;
+
+	vfloat p = fsplat(1.0f / 9.0f);
+	p = p * s2 + 1.0f / 7.0f;
+	p = p * s2 + 1.0f / 5.0f;
+	p = p * s2 + 1.0f / 3.0f;
+	p = p * s2 + 1.0f;
+
+	return e * 0.693147181f + 2.0f * s * p;
+}
+
+/**
+ * Math traits of a single precision lane group, for the payoff policies
+ */
+struct FloatMath {
+
+	typedef vfloat type;
+	typedef float scalar;
+
+	static double tiny() {
+		return 1e-30;
+	}
+
+	static vfloat splat(double x) {
+		return fsplat((float) x);
+	}
+
+	static vfloat max(vfloat x, vfloat y) {
+		return fmax(x, y);
+	}
+
+	static vfloat min(vfloat x, vfloat y) {
+		return fmin(x, y);
+	}
+
+	static vfloat exp(vfloat x) {
+		return fexp(x);
+	}
+
+};
+
+}
+
+/**
+ * @brief		Simulate 2 HESTON_KERNEL_LANES paths and their antithetic twins in single precision, with the
+ *			full-truncation Euler or the LOG_EULER scheme (see pathKernel). The step constants are computed
+ *			in double and rounded once
+ * @param P		The payoff policy, instantiated on the single precision lane group
+ * @param[in] args	The parameters of the simulation
+ * @param[in] normals	The N(0,1) draws, stored as [step][spot, volatility][lane]
+ * @param[out] payoffs	The sum of the payoffs of each path and of its antithetic twin, in double
+ */
+template <class P>
+void floatPathKernel(HestonKernelArgs const & args, double const * normals, double * payoffs){
+
+	const int L = FLOAT_LANES;
+
+	double step = args.T / ((double) args.discretization);
+	float deltaT = (float) step;
+	float rho = (float) args.rho;
+	float rhoComplement = (float) sqrt(1 - args.rho * args.rho);
+	float kappaDeltaT = (float) (args.kappa * step);
+	float theta = (float) args.theta;
+	float xi = (float) args.xi;
+	float decay = (float) args.qeDecay;
+	float slope = (float) args.qeSlope;
+	float constant = (float) args.qeConstant;
+	float r = (float) args.r;
+	float S0 = (float) args.S0;
+	float K = (float) args.K;
+
+	vfloat volatility = fsplat((float) args.V0);
+	vfloat log_spot = fsplat(0.0f);
+	vfloat antithetic_volatility = volatility;
+	vfloat antithetic_log_spot = log_spot;
+	int observation = 0;
+
+	P payoff(args);
+	P antithetic_payoff(args);
+
+	float companionDrift = (float) ((args.r - 0.5 * args.companionVariance) * step);
+	float companionDiffusion = (float) sqrt(args.companionVariance * step);
+	vfloat log_companion = fsplat(0.0f);
+	vfloat antithetic_log_companion = log_companion;
+
+	for (int j = 0; j < args.discretization; j++) {
+
+		vfloat random_spot = fload(normals + (2 * j) * L);
+		vfloat random_volatility = fload(normals + (2 * j + 1) * L);
+		vfloat correlated_random_spot = rho * random_volatility + rhoComplement * random_spot;
+
+		vfloat step_variance = fmax(volatility, fsplat(0.0f));
+		vfloat antithetic_step_variance = fmax(antithetic_volatility, fsplat(0.0f));
+
+		if (args.scheme == HestonKernel::LOG_EULER) {
+			vfloat diffusion = fsqrt(volatility * deltaT);
+			vfloat antithetic_diffusion = fsqrt(antithetic_volatility * deltaT);
+
+			log_spot += (r - 0.5f * volatility) * deltaT + diffusion * correlated_random_spot;
+			antithetic_log_spot += (r - 0.5f * antithetic_volatility) * deltaT - antithetic_diffusion * correlated_random_spot;
+
+			// Lognormal variance step, see lognormalStep() of the double kernel
+			vfloat mean = theta + (volatility - theta) * decay;
+			vfloat antithetic_mean = theta + (antithetic_volatility - theta) * decay;
+			vfloat spread = flog(1.0f + (slope * volatility + constant) / (mean * mean));
+			vfloat antithetic_spread = flog(1.0f + (slope * antithetic_volatility + constant) / (antithetic_mean * antithetic_mean));
+
+			volatility = mean * fexp(-0.5f * spread + fsqrt(spread) * random_volatility);
+			antithetic_volatility = antithetic_mean * fexp(-0.5f * antithetic_spread - fsqrt(antithetic_spread) * random_volatility);
+		}
+		else {
+			vfloat correct_volatility = fmax(volatility, fsplat(0.0f));
+			vfloat antithetic_correct_volatility = fmax(antithetic_volatility, fsplat(0.0f));
+
+			vfloat diffusion = fsqrt(correct_volatility * deltaT);
+			vfloat antithetic_diffusion = fsqrt(antithetic_correct_volatility * deltaT);
+
+			log_spot += (r - 0.5f * correct_volatility) * deltaT + diffusion * correlated_random_spot;
+			antithetic_log_spot += (r - 0.5f * antithetic_correct_volatility) * deltaT - antithetic_diffusion * correlated_random_spot;
+
+			volatility += kappaDeltaT * (theta - correct_volatility) + xi * diffusion * random_volatility;
+			antithetic_volatility += kappaDeltaT * (theta - antithetic_correct_volatility) - xi * antithetic_diffusion * random_volatility;
+		}
+
+		payoff.step(log_spot, S0 * fexp(log_spot), step_variance);
+		antithetic_payoff.step(antithetic_log_spot, S0 * fexp(antithetic_log_spot), antithetic_step_variance);
+
+		log_companion += companionDrift + companionDiffusion * correlated_random_spot;
+		antithetic_log_companion += companionDrift - companionDiffusion * correlated_random_spot;
+
+		while (observation < args.observations && args.observationSteps[observation] == j + 1) {
+			fstore(args.observed + (2 * observation) * L, S0 * fexp(log_spot));
+			fstore(args.observed + (2 * observation + 1) * L, S0 * fexp(antithetic_log_spot));
+			observation++;
+		}
+	}
+
+	vfloat spot = S0 * fexp(log_spot);
+	vfloat antithetic_spot = S0 * fexp(antithetic_log_spot);
+	vfloat path_payoff = payoff.payoff(log_spot, spot);
+	vfloat antithetic_path_payoff = antithetic_payoff.payoff(antithetic_log_spot, antithetic_spot);
+
+	for (int l = 0; l < L; l++)
+		payoffs[l] = (double) path_payoff[l] + (double) antithetic_path_payoff[l];
+
+	if (args.controls != NULL) {
+		vfloat companion = fmax(S0 * fexp(log_companion) - K, fsplat(0.0f));
+		vfloat antithetic_companion = fmax(S0 * fexp(antithetic_log_companion) - K, fsplat(0.0f));
+		vfloat call = fmax(spot - K, fsplat(0.0f));
+		vfloat antithetic_call = fmax(antithetic_spot - K, fsplat(0.0f));
+		for (int l = 0; l < L; l++) {
+			args.controls[l] = (double) spot[l] + (double) antithetic_spot[l];
+			args.controls[L + l] = (double) companion[l] + (double) antithetic_companion[l];
+			args.controls[2 * L + l] = (double) call[l] + (double) antithetic_call[l];
+		}
+	}
+}
+
+/**
+ * @brief		Return the single precision kernel of a payoff
+ */
+HestonKernel::Function HESTON_KERNEL_FLOAT_NAME(HestonKernel::Payoff payoff){
+
+	switch (payoff) {
+	case HestonKernel::ASIAN_ARITHMETIC:
+		return floatPathKernel<HestonAsianArithmetic<FloatMath> >;
+	case HestonKernel::ASIAN_GEOMETRIC:
+		return floatPathKernel<HestonAsianGeometric<FloatMath> >;
+	case HestonKernel::UP_AND_OUT:
+		return floatPathKernel<HestonBarrierCall<FloatMath, true, false> >;
+	case HestonKernel::UP_AND_IN:
+		return floatPathKernel<HestonBarrierCall<FloatMath, true, true> >;
+	case HestonKernel::DOWN_AND_OUT:
+		return floatPathKernel<HestonBarrierCall<FloatMath, false, false> >;
+	case HestonKernel::DOWN_AND_IN:
+		return floatPathKernel<HestonBarrierCall<FloatMath, false, true> >;
+	case HestonKernel::LOOKBACK:
+		return floatPathKernel<HestonLookbackCall<FloatMath> >;
+	default:
+		return floatPathKernel<HestonEuropeanCall<FloatMath> >;
+	}
+}
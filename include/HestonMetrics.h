@@ -0,0 +1,183 @@
+/**
+ *       @file  HestonMetrics.h
+ *      @brief  The HestonFour BarbequeRTRM application
+ *
+ * Description: Metrics of the simulation engine. Every worker counts its paths and steps, and with
+ *		HESTON_TIMERS the time of its random draws and of its path evolution, in counters written only by
+ *		its own pool thread. The EXC adds the busy and idle time of the workers, its own wait for them
+ *		and the latency of every cycle, split by AWM. Everything is an atomic read without locks: the
+ *		metrics are written by onMonitor() to a JSON file and served in the Prometheus text format on a
+ *		local socket, while the workers run.
+ *
+ *     @author  Luca Napoletano, luca.napoletano@mail.polimi.it, Claudio Montanari, claudio1.montanari@mail.polimi.it
+ *
+ *     Company  Politecnico di Milano
+ *   Copyright  Copyright (c) 2017, Luca Napoletano, Claudio Montanari
+ *
+ * This source code is released for free distribution under the terms of the
+ * GNU General Public License as published by the Free Software Foundation.
+ * =====================================================================================
+ */
+
+#ifndef HESTONMETRICS_H_
+#define HESTONMETRICS_H_
+
+#include <stdint.h>
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "HestonScheduler.h"
+
+/**
+ * The counters of a worker. A counter has a single writer, the pool thread of the worker, thus it is
+ * updated by a relaxed load and store instead of a locked read-modify-write
+ */
+struct HestonCounters {
+	std::atomic<uint64_t> paths;
+	std::atomic<uint64_t> steps;
+	/**
+	 * Time (ns) of the random draws and of the path evolution, only counted with HESTON_TIMERS
+	 */
+	std::atomic<uint64_t> rngTime;
+	std::atomic<uint64_t> evolutionTime;
+
+	HestonCounters() :
+		paths(0),
+		steps(0),
+		rngTime(0),
+		evolutionTime(0) {
+	}
+
+	static void add(std::atomic<uint64_t> & counter, uint64_t value) {
+		counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+	}
+};
+
+#ifdef HESTON_TIMERS
+
+/**
+ * Adds the lifetime of its scope (ns) to a counter of a worker
+ */
+class HestonTimer {
+
+public:
+
+	explicit HestonTimer(std::atomic<uint64_t> & counter) :
+		counter(counter),
+		start(std::chrono::steady_clock::now()) {
+	}
+
+	~HestonTimer() {
+		HestonCounters::add(counter, (uint64_t) std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now() - start).count());
+	}
+
+private:
+
+	std::atomic<uint64_t> & counter;
+	std::chrono::steady_clock::time_point start;
+
+};
+
+#define HESTON_TIMER_NAME(line) hestonTimer ## line
+#define HESTON_TIMER_LINE(counter, line) HestonTimer HESTON_TIMER_NAME(line)(counter)
+#define HESTON_TIMED(counter) HESTON_TIMER_LINE(counter, __LINE__)
+
+#else
+
+#define HESTON_TIMED(counter) ((void) 0)
+
+#endif
+
+class HestonMetrics {
+
+public:
+
+	HestonMetrics(int workers);
+	~HestonMetrics();
+
+	void attach(int worker, HestonCounters const * counters);
+	void configure(int awm, int workers);
+	void cycle(double latency, double wait, HestonScheduler const * scheduler);
+	void estimate(double price, double error);
+	void requests(long done);
+
+	bool listen(std::string const & address);
+	void close();
+	bool write(std::string const & path);
+
+	std::string text() const;
+	std::string json();
+
+	static bool timers();
+
+private:
+
+	/**
+	 * Upper bounds of the buckets of the cycle latency histogram (s), the last bucket is unbounded
+	 */
+	static const int BUCKETS = 13;
+	static const double BOUNDS[BUCKETS - 1];
+	/**
+	 * AWM ids are 8 bits wide
+	 */
+	static const int AWMS = 256;
+
+	/**
+	 * The counters of the workers, and the time (ns) they spent running chunks and waiting for the other
+	 * workers of their cycles, and the chunks they ran
+	 */
+	int WORKERS;
+	std::vector<HestonCounters const *> counters;
+	std::atomic<uint64_t>* busyTime;
+	std::atomic<uint64_t>* idleTime;
+	std::atomic<uint64_t>* chunks;
+
+	/**
+	 * The cycles: latency histogram and sum (ns), the time (ns) the EXC waited for the workers, the
+	 * chunks stolen, and the paths and the time (ns) of the cycles of each AWM
+	 */
+	std::atomic<uint64_t> cycleBuckets[BUCKETS];
+	std::atomic<uint64_t> cycleTime;
+	std::atomic<uint64_t> waitTime;
+	std::atomic<uint64_t> steals;
+	std::atomic<uint64_t>* awmPaths;
+	std::atomic<uint64_t>* awmTime;
+	uint64_t cyclePaths;
+
+	/**
+	 * Gauges: the AWM and the workers of the last configuration, the estimate of the price and the
+	 * requests replied, NAN or negative while unknown
+	 */
+	std::atomic<int> AWM;
+	std::atomic<int> ACTIVE;
+	std::atomic<double> price;
+	std::atomic<double> error;
+	std::atomic<long> REQUESTS;
+
+	/**
+	 * The totals of the last json(), for the rates of the next one
+	 */
+	std::chrono::steady_clock::time_point lastTime;
+	uint64_t lastPaths;
+	uint64_t lastSteps;
+
+	/**
+	 * The endpoint: its listening socket and the thread serving it
+	 */
+	int listener;
+	std::string socketPath;
+	std::thread server;
+	std::atomic<bool> CLOSING;
+
+	uint64_t total(std::atomic<uint64_t> HestonCounters::* counter) const;
+	void serveLoop();
+	void serveClient(int fd);
+
+};
+
+#endif // HESTONMETRICS_H_
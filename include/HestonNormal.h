@@ -0,0 +1,68 @@
+/**
+ *       @file  HestonNormal.h
+ *      @brief  The HestonFour BarbequeRTRM application
+ *
+ * Description: Block generator of N(0,1) draws. A single call fills a whole buffer, so that the simulation
+ *		loop reads its draws from memory instead of calling a function for every draw.
+ *
+ *     @author  Luca Napoletano, luca.napoletano@mail.polimi.it, Claudio Montanari, claudio1.montanari@mail.polimi.it
+ *
+ *     Company  Politecnico di Milano
+ *   Copyright  Copyright (c) 2017, Luca Napoletano, Claudio Montanari
+ *
+ * This source code is released for free distribution under the terms of the
+ * GNU General Public License as published by the Free Software Foundation.
+ * =====================================================================================
+ */
+
+#ifndef HESTONNORMAL_H_
+#define HESTONNORMAL_H_
+
+#include "HestonKernel.h"
+#include "HestonRandom.h"
+
+#include <iostream>
+#include <string>
+
+class HestonNormal {
+
+public:
+
+	/**
+	 * The available algorithms:
+	 *  - BOX_MULLER, the Box-Muller transform, vectorized with the path kernel instruction set
+	 *  - ZIGGURAT, the Marsaglia-Tsang ziggurat with 128 blocks (Doornik ZIGNOR variant)
+	 *  - AS241, inversion of the CDF with the Wichura PPND16 algorithm, about 1e-16 accuracy
+	 *  - ABRAMOWITZ_STEGUN, inversion with the 26.2.23 formula, about 4.5e-4 accuracy (the original code)
+	 */
+	enum Algorithm { BOX_MULLER = 0, ZIGGURAT, AS241, ABRAMOWITZ_STEGUN };
+
+	HestonNormal(Algorithm algorithm, HestonKernel::Isa isa);
+
+	void fill(HestonRandom & generator, double * buffer, int n);
+
+	static double inverse(double p);
+	static double legacyInverse(double p);
+	static double cdf(double x);
+
+	static Algorithm parse(std::string const & name);
+	static const char* name(Algorithm algorithm);
+	static void benchmark(HestonKernel::Isa isa, std::ostream & out);
+
+private:
+
+	Algorithm algorithm;
+	HestonKernel::Transform transform;
+	int GROUP;
+
+	/**
+	 * Ziggurat tables: the right edge of each block and the ratio between two consecutive edges
+	 */
+	double zigguratX[129];
+	double zigguratRatio[128];
+
+	double zigguratTail(HestonRandom & generator, bool negative);
+
+};
+
+#endif // HESTONNORMAL_H_
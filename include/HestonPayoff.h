@@ -0,0 +1,234 @@
+/**
+ *       @file  HestonPayoff.h
+ *      @brief  The HestonFour BarbequeRTRM application
+ *
+ * Description: Payoff policies of the path kernels. A policy keeps an O(1) streaming state per path (running
+ *		sum, extremum, survival probability), it is updated inline at the end of every step and closed at
+ *		maturity. The kernels are templates on the policy, thus every payoff gets its own fully inlined
+ *		kernel and no call nor branch on the payoff type is left in the step loop. The policies are also
+ *		templates on a math traits class, the same code runs on a double (scalar reference kernel) and on
+ *		a lane group (batched kernels).
+ *
+ *     @author  Luca Napoletano, luca.napoletano@mail.polimi.it, Claudio Montanari, claudio1.montanari@mail.polimi.it
+ *
+ *     Company  Politecnico di Milano
+ *   Copyright  Copyright (c) 2017, Luca Napoletano, Claudio Montanari
+ *
+ * This source code is released for free distribution under the terms of the
+ * GNU General Public License as published by the Free Software Foundation.
+ * =====================================================================================
+ */
+
+#ifndef HESTONPAYOFF_H_
+#define HESTONPAYOFF_H_
+
+#include "HestonKernel.h"
+
+#include <math.h>
+
+/**
+ * Math traits of the scalar reference kernel. The batched kernels define the same members on their lane
+ * group type: the type of a lane (scalar), the smallest positive value used as a floor (tiny), splat, max,
+ * min and exp
+ */
+struct HestonScalarMath {
+
+	typedef double type;
+	typedef double scalar;
+
+	static double tiny() {
+		return 1e-300;
+	}
+
+	static double splat(double x) {
+		return x;
+	}
+
+	static double max(double x, double y) {
+		return x > y ? x : y;
+	}
+
+	static double min(double x, double y) {
+		return x < y ? x : y;
+	}
+
+	static double exp(double x) {
+		return ::exp(x);
+	}
+
+};
+
+/**
+ * The interface of a policy, on the log spot x = ln(S / S0) of a path:
+ *	P(args)			read the option parameters
+ *	step(x, spot, variance)	the path reached x (and spot = S0 exp(x)) at the end of a step which started
+ *				with the variance given
+ *	payoff(x, spot)		the payoff at maturity
+ *	LOG			true when step or payoff read x
+ * The batched kernels always pass the spot, a policy which does not use it lets the compiler drop its
+ * exponential. The scalar kernel evolves the spot itself and only computes x when LOG is set: it is not built
+ * with -fno-math-errno, thus the compiler keeps every call to log().
+ */
+
+/**
+ * @brief		European call, max(S_T - K, 0), no state
+ */
+template <class M>
+struct HestonEuropeanCall {
+
+	typedef typename M::type T;
+	typedef typename M::scalar S;
+
+	static const bool LOG = false;
+
+	S K;
+
+	HestonEuropeanCall(HestonKernelArgs const & args) :
+		K(args.K) {
+	}
+
+	void step(T, T, T) {
+	}
+
+	T payoff(T, T spot) const {
+		return M::max(spot - K, M::splat(0.0));
+	}
+
+};
+
+/**
+ * @brief		Arithmetic Asian call on the spots at the end of every step, max(mean(S) - K, 0)
+ */
+template <class M>
+struct HestonAsianArithmetic {
+
+	typedef typename M::type T;
+	typedef typename M::scalar S;
+
+	static const bool LOG = false;
+
+	S K;
+	S weight;
+	T sum;
+
+	HestonAsianArithmetic(HestonKernelArgs const & args) :
+		K(args.K), weight(1.0 / args.discretization), sum(M::splat(0.0)) {
+	}
+
+	void step(T, T spot, T) {
+		sum += spot;
+	}
+
+	T payoff(T, T) const {
+		return M::max(sum * weight - K, M::splat(0.0));
+	}
+
+};
+
+/**
+ * @brief		Geometric Asian call on the spots at the end of every step, max(exp(mean(ln S)) - K, 0)
+ */
+template <class M>
+struct HestonAsianGeometric {
+
+	typedef typename M::type T;
+	typedef typename M::scalar S;
+
+	static const bool LOG = true;
+
+	S S0;
+	S K;
+	S weight;
+	T sum;
+
+	HestonAsianGeometric(HestonKernelArgs const & args) :
+		S0(args.S0), K(args.K), weight(1.0 / args.discretization), sum(M::splat(0.0)) {
+	}
+
+	void step(T x, T, T) {
+		sum += x;
+	}
+
+	T payoff(T, T) const {
+		return M::max(S0 * M::exp(sum * weight) - K, M::splat(0.0));
+	}
+
+};
+
+/**
+ * @brief		Barrier call, continuously monitored. Inside a step the log spot is a Brownian bridge between
+ *			its end points, it crosses the barrier b with probability exp(-2 (b - x0)(b - x1) / (v dt)):
+ *			the state is the probability that the path is still alive, which also removes the bias of
+ *			discrete monitoring. The knock-in price is the call minus the knock-out one on the same path
+ * @param UP		True for an up barrier, false for a down one
+ * @param IN		True for a knock-in option, false for a knock-out one
+ */
+template <class M, bool UP, bool IN>
+struct HestonBarrierCall {
+
+	typedef typename M::type T;
+	typedef typename M::scalar S;
+
+	static const bool LOG = true;
+
+	S K;
+	S barrier;		/**<ln(B / S0)*/
+	S deltaT;
+	T previous;
+	T alive;
+
+	HestonBarrierCall(HestonKernelArgs const & args) :
+		K(args.K), barrier(log(args.barrier / args.S0)), deltaT(args.T / args.discretization),
+		previous(M::splat(0.0)) {
+		// A path which starts beyond the barrier is already knocked
+		alive = M::splat((UP ? 0.0 < barrier : 0.0 > barrier) ? 1.0 : 0.0);
+	}
+
+	void step(T x, T, T variance) {
+
+		// Distances from the barrier, a path which ends beyond it crosses with probability 1
+		T start = M::max(UP ? barrier - previous : previous - barrier, M::splat(0.0));
+		T end = M::max(UP ? barrier - x : x - barrier, M::splat(0.0));
+
+		T crossing = M::exp(-2.0 * start * end / M::max(variance * deltaT, M::splat(M::tiny())));
+		alive = alive * (1.0 - crossing);
+		previous = x;
+	}
+
+	T payoff(T, T spot) const {
+		T call = M::max(spot - K, M::splat(0.0));
+		return IN ? call * (1.0 - alive) : call * alive;
+	}
+
+};
+
+/**
+ * @brief		Floating strike lookback call, S_T - min(S), the minimum over S0 and the spots at the end of
+ *			every step
+ */
+template <class M>
+struct HestonLookbackCall {
+
+	typedef typename M::type T;
+	typedef typename M::scalar S;
+
+	static const bool LOG = true;
+
+	S S0;
+	T minimum;
+
+	HestonLookbackCall(HestonKernelArgs const & args) :
+		S0(args.S0), minimum(M::splat(0.0)) {
+	}
+
+	void step(T x, T, T) {
+		minimum = M::min(minimum, x);
+	}
+
+	T payoff(T, T spot) const {
+		return spot - S0 * M::exp(minimum);
+	}
+
+};
+
+#endif // HESTONPAYOFF_H_
@@ -0,0 +1,66 @@
+/**
+ *       @file  HestonPool.h
+ *      @brief  The HestonFour BarbequeRTRM application
+ *
+ * Description: A persistent pool of worker threads. Threads are created once in onSetup(), park on a
+ *		condition variable between two onRun() cycles and are pinned to the CPUs granted by the RTRM.
+ *
+ *     @author  Luca Napoletano, luca.napoletano@mail.polimi.it, Claudio Montanari, claudio1.montanari@mail.polimi.it
+ *
+ *     Company  Politecnico di Milano
+ *   Copyright  Copyright (c) 2017, Luca Napoletano, Claudio Montanari
+ *
+ * This source code is released for free distribution under the terms of the
+ * GNU General Public License as published by the Free Software Foundation.
+ * =====================================================================================
+ */
+
+#ifndef HESTONPOOL_H_
+#define HESTONPOOL_H_
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class HestonPool {
+
+public:
+
+	HestonPool(int threads);
+	~HestonPool();
+
+	void post(int slot, std::function<void()> const & task);
+	void join(int slot);
+	void setAffinity(std::vector<int> const & cpus);
+	int size();
+
+	static std::vector<int> allowedCpus();
+	static int currentNode();
+
+private:
+
+	/**
+	 * Mailbox of a single pool thread: the thread sleeps until a task is posted or the pool shuts down. The
+	 * flags are guarded by the lock of the slot
+	 */
+	struct Slot {
+		std::mutex lock;
+		std::condition_variable wakeup;
+		std::condition_variable done;
+		std::function<void()> task;
+		bool busy;
+		bool shutdown;
+	};
+
+	int THREADS;
+
+	Slot* slots;
+	std::vector<std::thread> threads;
+
+	void loop(int slot);
+
+};
+
+#endif // HESTONPOOL_H_
@@ -0,0 +1,79 @@
+/**
+ *       @file  HestonProfile.h
+ *      @brief  The HestonFour BarbequeRTRM application
+ *
+ * Description: Operating points of the AWMs. Each AWM of the recipe maps to the knobs of the paths it
+ *		simulates: discretization, variance scheme, precision and the error at which the run stops, with
+ *		the throughput and the error hestonfour_profile measured for them on the host. The profiler
+ *		writes the operating points file and the recipe whose AWMs match it, hestonfour reads the file
+ *		back (--awm-file) and applies the knobs of the AWM the RTRM assigns.
+ *
+ *     @author  Luca Napoletano, luca.napoletano@mail.polimi.it, Claudio Montanari, claudio1.montanari@mail.polimi.it
+ *
+ *     Company  Politecnico di Milano
+ *   Copyright  Copyright (c) 2017, Luca Napoletano, Claudio Montanari
+ *
+ * This source code is released for free distribution under the terms of the
+ * GNU General Public License as published by the Free Software Foundation.
+ * =====================================================================================
+ */
+
+#ifndef HESTONPROFILE_H_
+#define HESTONPROFILE_H_
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "HestonKernel.h"
+
+/**
+ * The knobs of an AWM and their measures
+ */
+struct HestonOperatingPoint {
+	int awm;
+	int discretization;
+	HestonKernel::Scheme scheme;
+	HestonKernel::Precision precision;
+	/**
+	 * Half-width of the confidence interval at which the run stops (0: the paths of the run), the profiler
+	 * sets it to the discretization bias: below it more paths do not make the price more accurate
+	 */
+	double targetError;
+	/**
+	 * The CPU quota of the AWM (% of a processing element), the paths per second of one core, the bias and
+	 * the root mean square error of the price simulated within the time budget of the profile, and the
+	 * value of the AWM in the recipe
+	 */
+	int quota;
+	double throughput;
+	double bias;
+	double rmse;
+	int value;
+
+	HestonOperatingPoint() :
+		awm(0),
+		discretization(1),
+		scheme(HestonKernel::FULL_TRUNCATION),
+		precision(HestonKernel::DOUBLE),
+		targetError(0.0),
+		quota(100),
+		throughput(0.0),
+		bias(0.0),
+		rmse(0.0),
+		value(1) {
+	}
+};
+
+class HestonProfile {
+
+public:
+
+	static int load(std::string const & path, std::vector<HestonOperatingPoint> & points);
+	static bool save(std::string const & path, std::vector<HestonOperatingPoint> const & points);
+	static void writeRecipe(std::ostream & out, std::vector<HestonOperatingPoint> const & points);
+	static HestonOperatingPoint const * find(std::vector<HestonOperatingPoint> const & points, int awm);
+
+};
+
+#endif // HESTONPROFILE_H_
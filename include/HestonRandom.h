@@ -0,0 +1,119 @@
+/**
+ *       @file  HestonRandom.h
+ *      @brief  The HestonFour BarbequeRTRM application
+ *
+ * Description: Counter-based random number generator (Philox4x32-10, Salmon et al. 2011). The output is a pure
+ *		function of the key (the job seed) and of a 128 bit counter, so a worker can jump in O(1) to the
+ *		stream of any (block, path) pair: the random numbers of a path do not depend on which thread
+ *		simulates it nor on how many workers the RTRM grants.
+ *
+ *     @author  Luca Napoletano, luca.napoletano@mail.polimi.it, Claudio Montanari, claudio1.montanari@mail.polimi.it
+ *
+ *     Company  Politecnico di Milano
+ *   Copyright  Copyright (c) 2017, Luca Napoletano, Claudio Montanari
+ *
+ * This source code is released for free distribution under the terms of the
+ * GNU General Public License as published by the Free Software Foundation.
+ * =====================================================================================
+ */
+
+#ifndef HESTONRANDOM_H_
+#define HESTONRANDOM_H_
+
+#include <stdint.h>
+
+class HestonRandom {
+
+public:
+
+	typedef uint32_t result_type;
+
+	HestonRandom(uint64_t seed = 0) {
+		this->key[0] = (uint32_t) seed;
+		this->key[1] = (uint32_t) (seed >> 32);
+		seek(0, 0);
+	}
+
+	static result_type min() {
+		return 0;
+	}
+
+	static result_type max() {
+		return 0xFFFFFFFF;
+	}
+
+	/**
+	 * @brief		Move to the beginning of the stream of a path: counter = (0, 0, path, block)
+	 * @param[in] block	The index of the block of paths
+	 * @param[in] path	The index of the path inside the block
+	 */
+	void seek(uint32_t block, uint32_t path) {
+		counter[0] = 0;
+		counter[1] = 0;
+		counter[2] = path;
+		counter[3] = block;
+		index = 4;
+	}
+
+	/**
+	 * @brief		Return the next 32 random bits of the current stream
+	 */
+	result_type operator()() {
+		if (index == 4) {
+			generate();
+			index = 0;
+		}
+		return output[index++];
+	}
+
+private:
+
+	uint32_t key[2];
+	uint32_t counter[4];
+	uint32_t output[4];
+	int index;
+
+	static inline uint32_t mulhilo(uint32_t a, uint32_t b, uint32_t & hi) {
+		uint64_t product = (uint64_t) a * b;
+		hi = (uint32_t) (product >> 32);
+		return (uint32_t) product;
+	}
+
+	/**
+	 * @brief		Encrypt the counter with 10 Philox rounds, then increment it
+	 */
+	void generate() {
+
+		uint32_t c0 = counter[0];
+		uint32_t c1 = counter[1];
+		uint32_t c2 = counter[2];
+		uint32_t c3 = counter[3];
+		uint32_t k0 = key[0];
+		uint32_t k1 = key[1];
+
+		for (int round = 0; round < 10; round++) {
+			uint32_t hi0, hi1;
+			uint32_t lo0 = mulhilo(0xD2511F53, c0, hi0);
+			uint32_t lo1 = mulhilo(0xCD9E8D57, c2, hi1);
+
+			c0 = hi1 ^ c1 ^ k0;
+			c1 = lo1;
+			c2 = hi0 ^ c3 ^ k1;
+			c3 = lo0;
+
+			k0 += 0x9E3779B9;
+			k1 += 0xBB67AE85;
+		}
+
+		output[0] = c0;
+		output[1] = c1;
+		output[2] = c2;
+		output[3] = c3;
+
+		if (++counter[0] == 0)
+			++counter[1];
+	}
+
+};
+
+#endif // HESTONRANDOM_H_
@@ -0,0 +1,101 @@
+/**
+ *       @file  HestonScheduler.h
+ *      @brief  The HestonFour BarbequeRTRM application
+ *
+ * Description: Work-stealing scheduler of the chunks of a cycle. The chunks are dealt in contiguous ranges to
+ *		per-worker deques: a worker takes its own chunks from the front and, when it runs out, steals
+ *		from the back of the others. A fast core thus ends up doing more chunks than a slow one and the
+ *		cycle ends with the last chunk, not with the slowest pre-assigned block. The completion of every
+ *		chunk is signalled, so the results are reduced in chunk order while the others still run. A
+ *		cycle can be cancelled, the workers then return as soon as their running chunk does.
+ *
+ *     @author  Luca Napoletano, luca.napoletano@mail.polimi.it, Claudio Montanari, claudio1.montanari@mail.polimi.it
+ *
+ *     Company  Politecnico di Milano
+ *   Copyright  Copyright (c) 2017, Luca Napoletano, Claudio Montanari
+ *
+ * This source code is released for free distribution under the terms of the
+ * GNU General Public License as published by the Free Software Foundation.
+ * =====================================================================================
+ */
+
+#ifndef HESTONSCHEDULER_H_
+#define HESTONSCHEDULER_H_
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+#include "HestonPool.h"
+
+class HestonScheduler {
+
+public:
+
+	/**
+	 * A task runs a chunk on the pool thread of a worker
+	 */
+	typedef std::function<void(int worker, long chunk)> Task;
+
+	HestonScheduler(HestonPool* pool);
+	~HestonScheduler();
+
+	void start(int workers, long chunks, Task const & task);
+	void wait(long chunk);
+	bool wait(long chunk, std::chrono::steady_clock::time_point deadline);
+	void cancel();
+	void join();
+
+	int getWorkers() const;
+	double getBusy(int worker) const;
+	long getChunks(int worker) const;
+	long getSteals() const;
+	double getImbalance() const;
+
+private:
+
+	/**
+	 * The chunks still to run of a worker
+	 */
+	struct Queue {
+		std::mutex lock;
+		std::deque<long> chunks;
+	};
+
+	HestonPool* pool;
+	Queue* queues;
+	Task task;
+
+	int WORKERS;
+	long CHUNKS;
+
+	/**
+	 * Set by cancel(): the workers take no more chunks, the untaken ones stay undone
+	 */
+	std::atomic<bool> CANCELLED;
+
+	/**
+	 * Completion flags of the chunks of the cycle
+	 */
+	std::mutex doneLock;
+	std::condition_variable doneSignal;
+	std::vector<char> done;
+
+	/**
+	 * Time spent running chunks (seconds) and chunks run by each worker in the cycle, and chunks stolen
+	 */
+	std::vector<double> busy;
+	std::vector<long> executed;
+	std::atomic<long> steals;
+
+	bool pop(int worker, long & chunk);
+	bool steal(int worker, long & chunk);
+	void loop(int worker);
+
+};
+
+#endif // HESTONSCHEDULER_H_
@@ -0,0 +1,164 @@
+/**
+ *       @file  HestonServer.h
+ *      @brief  The HestonFour BarbequeRTRM application
+ *
+ * Description: Request stream of the batch pricing mode. A reader thread parses the pricing requests of the
+ *		standard input, of a file or of the clients of a local Unix socket (one after the other) and
+ *		queues them. The EXC takes the queued requests in batches and replies to each one, in the
+ *		order of arrival, on the stream it came from. Requests and replies are CSV lines or fixed size
+ *		binary records:
+ *
+ *		CSV request	id,S0,K,r,T,V0,rho,kappa,theta,xi[,simulations[,discretization]]
+ *		CSV reply	id,price,standard error,simulations,latency (ms), or id,error,message
+ *		binary		HestonRequestRecord and HestonReplyRecord, in the byte order of the host
+ *
+ *     @author  Luca Napoletano, luca.napoletano@mail.polimi.it, Claudio Montanari, claudio1.montanari@mail.polimi.it
+ *
+ *     Company  Politecnico di Milano
+ *   Copyright  Copyright (c) 2017, Luca Napoletano, Claudio Montanari
+ *
+ * This source code is released for free distribution under the terms of the
+ * GNU General Public License as published by the Free Software Foundation.
+ * =====================================================================================
+ */
+
+#ifndef HESTONSERVER_H_
+#define HESTONSERVER_H_
+
+#include <signal.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "HestonStats.h"
+
+/**
+ * A binary request: the option (S0, K, r, T) and the model (V0, rho, kappa, theta, xi) parameters. The
+ * simulations and the discretization default to the ones of the command line when not positive
+ */
+struct HestonRequestRecord {
+	uint64_t id;
+	double parameters[9];
+	int32_t simulations;
+	int32_t discretization;
+};
+
+/**
+ * A binary reply, simulations is -1 for an invalid request
+ */
+struct HestonReplyRecord {
+	uint64_t id;
+	double price;
+	double error;
+	int64_t simulations;
+};
+
+/**
+ * A pricing request and, once priced, its result
+ */
+struct HestonJob {
+	std::string id;
+	double S0;
+	double K;
+	double r;
+	double T;
+	double V0;
+	double rho;
+	double kappa;
+	double theta;
+	double xi;
+	int simulations;
+	int discretization;
+
+	/**
+	 * Why the request cannot be priced, empty for a valid one
+	 */
+	std::string invalid;
+
+	double price;
+	double error;
+	long done;
+
+	std::chrono::steady_clock::time_point arrival;
+
+	/**
+	 * The stream of the request, its reply goes there
+	 */
+	std::shared_ptr<int> output;
+};
+
+class HestonServer {
+
+public:
+
+	enum Format { CSV = 0, BINARY };
+
+	HestonServer(Format format, int simulations, int discretization);
+	~HestonServer();
+
+	bool open(std::string const & source);
+	bool take(std::vector<HestonJob> & batch, size_t count, double timeout);
+	void reply(HestonJob const & job);
+	void close();
+
+	long getRequests() const;
+	double getThroughput() const;
+	HestonStats const & getLatency() const;
+
+	static void interrupt(int signal);
+	static Format parseFormat(std::string const & name);
+	static const char* formatName(Format format);
+	static void validate(HestonJob & job);
+
+private:
+
+	Format FORMAT;
+	int SIMULATIONS;
+	int DISCRETIZATION;
+
+	int input;
+	int listener;
+	std::string socketPath;
+	std::thread reader;
+	std::atomic<bool> CLOSING;
+
+	/**
+	 * Set by interrupt(): the reader stops as after the end of the stream, the requests queued are priced
+	 */
+	static volatile sig_atomic_t INTERRUPTED;
+
+	/**
+	 * The requests read and not taken yet, ENDED is set when no more requests will come
+	 */
+	std::mutex lock;
+	std::condition_variable signal;
+	std::deque<HestonJob> pending;
+	bool ENDED;
+
+	/**
+	 * Replies sent, their latency (ms from the arrival of the request) and the time of the first request
+	 */
+	long REPLIES;
+	HestonStats latency;
+	bool STARTED;
+	std::chrono::steady_clock::time_point first;
+
+	void readLoop();
+	void readStream(int fd, std::shared_ptr<int> const & output);
+	void queue(HestonJob & job);
+	bool parseLine(std::string const & line, HestonJob & job);
+	void parseRecord(HestonRequestRecord const & record, HestonJob & job);
+
+	static bool writeAll(int fd, char const * data, size_t bytes);
+
+};
+
+#endif // HESTONSERVER_H_
@@ -0,0 +1,221 @@
+/**
+ *       @file  HestonSettings.h
+ *      @brief  The HestonFour BarbequeRTRM application
+ *
+ * Description: The settings of the simulation engine, they do not depend on the option to price and are
+ *		shared by the HestonFour EXC and all its workers.
+ *
+ *     @author  Luca Napoletano, luca.napoletano@mail.polimi.it, Claudio Montanari, claudio1.montanari@mail.polimi.it
+ *
+ *     Company  Politecnico di Milano
+ *   Copyright  Copyright (c) 2017, Luca Napoletano, Claudio Montanari
+ *
+ * This source code is released for free distribution under the terms of the
+ * GNU General Public License as published by the Free Software Foundation.
+ * =====================================================================================
+ */
+
+#ifndef HESTONSETTINGS_H_
+#define HESTONSETTINGS_H_
+
+#include "HestonKernel.h"
+#include "HestonNormal.h"
+#include "HestonProfile.h"
+
+#include <math.h>
+#include <stdint.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+struct HestonSettings {
+
+	/**
+	 * The pricing engine: AUTO routes the payoffs with a closed-form characteristic function to the
+	 * Fourier pricer and all the others to the Monte Carlo workers
+	 */
+	enum Engine {
+		ENGINE_AUTO = 0,
+		ENGINE_FOURIER,
+		ENGINE_MONTECARLO
+	};
+
+	/**
+	 * The instruction set of the path kernel, SCALAR runs the reference code
+	 */
+	HestonKernel::Isa kernel;
+
+	/**
+	 * The variance discretization scheme of the paths
+	 */
+	HestonKernel::Scheme scheme;
+
+	/**
+	 * The algorithm of the N(0,1) block generator
+	 */
+	HestonNormal::Algorithm normal;
+
+	/**
+	 * The key of the counter-based generator, equal seeds give bit-identical prices
+	 */
+	uint64_t seed;
+
+	/**
+	 * Quasi-Monte Carlo mode: scrambled Sobol points, split in randomized replications
+	 */
+	bool qmc;
+	int replications;
+
+	/**
+	 * Adaptive stopping: the run ends when the confidence interval half-width drops below targetError
+	 * (disabled when targetError is 0)
+	 */
+	double targetError;
+	double confidence;
+
+	/**
+	 * Grid mode: all the (strike, maturity) pairs are priced on the same paths, simulated up to the
+	 * longest maturity (horizon). The option maturity is one of the grid maturities, the price of the
+	 * option is read on the way. Empty lists disable the grid
+	 */
+	std::vector<double> strikes;
+	std::vector<double> maturities;
+	double horizon;
+
+	/**
+	 * Control variate mode: the payoff is regressed on controls with a known expectation
+	 */
+	bool controlVariates;
+
+	/**
+	 * Multilevel Monte Carlo mode: levels with DISCR / 2^l steps, the number of paths of each level is
+	 * chosen for the requested root mean square error (disabled when mlmcLevels is 0)
+	 */
+	int mlmcLevels;
+	double mlmcRmse;
+
+	bool grid() const {
+		return !strikes.empty() && !maturities.empty();
+	}
+
+	/**
+	 * @brief		The time up to which the paths of an option of maturity T are simulated
+	 */
+	double pathTime(double T) const {
+		return grid() ? horizon : T;
+	}
+
+	/**
+	 * @brief		The step at the end of which a maturity is observed, on a path of the given
+	 *			discretization up to time T
+	 */
+	static int maturityStep(double maturity, double T, int discretization) {
+		int step = (int) floor(maturity / T * discretization + 0.5);
+		return std::max(1, std::min(step, discretization));
+	}
+
+	Engine engine;
+
+	/**
+	 * The payoff of the option and the barrier level of the barrier calls
+	 */
+	HestonKernel::Payoff payoff;
+	double barrier;
+
+	/**
+	 * American mode: number of evenly spaced exercise dates of a put priced by Longstaff-Schwartz (disabled
+	 * when exercises is 0)
+	 */
+	int exercises;
+
+	/**
+	 * Greeks mode: delta, gamma, vega (w.r.t. V0) and rho are estimated on the paths of the price
+	 */
+	bool greeks;
+
+	/**
+	 * Cooperative preemption: a Monte Carlo cycle returns after about cycleTime ms, the chunks still running
+	 * are stopped and resumed in the next cycle. A resource change is applied at the end of a cycle, thus
+	 * within cycleTime ms (disabled when cycleTime is 0)
+	 */
+	double cycleTime;
+
+	/**
+	 * Checkpoints: the state of the Monte Carlo run is saved in the checkpoint file every checkpointInterval
+	 * ms, resume continues the run it holds (disabled when checkpoint is empty)
+	 */
+	std::string checkpoint;
+	double checkpointInterval;
+	bool resume;
+
+	/**
+	 * Result cache of the batch pricing mode: its file and its largest number of entries (disabled when
+	 * cache is empty). The file is saved every checkpointInterval ms, when an entry changed
+	 */
+	std::string cache;
+	int cacheSize;
+
+	/**
+	 * Metrics of the engine: the JSON file written every metricsInterval ms and the local socket of the
+	 * Prometheus endpoint, unix:PATH or a TCP port of the loopback interface (disabled when empty)
+	 */
+	std::string metrics;
+	std::string metricsListen;
+	double metricsInterval;
+
+	/**
+	 * Mixed precision: with FLOAT the AWMs in floatAwms evolve the paths with the single precision kernels,
+	 * once a check on a sample of paths has shown that their bias is negligible against the error of the run
+	 */
+	HestonKernel::Precision precision;
+	std::vector<int> floatAwms;
+
+	/**
+	 * Operating points: the discretization, scheme, precision and target error of the paths of each AWM,
+	 * the AWMs without one use the settings of the command line (disabled when empty)
+	 */
+	std::vector<HestonOperatingPoint> operatingPoints;
+
+	/**
+	 * @brief		True when the payoff is a plain European call, which the Fourier pricer handles
+	 */
+	bool european() const {
+		return payoff == HestonKernel::EUROPEAN && exercises == 0;
+	}
+
+	/**
+	 * @brief		True when the job is priced by the Fourier engine instead of the Monte Carlo workers
+	 */
+	bool fourier() const {
+		return engine == ENGINE_FOURIER || (engine == ENGINE_AUTO && european());
+	}
+
+	HestonSettings() :
+		kernel(HestonKernel::SCALAR),
+		scheme(HestonKernel::FULL_TRUNCATION),
+		normal(HestonNormal::BOX_MULLER),
+		seed(0),
+		qmc(false),
+		replications(16),
+		targetError(0.0),
+		confidence(0.95),
+		horizon(0.0),
+		controlVariates(false),
+		mlmcLevels(0),
+		mlmcRmse(0.05),
+		engine(ENGINE_AUTO),
+		payoff(HestonKernel::EUROPEAN),
+		barrier(0.0),
+		exercises(0),
+		greeks(false),
+		cycleTime(0.0),
+		checkpointInterval(1000.0),
+		resume(false),
+		cacheSize(100000),
+		metricsInterval(1000.0),
+		precision(HestonKernel::DOUBLE) {
+	}
+
+};
+
+#endif // HESTONSETTINGS_H_
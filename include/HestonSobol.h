@@ -0,0 +1,70 @@
+/**
+ *       @file  HestonSobol.h
+ *      @brief  The HestonFour BarbequeRTRM application
+ *
+ * Description: Quasi-Monte Carlo source of the N(0,1) draws. Points of an Owen-scrambled Sobol sequence in
+ *		(2 x steps) dimensions are mapped to normals and ordered with a Brownian bridge, so that the first
+ *		(best distributed) dimensions drive the largest moves of the spot and volatility paths.
+ *
+ *     @author  Luca Napoletano, luca.napoletano@mail.polimi.it, Claudio Montanari, claudio1.montanari@mail.polimi.it
+ *
+ *     Company  Politecnico di Milano
+ *   Copyright  Copyright (c) 2017, Luca Napoletano, Claudio Montanari
+ *
+ * This source code is released for free distribution under the terms of the
+ * GNU General Public License as published by the Free Software Foundation.
+ * =====================================================================================
+ */
+
+#ifndef HESTONSOBOL_H_
+#define HESTONSOBOL_H_
+
+#include <stdint.h>
+#include <vector>
+
+class HestonSobol {
+
+public:
+
+	HestonSobol(int steps, uint64_t seed);
+
+	void path(int replication, uint32_t index, double * normals, int stride);
+	int getSteps();
+
+private:
+
+	int STEPS;
+	int DIMENSIONS;
+	uint64_t SEED;
+
+	/**
+	 * Direction numbers, 32 for each dimension, and the current (unscrambled) point
+	 */
+	std::vector<uint32_t> directions;
+	std::vector<uint32_t> point;
+	uint32_t INDEX;
+	bool VALID;
+
+	/**
+	 * Brownian bridge construction, one entry for each step in the order the bridge fills the path
+	 */
+	std::vector<int> bridgeIndex;
+	std::vector<int> leftIndex;
+	std::vector<int> rightIndex;
+	std::vector<double> leftWeight;
+	std::vector<double> rightWeight;
+	std::vector<double> stdDev;
+
+	std::vector<double> normal;
+	std::vector<double> ordered;
+	std::vector<double> increments;
+	std::vector<double> brownian;
+
+	void initDirections();
+	void initBridge();
+	void moveTo(uint32_t index);
+	void bridge(double const * z, double * out);
+
+};
+
+#endif // HESTONSOBOL_H_
@@ -0,0 +1,95 @@
+/**
+ *       @file  HestonStats.h
+ *      @brief  The HestonFour BarbequeRTRM application
+ *
+ * Description: Running mean and variance of the simulated payoffs (Welford). Every worker keeps the statistics
+ *		of its own block, the EXC merges them (Chan et al.) in block order.
+ *
+ *     @author  Luca Napoletano, luca.napoletano@mail.polimi.it, Claudio Montanari, claudio1.montanari@mail.polimi.it
+ *
+ *     Company  Politecnico di Milano
+ *   Copyright  Copyright (c) 2017, Luca Napoletano, Claudio Montanari
+ *
+ * This source code is released for free distribution under the terms of the
+ * GNU General Public License as published by the Free Software Foundation.
+ * =====================================================================================
+ */
+
+#ifndef HESTONSTATS_H_
+#define HESTONSTATS_H_
+
+#include <math.h>
+
+struct HestonStats {
+
+	long count;
+	double mean;
+	double m2;	/**<Sum of the squared deviations from the mean*/
+
+	HestonStats() :
+		count(0),
+		mean(0.0),
+		m2(0.0) {
+	}
+
+	void reset() {
+		count = 0;
+		mean = 0.0;
+		m2 = 0.0;
+	}
+
+	/**
+	 * @brief		Add a sample
+	 */
+	void add(double x) {
+		count++;
+		double delta = x - mean;
+		mean += delta / count;
+		m2 += delta * (x - mean);
+	}
+
+	/**
+	 * @brief		Add all the samples summarized by another accumulator
+	 */
+	void merge(HestonStats const & other) {
+		if (other.count == 0)
+			return;
+
+		long total = count + other.count;
+		double delta = other.mean - mean;
+		mean += delta * other.count / total;
+		m2 += other.m2 + delta * delta * ((double) count * other.count / total);
+		count = total;
+	}
+
+	/**
+	 * @brief		Build the statistics of a block from its plain sums, used where a Welford update per
+	 *			sample would stop the vectorization of the accumulation loop
+	 */
+	static HestonStats fromSums(long count, double sum, double squares) {
+		HestonStats stats;
+		if (count == 0)
+			return stats;
+
+		stats.count = count;
+		stats.mean = sum / count;
+		stats.m2 = squares - sum * stats.mean;
+		if (stats.m2 < 0.0)
+			stats.m2 = 0.0;
+		return stats;
+	}
+
+	double variance() const {
+		return (count > 1) ? m2 / (count - 1) : 0.0;
+	}
+
+	/**
+	 * @brief		The standard error of the mean
+	 */
+	double stdError() const {
+		return (count > 1) ? sqrt(variance() / count) : 0.0;
+	}
+
+};
+
+#endif // HESTONSTATS_H_
@@ -3,43 +3,148 @@
 #ifndef HESTONWORKER_H_
 #define HESTONWORKER_H_
 
-#include <bbque/bbque_exc.h>
-
+#include <atomic>
 #include <iostream>
 #include <random>
 #include <time.h>
 #include <math.h>
-#include <thread>
+
+#include "HestonAmerican.h"
+#include "HestonControl.h"
+#include "HestonFourier.h"
+#include "HestonKernel.h"
+#include "HestonMetrics.h"
+#include "HestonNormal.h"
+#include "HestonPayoff.h"
+#include "HestonPool.h"
+#include "HestonRandom.h"
+#include "HestonSettings.h"
+#include "HestonSobol.h"
+#include "HestonStats.h"
+
 #define DEFAULT_SIMULATIONS 10000
+#define HESTON_MAX_MATURITIES 64
+
+/**
+ * The widest lane group of a kernel, 32 floats of the AVX-512 single precision kernel
+ */
+#define HESTON_MAX_LANES 32
+
+/**
+ * Relative bump of V0 of the variance paths of the vega, a central difference of call prices given the variance
+ * path: its bias is about (VEGA_BUMP V0)^2 / 6 times the third derivative of the price by V0, its variance falls
+ * as the bump grows, since a small bump differentiates the paths which touch 0 where the variance step is not
+ * smooth. With the default parameters 0.1 keeps the bias below 0.1% of the vega
+ */
+#define VEGA_BUMP 0.1
+
+/**
+ * The sensitivities estimated in the same pass as the price
+ */
+enum HestonGreek { GREEK_DELTA = 0, GREEK_GAMMA, GREEK_VEGA, GREEK_RHO, HESTON_GREEKS };
+
+/**
+ * The accumulators of a chunk of paths, reduced in chunk order by the EXC. A preempted chunk keeps the
+ * accumulators of the paths done, the chunk is resumed from there
+ */
+struct HestonPartial {
+	int paths;
+	double sum;
+	double compensation;
+	HestonStats stats;
+	HestonControl control;
+	HestonStats greeks[HESTON_GREEKS];
+	std::vector<double> gridSums;
+	std::vector<double> gridSquares;
+
+	HestonPartial() :
+		paths(0),
+		sum(0.0),
+		compensation(0.0) {
+	}
+};
+
+/**
+ * The comparison of the single and double precision kernels on the same paths: the statistics of the double
+ * samples, of the differences float - double of the samples, and the largest difference
+ */
+struct HestonPrecisionCheck {
+	HestonStats reference;
+	HestonStats difference;
+	double largest;
 
-using bbque::rtlib::BbqueEXC;
+	HestonPrecisionCheck() :
+		largest(0.0) {
+	}
+};
 
 class HestonWorker {
 
 public:
 
-	HestonWorker(double S0, double K, double r, double T, double V0, double rho, double kappa, double theta, double xi);
-	void start(int simulationToDo, int discretization);
-	void start(int discretization);
+	HestonWorker(HestonPool* pool, int slot, HestonSettings const & settings, double S0, double K, double r, double T, double V0, double rho, double kappa, double theta, double xi);
+	~HestonWorker();
+	void setOption(double S0, double K, double r, double T, double V0, double rho, double kappa, double theta, double xi);
+	void start(int simulationToDo, int discretization, int block);
+	void start(int discretization, int block);
+	void startLevel(int level, int simulationToDo, int discretization, int block);
+	void startAmerican(HestonAmerican* american, bool training, int simulationToDo, int discretization, int block);
+	void simulate(int firstPath, int simulationToDo, int blockSize, int discretization, int block, HestonPartial const & from);
+	void collect(HestonPartial & partial);
+	void setPrecision(HestonKernel::Precision precision);
+	void setScheme(HestonKernel::Scheme scheme);
+	void checkPrecision(int simulations, int discretization, int block, HestonPrecisionCheck & check);
 	int stop();
+	void resume();
 	void join();
 	void hestonSimulation();
+	void levelSimulation();
+	void americanSimulation();
+	void precisionSimulation();
 	double getCalculus();
+	HestonStats const & getStats();
+	HestonStats getGridStats(int node);
+	HestonControl const & getControl();
+	HestonStats const & getGreekStats(int greek);
 	int getSimulationsDone();
 	int getDefSimulations();
+	HestonCounters const & getCounters();
 
 private:
 	
 	int SIMULATIONSTODO;
 	int SIMULATIONSDONE;
 	int DISCRETIZATION;
-	bool HASTOWORK;
+	int BLOCK;
+	/**
+	 * The running paths are [FIRSTPATH, FIRSTPATH + SIMULATIONSTODO) of a block of BLOCKSIZE paths
+	 */
+	int FIRSTPATH;
+	int BLOCKSIZE;
+	/**
+	 * Cleared by stop(): the path loop leaves at the next lane group, the accumulators hold the paths done
+	 */
+	std::atomic<bool> HASTOWORK;
+	/**
+	 * Paths, steps and timers of the worker, read by the metrics while it runs
+	 */
+	HestonCounters counters;
 
 	double finalPrice;
 	/**
 	 * Variable used to accumulate the results from each run
 	 */
 	double totalSum;
+	/**
+	 * Kahan compensation of totalSum, the low order bits it lost (single precision kernel only)
+	 */
+	double totalCompensation;
+	/**
+	 * Running statistics of the samples of the block, a sample is the mean payoff of a path and of its
+	 * antithetic twin
+	 */
+	HestonStats stats;
+	double payoffs[HESTON_MAX_LANES];
 	/**
 	 *  Variables used to setup the heston simulation
 	 */
@@ -58,16 +163,125 @@ private:
 	double K;
 	double r;
 	double T;
+
+	/**
+	 * The time up to which the paths are simulated: T, or the longest maturity of the grid
+	 */
+	double HORIZON;
 	
 	/**
-	 * Random Generator 
+	 * Random Generator, every path reads its own stream (BLOCK, path)
 	 */
 	
-	std::mt19937 generator;	
-	std::thread worker;	
+	HestonRandom generator;	
+	HestonNormal normal;
+
+	/**
+	 * Quasi-Monte Carlo generator (NULL in Monte Carlo mode). A block is a slice of the points of one
+	 * randomized replication: block b belongs to replication b % REPLICATIONS
+	 */
+	HestonSobol* sobol;
+	bool QMC;
+	int REPLICATIONS;
+	uint64_t SEED;
+
+	/**
+	 * The pool thread running this worker
+	 */
+
+	HestonPool* pool;
+	int slot;
+
+	/**
+	 * Path buffer, allocated by the pool thread itself so that it is first touched on the worker NUMA node
+	 */
+
+	double* normals;
+	int BUFFERSIZE;
+	int BUFFERNODE;
+
+	/**
+	 * The batched path kernel and the number of paths it simulates per call, and the single precision
+	 * kernel (NULL when it is not available) with its own lane group, used when FLOAT is set
+	 */
+
+	HestonKernel::Function kernel;
+	int LANES;
+	HestonKernel::Function floatKernel;
+	int FLOATLANES;
+	bool FLOAT;
+	HestonPrecisionCheck* check;
+
+	/**
+	 * Grid mode: strikes, observation steps of the maturities and per-node (maturity x strike)
+	 * accumulators of the payoff samples
+	 */
+	bool GRID;
+	std::vector<double> strikes;
+	std::vector<double> maturities;
+	std::vector<int> maturitySteps;
+	size_t OPTIONMATURITY;
+	std::vector<double> gridSums;
+	std::vector<double> gridSquares;
+	std::vector<double> gridPayoffs;
+	double observed[2 * HESTON_MAX_LANES * HESTON_MAX_MATURITIES];
+
+	/**
+	 * Control variates: regression sums of the block and the controls of the last lane group, stored as
+	 * [control][lane]
+	 */
+	bool CONTROL;
+	double companionVariance;
+	HestonControl control;
+	double controlValues[HESTON_MAX_CONTROLS * HESTON_MAX_LANES];
+
+	void allocateBuffers();
+	void drawNormals(int path, int lanes);
+	HestonKernelArgs kernelArgs(double pathTime, int discretization) const;
+	void evaluateGrid(int lanes);
+	void optionPayoffs(int lanes);
+	/**
+	 * Variance discretization scheme and the kernel arguments of the running block
+	 */
+	HestonKernel::Scheme SCHEME;
+	HestonKernelArgs args;
+
+	/**
+	 * The payoff and the scalar reference kernel specialized for it
+	 */
+	HestonKernel::Payoff PAYOFF;
+	double BARRIER;
+	double (HestonWorker::*path)(double const * normals, double * observed, double * controls);
+
+	/**
+	 * Multilevel Monte Carlo: the level of the running block and the arguments of its coarse paths
+	 */
+	int LEVEL;
+	HestonKernelArgs coarseArgs;
+
+	/**
+	 * Longstaff-Schwartz: the path store of the training set and whether the running block fills it or
+	 * applies its exercise rule
+	 */
+	HestonAmerican* american;
+	bool TRAINING;
+
+	/**
+	 * Greeks mode: the statistics of the samples of each sensitivity in the block
+	 */
+	bool GREEKS;
+	HestonStats greekStats[HESTON_GREEKS];
+
+	void addControls(int lanes);
+	void greekSamples(double spot_price, double const * conditional, double const * bumped_spot_price,
+		double const (* bumped_conditional)[2], double width, double * samples);
+	double conditionalCall(double spot_price, double const * conditional);
+	void schemeStep(HestonKernelArgs const & step, double & volatility, double & spot_price, double random_spot, double random_volatility,
+		double * conditional = NULL);
+	double coupledPath(double const * normals, double & coarse);
+	template <class P>
+	double hestonPath(double const * normals, double * observed, double * controls);
 
-	double rationalApproximation(double t);
-	double normalCDFInverse(double p);
 	double maxValue(double, double);
 	double europeanCall(double, double);
 
@@ -0,0 +1,176 @@
+/**
+ *       @file  bbque_exc.h
+ *      @brief  The HestonFour BarbequeRTRM application
+ *
+ * Description: In-process stand-in of the RTLib used by hestonfour_replay. The EXC control loop calls the
+ *		callbacks as the RTLib does, but the working modes and the resources come from a trace file
+ *		instead of the BarbequeRTRM daemon. A grant of the trace is applied at the first cycle boundary
+ *		after its time: the control thread is restricted to the first PROC_NR CPUs of the process (the
+ *		pool threads follow it in onConfigure()) and onConfigure() is called. The quota is only
+ *		reported, it is not enforced. Every grant opens a phase, which records the reconfiguration
+ *		latency, the cycles, the throughput and the cores left idle.
+ *
+ *     @author  Luca Napoletano, luca.napoletano@mail.polimi.it, Claudio Montanari, claudio1.montanari@mail.polimi.it
+ *
+ *     Company  Politecnico di Milano
+ *   Copyright  Copyright (c) 2017, Luca Napoletano, Claudio Montanari
+ *
+ * This source code is released for free distribution under the terms of the
+ * GNU General Public License as published by the Free Software Foundation.
+ * =====================================================================================
+ */
+
+#ifndef BBQUE_REPLAY_EXC_H_
+#define BBQUE_REPLAY_EXC_H_
+
+#include <stdint.h>
+
+#include <functional>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <bbque/utils/logging/logger.h>
+
+#define BBQUE_PATH_PREFIX "."
+#define BBQUE_PATH_CONF "etc/bbque"
+
+typedef enum RTLIB_ExitCode {
+	RTLIB_OK = 0,
+	RTLIB_ERROR,
+	RTLIB_EXC_WORKLOAD_NONE
+} RTLIB_ExitCode_t;
+
+typedef enum RTLIB_ResourceType {
+	PROC_NR = 0,
+	PROC_ELEMENT,
+	MEMORY
+} RTLIB_ResourceType_t;
+
+/**
+ * The stand-in has no daemon to talk to, the trace is loaded with Replay::Load()
+ */
+typedef struct RTLIB_Services {
+	int replay;
+} RTLIB_Services_t;
+
+typedef struct RTLIB_WorkingModeParams {
+	int8_t awm_id;
+} RTLIB_WorkingModeParams_t;
+
+RTLIB_ExitCode_t RTLIB_Init(const char * name, RTLIB_Services_t ** rtlib);
+
+namespace bbque { namespace rtlib {
+
+/**
+ * A line of the trace: from time (ms since the start of the control loop) the EXC runs in awm_id with the
+ * given resources. A negative awm_id blocks the EXC until the next grant
+ */
+struct ReplayGrant {
+	double time;
+	int awm_id;
+	int32_t proc_nr;
+	int32_t proc_element;
+	int32_t memory;
+};
+
+/**
+ * What happened while a grant was in place. drain is the time from the grant to the end of the cycle in
+ * flight, configure the time of onConfigure(), their sum is the reconfiguration latency. A grant superseded
+ * before the end of the cycle in flight is skipped, the application never sees it
+ */
+struct ReplayPhase {
+	ReplayGrant grant;
+	bool skipped;
+	int cpus;
+	double drain;
+	double configure;
+	int cycles;
+	double wall;
+	double cpu;
+	long progress;
+};
+
+class Replay {
+
+public:
+
+	static int Load(std::string const & path);
+	static void SetProgress(std::function<long()> const & progress);
+	static void Report(std::ostream & out);
+
+	static std::vector<ReplayGrant> grants;
+	static std::vector<ReplayPhase> phases;
+	static std::function<long()> progress;
+
+};
+
+class BbqueEXC {
+
+public:
+
+	BbqueEXC(std::string const & name, std::string const & recipe, RTLIB_Services_t * rtlib);
+	virtual ~BbqueEXC();
+
+	bool isRegistered() const;
+	RTLIB_ExitCode_t Start();
+	RTLIB_ExitCode_t WaitCompletion();
+	uint32_t GetUniqueID() const;
+
+protected:
+
+	std::string exc_name;
+	std::unique_ptr<bbque::utils::Logger> logger;
+
+	RTLIB_WorkingModeParams_t const WorkingModeParams() const;
+	uint32_t Cycles() const;
+	RTLIB_ExitCode_t GetAssignedResources(RTLIB_ResourceType_t r_type, int32_t & r_amount);
+
+	virtual RTLIB_ExitCode_t onSetup() {
+		return RTLIB_OK;
+	}
+
+	virtual RTLIB_ExitCode_t onConfigure(int8_t awm_id) {
+		(void) awm_id;
+		return RTLIB_OK;
+	}
+
+	virtual RTLIB_ExitCode_t onRun() {
+		return RTLIB_OK;
+	}
+
+	virtual RTLIB_ExitCode_t onMonitor() {
+		return RTLIB_OK;
+	}
+
+	virtual RTLIB_ExitCode_t onRelease() {
+		return RTLIB_OK;
+	}
+
+private:
+
+	std::string recipe;
+	std::thread control;
+	bool started;
+
+	/**
+	 * The CPUs of the process when the EXC is started, a grant of PROC_NR CPUs keeps the first ones
+	 */
+	std::vector<int> cpus;
+
+	RTLIB_WorkingModeParams_t wmp;
+	ReplayGrant current;
+	uint32_t cycles;
+
+	void ControlLoop();
+	int Restrict(int32_t proc_nr);
+
+};
+
+} // namespace rtlib
+
+} // namespace bbque
+
+#endif // BBQUE_REPLAY_EXC_H_
@@ -0,0 +1,127 @@
+/**
+ *       @file  logger.h
+ *      @brief  The HestonFour BarbequeRTRM application
+ *
+ * Description: Logger of the RTLib stand-in used by hestonfour_replay. It has the interface of the BOSP
+ *		logger used by the application and prints on the standard error the messages at or above a
+ *		global level.
+ *
+ *     @author  Luca Napoletano, luca.napoletano@mail.polimi.it, Claudio Montanari, claudio1.montanari@mail.polimi.it
+ *
+ *     Company  Politecnico di Milano
+ *   Copyright  Copyright (c) 2017, Luca Napoletano, Claudio Montanari
+ *
+ * This source code is released for free distribution under the terms of the
+ * GNU General Public License as published by the Free Software Foundation.
+ * =====================================================================================
+ */
+
+#ifndef BBQUE_REPLAY_LOGGER_H_
+#define BBQUE_REPLAY_LOGGER_H_
+
+#include <cstdarg>
+#include <cstdio>
+#include <memory>
+#include <string>
+
+namespace bbque { namespace utils {
+
+class Logger {
+
+public:
+
+	enum Level { DEBUG = 0, INFO, NOTICE, WARN, ERROR, CRIT, FATAL };
+
+	static void SetConfigurationFile(std::string const & conf_file) {
+		(void) conf_file;
+	}
+
+	static std::unique_ptr<Logger> GetLogger(std::string const & module) {
+		return std::unique_ptr<Logger>(new Logger(module));
+	}
+
+	/**
+	 * @brief		Set the lowest level which is printed, for all the loggers
+	 */
+	static void SetLevel(Level level) {
+		Threshold() = level;
+	}
+
+	void Debug(const char * format, ...) __attribute__((format(printf, 2, 3))) {
+		va_list args;
+		va_start(args, format);
+		Print(DEBUG, "DBG", format, args);
+		va_end(args);
+	}
+
+	void Info(const char * format, ...) __attribute__((format(printf, 2, 3))) {
+		va_list args;
+		va_start(args, format);
+		Print(INFO, "INF", format, args);
+		va_end(args);
+	}
+
+	void Notice(const char * format, ...) __attribute__((format(printf, 2, 3))) {
+		va_list args;
+		va_start(args, format);
+		Print(NOTICE, "NOT", format, args);
+		va_end(args);
+	}
+
+	void Warn(const char * format, ...) __attribute__((format(printf, 2, 3))) {
+		va_list args;
+		va_start(args, format);
+		Print(WARN, "WRN", format, args);
+		va_end(args);
+	}
+
+	void Error(const char * format, ...) __attribute__((format(printf, 2, 3))) {
+		va_list args;
+		va_start(args, format);
+		Print(ERROR, "ERR", format, args);
+		va_end(args);
+	}
+
+	void Crit(const char * format, ...) __attribute__((format(printf, 2, 3))) {
+		va_list args;
+		va_start(args, format);
+		Print(CRIT, "CRT", format, args);
+		va_end(args);
+	}
+
+	void Fatal(const char * format, ...) __attribute__((format(printf, 2, 3))) {
+		va_list args;
+		va_start(args, format);
+		Print(FATAL, "FAT", format, args);
+		va_end(args);
+	}
+
+private:
+
+	std::string module;
+
+	Logger(std::string const & module) :
+		module(module) {
+	}
+
+	static Level & Threshold() {
+		static Level threshold = DEBUG;
+		return threshold;
+	}
+
+	void Print(Level level, const char * tag, const char * format, va_list args) {
+		if (level < Threshold())
+			return;
+
+		char line[1024];
+		vsnprintf(line, sizeof(line), format, args);
+		fprintf(stderr, "%s %-12s: %s\n", tag, module.c_str(), line);
+	}
+
+};
+
+} // namespace utils
+
+} // namespace bbque
+
+#endif // BBQUE_REPLAY_LOGGER_H_
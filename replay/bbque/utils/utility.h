@@ -0,0 +1,23 @@
+/**
+ *       @file  utility.h
+ *      @brief  The HestonFour BarbequeRTRM application
+ *
+ * Description: Utilities of the RTLib stand-in used by hestonfour_replay, the application does not use any
+ *		of the BOSP ones.
+ *
+ *     @author  Luca Napoletano, luca.napoletano@mail.polimi.it, Claudio Montanari, claudio1.montanari@mail.polimi.it
+ *
+ *     Company  Politecnico di Milano
+ *   Copyright  Copyright (c) 2017, Luca Napoletano, Claudio Montanari
+ *
+ * This source code is released for free distribution under the terms of the
+ * GNU General Public License as published by the Free Software Foundation.
+ * =====================================================================================
+ */
+
+#ifndef BBQUE_REPLAY_UTILITY_H_
+#define BBQUE_REPLAY_UTILITY_H_
+
+#include <cassert>
+
+#endif // BBQUE_REPLAY_UTILITY_H_
@@ -0,0 +1,331 @@
+/**
+ *       @file  bbque_exc.cc
+ *
+ * Description: In-process stand-in of the RTLib: the EXC control loop driven by a trace of working modes and
+ *		resource grants. A trace line is: time (ms), AWM id, PROC_NR, PROC_ELEMENT and optionally
+ *		MEMORY, the lines starting with # are comments. The grants must be in time order.
+ *
+ *     @author  Luca Napoletano luca.napoletano@mail.polimi.it, Claudio Montanari claudio1.montanari@mail.polimi.it
+ *
+ *     Company  Politecnico di Milano
+ *   Copyright  Copyright (c) 2017, Luca Napoletano, Claudio Montanari
+ *
+ * This source code is released for free distribution under the terms of the
+ * GNU General Public License as published by the Free Software Foundation.
+ * =====================================================================================
+ */
+#include <bbque/bbque_exc.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+
+namespace {
+
+/**
+ * The services handed to the application, they are never used
+ */
+RTLIB_Services_t services = { 1 };
+
+double ProcessCpuTime() {
+	struct timespec now;
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &now);
+	return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+}
+
+RTLIB_ExitCode_t RTLIB_Init(const char * name, RTLIB_Services_t ** rtlib) {
+	(void) name;
+	*rtlib = &services;
+	return RTLIB_OK;
+}
+
+namespace bbque { namespace rtlib {
+
+std::vector<ReplayGrant> Replay::grants;
+std::vector<ReplayPhase> Replay::phases;
+std::function<long()> Replay::progress;
+
+/**
+ * @brief		Load the grants of a trace file, the invalid lines are skipped
+ * @return		The number of grants, -1 if the file cannot be read
+ */
+int Replay::Load(std::string const & path) {
+
+	std::ifstream file(path.c_str());
+	if (!file)
+		return -1;
+
+	grants.clear();
+
+	std::string line;
+	while (std::getline(file, line)) {
+		size_t start = line.find_first_not_of(" \t\r");
+		if (start == std::string::npos || line[start] == '#')
+			continue;
+
+		std::stringstream stream(line);
+		ReplayGrant grant;
+		if (!(stream >> grant.time >> grant.awm_id >> grant.proc_nr >> grant.proc_element)
+				|| (!grants.empty() && grant.time < grants.back().time)) {
+			std::cout << "Skipping invalid trace line: " << line << std::endl;
+			continue;
+		}
+		if (!(stream >> grant.memory))
+			grant.memory = 0;
+		grants.push_back(grant);
+	}
+
+	return (int) grants.size();
+}
+
+/**
+ * @brief		Set the counter of the work done by the application, it gives the throughput of a phase
+ */
+void Replay::SetProgress(std::function<long()> const & progress) {
+
+	Replay::progress = progress;
+}
+
+/**
+ * @brief		Write the phases as a JSON document
+ */
+void Replay::Report(std::ostream & out) {
+
+	char line[512];
+
+	out << "{" << std::endl << "  \"phases\": [" << std::endl;
+	for (size_t p = 0; p < phases.size(); p++) {
+		ReplayPhase const & phase = phases[p];
+		double busy = (phase.wall > 0.0) ? phase.cpu / phase.wall : 0.0;
+		double throughput = (phase.wall > 0.0) ? phase.progress / phase.wall : 0.0;
+
+		snprintf(line, sizeof(line), "    {\"time_ms\": %.1f, \"awm\": %d, \"proc_nr\": %d, \"proc_element\": %d, "
+			"\"skipped\": %s, \"cpus\": %d, \"drain_ms\": %.3f, \"configure_ms\": %.3f, \"latency_ms\": %.3f, "
+			"\"cycles\": %d, \"wall_s\": %.3f, \"busy_cores\": %.2f, \"idle_cores\": %.2f, "
+			"\"progress\": %ld, \"progress_per_sec\": %.1f}%s",
+			phase.grant.time, phase.grant.awm_id, phase.grant.proc_nr, phase.grant.proc_element,
+			phase.skipped ? "true" : "false", phase.cpus, phase.drain, phase.configure, phase.drain + phase.configure,
+			phase.cycles, phase.wall, busy, std::max(0.0, phase.cpus - busy),
+			phase.progress, throughput, (p + 1 < phases.size()) ? "," : "");
+		out << line << std::endl;
+	}
+	out << "  ]" << std::endl << "}" << std::endl;
+}
+
+BbqueEXC::BbqueEXC(std::string const & name, std::string const & recipe, RTLIB_Services_t * rtlib) :
+	exc_name(name),
+	recipe(recipe),
+	started(false),
+	cycles(0) {
+
+	(void) rtlib;
+	logger = bbque::utils::Logger::GetLogger("rpl.exc");
+	wmp.awm_id = 0;
+	current.time = 0.0;
+	current.awm_id = 0;
+	current.proc_nr = 0;
+	current.proc_element = 0;
+	current.memory = 0;
+}
+
+BbqueEXC::~BbqueEXC() {
+
+	WaitCompletion();
+}
+
+bool BbqueEXC::isRegistered() const {
+	return true;
+}
+
+/**
+ * @brief		Start the control thread, it runs the trace until onRun() has no more work
+ */
+RTLIB_ExitCode_t BbqueEXC::Start() {
+
+	if (started)
+		return RTLIB_ERROR;
+
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	sched_getaffinity(0, sizeof(cpu_set_t), &set);
+	cpus.clear();
+	for (int i = 0; i < CPU_SETSIZE; i++) {
+		if (CPU_ISSET(i, &set))
+			cpus.push_back(i);
+	}
+
+	// Without a trace the EXC gets all the CPUs in AWM 0
+	if (Replay::grants.empty()) {
+		ReplayGrant grant = { 0.0, 0, (int32_t) cpus.size(), (int32_t) (100 * cpus.size()), 0 };
+		Replay::grants.push_back(grant);
+	}
+
+	started = true;
+	control = std::thread(&BbqueEXC::ControlLoop, this);
+	return RTLIB_OK;
+}
+
+RTLIB_ExitCode_t BbqueEXC::WaitCompletion() {
+
+	if (control.joinable())
+		control.join();
+	return RTLIB_OK;
+}
+
+uint32_t BbqueEXC::GetUniqueID() const {
+	return 0;
+}
+
+RTLIB_WorkingModeParams_t const BbqueEXC::WorkingModeParams() const {
+	return wmp;
+}
+
+uint32_t BbqueEXC::Cycles() const {
+	return cycles;
+}
+
+RTLIB_ExitCode_t BbqueEXC::GetAssignedResources(RTLIB_ResourceType_t r_type, int32_t & r_amount) {
+
+	switch (r_type) {
+	case PROC_NR:
+		r_amount = current.proc_nr;
+		return RTLIB_OK;
+	case PROC_ELEMENT:
+		r_amount = current.proc_element;
+		return RTLIB_OK;
+	case MEMORY:
+		r_amount = current.memory;
+		return RTLIB_OK;
+	default:
+		return RTLIB_ERROR;
+	}
+}
+
+/**
+ * @brief		Restrict the control thread to the first proc_nr CPUs of the process, as the cpuset of the
+ *			BarbequeRTRM does before onConfigure()
+ * @return		The number of CPUs granted
+ */
+int BbqueEXC::Restrict(int32_t proc_nr) {
+
+	int count = std::max(1, std::min((int) proc_nr, (int) cpus.size()));
+
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	for (int i = 0; i < count; i++)
+		CPU_SET(cpus[i], &set);
+	pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &set);
+
+	return count;
+}
+
+/**
+ * @brief		The control loop: apply the grants due at each cycle boundary, then run and monitor a cycle
+ */
+void BbqueEXC::ControlLoop() {
+
+	std::vector<ReplayGrant> const & grants = Replay::grants;
+	std::chrono::steady_clock::time_point origin = std::chrono::steady_clock::now();
+	auto elapsed = [origin]() {
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - origin).count();
+	};
+
+	if (onSetup() != RTLIB_OK) {
+		logger->Error("onSetup() failed, the EXC is not started");
+		return;
+	}
+
+	ReplayPhase phase;
+	bool open = false;
+	bool blocked = false;
+	double wallStart = 0.0, cpuStart = 0.0;
+	long progressStart = 0;
+	size_t next = 0;
+
+	// Close the running phase with the time, the CPU time and the work of its cycles
+	auto close = [&]() {
+		if (!open)
+			return;
+		phase.wall = (elapsed() - wallStart) / 1000.0;
+		phase.cpu = ProcessCpuTime() - cpuStart;
+		phase.progress = Replay::progress ? Replay::progress() - progressStart : 0;
+		Replay::phases.push_back(phase);
+		open = false;
+	};
+
+	for (;;) {
+		double now = elapsed();
+
+		// A blocked EXC runs no cycle, it waits for the next grant
+		if (next < grants.size() && (grants[next].time <= now || !open || blocked)) {
+			if (grants[next].time > now) {
+				std::this_thread::sleep_for(std::chrono::duration<double, std::milli>(grants[next].time - now));
+				now = elapsed();
+			}
+
+			// The grants superseded during the cycle in flight are never seen by the application
+			while (next + 1 < grants.size() && grants[next + 1].time <= now) {
+				ReplayPhase skipped = ReplayPhase();
+				skipped.grant = grants[next++];
+				skipped.skipped = true;
+				skipped.drain = now - skipped.grant.time;
+				Replay::phases.push_back(skipped);
+			}
+
+			close();
+			phase = ReplayPhase();
+			phase.grant = grants[next++];
+			phase.drain = now - phase.grant.time;
+
+			if (phase.grant.awm_id < 0) {
+				// Blocked until the next grant, the run ends if there is none
+				logger->Notice("EXC [%s] blocked at %.1f ms", exc_name.c_str(), now);
+				open = true;
+				blocked = true;
+				wallStart = elapsed();
+				cpuStart = ProcessCpuTime();
+				progressStart = Replay::progress ? Replay::progress() : 0;
+				if (next == grants.size())
+					break;
+				continue;
+			}
+
+			blocked = false;
+			current = phase.grant;
+			wmp.awm_id = (int8_t) current.awm_id;
+			phase.cpus = Restrict(current.proc_nr);
+
+			double before = elapsed();
+			onConfigure(wmp.awm_id);
+			phase.configure = elapsed() - before;
+
+			open = true;
+			wallStart = elapsed();
+			cpuStart = ProcessCpuTime();
+			progressStart = Replay::progress ? Replay::progress() : 0;
+		}
+
+		if (onRun() == RTLIB_EXC_WORKLOAD_NONE)
+			break;
+
+		cycles++;
+		phase.cycles++;
+		onMonitor();
+	}
+
+	close();
+	onRelease();
+}
+
+} // namespace rtlib
+
+} // namespace bbque
@@ -0,0 +1,261 @@
+/**
+ *       @file  HestonAmerican.cc
+ *
+ * Description: Longstaff and Schwartz (2001) least squares Monte Carlo. The cashflow of a training path starts
+ *		as the put payoff at maturity and moves to an earlier date whenever the immediate exercise beats
+ *		the regressed continuation value of that date. Only the in the money paths enter a regression.
+ *		All the values are discounted to time 0, so the regression needs no per-date rescaling.
+ *
+ *     @author  Luca Napoletano luca.napoletano@mail.polimi.it, Claudio Montanari claudio1.montanari@mail.polimi.it
+ *
+ *     Company  Politecnico di Milano
+ *   Copyright  Copyright (c) 2017, Luca Napoletano, Claudio Montanari
+ *
+ * This source code is released for free distribution under the terms of the
+ * GNU General Public License as published by the Free Software Foundation.
+ * =====================================================================================
+ */
+#include "HestonAmerican.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+/**
+ * @brief		Allocate the arena of a training path set
+ * @param[in] paths	The number of stored paths (a path and its antithetic twin are two paths)
+ * @param[in] dates	The number of exercise dates, evenly spaced, the last one is the maturity
+ * @param[in] K		The strike price of the put
+ * @param[in] r		The risk-free rate
+ * @param[in] T		The maturity (in years)
+ * @param[in] theta	The long-term variance, the scale of the variance in the basis functions
+ */
+HestonAmerican::HestonAmerican(long paths, int dates, double K, double r, double T, double theta){
+
+	this->PATHS = paths;
+	this->DATES = dates;
+	this->K = K;
+	this->r = r;
+	this->T = T;
+	this->theta = theta;
+
+	size_t states = (size_t) paths * dates * sizeof(float);
+	BYTES = 2 * states + (size_t) paths * sizeof(double);
+
+	arena = NULL;
+	if(posix_memalign((void**) &arena, 64, BYTES) != 0) {
+		arena = NULL;
+		throw std::bad_alloc();
+	}
+
+	spots = (float*) arena;
+	variances = (float*) (arena + states);
+	cashflows = (double*) (arena + 2 * states);
+
+	coefficients.assign((size_t) dates * LSM_BASIS, 0.0);
+	regressed.assign(dates, 0);
+
+	discounts.resize(dates);
+	for (int d = 0; d < dates; d++)
+		discounts[d] = exp(-r * exerciseTime(d));
+}
+
+HestonAmerican::~HestonAmerican(){
+
+	free(arena);
+}
+
+long HestonAmerican::getPaths() const {
+	return PATHS;
+}
+
+int HestonAmerican::getDates() const {
+	return DATES;
+}
+
+/**
+ * @brief		The size of the arena in bytes
+ */
+size_t HestonAmerican::getBytes() const {
+	return BYTES;
+}
+
+double HestonAmerican::exerciseTime(int date) const {
+	return T * (date + 1) / DATES;
+}
+
+/**
+ * @brief		Store the state of a training path at an exercise date
+ */
+void HestonAmerican::store(long path, int date, double spot, double variance){
+
+	spots[(size_t) date * PATHS + path] = (float) spot;
+	variances[(size_t) date * PATHS + path] = (float) variance;
+}
+
+/**
+ * @brief		Set the cashflow of a training path, discounted to 0
+ */
+void HestonAmerican::setCashflow(long path, double value){
+
+	cashflows[path] = value;
+}
+
+/**
+ * @brief		The put payoff of an exercise at a given date, discounted to 0
+ */
+double HestonAmerican::payoff(int date, double spot) const {
+
+	return discounts[date] * std::max(K - spot, 0.0);
+}
+
+void HestonAmerican::basis(double spot, double variance, double * phi) const {
+
+	double x = spot / K;
+	double y = std::max(variance, 0.0) / theta;
+
+	phi[0] = 1.0;
+	phi[1] = x;
+	phi[2] = x * x;
+	phi[3] = y;
+	phi[4] = y * y;
+	phi[5] = x * y;
+}
+
+/**
+ * @brief		Partial sums of the regression of a date over a range of training paths, the ranges are
+ *			independent and can be accumulated in parallel
+ * @param[in] date	The exercise date
+ * @param[in] first	The first path of the range
+ * @param[in] count	The number of paths of the range
+ * @param[out] sums	LSM_SUMS values: normal equations, right hand side and number of in the money paths
+ */
+void HestonAmerican::accumulate(int date, long first, long count, double * sums) const {
+
+	double phi[LSM_BASIS];
+	float const * spot = spots + (size_t) date * PATHS;
+	float const * variance = variances + (size_t) date * PATHS;
+
+	// Local sums, the output may alias the arena as far as the compiler knows
+	double local[LSM_SUMS];
+	memset(local, 0, sizeof(local));
+
+	for (long p = first; p < first + count; p++) {
+		if (spot[p] >= K)
+			continue;
+
+		basis(spot[p], variance[p], phi);
+		for (int j = 0; j < LSM_BASIS; j++) {
+			for (int k = 0; k <= j; k++)
+				local[j * LSM_BASIS + k] += phi[j] * phi[k];
+			local[LSM_BASIS * LSM_BASIS + j] += phi[j] * cashflows[p];
+		}
+		local[LSM_SUMS - 1] += 1.0;
+	}
+
+	memcpy(sums, local, sizeof(local));
+}
+
+/**
+ * @brief		Solve the normal equations of a date (Gaussian elimination with partial pivoting), the sums
+ *			of all the ranges must be already added together
+ * @param[in] date	The exercise date
+ * @param[in] sums	The LSM_SUMS values of accumulate(), summed over all the paths
+ */
+void HestonAmerican::regress(int date, double const * sums){
+
+	double a[LSM_BASIS][LSM_BASIS + 1];
+
+	regressed[date] = 0;
+	if (sums[LSM_SUMS - 1] < 2 * LSM_BASIS)
+		return;
+
+	// Only the lower triangle is accumulated
+	for (int j = 0; j < LSM_BASIS; j++) {
+		for (int k = 0; k < LSM_BASIS; k++)
+			a[j][k] = (k <= j) ? sums[j * LSM_BASIS + k] : sums[k * LSM_BASIS + j];
+		a[j][LSM_BASIS] = sums[LSM_BASIS * LSM_BASIS + j];
+	}
+
+	for (int j = 0; j < LSM_BASIS; j++) {
+		int pivot = j;
+		for (int i = j + 1; i < LSM_BASIS; i++) {
+			if (fabs(a[i][j]) > fabs(a[pivot][j]))
+				pivot = i;
+		}
+		if (fabs(a[pivot][j]) < 1e-12 * (fabs(a[0][0]) + 1e-300))
+			return;
+		for (int k = 0; k <= LSM_BASIS; k++)
+			std::swap(a[j][k], a[pivot][k]);
+
+		for (int i = j + 1; i < LSM_BASIS; i++) {
+			double factor = a[i][j] / a[j][j];
+			for (int k = j; k <= LSM_BASIS; k++)
+				a[i][k] -= factor * a[j][k];
+		}
+	}
+
+	double * beta = coefficients.data() + (size_t) date * LSM_BASIS;
+	for (int j = LSM_BASIS - 1; j >= 0; j--) {
+		double rest = a[j][LSM_BASIS];
+		for (int k = j + 1; k < LSM_BASIS; k++)
+			rest -= a[j][k] * beta[k];
+		beta[j] = rest / a[j][j];
+	}
+
+	regressed[date] = 1;
+}
+
+/**
+ * @brief		Apply the exercise rule of a date to a range of training paths: the cashflow of a path moves
+ *			to this date when the immediate exercise beats the continuation value
+ */
+void HestonAmerican::exercise(int date, long first, long count){
+
+	float const * spot = spots + (size_t) date * PATHS;
+	float const * variance = variances + (size_t) date * PATHS;
+
+	for (long p = first; p < first + count; p++) {
+		if (exercises(date, spot[p], variance[p]))
+			cashflows[p] = payoff(date, spot[p]);
+	}
+}
+
+/**
+ * @brief		The exercise rule: exercise in the money when the immediate payoff is above the regressed
+ *			continuation value, always at maturity
+ */
+bool HestonAmerican::exercises(int date, double spot, double variance) const {
+
+	if (spot >= K)
+		return false;
+	if (date == DATES - 1)
+		return true;
+	if (!regressed[date])
+		return false;
+
+	double phi[LSM_BASIS];
+	double const * beta = coefficients.data() + (size_t) date * LSM_BASIS;
+	double continuation = 0.0;
+
+	basis(spot, variance, phi);
+	for (int j = 0; j < LSM_BASIS; j++)
+		continuation += beta[j] * phi[j];
+
+	return payoff(date, spot) > continuation;
+}
+
+/**
+ * @brief		The in-sample price, the mean cashflow of the training paths. The exercise rule is fitted
+ *			on the same paths, thus it is biased high
+ */
+double HestonAmerican::price() const {
+
+	double sum = 0.0;
+	for (long p = 0; p < PATHS; p++)
+		sum += cashflows[p];
+
+	return (PATHS > 0) ? sum / PATHS : 0.0;
+}
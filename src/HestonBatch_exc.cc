@@ -0,0 +1,348 @@
+/**
+ *       @file  HestonBatch_exc.cc
+ *      @brief  The HestonFour BarbequeRTRM application
+ *
+ * Description: The batch pricing EXC. The requests of a cycle share one scheduler cycle: the chunks of all of
+ *		them are stolen by the workers, thus a small request does not leave the other cores idle. A
+ *		request is priced by the Fourier engine when the settings route its payoff there.
+ *
+ *     @author  Luca Napoletano luca.napoletano@mail.polimi.it, Claudio Montanari claudio1.montanari@mail.polimi.it
+ *
+ *     Company  Politecnico di Milano
+ *   Copyright  Copyright (c) 2017, Luca Napoletano, Claudio Montanari
+ *
+ * This source code is released for free distribution under the terms of the
+ * GNU General Public License as published by the Free Software Foundation.
+ * =====================================================================================
+ */
+
+#include "HestonBatch_exc.h"
+#include "HestonFourier.h"
+
+#include <algorithm>
+#include <math.h>
+#include <thread>
+#include <bbque/utils/utility.h>
+
+/**
+ * @brief		The batch pricing EXC
+ * @param[in] name	The name of the application
+ * @param[in] recipe	A reference to the recipe of the application
+ * @param[in] settings	The settings of the simulation engine, shared by all the requests
+ * @param[in] server	The stream of the requests, already open
+ * @param[in] batch	The largest number of requests of a cycle
+ */
+HestonBatch::HestonBatch(std::string const & name,
+		std::string const & recipe,
+		RTLIB_Services_t *rtlib, HestonSettings const & settings, HestonServer* server, int batch) :
+	BbqueEXC(name, recipe, rtlib),
+	settings(settings) {
+
+	logger->Warn("New HestonBatch::HestonBatch()");
+	logger->Info("EXC Unique IDentifier (UID): %u", GetUniqueID());
+
+	this->server = server;
+	this->BATCH = std::max(1, batch);
+	this->pool = NULL;
+	this->workers = NULL;
+	this->scheduler = NULL;
+	this->WORKERS = 1;
+	this->NUM_PROC = 0;
+	this->DONE_REQUESTS = 0;
+	this->DONE_SIMULATIONS = 0;
+	this->cache = NULL;
+	this->CACHE_HITS = 0;
+	this->CACHE_REFINED = 0;
+	this->CACHE_SAVED = 0;
+	this->metrics = NULL;
+}
+
+/**
+ * @brief	The number of requests replied so far
+ */
+long HestonBatch::getRequestsDone() const {
+	return DONE_REQUESTS;
+}
+
+/**
+ * @brief	Create the pool and the workers, they serve all the requests
+ */
+RTLIB_ExitCode_t HestonBatch::onSetup() {
+
+	logger->Warn("HestonBatch::onSetup()");
+
+	NUM_PROC = std::max(1, (int) std::thread::hardware_concurrency());
+	pool = new HestonPool(NUM_PROC);
+
+	// The option of a worker is set by every chunk it runs
+	workers = new HestonWorker*[NUM_PROC];
+	for(int i=0; i<NUM_PROC; i++){
+		workers[i] = new HestonWorker(pool, i, settings, 100.0, 100.0, 0.0, 1.0, 0.04, 0.0, 1.0, 0.04, 0.1);
+	}
+
+	scheduler = new HestonScheduler(pool);
+
+	if(!settings.metrics.empty() || !settings.metricsListen.empty()){
+		metrics = new HestonMetrics(NUM_PROC);
+		for(int i=0; i<NUM_PROC; i++){
+			metrics->attach(i, &workers[i]->getCounters());
+		}
+		metrics->requests(0);
+		if(!settings.metricsListen.empty() && !metrics->listen(settings.metricsListen))
+			logger->Error("Metrics: unable to listen on [%s]", settings.metricsListen.c_str());
+		metricsTime = std::chrono::steady_clock::now();
+	}
+
+	if(!settings.cache.empty()){
+		cache = new HestonCache(settings.cache, settings.cacheSize);
+		int entries = cache->load();
+		logger->Warn("Cache [%s]: %d entries loaded", settings.cache.c_str(), std::max(0, entries));
+		cacheTime = std::chrono::steady_clock::now();
+	}
+
+	return RTLIB_OK;
+}
+
+/**
+ * @brief	Take the workers granted by the BarbequeRTRM, the next cycle uses them
+ */
+RTLIB_ExitCode_t HestonBatch::onConfigure(int8_t awm_id) {
+
+	int32_t proc_quota, proc_nr, mem;
+	GetAssignedResources(PROC_ELEMENT, proc_quota);
+	GetAssignedResources(PROC_NR, proc_nr);
+	GetAssignedResources(MEMORY, mem);
+	logger->Notice("HestonBatch::onConfigure(): "
+		"EXC [%s], AWM[%02d] => R<PROC_quota>=%3d, R<PROC_nr>=%2d, R<MEM>=%3d",
+		exc_name.c_str(), awm_id, proc_quota, proc_nr, mem);
+
+	WORKERS = std::max(1, std::min((int) proc_nr, NUM_PROC));
+
+	std::vector<int> cpus = HestonPool::allowedCpus();
+	pool->setAffinity(cpus);
+
+	if(metrics != NULL)
+		metrics->configure(awm_id, WORKERS);
+
+	return RTLIB_OK;
+}
+
+/**
+ * @brief	Price the requests queued, the cycle is idle when none arrives for IDLE_WAIT ms. The application
+ *		ends with the stream of the requests
+ */
+RTLIB_ExitCode_t HestonBatch::onRun() {
+
+	if(!server->take(jobs, BATCH, IDLE_WAIT))
+		return RTLIB_EXC_WORKLOAD_NONE;
+	if(jobs.empty())
+		return RTLIB_OK;
+
+	// The chunks of the requests, in request order. jobLast is the number of chunks up to the end of a
+	// request: the request is complete when as many chunks are reduced
+	int chunksPerBlock = WORKERS_SIM / CHUNK_SIM;
+	chunks.clear();
+	jobStats.assign(jobs.size(), HestonStats());
+	jobLast.assign(jobs.size(), 0);
+	jobKeys.assign(jobs.size(), std::string());
+
+	for(size_t j = 0; j < jobs.size(); j++){
+		HestonJob & job = jobs[j];
+		job.price = 0.0;
+		job.error = 0.0;
+		job.done = 0;
+
+		if(job.invalid.empty() && settings.fourier()){
+			job.price = HestonFourier(job.S0, job.r, job.V0, job.rho, job.kappa, job.theta, job.xi).call(job.K, job.T);
+		}
+		else if(job.invalid.empty()){
+			long count = (job.simulations + CHUNK_SIM - 1) / CHUNK_SIM;
+			long first = 0;
+
+			// A cached entry holds the first chunks of the request, in the same reduction order
+			if(cache != NULL){
+				jobKeys[j] = cacheKey(job);
+				if(cache->find(jobKeys[j], jobStats[j])){
+					first = jobStats[j].count / CHUNK_SIM;
+					if(first >= count)
+						CACHE_HITS++;
+					else
+						CACHE_REFINED++;
+					CACHE_SAVED += std::min(first, count) * CHUNK_SIM;
+				}
+			}
+
+			for(long c = first; c < count; c++){
+				Chunk chunk;
+				chunk.job = (int) j;
+				chunk.block = (int) (c / chunksPerBlock);
+				chunk.first = (int) (c % chunksPerBlock) * CHUNK_SIM;
+				chunks.push_back(chunk);
+			}
+		}
+		jobLast[j] = (long) chunks.size();
+	}
+
+	std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+	scheduler->start(WORKERS, (long) chunks.size(), [this](int worker, long c) {
+		Chunk & chunk = chunks[c];
+		HestonJob const & job = jobs[chunk.job];
+		workers[worker]->setOption(job.S0, job.K, job.r, job.T, job.V0, job.rho, job.kappa, job.theta, job.xi);
+		workers[worker]->simulate(chunk.first, CHUNK_SIM, WORKERS_SIM, job.discretization, chunk.block, empty);
+		workers[worker]->collect(chunk.partial);
+	});
+
+	// The chunks of a request are reduced in chunk order, the request is replied as soon as they are
+	size_t next = 0;
+	std::chrono::steady_clock::duration wait(0);
+	for(long c = 0; c <= (long) chunks.size(); c++){
+		while(next < jobs.size() && jobLast[next] <= c){
+			finish((int) next);
+			next++;
+		}
+		if(c == (long) chunks.size())
+			break;
+
+		std::chrono::steady_clock::time_point waiting = std::chrono::steady_clock::now();
+		scheduler->wait(c);
+		wait += std::chrono::steady_clock::now() - waiting;
+		jobStats[chunks[c].job].merge(chunks[c].partial.stats);
+		DONE_SIMULATIONS += CHUNK_SIM;
+	}
+	std::chrono::steady_clock::time_point waiting = std::chrono::steady_clock::now();
+	scheduler->join();
+	wait += std::chrono::steady_clock::now() - waiting;
+
+	batchStats.add((double) jobs.size());
+
+	if(metrics != NULL){
+		metrics->cycle(std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count(),
+			std::chrono::duration<double>(wait).count(), scheduler);
+		metrics->requests(DONE_REQUESTS);
+	}
+
+	return RTLIB_OK;
+}
+
+/**
+ * @brief	Reply to a request with the discounted mean of its samples
+ */
+void HestonBatch::finish(int j) {
+
+	HestonJob & job = jobs[j];
+
+	if(job.invalid.empty() && !settings.fourier()){
+		double discount = exp( -(job.r) * (job.T) );
+		job.price = jobStats[j].mean * discount;
+		job.error = jobStats[j].stdError() * discount;
+		job.done = jobStats[j].count;
+		if(cache != NULL)
+			cache->store(jobKeys[j], jobStats[j]);
+	}
+
+	server->reply(job);
+	job.output.reset();
+	DONE_REQUESTS++;
+}
+
+/**
+ * @brief	The key of a request in the result cache: the parameters of the request and the settings which
+ *		select its paths
+ */
+std::string HestonBatch::cacheKey(HestonJob const & job) {
+
+	double parameters[] = { job.S0, job.K, job.r, job.T, job.V0, job.rho, job.kappa, job.theta, job.xi, settings.barrier };
+	int32_t modes[] = { job.discretization, settings.kernel, settings.scheme, settings.normal, settings.payoff,
+		WORKERS_SIM, CHUNK_SIM };
+
+	HestonRecord record;
+	record.put(parameters, sizeof(parameters) / sizeof(parameters[0]));
+	record.put(modes, sizeof(modes) / sizeof(modes[0]));
+	record.put(settings.seed);
+	return std::string(record.data.begin(), record.data.end());
+}
+
+/**
+ * @brief	Save the result cache, if an entry changed
+ */
+void HestonBatch::saveCache() {
+
+	if(!cache->isDirty())
+		return;
+
+	std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+	if(!cache->save()){
+		logger->Error("Cache [%s]: unable to save the entries", cache->getPath().c_str());
+		return;
+	}
+
+	cacheTime = std::chrono::steady_clock::now();
+	logger->Info("Cache [%s]: %zu entries saved in %.3f ms", cache->getPath().c_str(), cache->size(),
+		std::chrono::duration<double, std::milli>(cacheTime - begin).count());
+}
+
+/**
+ * @brief	Write the metrics file, if any
+ */
+void HestonBatch::writeMetrics() {
+
+	metricsTime = std::chrono::steady_clock::now();
+	if(!settings.metrics.empty() && !metrics->write(settings.metrics))
+		logger->Error("Metrics: unable to write [%s]", settings.metrics.c_str());
+}
+
+RTLIB_ExitCode_t HestonBatch::onMonitor() {
+	RTLIB_WorkingModeParams_t const wmp = WorkingModeParams();
+
+	logger->Warn("HestonBatch::onMonitor()  : EXC [%s]  @ AWM [%02d], Cycle [%4d]",
+		exc_name.c_str(), wmp.awm_id, Cycles());
+
+	HestonStats const & latency = server->getLatency();
+	logger->Warn("ON_MONITOR: %ld requests, %.1f requests/s, latency %.3f ms (mean), %d workers",
+		DONE_REQUESTS, server->getThroughput(), latency.mean, WORKERS);
+
+	if(cache != NULL && std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - cacheTime).count()
+			>= settings.checkpointInterval)
+		saveCache();
+
+	if(metrics != NULL && std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - metricsTime).count()
+			>= settings.metricsInterval)
+		writeMetrics();
+
+	return RTLIB_OK;
+}
+
+RTLIB_ExitCode_t HestonBatch::onRelease() {
+
+	logger->Warn("HestonBatch::onRelease()  : exit");
+
+	HestonStats const & latency = server->getLatency();
+	logger->Warn("Server: %ld requests, %ld simulations, %.1f requests/s, latency mean %.3f ms, stddev %.3f ms, "
+		"%.1f requests per cycle", DONE_REQUESTS, DONE_SIMULATIONS, server->getThroughput(), latency.mean,
+		sqrt(latency.variance()), batchStats.mean);
+
+	if(cache != NULL){
+		saveCache();
+		logger->Warn("Cache [%s]: %zu entries, %ld requests answered, %ld refined, %ld simulations saved",
+			cache->getPath().c_str(), cache->size(), CACHE_HITS, CACHE_REFINED, CACHE_SAVED);
+		delete cache;
+		cache = NULL;
+	}
+
+	// The endpoint reads the counters of the workers, it stops before they are deleted
+	if(metrics != NULL){
+		writeMetrics();
+		metrics->close();
+		delete metrics;
+		metrics = NULL;
+	}
+
+	delete scheduler;
+	for(int i=0; i<NUM_PROC; i++){
+		delete workers[i];
+	}
+	delete[] workers;
+	delete pool;
+
+	return RTLIB_OK;
+}
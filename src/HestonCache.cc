@@ -0,0 +1,138 @@
+/**
+ *       @file  HestonCache.cc
+ *
+ * Description: Persistent cache of the Monte Carlo results. The whole cache is one record of its state file,
+ *		written only when an entry changed.
+ *
+ *     @author  Luca Napoletano luca.napoletano@mail.polimi.it, Claudio Montanari claudio1.montanari@mail.polimi.it
+ *
+ *     Company  Politecnico di Milano
+ *   Copyright  Copyright (c) 2017, Luca Napoletano, Claudio Montanari
+ *
+ * This source code is released for free distribution under the terms of the
+ * GNU General Public License as published by the Free Software Foundation.
+ * =====================================================================================
+ */
+#include "HestonCache.h"
+
+#include <algorithm>
+
+/**
+ * @brief		An empty cache, load() reads its file
+ * @param[in] path	The path of the state file of the cache
+ * @param[in] capacity	The largest number of entries
+ */
+HestonCache::HestonCache(std::string const & path, size_t capacity) :
+	file(path) {
+
+	this->CAPACITY = std::max((size_t) 1, capacity);
+	this->DIRTY = false;
+}
+
+/**
+ * @brief		Read the entries of the state file, the most recently used are kept up to the capacity
+ * @return		The number of entries, -1 if the file holds no valid cache
+ */
+int HestonCache::load(){
+
+	HestonRecord record;
+	uint64_t count;
+	if (!file.load(record) || !record.get(count))
+		return -1;
+
+	entries.clear();
+	index.clear();
+
+	for (uint64_t e = 0; e < count && entries.size() < CAPACITY; e++) {
+		std::vector<char> key;
+		HestonStats stats;
+		if (!record.getVector(key) || !record.get(stats))
+			break;
+
+		std::string name(key.begin(), key.end());
+		if (index.count(name))
+			continue;
+		entries.push_back(std::make_pair(name, stats));
+		index[name] = --entries.end();
+	}
+
+	DIRTY = false;
+	return (int) entries.size();
+}
+
+/**
+ * @brief		Write the entries to the state file, if any changed since the last save
+ * @return		false if the file cannot be written
+ */
+bool HestonCache::save(){
+
+	if (!DIRTY)
+		return true;
+
+	HestonRecord record;
+	record.put((uint64_t) entries.size());
+	for (Entries::const_iterator e = entries.begin(); e != entries.end(); ++e) {
+		record.putVector(std::vector<char>(e->first.begin(), e->first.end()));
+		record.put(e->second);
+	}
+
+	if (!file.save(record))
+		return false;
+	DIRTY = false;
+	return true;
+}
+
+/**
+ * @brief		Look up the statistics of a key, the entry becomes the most recently used
+ * @return		false if the key is not cached
+ */
+bool HestonCache::find(std::string const & key, HestonStats & stats){
+
+	std::unordered_map<std::string, Entries::iterator>::iterator found = index.find(key);
+	if (found == index.end())
+		return false;
+
+	entries.splice(entries.begin(), entries, found->second);
+	stats = found->second->second;
+	return true;
+}
+
+/**
+ * @brief		Store the statistics of a key, unless the entry already holds more samples
+ */
+void HestonCache::store(std::string const & key, HestonStats const & stats){
+
+	std::unordered_map<std::string, Entries::iterator>::iterator found = index.find(key);
+	if (found != index.end()) {
+		entries.splice(entries.begin(), entries, found->second);
+		if (found->second->second.count >= stats.count)
+			return;
+		found->second->second = stats;
+		DIRTY = true;
+		return;
+	}
+
+	entries.push_front(std::make_pair(key, stats));
+	index[key] = entries.begin();
+	DIRTY = true;
+
+	if (entries.size() > CAPACITY) {
+		index.erase(entries.back().first);
+		entries.pop_back();
+	}
+}
+
+size_t HestonCache::size() const {
+	return entries.size();
+}
+
+/**
+ * @brief		True when an entry changed since the last save
+ */
+bool HestonCache::isDirty() const {
+	return DIRTY;
+}
+
+std::string const & HestonCache::getPath() const {
+	return file.getPath();
+}
@@ -0,0 +1,407 @@
+/**
+ *       @file  HestonCalibration.cc
+ *
+ * Description: Levenberg-Marquardt calibration of the Heston parameters (V0, kappa, theta, xi, rho) to a
+ *		surface file. The surface holds one quote per line: maturity, strike, implied volatility and an
+ *		optional weight, the lines starting with # are comments. A step is accepted when it lowers the
+ *		weighted sum of squares, the damping is then reduced, otherwise it is increased and the step is
+ *		solved again on the same Jacobian. The parameters are projected back in their domain.
+ *
+ *     @author  Luca Napoletano luca.napoletano@mail.polimi.it, Claudio Montanari claudio1.montanari@mail.polimi.it
+ *
+ *     Company  Politecnico di Milano
+ *   Copyright  Copyright (c) 2017, Luca Napoletano, Claudio Montanari
+ *
+ * This source code is released for free distribution under the terms of the
+ * GNU General Public License as published by the Free Software Foundation.
+ * =====================================================================================
+ */
+#include "HestonCalibration.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+namespace {
+
+/**
+ * Domain of the parameters, in the order V0, kappa, theta, xi, rho
+ */
+const double LOWER[HESTON_PARAMETERS] = { 1e-6, 1e-3, 1e-6, 1e-3, -0.999 };
+const double UPPER[HESTON_PARAMETERS] = { 4.0, 20.0, 4.0, 5.0, 0.999 };
+
+/**
+ * Solve a HESTON_PARAMETERS square system by Gaussian elimination with partial pivoting
+ * @return		false when the system is singular
+ */
+bool solve(double a[HESTON_PARAMETERS][HESTON_PARAMETERS + 1], double * x) {
+
+	const int n = HESTON_PARAMETERS;
+
+	for (int j = 0; j < n; j++) {
+		int pivot = j;
+		for (int i = j + 1; i < n; i++) {
+			if (fabs(a[i][j]) > fabs(a[pivot][j]))
+				pivot = i;
+		}
+		if (fabs(a[pivot][j]) < 1e-300)
+			return false;
+		for (int k = 0; k <= n; k++)
+			std::swap(a[j][k], a[pivot][k]);
+
+		for (int i = j + 1; i < n; i++) {
+			double factor = a[i][j] / a[j][j];
+			for (int k = j; k <= n; k++)
+				a[i][k] -= factor * a[j][k];
+		}
+	}
+
+	for (int j = n - 1; j >= 0; j--) {
+		double rest = a[j][n];
+		for (int k = j + 1; k < n; k++)
+			rest -= a[j][k] * x[k];
+		x[j] = rest / a[j][j];
+	}
+
+	return true;
+}
+
+/**
+ * Black-Scholes implied volatility of a call price, Newton iterations from a guess with a bisection fallback
+ */
+double impliedVolatility(double S0, double K, double r, double T, double price, double guess) {
+
+	double low = 1e-4, high = 5.0;
+	double sigma = std::min(std::max(guess, low), high);
+
+	for (int iteration = 0; iteration < 100; iteration++) {
+		double difference = HestonFourier::blackScholesCall(S0, K, r, T, sigma * sigma) - price;
+		if (fabs(difference) < 1e-12 * S0)
+			break;
+
+		if (difference > 0.0)
+			high = sigma;
+		else
+			low = sigma;
+
+		double vega = HestonFourier::blackScholesVega(S0, K, r, T, sigma * sigma);
+		double next = (vega > 0.0) ? sigma - difference / vega : 0.0;
+		sigma = (next > low && next < high) ? next : 0.5 * (low + high);
+	}
+
+	return sigma;
+}
+
+}
+
+/**
+ * @brief		The calibrator of the options on one underlying
+ * @param[in] S0	The spot price of the underlying
+ * @param[in] r		The risk-free rate
+ * @param[in] pool	The threads the strikes are evaluated on
+ */
+HestonCalibration::HestonCalibration(double S0, double r, HestonPool * pool){
+
+	this->S0 = S0;
+	this->r = r;
+	this->pool = pool;
+
+	// One pricer for each slot, they only share the quadrature nodes by value
+	pricers.assign(pool->size(), HestonFourier(S0, r, 0.0, 0.0, 1.0, 0.0, 1.0));
+
+	ITERATIONS = 0;
+	PRICE_RMSE = 0.0;
+	VOLATILITY_RMSE = 0.0;
+}
+
+/**
+ * @brief		Load the quotes of a surface file, the invalid lines are skipped
+ * @param[in] path	The surface file: maturity, strike, implied volatility and optionally a weight per line
+ * @return		The number of quotes, -1 if the file cannot be read
+ */
+int HestonCalibration::load(std::string const & path){
+
+	std::ifstream file(path.c_str());
+	if (!file)
+		return -1;
+
+	quotes.clear();
+
+	std::string line;
+	while (std::getline(file, line)) {
+		size_t start = line.find_first_not_of(" \t\r");
+		if (start == std::string::npos || line[start] == '#')
+			continue;
+
+		std::stringstream stream(line);
+		Quote quote;
+		if (!(stream >> quote.T >> quote.K >> quote.volatility)
+				|| quote.T <= 0.0 || quote.K <= 0.0 || quote.volatility <= 0.0) {
+			std::cout << "Skipping invalid surface quote: " << line << std::endl;
+			continue;
+		}
+		if (!(stream >> quote.weight) || quote.weight < 0.0)
+			quote.weight = 1.0;
+
+		double variance = quote.volatility * quote.volatility;
+		quote.price = HestonFourier::blackScholesCall(S0, quote.K, r, quote.T, variance);
+		// Deep out of the money quotes have no vega, bounded to keep their volatility error finite
+		quote.vega = std::max(HestonFourier::blackScholesVega(S0, quote.K, r, quote.T, variance),
+			1e-3 * S0 * sqrt(quote.T));
+		quotes.push_back(quote);
+	}
+
+	std::sort(quotes.begin(), quotes.end(), [](Quote const & a, Quote const & b) {
+		return (a.T < b.T) || (a.T == b.T && a.K < b.K);
+	});
+
+	strikes.resize(quotes.size());
+	for (size_t q = 0; q < quotes.size(); q++)
+		strikes[q] = quotes[q].K;
+
+	prices.assign(quotes.size(), 0.0);
+	gradients.assign(quotes.size() * HESTON_PARAMETERS, 0.0);
+	split();
+
+	return (int) quotes.size();
+}
+
+size_t HestonCalibration::size() const {
+	return quotes.size();
+}
+
+/**
+ * @brief		Split the strikes of every maturity in chunks, about one chunk per slot over the whole
+ *			surface: many maturities give one chunk each, a few maturities are split among the slots
+ */
+void HestonCalibration::split(){
+
+	chunks.clear();
+
+	size_t slots = pricers.size();
+	size_t target = std::max((size_t) CALIBRATION_MIN_CHUNK, (quotes.size() + slots - 1) / slots);
+
+	for (size_t first = 0; first < quotes.size(); ) {
+		size_t last = first;
+		while (last < quotes.size() && quotes[last].T == quotes[first].T)
+			last++;
+
+		size_t count = last - first;
+		size_t parts = (count + target - 1) / target;
+		for (size_t p = 0; p < parts; p++) {
+			Chunk chunk;
+			chunk.T = quotes[first].T;
+			chunk.first = first + count * p / parts;
+			chunk.count = (int) (first + count * (p + 1) / parts - chunk.first);
+			chunks.push_back(chunk);
+		}
+
+		first = last;
+	}
+}
+
+/**
+ * @brief		Model prices and gradients of all the quotes, the chunks are dealt to the slots in turn and
+ *			every quote is written by exactly one chunk
+ * @param[in] parameters The HESTON_PARAMETERS values
+ */
+void HestonCalibration::evaluate(double const * parameters){
+
+	int slots = (int) pricers.size();
+
+	for (int s = 0; s < slots; s++) {
+		pool->post(s, [this, s, slots, parameters]() {
+			HestonFourier & pricer = pricers[s];
+			pricer.setParameters(parameters);
+			for (size_t c = s; c < chunks.size(); c += slots) {
+				Chunk const & chunk = chunks[c];
+				pricer.callGradients(chunk.T, &strikes[chunk.first], chunk.count,
+					&prices[chunk.first], &gradients[chunk.first * HESTON_PARAMETERS]);
+			}
+		});
+	}
+
+	for (int s = 0; s < slots; s++)
+		pool->join(s);
+}
+
+/**
+ * @brief		Weighted residuals of the last evaluation, and their Jacobian
+ * @param[in] error	The calibration error
+ * @param[out] residual	One residual per quote
+ * @param[out] jacobian	When not NULL, the derivatives of the residuals as [quote][parameter]
+ * @return		The half sum of the squared residuals
+ */
+double HestonCalibration::residuals(Error error, std::vector<double> & residual, std::vector<double> * jacobian){
+
+	double cost = 0.0;
+
+	residual.resize(quotes.size());
+	if (jacobian)
+		jacobian->resize(quotes.size() * HESTON_PARAMETERS);
+
+	for (size_t q = 0; q < quotes.size(); q++) {
+		double scale = sqrt(quotes[q].weight);
+		if (error == VOLATILITY_ERROR)
+			scale /= quotes[q].vega;
+
+		residual[q] = scale * (prices[q] - quotes[q].price);
+		cost += 0.5 * residual[q] * residual[q];
+
+		if (jacobian) {
+			for (int p = 0; p < HESTON_PARAMETERS; p++)
+				(*jacobian)[q * HESTON_PARAMETERS + p] = scale * gradients[q * HESTON_PARAMETERS + p];
+		}
+	}
+
+	return cost;
+}
+
+/**
+ * @brief		Fit the parameters to the loaded surface
+ * @param[in,out] parameters The HESTON_PARAMETERS values, the initial guess on entry, the fit on exit
+ * @param[in] error	The calibration error
+ * @param[in] maxIterations The maximum number of Levenberg-Marquardt iterations
+ * @return		The weighted root mean square price error of the fit
+ */
+double HestonCalibration::calibrate(double * parameters, Error error, int maxIterations){
+
+	const int n = HESTON_PARAMETERS;
+
+	ITERATIONS = 0;
+	if (quotes.empty())
+		return 0.0;
+
+	for (int p = 0; p < n; p++)
+		parameters[p] = std::min(std::max(parameters[p], LOWER[p]), UPPER[p]);
+
+	std::vector<double> residual, jacobian, trialResidual, trialJacobian;
+	double trial[HESTON_PARAMETERS];
+
+	evaluate(parameters);
+	double cost = residuals(error, residual, &jacobian);
+	double damping = 1e-3;
+
+	while (ITERATIONS < maxIterations) {
+		ITERATIONS++;
+
+		// Normal equations J'J and J'r
+		double normal[HESTON_PARAMETERS][HESTON_PARAMETERS];
+		double gradient[HESTON_PARAMETERS];
+		for (int j = 0; j < n; j++) {
+			gradient[j] = 0.0;
+			for (int k = 0; k < n; k++)
+				normal[j][k] = 0.0;
+		}
+		for (size_t q = 0; q < quotes.size(); q++) {
+			double const * row = &jacobian[q * n];
+			for (int j = 0; j < n; j++) {
+				gradient[j] += row[j] * residual[q];
+				for (int k = 0; k < n; k++)
+					normal[j][k] += row[j] * row[k];
+			}
+		}
+
+		// Retry with more damping until a step lowers the cost
+		bool accepted = false;
+		bool converged = false;
+		while (!accepted && damping < 1e16) {
+			double a[HESTON_PARAMETERS][HESTON_PARAMETERS + 1];
+			double step[HESTON_PARAMETERS];
+			for (int j = 0; j < n; j++) {
+				for (int k = 0; k < n; k++)
+					a[j][k] = normal[j][k];
+				a[j][j] += damping * std::max(normal[j][j], 1e-12);
+				a[j][n] = -gradient[j];
+			}
+			if (!solve(a, step)) {
+				damping *= 4.0;
+				continue;
+			}
+
+			double change = 0.0;
+			for (int p = 0; p < n; p++) {
+				trial[p] = std::min(std::max(parameters[p] + step[p], LOWER[p]), UPPER[p]);
+				change = std::max(change, fabs(trial[p] - parameters[p]) / (fabs(parameters[p]) + 1e-3));
+			}
+			if (change < 1e-10) {
+				converged = true;
+				break;
+			}
+
+			evaluate(trial);
+			double trialCost = residuals(error, trialResidual, &trialJacobian);
+			if (trialCost < cost) {
+				converged = (cost - trialCost) < 1e-12 * cost;
+				std::copy(trial, trial + n, parameters);
+				cost = trialCost;
+				residual.swap(trialResidual);
+				jacobian.swap(trialJacobian);
+				damping = std::max(damping / 3.0, 1e-12);
+				accepted = true;
+			} else {
+				damping *= 4.0;
+			}
+		}
+
+		if (converged || !accepted)
+			break;
+	}
+
+	// The prices of the last evaluation may be those of a rejected step
+	evaluate(parameters);
+	errors();
+
+	return PRICE_RMSE;
+}
+
+/**
+ * @brief		Weighted root mean square errors of the last evaluation, in price and in implied volatility
+ */
+void HestonCalibration::errors(){
+
+	double priceSum = 0.0, volatilitySum = 0.0, weightSum = 0.0;
+
+	for (size_t q = 0; q < quotes.size(); q++) {
+		Quote const & quote = quotes[q];
+		double volatility = impliedVolatility(S0, quote.K, r, quote.T, prices[q], quote.volatility);
+		priceSum += quote.weight * (prices[q] - quote.price) * (prices[q] - quote.price);
+		volatilitySum += quote.weight * (volatility - quote.volatility) * (volatility - quote.volatility);
+		weightSum += quote.weight;
+	}
+
+	PRICE_RMSE = (weightSum > 0.0) ? sqrt(priceSum / weightSum) : 0.0;
+	VOLATILITY_RMSE = (weightSum > 0.0) ? sqrt(volatilitySum / weightSum) : 0.0;
+}
+
+int HestonCalibration::getIterations() const {
+	return ITERATIONS;
+}
+
+double HestonCalibration::getPriceRmse() const {
+	return PRICE_RMSE;
+}
+
+double HestonCalibration::getVolatilityRmse() const {
+	return VOLATILITY_RMSE;
+}
+
+HestonCalibration::Error HestonCalibration::parseError(std::string const & name){
+
+	if (name == "vol")
+		return VOLATILITY_ERROR;
+
+	return PRICE_ERROR;
+}
+
+const char* HestonCalibration::errorName(Error error){
+
+	switch (error) {
+	case VOLATILITY_ERROR:
+		return "vol";
+	default:
+		return "price";
+	}
+}
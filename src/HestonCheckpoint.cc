@@ -0,0 +1,231 @@
+/**
+ *       @file  HestonCheckpoint.cc
+ *
+ * Description: Memory mapped state file with two slots. The first save of a run, and any save which does
+ *		not fit the slots, builds a new file aside and renames it over the old one: the last record
+ *		is never overwritten in place.
+ *
+ *     @author  Luca Napoletano luca.napoletano@mail.polimi.it, Claudio Montanari claudio1.montanari@mail.polimi.it
+ *
+ *     Company  Politecnico di Milano
+ *   Copyright  Copyright (c) 2017, Luca Napoletano, Claudio Montanari
+ *
+ * This source code is released for free distribution under the terms of the
+ * GNU General Public License as published by the Free Software Foundation.
+ * =====================================================================================
+ */
+#include "HestonCheckpoint.h"
+
+#include <atomic>
+#include <cstdio>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+const char MAGIC[8] = { 'H', 'E', 'S', 'T', 'O', 'N', 'C', 'K' };
+const uint32_t VERSION = 1;
+const uint64_t PAGE = 4096;
+
+}
+
+/**
+ * @brief		A state file, nothing is mapped until the first load() or save()
+ * @param[in] path	The path of the file
+ */
+HestonCheckpoint::HestonCheckpoint(std::string const & path) :
+	path(path),
+	map(NULL),
+	mapped(0),
+	capacity(0),
+	sequence(0),
+	last(-1) {
+}
+
+HestonCheckpoint::~HestonCheckpoint(){
+
+	unmap();
+}
+
+/**
+ * @brief		Read the last valid record of the file. The next saves go on with its sequence number
+ * @return		false if the file cannot be read or holds no valid record
+ */
+bool HestonCheckpoint::load(HestonRecord & record){
+
+	int fd = ::open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+		return false;
+
+	struct stat info;
+	if (fstat(fd, &info) != 0 || (size_t) info.st_size < sizeof(Header)) {
+		::close(fd);
+		return false;
+	}
+
+	size_t size = info.st_size;
+	void * address = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);
+	if (address == MAP_FAILED)
+		return false;
+
+	char * base = static_cast<char *>(address);
+	Header const * header = reinterpret_cast<Header const *>(base);
+	Slot * best = NULL;
+
+	if (memcmp(header->magic, MAGIC, sizeof(MAGIC)) == 0 && header->version == VERSION
+			&& sizeof(Header) + 2 * (sizeof(Slot) + header->capacity) <= size) {
+		for (int index = 0; index < 2; index++) {
+			Slot * candidate = slot(base, header->capacity, index);
+			if (candidate->sequence == 0 || candidate->bytes > header->capacity
+					|| candidate->checksum != checksum(reinterpret_cast<char const *>(candidate + 1), candidate->bytes))
+				continue;
+			if (best == NULL || candidate->sequence > best->sequence)
+				best = candidate;
+		}
+	}
+
+	if (best != NULL) {
+		char const * data = reinterpret_cast<char const *>(best + 1);
+		record.data.assign(data, data + best->bytes);
+		record.offset = 0;
+		sequence = best->sequence;
+	}
+
+	munmap(address, size);
+	return best != NULL;
+}
+
+/**
+ * @brief		Save a record in the slot not holding the last one. The slot is invalidated, filled and then
+ *			sealed, the flush to the disk is left to the kernel
+ * @return		false if the file cannot be written
+ */
+bool HestonCheckpoint::save(HestonRecord const & record){
+
+	if (map == NULL || record.data.size() > capacity)
+		return create(record);
+
+	int index = 1 - last;
+	Slot * target = slot(map, capacity, index);
+
+	target->sequence = 0;
+	std::atomic_thread_fence(std::memory_order_release);
+	memcpy(target + 1, record.data.data(), record.data.size());
+	target->bytes = record.data.size();
+	target->checksum = checksum(record.data.data(), record.data.size());
+	std::atomic_thread_fence(std::memory_order_release);
+	target->sequence = ++sequence;
+	last = index;
+
+	msync(map, mapped, MS_ASYNC);
+	return true;
+}
+
+/**
+ * @brief		Build a new file with slots twice the size of the record, holding the record in its first
+ *			slot, and rename it over the old one once it is on the disk
+ */
+bool HestonCheckpoint::create(HestonRecord const & record){
+
+	std::string temporary = path + ".tmp";
+	uint64_t slotCapacity = ((2 * record.data.size() + PAGE - 1) / PAGE) * PAGE;
+	if (slotCapacity == 0)
+		slotCapacity = PAGE;
+	size_t size = sizeof(Header) + 2 * (sizeof(Slot) + slotCapacity);
+
+	int fd = ::open(temporary.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0)
+		return false;
+	if (ftruncate(fd, size) != 0) {
+		::close(fd);
+		unlink(temporary.c_str());
+		return false;
+	}
+
+	void * address = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	::close(fd);
+	if (address == MAP_FAILED) {
+		unlink(temporary.c_str());
+		return false;
+	}
+
+	char * base = static_cast<char *>(address);
+	Header * header = reinterpret_cast<Header *>(base);
+	memcpy(header->magic, MAGIC, sizeof(MAGIC));
+	header->version = VERSION;
+	header->reserved = 0;
+	header->capacity = slotCapacity;
+
+	Slot * target = slot(base, slotCapacity, 0);
+	memcpy(target + 1, record.data.data(), record.data.size());
+	target->bytes = record.data.size();
+	target->checksum = checksum(record.data.data(), record.data.size());
+	target->sequence = sequence + 1;
+
+	if (msync(base, size, MS_SYNC) != 0 || rename(temporary.c_str(), path.c_str()) != 0) {
+		munmap(address, size);
+		unlink(temporary.c_str());
+		return false;
+	}
+
+	unmap();
+	map = base;
+	mapped = size;
+	capacity = slotCapacity;
+	sequence++;
+	last = 0;
+	return true;
+}
+
+void HestonCheckpoint::unmap(){
+
+	if (map != NULL)
+		munmap(map, mapped);
+	map = NULL;
+	mapped = 0;
+	capacity = 0;
+	last = -1;
+}
+
+/**
+ * @brief		The head of a slot, its record follows it
+ */
+HestonCheckpoint::Slot * HestonCheckpoint::slot(char * base, uint64_t capacity, int index) const {
+
+	return reinterpret_cast<Slot *>(base + sizeof(Header) + index * (sizeof(Slot) + capacity));
+}
+
+/**
+ * @brief		64 bit FNV-1a hash of a record
+ */
+uint64_t HestonCheckpoint::checksum(char const * data, uint64_t bytes){
+
+	uint64_t hash = 14695981039346656037ULL;
+	for (uint64_t i = 0; i < bytes; i++) {
+		hash ^= (unsigned char) data[i];
+		hash *= 1099511628211ULL;
+	}
+	return hash ^ bytes;
+}
+
+std::string const & HestonCheckpoint::getPath() const {
+	return path;
+}
+
+/**
+ * @brief		The sequence number of the last record, 0 if there is none
+ */
+uint64_t HestonCheckpoint::getSequence() const {
+	return sequence;
+}
+
+/**
+ * @brief		The size of the mapped file
+ */
+size_t HestonCheckpoint::getBytes() const {
+	return mapped;
+}
@@ -0,0 +1,327 @@
+/**
+ *       @file  HestonFour_bench.cc
+ *      @brief  The HestonFour BarbequeRTRM application
+ *
+ * Description: Benchmark of the pricing core, without the RTLib. It measures the normal generators (ns per
+ *		variate) and, for every path kernel supported by the host in double and single precision, the
+ *		throughput of the workers from 1 to N threads (paths per second, ns per path step, speedup and
+ *		parallel efficiency). Every measure is repeated after some warmup rounds, the report is a JSON
+ *		document with the mean, the standard deviation and the minimum of the repetitions.
+ *
+ *     @author  Luca Napoletano luca.napoletano@mail.polimi.it, Claudio Montanari claudio1.montanari@mail.polimi.it
+ *
+ *     Company  Politecnico di Milano
+ *   Copyright  Copyright (c) 2017, Luca Napoletano, Claudio Montanari
+ *
+ * This source code is released for free distribution under the terms of the
+ * GNU General Public License as published by the Free Software Foundation.
+ * =====================================================================================
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <boost/program_options/options_description.hpp>
+#include <boost/program_options/parsers.hpp>
+#include <boost/program_options/variables_map.hpp>
+
+#include "version.h"
+#include "HestonNormal.h"
+#include "HestonPool.h"
+#include "HestonRandom.h"
+#include "HestonSettings.h"
+#include "HestonStats.h"
+#include "HestonWorker.h"
+
+namespace po = boost::program_options;
+
+/**
+ * @brief Model and option of the benchmark, the defaults of hestonfour
+ */
+double S0 = 100.0;
+double K = 100.0;
+double r = 0.05;
+double T = 5.0;
+
+double V0 = 0.09;
+double rho = -0.30;
+double kappa = 2.0;
+double theta = 0.09;
+double xi = 1.0;
+
+int N_SIM;
+int DISCR;
+int THREADS;
+int WARMUP;
+int REPETITIONS;
+
+HestonSettings settings;
+
+/**
+ * @brief		The repetitions of a measure, with their minimum
+ */
+struct Measure {
+	HestonStats stats;
+	double min;
+
+	Measure() : min(0.0) {
+	}
+
+	void add(double x) {
+		min = (stats.count == 0) ? x : std::min(min, x);
+		stats.add(x);
+	}
+};
+
+/**
+ * @brief		Write a measure as a JSON object
+ */
+std::string Json(Measure const & measure) {
+	char text[160];
+	snprintf(text, sizeof(text), "{\"mean\": %.6g, \"stddev\": %.6g, \"min\": %.6g}",
+		measure.stats.mean, sqrt(measure.stats.variance()), measure.min);
+	return text;
+}
+
+/**
+ * @brief		Nanoseconds per N(0,1) variate of a generator, one round fills a buffer of 2^16 variates
+ */
+Measure BenchNormal(HestonNormal::Algorithm algorithm, HestonKernel::Isa isa) {
+	const int BUFFER = 1 << 16;
+	const int ROUNDS = 64;
+
+	std::vector<double> buffer(BUFFER);
+	HestonRandom generator(settings.seed);
+	HestonNormal normal(algorithm, isa);
+	Measure measure;
+
+	for (int repetition = -WARMUP; repetition < REPETITIONS; repetition++) {
+		auto start = std::chrono::steady_clock::now();
+		for (int round = 0; round < ROUNDS; round++)
+			normal.fill(generator, buffer.data(), BUFFER);
+		double elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+
+		if (repetition >= 0)
+			measure.add(elapsed / ((double) BUFFER * ROUNDS));
+	}
+
+	return measure;
+}
+
+/**
+ * @brief		Simulate one block of N_SIM paths on each of the workers, as a cycle of onRun() does, and
+ *			return the wall time in seconds. The blocks are never reused, so no cache holds a result
+ */
+double RunCycle(std::vector<std::unique_ptr<HestonWorker> > & workers, int & block) {
+	auto start = std::chrono::steady_clock::now();
+
+	for (size_t w = 0; w < workers.size(); w++)
+		workers[w]->start(N_SIM, DISCR, block++);
+	for (size_t w = 0; w < workers.size(); w++)
+		workers[w]->join();
+
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+/**
+ * @brief		The thread counts of the scaling curve: the powers of two below the maximum, and the maximum
+ */
+std::vector<int> ThreadCounts(int threads) {
+	std::vector<int> counts;
+	for (int t = 1; t < threads; t *= 2)
+		counts.push_back(t);
+	counts.push_back(threads);
+	return counts;
+}
+
+/**
+ * @brief		Scaling curve of a path kernel
+ */
+void BenchKernel(HestonKernel::Isa isa, HestonKernel::Precision precision, std::ostream & out) {
+	std::vector<int> counts = ThreadCounts(THREADS);
+	double single = 0.0;
+	int block = 0;
+
+	settings.kernel = isa;
+	settings.precision = precision;
+
+	out << "    {\"kernel\": \"" << HestonKernel::name(isa) << "\", \"precision\": \"" << HestonKernel::precisionName(precision)
+		<< "\", \"lanes\": " << HestonKernel::lanes(isa, precision) << ", \"scaling\": [" << std::endl;
+
+	for (size_t c = 0; c < counts.size(); c++) {
+		int threads = counts[c];
+		HestonPool pool(threads);
+		std::vector<std::unique_ptr<HestonWorker> > workers;
+		for (int w = 0; w < threads; w++) {
+			workers.emplace_back(new HestonWorker(&pool, w, settings, S0, K, r, T, V0, rho, kappa, theta, xi));
+			workers.back()->setPrecision(precision);
+		}
+
+		Measure throughput, step;
+		for (int repetition = -WARMUP; repetition < REPETITIONS; repetition++) {
+			double elapsed = RunCycle(workers, block);
+			double paths = (double) N_SIM * threads;
+			if (repetition >= 0) {
+				throughput.add(paths / elapsed);
+				// Core time of a step of a path and of its antithetic twin
+				step.add(elapsed * 1e9 * threads / (paths * DISCR));
+			}
+		}
+
+		if (threads == 1)
+			single = throughput.stats.mean;
+		double speedup = (single > 0.0) ? throughput.stats.mean / single : 0.0;
+
+		out << "      {\"threads\": " << threads
+			<< ", \"paths_per_sec\": " << Json(throughput)
+			<< ", \"ns_per_step\": " << Json(step)
+			<< ", \"speedup\": " << speedup
+			<< ", \"efficiency\": " << speedup / threads
+			<< "}" << ((c + 1 < counts.size()) ? "," : "") << std::endl;
+	}
+
+	out << "    ]}";
+}
+
+void ParseCommandLine(int argc, char *argv[], po::options_description & opts_desc, po::variables_map & opts_vm) {
+	try {
+		po::store(po::parse_command_line(argc, argv, opts_desc), opts_vm);
+	} catch(...) {
+		std::cout << "Usage: " << argv[0] << " [options]\n";
+		std::cout << opts_desc << std::endl;
+		::exit(EXIT_FAILURE);
+	}
+	po::notify(opts_vm);
+
+	if (opts_vm.count("help")) {
+		std::cout << "Usage: " << argv[0] << " [options]\n";
+		std::cout << opts_desc << std::endl;
+		::exit(EXIT_SUCCESS);
+	}
+}
+
+int main(int argc, char *argv[]) {
+	po::options_description opts_desc("HestonFour Benchmark Options");
+	po::variables_map opts_vm;
+	std::string kernel;
+	std::string precision;
+	std::string scheme;
+	std::string output;
+	uint64_t seed;
+
+	opts_desc.add_options()
+		("help,h", "print this help message")
+		("sims,n", po::value<int>(&N_SIM)->
+			default_value(10000),
+			"Number of paths of a block, each worker simulates one block per cycle")
+		("discr,d", po::value<int>(&DISCR)->
+			default_value(300),
+			"Discretization value")
+		("threads,t", po::value<int>(&THREADS)->
+			default_value(std::max(1u, std::thread::hardware_concurrency())),
+			"Largest number of threads of the scaling curve")
+		("warmup", po::value<int>(&WARMUP)->
+			default_value(1),
+			"Number of discarded rounds before each measure")
+		("repetitions", po::value<int>(&REPETITIONS)->
+			default_value(5),
+			"Number of measured rounds")
+		("kernel", po::value<std::string>(&kernel)->
+			default_value("all"),
+			"Path kernel [all, scalar, sse2, avx2, avx512]")
+		("precision", po::value<std::string>(&precision)->
+			default_value("all"),
+			"Path evolution precision [all, double, float], float is measured on the SIMD kernels with the euler and logeuler schemes")
+		("scheme", po::value<std::string>(&scheme)->
+			default_value("euler"),
+			"Variance discretization [euler (full truncation), logeuler, qe (Andersen)]")
+		("seed", po::value<uint64_t>(&seed)->
+			default_value(42),
+			"Random seed")
+		("output,o", po::value<std::string>(&output),
+			"JSON report file (default: standard output)")
+	;
+
+	ParseCommandLine(argc, argv, opts_desc, opts_vm);
+
+	N_SIM = std::max(1, N_SIM);
+	DISCR = std::max(1, DISCR);
+	THREADS = std::max(1, THREADS);
+	WARMUP = std::max(0, WARMUP);
+	REPETITIONS = std::max(1, REPETITIONS);
+
+	settings.scheme = HestonKernel::parseScheme(scheme);
+	settings.seed = seed;
+
+	// All the kernels the host supports, or the requested one
+	HestonKernel::Isa best = HestonKernel::detect();
+	std::vector<HestonKernel::Isa> kernels;
+	for (int isa = HestonKernel::SCALAR; isa <= best; isa++) {
+		if (kernel == "all" || kernel == HestonKernel::name((HestonKernel::Isa) isa))
+			kernels.push_back((HestonKernel::Isa) isa);
+	}
+	if (kernels.empty())
+		kernels.push_back(HestonKernel::parse(kernel));
+
+	std::ofstream file;
+	if (opts_vm.count("output")) {
+		file.open(output.c_str());
+		if (!file) {
+			std::cerr << "Unable to write the report [" << output << "]" << std::endl;
+			return EXIT_FAILURE;
+		}
+	}
+	std::ostream & out = opts_vm.count("output") ? file : std::cout;
+
+	out << "{" << std::endl;
+	out << "  \"version\": \"" << g_git_version << "\"," << std::endl;
+	out << "  \"host\": {\"hardware_threads\": " << std::thread::hardware_concurrency()
+		<< ", \"isa\": \"" << HestonKernel::name(best) << "\"}," << std::endl;
+	out << "  \"config\": {\"sims\": " << N_SIM << ", \"discr\": " << DISCR << ", \"threads\": " << THREADS
+		<< ", \"warmup\": " << WARMUP << ", \"repetitions\": " << REPETITIONS
+		<< ", \"scheme\": \"" << HestonKernel::schemeName(settings.scheme) << "\", \"seed\": " << seed << "},"
+		<< std::endl;
+
+	out << "  \"normals\": [" << std::endl;
+	for (int a = HestonNormal::BOX_MULLER; a <= HestonNormal::ABRAMOWITZ_STEGUN; a++) {
+		HestonNormal::Algorithm algorithm = (HestonNormal::Algorithm) a;
+		out << "    {\"algorithm\": \"" << HestonNormal::name(algorithm) << "\", \"isa\": \"" << HestonKernel::name(best)
+			<< "\", \"ns_per_variate\": " << Json(BenchNormal(algorithm, best)) << "}"
+			<< ((a < HestonNormal::ABRAMOWITZ_STEGUN) ? "," : "") << std::endl;
+	}
+	out << "  ]," << std::endl;
+
+	// Every kernel in each requested precision, the scalar code and the QE scheme only run in double
+	std::vector<std::pair<HestonKernel::Isa, HestonKernel::Precision> > runs;
+	for (size_t k = 0; k < kernels.size(); k++) {
+		for (int p = HestonKernel::DOUBLE; p <= HestonKernel::FLOAT; p++) {
+			HestonKernel::Precision candidate = (HestonKernel::Precision) p;
+			if (precision != "all" && precision != HestonKernel::precisionName(candidate))
+				continue;
+			if (candidate == HestonKernel::FLOAT && (kernels[k] == HestonKernel::SCALAR
+					|| settings.scheme == HestonKernel::QUADRATIC_EXPONENTIAL))
+				continue;
+			runs.push_back(std::make_pair(kernels[k], candidate));
+		}
+	}
+
+	out << "  \"kernels\": [" << std::endl;
+	for (size_t k = 0; k < runs.size(); k++) {
+		BenchKernel(runs[k].first, runs[k].second, out);
+		out << ((k + 1 < runs.size()) ? "," : "") << std::endl;
+	}
+	out << "  ]" << std::endl;
+	out << "}" << std::endl;
+
+	return EXIT_SUCCESS;
+}
@@ -18,7 +18,10 @@
 
 
 #include "HestonFour_exc.h"
+#include "HestonFourier.h"
 
+#include <algorithm>
+#include <chrono>
 #include <cstdio>
 #include <bbque/utils/utility.h>
 
@@ -38,12 +41,14 @@
  * @param[in] xi	The volatility of volatility (V0)
  * @param[in] N_SIM	The number of wanted simulations
  * @param[in] DISCR	The discretization value
+ * @param[in] settings	The settings of the simulation engine
  */
 HestonFour::HestonFour(std::string const & name,
 		std::string const & recipe,
 		RTLIB_Services_t *rtlib, double S0, double K, double r, double T, double V0, double rho, double kappa, double theta, double xi,
-		int N_SIM, int DISCR) :
-	BbqueEXC(name, recipe, rtlib) {
+		int N_SIM, int DISCR, HestonSettings const & settings) :
+	BbqueEXC(name, recipe, rtlib),
+	settings(settings) {
 
 	logger->Warn("New HestonFour::HestonFour()");
 
@@ -74,9 +79,71 @@ HestonFour::HestonFour(std::string const & name,
 	this->DONE_SIMULATIONS = 0;
 	
 	this->pricesToCompute = (int) (TODO_SIMULATIONS / WORKERS_SIM);
+
+	// In QMC mode every replication gets the same number of blocks
+	if(this->settings.qmc) {
+		int replications = this->settings.replications;
+		this->pricesToCompute = ((pricesToCompute + replications - 1) / replications) * replications;
+		this->TODO_SIMULATIONS = pricesToCompute * WORKERS_SIM;
+	}
+
 	this->computedPrices = new double[pricesToCompute];
 	this->computedPricesIndex = 0;	
 
+	if(this->settings.grid())
+		this->gridStats.resize(this->settings.strikes.size() * this->settings.maturities.size());
+
+	// Expectations of the controls, undiscounted as the payoffs: terminal spot, companion call and, for the
+	// path-dependent payoffs, the European call. The controls are taken at the end of the paths
+	double horizon = this->settings.pathTime(this->T);
+	this->controlExpected[0] = this->S0 * exp(this->r * horizon);
+	this->controlExpected[1] = exp(this->r * horizon) * HestonFourier::blackScholesCall(this->S0, this->K, this->r, horizon,
+		HestonFourier::meanVariance(this->V0, this->kappa, this->theta, horizon));
+	this->controlExpected[2] = 0.0;
+	if(this->settings.controlVariates && !this->settings.european())
+		this->controlExpected[2] = exp(this->r * horizon) *
+			HestonFourier(this->S0, this->r, this->V0, this->rho, this->kappa, this->theta, this->xi).call(this->K, horizon);
+
+	// Every level starts with one block, its variance sets the number of paths of the next cycles
+	if(this->settings.mlmcLevels > 0) {
+		int levels = this->settings.mlmcLevels;
+		this->levelStats.resize(levels);
+		this->levelTarget.resize(levels);
+		this->levelBlocks.assign(levels, 0);
+		this->levelSteps = 0.0;
+		for(int l = 0; l < levels; l++){
+			this->levelTarget[l] = levelBlockSize(l);
+		}
+	}
+
+	// The path store is allocated in onSetup(), with the other resources
+	this->american = NULL;
+	this->americanTrained = false;
+	this->americanBlock = 0;
+	this->regressionTime = 0.0;
+
+	this->scheduler = NULL;
+	this->steals = 0;
+
+	this->nextChunk = 0;
+	this->blockSum = 0.0;
+	this->preemptionMax = 0.0;
+	this->lastLatency = -1.0;
+
+	this->checkpoint = NULL;
+	this->metrics = NULL;
+
+	this->FLOAT_ACCEPTED = false;
+	this->FLOAT_ACTIVE = false;
+	this->floatCycles = 0;
+
+	this->pointDiscretization = DISCR;
+	this->pointScheme = this->settings.scheme;
+	this->pointError = this->settings.targetError;
+
+	// Two-sided quantile of the confidence interval
+	this->zScore = HestonNormal::inverse(0.5 + 0.5 * this->settings.confidence);
+
 	std::cout << std::endl;
 
 	std::cout << "S0: " << this->S0 << std::endl;
@@ -92,11 +159,56 @@ HestonFour::HestonFour(std::string const & name,
 
 	std::cout << "SIMULATIONS TO-DO: " << this->TODO_SIMULATIONS << std::endl;
 	std::cout << "DISCRETIZATION: " << this->DISCRETIZATION << std::endl;
+	std::cout << "KERNEL: " << HestonKernel::name(this->settings.kernel) << std::endl;
+	if(this->settings.precision == HestonKernel::FLOAT){
+		std::cout << "PRECISION: float on AWM";
+		for(size_t a = 0; a < this->settings.floatAwms.size(); a++)
+			std::cout << (a == 0 ? " " : ", ") << this->settings.floatAwms[a];
+		std::cout << ", double otherwise" << std::endl;
+	}
+	std::cout << "SCHEME: " << HestonKernel::schemeName(this->settings.scheme) << std::endl;
+	std::cout << "PAYOFF: " << HestonKernel::payoffName(this->settings.payoff) << std::endl;
+	if(this->settings.payoff >= HestonKernel::UP_AND_OUT && this->settings.payoff <= HestonKernel::DOWN_AND_IN)
+		std::cout << "BARRIER: " << this->settings.barrier << std::endl;
+	std::cout << "NORMAL: " << HestonNormal::name(this->settings.normal) << std::endl;
+	std::cout << "SEED: " << this->settings.seed << std::endl;
+	if(this->settings.targetError > 0.0)
+		std::cout << "TARGET ERROR: " << this->settings.targetError << " @ " << this->settings.confidence << std::endl;
+	if(this->settings.qmc)
+		std::cout << "QMC REPLICATIONS: " << this->settings.replications << std::endl;
+	if(this->settings.controlVariates)
+		std::cout << "CONTROL VARIATES: terminal spot, Black-Scholes companion"
+			<< (this->settings.european() ? "" : ", European call") << std::endl;
+	if(this->settings.mlmcLevels > 0)
+		std::cout << "MLMC: " << this->settings.mlmcLevels << " levels, " << levelDiscretization(0) << " to "
+			<< this->DISCRETIZATION << " steps, RMSE " << this->settings.mlmcRmse << std::endl;
+	if(this->settings.greeks)
+		std::cout << "GREEKS: delta, gamma, vega, rho (scalar kernel)" << std::endl;
+	if(this->settings.exercises > 0)
+		std::cout << "AMERICAN PUT: " << this->settings.exercises << " exercise dates, Longstaff-Schwartz" << std::endl;
+	if(this->settings.grid())
+		std::cout << "GRID: " << this->settings.maturities.size() << " maturities x "
+			<< this->settings.strikes.size() << " strikes" << std::endl;
+	for(size_t p = 0; p < this->settings.operatingPoints.size(); p++){
+		HestonOperatingPoint const & point = this->settings.operatingPoints[p];
+		std::cout << "AWM " << point.awm << ": " << point.discretization << " steps, "
+			<< HestonKernel::schemeName(point.scheme) << ", " << HestonKernel::precisionName(point.precision);
+		if(point.targetError > 0.0)
+			std::cout << ", target error " << point.targetError;
+		std::cout << std::endl;
+	}
 
 	std::cout << std::endl;
 
 }
 
+/**
+ * @brief	The number of paths simulated so far (each one with its antithetic twin)
+ */
+int HestonFour::getSimulationsDone() const {
+	return DONE_SIMULATIONS;
+}
+
 /**
  * @brief	Method used to do all the Setup operations
  */
@@ -109,6 +221,28 @@ RTLIB_ExitCode_t HestonFour::onSetup() {
 	
 	workersFinalSum = 0.0;
 
+	/**
+	 * @brief Open the state file, a resumed run starts from the state it holds
+	 */
+	if(!settings.checkpoint.empty()){
+		checkpoint = new HestonCheckpoint(settings.checkpoint);
+		if(settings.resume){
+			HestonRecord record;
+			if(!checkpoint->load(record)){
+				logger->Error("Checkpoint [%s]: no valid state to resume", settings.checkpoint.c_str());
+				return RTLIB_ERROR;
+			}
+			if(!restoreState(record)){
+				logger->Error("Checkpoint [%s]: the state belongs to a run with other parameters", settings.checkpoint.c_str());
+				return RTLIB_ERROR;
+			}
+			logger->Warn("Checkpoint [%s]: resuming record %lu, %d simulations done, seed %lu",
+				settings.checkpoint.c_str(), (unsigned long) checkpoint->getSequence(), DONE_SIMULATIONS,
+				(unsigned long) settings.seed);
+		}
+		checkpointTime = std::chrono::steady_clock::now();
+	}
+
 	/**
 	 * @brief Number of max processor in the computer
 	 */
@@ -116,6 +250,11 @@ RTLIB_ExitCode_t HestonFour::onSetup() {
 	std::cout << "Number of detected processors: " << NUM_PROC << std::endl;
 
 
+	/**
+	 * @brief Create the pool of threads, they live until onRelease() and sleep between two cycles
+	 */
+	pool = new HestonPool(NUM_PROC);
+
 	/**
 	 * @brief Create the workers with the NUM_PROC variables
 	 */	
@@ -123,7 +262,37 @@ RTLIB_ExitCode_t HestonFour::onSetup() {
 
 	for(int i=0;i<NUM_PROC; i++){
 		logger->Warn("Creating new worker"); 
-		workers[i] = new HestonWorker( S0, K, r, T, V0, rho, kappa, theta, xi);
+		workers[i] = new HestonWorker(pool, i, settings, S0, K, r, T, V0, rho, kappa, theta, xi);
+	}
+
+	scheduler = new HestonScheduler(pool);
+
+	/**
+	 * @brief Compare the single and double precision kernels before the AWMs may use the first one
+	 */
+	if(settings.precision == HestonKernel::FLOAT)
+		checkPrecision();
+
+	/**
+	 * @brief Read the counters of the workers, the endpoint serves them from now on
+	 */
+	if(!settings.metrics.empty() || !settings.metricsListen.empty()){
+		metrics = new HestonMetrics(NUM_PROC);
+		for(int i=0; i<NUM_PROC; i++){
+			metrics->attach(i, &workers[i]->getCounters());
+		}
+		if(!settings.metricsListen.empty() && !metrics->listen(settings.metricsListen))
+			logger->Error("Metrics: unable to listen on [%s]", settings.metricsListen.c_str());
+		metricsTime = std::chrono::steady_clock::now();
+	}
+
+	/**
+	 * @brief Allocate the arena of the training paths, a path and its antithetic twin take two rows
+	 */
+	if(settings.exercises > 0){
+		american = new HestonAmerican(2L * americanBlocks() * WORKERS_SIM, settings.exercises, K, r, T, theta);
+		logger->Warn("LSM: %ld paths x %d exercise dates, arena of %.1f MB",
+			american->getPaths(), american->getDates(), american->getBytes() / 1048576.0);
 	}
 	
 	return RTLIB_OK;
@@ -147,43 +316,236 @@ RTLIB_ExitCode_t HestonFour::onConfigure(int8_t awm_id) {
 		exc_name.c_str(), awm_id, proc_quota, proc_nr, mem);
 
 	WORKERS = proc_nr;
+	if(WORKERS > NUM_PROC)
+		WORKERS = NUM_PROC;
+	if(WORKERS < 1)
+		WORKERS = 1;
+
+	// Pin the pool threads to the CPUs granted by the RTRM
+	std::vector<int> cpus = HestonPool::allowedCpus();
+	pool->setAffinity(cpus);
+	logger->Notice("HestonFour::onConfigure(): %d workers pinned over %d CPUs",
+		WORKERS, (int) cpus.size());
+
+	if(metrics != NULL)
+		metrics->configure(awm_id, WORKERS);
+
+	// The chunks opened from now on take the knobs of the operating point of the AWM, the ones in flight
+	// keep their own
+	HestonOperatingPoint const * point = HestonProfile::find(settings.operatingPoints, awm_id);
+	pointDiscretization = (point != NULL) ? point->discretization : DISCRETIZATION;
+	pointScheme = (point != NULL) ? point->scheme : settings.scheme;
+	pointError = (point != NULL && point->targetError > 0.0) ? point->targetError : settings.targetError;
+	if(point != NULL)
+		logger->Notice("HestonFour::onConfigure(): %d steps, %s scheme, target error %g",
+			pointDiscretization, HestonKernel::schemeName(pointScheme), pointError);
+
+	// The cheaper operating points of the recipe evolve the paths of their chunks in single precision, if it
+	// was accepted
+	FLOAT_ACTIVE = FLOAT_ACCEPTED && std::find(settings.floatAwms.begin(), settings.floatAwms.end(), (int) awm_id)
+		!= settings.floatAwms.end();
+	if(settings.precision == HestonKernel::FLOAT)
+		logger->Notice("HestonFour::onConfigure(): %s precision paths", FLOAT_ACTIVE ? "single" : "double");
 
 	return RTLIB_OK;
 }
 
+/**
+ * @brief	Run a sample of paths through both kernels on the first worker and accept the single precision
+ *		kernel if its bias, with its own confidence interval, stays within a tenth of the standard error
+ *		the run is expected to reach: the target error when the run has one, the error of all its paths
+ *		otherwise. The report gives the bias and the spread of the differences of the samples
+ */
+void HestonFour::checkPrecision() {
+
+	double discount = exp( -(r) * (T) );
+
+	// With operating points the finest single precision one is checked, its paths accumulate the most
+	// roundings
+	int discretization = DISCRETIZATION;
+	HestonKernel::Scheme scheme = settings.scheme;
+	int finest = 0;
+	for(size_t p = 0; p < settings.operatingPoints.size(); p++){
+		HestonOperatingPoint const & point = settings.operatingPoints[p];
+		if(point.precision == HestonKernel::FLOAT && point.discretization > finest){
+			finest = point.discretization;
+			discretization = point.discretization;
+			scheme = point.scheme;
+		}
+	}
+
+	// The sample comes from the block after the last one of the run, its paths are never priced
+	workers[0]->setScheme(scheme);
+	workers[0]->checkPrecision(FLOAT_CHECK_SIM, discretization, pricesToCompute, precisionCheck);
+
+	HestonStats const & reference = precisionCheck.reference;
+	HestonStats const & difference = precisionCheck.difference;
+	if(reference.count < 2){
+		logger->Warn("Precision: no single precision kernel for these settings, double precision paths");
+		return;
+	}
+
+	double expected = (settings.targetError > 0.0) ? settings.targetError / zScore
+		: sqrt(reference.variance() / TODO_SIMULATIONS) * discount;
+	double budget = 0.1 * expected;
+	double bias = difference.mean * discount;
+	double biasError = difference.stdError() * discount;
+	double rms = sqrt(difference.mean * difference.mean + difference.variance()) * discount;
+
+	FLOAT_ACCEPTED = fabs(bias) + zScore * biasError <= budget;
+
+	logger->Warn("Precision: %ld paths on both kernels, double price = %f, float bias = %g, standard error = %g",
+		reference.count, reference.mean * discount, bias, biasError);
+	logger->Warn("Precision: RMS difference of a sample = %g, largest = %g, budget = %g (a tenth of the expected standard error %g)",
+		rms, precisionCheck.largest * discount, budget, expected);
+
+	if(FLOAT_ACCEPTED)
+		logger->Warn("Precision: single precision paths accepted");
+	else
+		logger->Warn("Precision: the bias of the single precision paths is not negligible, double precision paths");
+}
+
+/**
+ * @brief		Log how the run used the single precision kernel and its bias against the final error
+ * @param[in] error	The standard error of the final price
+ */
+void HestonFour::printPrecision(double error) {
+
+	if(settings.precision != HestonKernel::FLOAT || precisionCheck.reference.count < 2)
+		return;
+
+	double bias = precisionCheck.difference.mean * exp( -(r) * (T) );
+	logger->Warn("Precision: single precision %s, %ld cycles of %d, sampled bias = %g (%.3f standard errors of the price)",
+		FLOAT_ACCEPTED ? "accepted" : "rejected", floatCycles, (int) Cycles(), bias, (error > 0.0) ? bias / error : 0.0);
+}
+
 /**
  * @brief	Method used to start the computation of an Option price after our app is configured correctly in onCofigure() method
  */
 RTLIB_ExitCode_t HestonFour::onRun() {
 	RTLIB_WorkingModeParams_t const wmp = WorkingModeParams();
 
-	// Return when all the simulations are done
-	if (DONE_SIMULATIONS >= TODO_SIMULATIONS){
+	if (settings.mlmcLevels > 0)
+		return runLevels();
+
+	if (settings.exercises > 0)
+		return runAmerican();
+
+	// Return when all the blocks are done
+	if (DONE_SIMULATIONS >= pricesToCompute * WORKERS_SIM){
 		
 		return RTLIB_EXC_WORKLOAD_NONE;
 	}
 
-	if(DONE_SIMULATIONS + WORKERS * WORKERS_SIM > TODO_SIMULATIONS) {
-		WORKERS = (TODO_SIMULATIONS - DONE_SIMULATIONS) / WORKERS_SIM;
-		if(WORKERS == 0)
-			WORKERS = 1;
+	// Return as soon as the confidence interval is narrow enough for the current AWM
+	if (pointError > 0.0 && computedPricesIndex > 1) {
+		double price, error;
+		estimate(price, error);
+		if (error > 0.0 && zScore * error <= pointError) {
+			logger->Warn("HestonFour::onRun(): target error %f reached after %d simulations",
+				pointError, DONE_SIMULATIONS);
+			return RTLIB_EXC_WORKLOAD_NONE;
+		}
 	}
 
-	for(int i = 0; i < WORKERS; i++){
-		workers[i]->start(WORKERS_SIM, DISCRETIZATION);
+	// The window holds the next WORKERS blocks to do, split in chunks which the workers steal from each
+	// other. A chunk always runs on the worker of the pool thread which took it
+	int chunksPerBlock = WORKERS_SIM / CHUNK_SIM;
+	long lastChunk = (long) pricesToCompute * chunksPerBlock;
+	long open = 0;
+	for(size_t c = 0; c < window.size(); c++){
+		if(window[c].partial.paths < CHUNK_SIM)
+			open++;
 	}
-	
+	while(open < (long) WORKERS * chunksPerBlock && nextChunk < lastChunk){
+		Chunk chunk;
+		chunk.block = (int) (nextChunk / chunksPerBlock);
+		chunk.first = (int) (nextChunk % chunksPerBlock) * CHUNK_SIM;
+		chunk.discretization = pointDiscretization;
+		chunk.scheme = pointScheme;
+		chunk.precision = FLOAT_ACTIVE ? HestonKernel::FLOAT : HestonKernel::DOUBLE;
+		window.push_back(chunk);
+		nextChunk++;
+		open++;
+	}
+
+	// The tasks of the cycle are the chunks not complete yet, the preempted ones go first
+	std::vector<Chunk*> tasks;
+	for(size_t c = 0; c < window.size(); c++){
+		window[c].task = -1;
+		if(window[c].partial.paths < CHUNK_SIM){
+			window[c].task = (long) tasks.size();
+			tasks.push_back(&window[c]);
+		}
+	}
+
 	for(int i = 0; i < WORKERS; i++){
-		workers[i]->join();
-		DONE_SIMULATIONS += WORKERS_SIM;
-		double temp =  ( ( workers[i]->getCalculus() / (double) ( WORKERS_SIM * 2)) * exp( -(r) * (T) ) );
-		logger->Warn("Worker %d computed price: %f ", i, temp );
+		workers[i]->resume();
+	}
+
+	std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+	scheduler->start(WORKERS, (long) tasks.size(), [this, &tasks](int worker, long task) {
+		Chunk & chunk = *tasks[task];
+		workers[worker]->setScheme((HestonKernel::Scheme) chunk.scheme);
+		workers[worker]->setPrecision((HestonKernel::Precision) chunk.precision);
+		workers[worker]->simulate(chunk.first, CHUNK_SIM, WORKERS_SIM, chunk.discretization, chunk.block, chunk.partial);
+		workers[worker]->collect(chunk.partial);
+	});
+
+	// The chunks are reduced in order as soon as they are done. When the cycle lasts too long the workers
+	// are stopped at their next lane group, the chunks keep their partial results and go on in the next
+	// cycle, after the reconfiguration if any
+	std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() +
+		std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+			std::chrono::duration<double, std::milli>(settings.cycleTime));
+	long confirmed = 0;
+	lastLatency = -1.0;
+	std::chrono::steady_clock::duration wait(0);
 
-		workersFinalSum += workers[i]->getCalculus();
-		computedPrices[computedPricesIndex] = temp;
-		computedPricesIndex++;
+	for(; confirmed < (long) tasks.size(); confirmed++){
+		std::chrono::steady_clock::time_point waiting = std::chrono::steady_clock::now();
+		bool ready = true;
+		if(settings.cycleTime <= 0.0)
+			scheduler->wait(confirmed);
+		else
+			ready = scheduler->wait(confirmed, deadline);
+		wait += std::chrono::steady_clock::now() - waiting;
+		if(!ready)
+			break;
+		reduceWindow(confirmed + 1);
 	}
 
+	if(confirmed < (long) tasks.size()){
+		std::chrono::steady_clock::time_point stop = std::chrono::steady_clock::now();
+		scheduler->cancel();
+		for(int i = 0; i < WORKERS; i++){
+			workers[i]->stop();
+		}
+		scheduler->join();
+
+		std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+		wait += end - stop;
+		double latency = std::chrono::duration<double, std::milli>(end - stop).count();
+		preemptionStats.add(latency);
+		preemptionMax = std::max(preemptionMax, latency);
+		lastLatency = latency;
+		reduceWindow((long) tasks.size());
+	}
+	else {
+		std::chrono::steady_clock::time_point waiting = std::chrono::steady_clock::now();
+		scheduler->join();
+		wait += std::chrono::steady_clock::now() - waiting;
+	}
+
+	imbalanceStats.add(scheduler->getImbalance());
+	steals += scheduler->getSteals();
+	if(FLOAT_ACTIVE)
+		floatCycles++;
+
+	if(metrics != NULL)
+		metrics->cycle(std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count(),
+			std::chrono::duration<double>(wait).count(), scheduler);
+
 	// Do one more cycle
 	logger->Warn("HestonMultiThread::onRun()      : EXC [%s]  @ AWM [%02d]",
 		exc_name.c_str(), wmp.awm_id);
@@ -191,6 +553,440 @@ RTLIB_ExitCode_t HestonFour::onRun() {
 	return RTLIB_OK;
 }
 
+/**
+ * @brief		Reduce the complete chunks at the head of the window. Partial sums are reduced in chunk order,
+ *			so the final price is bit-identical for a given seed, whatever the number of workers, the steals
+ *			and the preemptions are
+ * @param[in] confirmed	The number of tasks of the cycle known to be done, the chunks of the other tasks may
+ *			still be running
+ */
+void HestonFour::reduceWindow(long confirmed) {
+
+	while(!window.empty() && window.front().task < confirmed && window.front().partial.paths == CHUNK_SIM){
+		Chunk const & chunk = window.front();
+		HestonPartial const & partial = chunk.partial;
+
+		// The compensation of the single precision chunks holds the low order bits their sums lost
+		blockSum += partial.sum - partial.compensation;
+		workersFinalSum += partial.sum - partial.compensation;
+		workersStats.merge(partial.stats);
+		controlStats.merge(partial.control);
+		for(int g = 0; g < HESTON_GREEKS; g++){
+			greekStats[g].merge(partial.greeks[g]);
+		}
+		for(size_t n = 0; n < gridStats.size(); n++){
+			gridStats[n].merge(HestonStats::fromSums(partial.paths, partial.gridSums[n], partial.gridSquares[n]));
+		}
+		DONE_SIMULATIONS += CHUNK_SIM;
+
+		if(chunk.first + CHUNK_SIM == WORKERS_SIM){
+			double temp =  ( ( blockSum / (double) ( WORKERS_SIM * 2)) * exp( -(r) * (T) ) );
+			logger->Warn("Block %d computed price: %f ", chunk.block, temp );
+			computedPrices[computedPricesIndex] = temp;
+			computedPricesIndex++;
+			blockSum = 0.0;
+		}
+
+		window.pop_front();
+	}
+}
+
+/**
+ * @brief		Append the parameters which select the paths and their reduction, a run can only resume the
+ *			state of a run with the same ones
+ */
+void HestonFour::putSignature(HestonRecord & record) {
+
+	double parameters[] = { S0, K, r, T, V0, rho, kappa, theta, xi, settings.barrier };
+	int32_t sizes[] = { TODO_SIMULATIONS, DISCRETIZATION, WORKERS_SIM, CHUNK_SIM, pricesToCompute };
+	int32_t modes[] = { settings.kernel, settings.scheme, settings.normal, settings.payoff, settings.qmc,
+		settings.replications, settings.controlVariates, settings.greeks, settings.precision };
+
+	record.put(parameters, sizeof(parameters) / sizeof(parameters[0]));
+	record.put(sizes, sizeof(sizes) / sizeof(sizes[0]));
+	record.put(modes, sizeof(modes) / sizeof(modes[0]));
+	record.putVector(settings.strikes);
+	record.putVector(settings.maturities);
+
+	std::vector<int32_t> points;
+	for(size_t p = 0; p < settings.operatingPoints.size(); p++){
+		HestonOperatingPoint const & point = settings.operatingPoints[p];
+		points.push_back(point.awm);
+		points.push_back(point.discretization);
+		points.push_back(point.scheme);
+		points.push_back(point.precision);
+	}
+	record.putVector(points);
+}
+
+/**
+ * @brief		Append the state of the run: the seed, the signature of the parameters, the accumulators of
+ *			the reduced chunks and the chunks of the window with their partial results. A chunk is the
+ *			position of its random streams, (block, first path + paths done)
+ */
+void HestonFour::saveState(HestonRecord & record) {
+
+	HestonRecord signature;
+	putSignature(signature);
+
+	record.put(settings.seed);
+	record.putVector(signature.data);
+
+	record.put(DONE_SIMULATIONS);
+	record.put(computedPricesIndex);
+	record.put(computedPrices, computedPricesIndex);
+	record.put(workersFinalSum);
+	record.put(blockSum);
+	record.put(nextChunk);
+	record.put(workersStats);
+	record.put(controlStats);
+	record.put(greekStats, HESTON_GREEKS);
+	record.putVector(gridStats);
+
+	record.put((uint64_t) window.size());
+	for(size_t c = 0; c < window.size(); c++){
+		HestonPartial const & partial = window[c].partial;
+		record.put(window[c].block);
+		record.put(window[c].first);
+		record.put(window[c].discretization);
+		record.put(window[c].scheme);
+		record.put(window[c].precision);
+		record.put(partial.paths);
+		record.put(partial.sum);
+		record.put(partial.compensation);
+		record.put(partial.stats);
+		record.put(partial.control);
+		record.put(partial.greeks, HESTON_GREEKS);
+		record.putVector(partial.gridSums);
+		record.putVector(partial.gridSquares);
+	}
+}
+
+/**
+ * @brief		Restore the state saved by saveState(), the seed comes from the state
+ * @return		false if the state is truncated or was saved with other parameters
+ */
+bool HestonFour::restoreState(HestonRecord & record) {
+
+	uint64_t seed;
+	std::vector<char> signature;
+	HestonRecord expected;
+	putSignature(expected);
+
+	if(!record.get(seed) || !record.getVector(signature) || signature != expected.data)
+		return false;
+
+	int index;
+	uint64_t chunks;
+	if(!record.get(DONE_SIMULATIONS) || !record.get(index) || index < 0 || index > pricesToCompute
+			|| !record.get(computedPrices, index))
+		return false;
+	computedPricesIndex = index;
+
+	std::vector<HestonStats> grid;
+	if(!record.get(workersFinalSum) || !record.get(blockSum) || !record.get(nextChunk) || !record.get(workersStats)
+			|| !record.get(controlStats) || !record.get(greekStats, HESTON_GREEKS)
+			|| !record.getVector(grid) || grid.size() != gridStats.size() || !record.get(chunks))
+		return false;
+	gridStats = grid;
+
+	window.clear();
+	for(uint64_t c = 0; c < chunks; c++){
+		Chunk chunk;
+		HestonPartial & partial = chunk.partial;
+		if(!record.get(chunk.block) || !record.get(chunk.first) || !record.get(chunk.discretization)
+				|| !record.get(chunk.scheme) || !record.get(chunk.precision) || !record.get(partial.paths) || !record.get(partial.sum)
+				|| !record.get(partial.compensation) || !record.get(partial.stats) || !record.get(partial.control) || !record.get(partial.greeks, HESTON_GREEKS)
+				|| !record.getVector(partial.gridSums) || !record.getVector(partial.gridSquares))
+			return false;
+		window.push_back(chunk);
+	}
+
+	settings.seed = seed;
+	return true;
+}
+
+/**
+ * @brief		Save the state of the run in the state file. It runs between two cycles, the workers wait
+ *			for the next one anyway and the pages are flushed in the background
+ */
+void HestonFour::writeCheckpoint() {
+
+	std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+
+	HestonRecord record;
+	saveState(record);
+	if(!checkpoint->save(record)){
+		logger->Error("Checkpoint [%s]: unable to save the state", checkpoint->getPath().c_str());
+		return;
+	}
+
+	checkpointTime = std::chrono::steady_clock::now();
+	double elapsed = std::chrono::duration<double, std::milli>(checkpointTime - begin).count();
+	checkpointStats.add(elapsed);
+	logger->Info("Checkpoint [%s]: record %lu, %zu bytes in %.3f ms", checkpoint->getPath().c_str(),
+		(unsigned long) checkpoint->getSequence(), record.data.size(), elapsed);
+}
+
+/**
+ * @brief	Write the metrics file, if any
+ */
+void HestonFour::writeMetrics() {
+
+	metricsTime = std::chrono::steady_clock::now();
+	if(!settings.metrics.empty() && !metrics->write(settings.metrics))
+		logger->Error("Metrics: unable to write [%s]", settings.metrics.c_str());
+}
+
+/**
+ * @brief	Multilevel Monte Carlo cycle: every worker runs a block of the level which misses the most paths.
+ *		When all the levels reached their target, the targets are updated with the current variances
+ *		and the run ends if no level needs more paths
+ */
+RTLIB_ExitCode_t HestonFour::runLevels() {
+
+	int levels = settings.mlmcLevels;
+	std::vector<long> planned(levels);
+	bool pending = false;
+
+	for(int l = 0; l < levels; l++){
+		planned[l] = (long) levelBlocks[l] * levelBlockSize(l);
+		pending = pending || planned[l] < levelTarget[l];
+	}
+
+	if(!pending){
+		updateLevelTargets();
+		for(int l = 0; l < levels; l++)
+			pending = pending || planned[l] < levelTarget[l];
+	}
+
+	if(!pending){
+		logger->Warn("HestonFour::runLevels(): RMSE %f reached after %d simulations",
+			settings.mlmcRmse, DONE_SIMULATIONS);
+		return RTLIB_EXC_WORKLOAD_NONE;
+	}
+
+	// Blocks of level l use the streams (l << 24 | block), independent across levels
+	std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+	std::vector<int> level(WORKERS, -1);
+	for(int i = 0; i < WORKERS; i++){
+		int best = -1;
+		long most = 0;
+		for(int l = 0; l < levels; l++){
+			if(levelTarget[l] - planned[l] > most){
+				most = levelTarget[l] - planned[l];
+				best = l;
+			}
+		}
+		if(best < 0)
+			break;
+
+		level[i] = best;
+		planned[best] += levelBlockSize(best);
+		workers[i]->startLevel(best, levelBlockSize(best), levelDiscretization(best), (best << 24) | levelBlocks[best]);
+		levelBlocks[best]++;
+	}
+
+	// The blocks of a level are merged in block order
+	std::chrono::steady_clock::time_point waiting = std::chrono::steady_clock::now();
+	for(int i = 0; i < WORKERS; i++){
+		if(level[i] < 0)
+			continue;
+		workers[i]->join();
+		levelStats[level[i]].merge(workers[i]->getStats());
+		DONE_SIMULATIONS += levelBlockSize(level[i]);
+		levelSteps += levelBlockSize(level[i]) * levelCost(level[i]);
+	}
+
+	if(metrics != NULL){
+		std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+		metrics->cycle(std::chrono::duration<double>(end - begin).count(),
+			std::chrono::duration<double>(end - waiting).count(), NULL);
+	}
+
+	return RTLIB_OK;
+}
+
+/**
+ * @brief	Longstaff-Schwartz cycle. The training blocks fill the path store, then a cycle runs the backward
+ *		regression and the independent blocks price the fitted exercise rule. Those use the streams
+ *		(1 << 30 | block), which the training set never reads
+ */
+RTLIB_ExitCode_t HestonFour::runAmerican() {
+
+	int blocks = americanBlocks();
+
+	if(!americanTrained && americanBlock >= blocks){
+		regressAmerican();
+		americanTrained = true;
+		americanBlock = 0;
+		return RTLIB_OK;
+	}
+
+	if(americanTrained && americanBlock >= blocks)
+		return RTLIB_EXC_WORKLOAD_NONE;
+
+	// The lower bound stops as soon as its confidence interval is narrow enough
+	if(americanTrained && settings.targetError > 0.0 && americanStats.count > 1 &&
+			zScore * americanStats.stdError() <= settings.targetError){
+		logger->Warn("HestonFour::runAmerican(): target error %f reached after %ld simulations",
+			settings.targetError, americanStats.count);
+		return RTLIB_EXC_WORKLOAD_NONE;
+	}
+
+	std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+	int started = std::min(WORKERS, blocks - americanBlock);
+	for(int i = 0; i < started; i++){
+		int block = americanBlock + i;
+		workers[i]->startAmerican(american, !americanTrained, WORKERS_SIM, DISCRETIZATION,
+			americanTrained ? ((1 << 30) | block) : block);
+	}
+
+	std::chrono::steady_clock::time_point waiting = std::chrono::steady_clock::now();
+	for(int i = 0; i < started; i++){
+		workers[i]->join();
+		if(americanTrained)
+			americanStats.merge(workers[i]->getStats());
+		else
+			DONE_SIMULATIONS += WORKERS_SIM;
+	}
+	americanBlock += started;
+
+	if(metrics != NULL){
+		std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+		metrics->cycle(std::chrono::duration<double>(end - begin).count(),
+			std::chrono::duration<double>(end - waiting).count(), NULL);
+	}
+
+	return RTLIB_OK;
+}
+
+/**
+ * @brief	The number of blocks of each Longstaff-Schwartz path set
+ */
+int HestonFour::americanBlocks() {
+	return std::max(1, (TODO_SIMULATIONS + WORKERS_SIM - 1) / WORKERS_SIM);
+}
+
+/**
+ * @brief	Backward regression over the exercise dates. Every worker slot accumulates the normal equations
+ *		of a range of paths, the ranges are added in slot order (the coefficients do not depend on the
+ *		timing) and every slot then applies the exercise rule to its range
+ */
+void HestonFour::regressAmerican() {
+
+	std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+
+	long paths = american->getPaths();
+	long chunk = (paths + WORKERS - 1) / WORKERS;
+	std::vector<double> sums(WORKERS * LSM_SUMS);
+	double total[LSM_SUMS];
+
+	for(int date = american->getDates() - 2; date >= 0; date--){
+
+		for(int i = 0; i < WORKERS; i++){
+			long first = std::min(paths, i * chunk);
+			long count = std::min(chunk, paths - first);
+			double * partial = sums.data() + i * LSM_SUMS;
+			pool->post(i, [this, date, first, count, partial]() {
+				american->accumulate(date, first, count, partial);
+			});
+		}
+
+		std::fill(total, total + LSM_SUMS, 0.0);
+		for(int i = 0; i < WORKERS; i++){
+			pool->join(i);
+			for(int k = 0; k < LSM_SUMS; k++)
+				total[k] += sums[i * LSM_SUMS + k];
+		}
+
+		american->regress(date, total);
+
+		for(int i = 0; i < WORKERS; i++){
+			long first = std::min(paths, i * chunk);
+			long count = std::min(chunk, paths - first);
+			pool->post(i, [this, date, first, count]() {
+				american->exercise(date, first, count);
+			});
+		}
+		for(int i = 0; i < WORKERS; i++)
+			pool->join(i);
+	}
+
+	regressionTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+	logger->Warn("LSM: backward regression of %d dates over %ld paths in %.1f ms (%d workers), in-sample price = %f",
+		american->getDates() - 1, paths, 1000.0 * regressionTime, WORKERS, american->price());
+}
+
+/**
+ * @brief	Optimal number of paths of each level for the requested RMSE (Giles, 2008): half of the mean square
+ *		error goes to the variance, N_l = 2 / eps^2 sqrt(V_l / C_l) sum_k sqrt(V_k C_k). Targets never shrink
+ */
+void HestonFour::updateLevelTargets() {
+
+	int levels = settings.mlmcLevels;
+	double discount = exp( -(r) * (T) );
+	double epsilon2 = settings.mlmcRmse * settings.mlmcRmse;
+	double sum = 0.0;
+
+	for(int l = 0; l < levels; l++){
+		sum += sqrt(levelStats[l].variance() * discount * discount * levelCost(l));
+	}
+
+	for(int l = 0; l < levels; l++){
+		double variance = levelStats[l].variance() * discount * discount;
+		long target = (long) ceil(2.0 / epsilon2 * sqrt(variance / levelCost(l)) * sum);
+		levelTarget[l] = std::max(levelTarget[l], target);
+	}
+}
+
+/**
+ * @brief	The number of paths of a block: the finer the level, the smaller the block, so that all the blocks
+ *		cost about the same
+ */
+int HestonFour::levelBlockSize(int level) {
+	return std::max(MLMC_MIN_BLOCK, WORKERS_SIM >> level);
+}
+
+/**
+ * @brief	The number of steps of the fine paths of a level, the finest level uses DISCRETIZATION steps
+ */
+int HestonFour::levelDiscretization(int level) {
+	return std::max(1, DISCRETIZATION >> (settings.mlmcLevels - 1 - level));
+}
+
+/**
+ * @brief	The step evaluations of a sample of a level, fine plus coarse path
+ */
+double HestonFour::levelCost(int level) {
+	return levelDiscretization(level) * ((level > 0) ? 1.5 : 1.0);
+}
+
+/**
+ * @brief	Log the statistics of the levels, the weak error estimate and the cost against a single-level
+ *		simulation with the finest discretization and the same variance budget
+ */
+void HestonFour::printLevels() {
+
+	int levels = settings.mlmcLevels;
+	double discount = exp( -(r) * (T) );
+
+	for(int l = 0; l < levels; l++){
+		logger->Warn("Level %d: %d steps, %ld paths, mean = %f, variance = %e",
+			l, levelDiscretization(l), levelStats[l].count, levelStats[l].mean * discount,
+			levelStats[l].variance() * discount * discount);
+	}
+
+	// First order weak convergence: the bias is about the mean correction of the finest level
+	double bias = fabs(levelStats[levels - 1].mean) * discount;
+	if(bias > settings.mlmcRmse * M_SQRT1_2)
+		logger->Warn("MLMC: estimated bias %f above the RMSE budget, more levels are needed", bias);
+
+	double single = 2.0 * levelStats[0].variance() * discount * discount / (settings.mlmcRmse * settings.mlmcRmse) * DISCRETIZATION;
+	logger->Warn("MLMC: %e step evaluations, single level at %d steps: %e (%.1fx), estimated bias = %f",
+		levelSteps, DISCRETIZATION, single, (levelSteps > 0.0) ? single / levelSteps : 0.0, bias);
+}
+
 /**
  * @brief	After every onRun(), this method will be executed and print the updated result
  */
@@ -200,12 +996,180 @@ RTLIB_ExitCode_t HestonFour::onMonitor() {
 	logger->Warn("HestonFour::onMonitor()  : EXC [%s]  @ AWM [%02d], Cycle [%4d]",
 		exc_name.c_str(), wmp.awm_id, Cycles());
 
-	threadFinalPrice = ( ( workersFinalSum / (double) ((DONE_SIMULATIONS * 2))) * exp( -(r) * (T) ) );
+	threadFinalPrice = (DONE_SIMULATIONS > 0) ? ( ( workersFinalSum / (double) ((DONE_SIMULATIONS * 2))) * exp( -(r) * (T) ) ) : 0.0;
 	logger->Warn("ON_MONITOR: Price updated: %f", threadFinalPrice);
 
+	double price, error;
+	estimate(price, error);
+	logger->Warn("ON_MONITOR: Standard error: %f, %.1f%% confidence interval: [%f, %f]",
+		error, 100.0 * settings.confidence, price - zScore * error, price + zScore * error);
+
+	printGrid(false);
+	printGreeks(false);
+
+	if(scheduler->getWorkers() > 0 && imbalanceStats.count > 0)
+		logger->Warn("ON_MONITOR: Load imbalance %.1f%% (mean %.1f%%), %ld steals in the last cycle",
+			100.0 * scheduler->getImbalance(), 100.0 * imbalanceStats.mean, scheduler->getSteals());
+
+	if(lastLatency >= 0.0)
+		logger->Warn("ON_MONITOR: Cycle preempted after %.1f ms, workers stopped in %.3f ms, %d chunks in flight",
+			settings.cycleTime, lastLatency, (int) window.size());
+
+	if(checkpoint != NULL && std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - checkpointTime).count()
+			>= settings.checkpointInterval)
+		writeCheckpoint();
+
+	if(metrics != NULL){
+		metrics->estimate(price, error);
+		if(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - metricsTime).count()
+				>= settings.metricsInterval)
+			writeMetrics();
+	}
+
 	return RTLIB_OK;
 }
 
+/**
+ * @brief		Log the Greeks estimated with the price, with their standard errors. The full report adds
+ *			the confidence intervals and the central differences of the Fourier price as a reference
+ * @param[in] full	Log the full report instead of the summary
+ */
+void HestonFour::printGreeks(bool full) {
+
+	if(!settings.greeks)
+		return;
+
+	const char* names[HESTON_GREEKS] = { "Delta", "Gamma", "Vega", "Rho" };
+	double references[HESTON_GREEKS] = { 0.0, 0.0, 0.0, 0.0 };
+
+	if(full)
+		HestonFourier(S0, r, V0, rho, kappa, theta, xi).callGreeks(K, T, references);
+
+	for(int g = 0; g < HESTON_GREEKS; g++){
+		double value = greekStats[g].mean;
+		double error = greekStats[g].stdError();
+
+		if(!full)
+			logger->Warn("ON_MONITOR: %s = %f, standard error = %f", names[g], value, error);
+		else
+			logger->Warn("%s = %f, standard error = %f, %.1f%% confidence interval: [%f, %f], Fourier = %f",
+				names[g], value, error, 100.0 * settings.confidence, value - zScore * error, value + zScore * error,
+				references[g]);
+	}
+}
+
+/**
+ * @brief		Log the prices of the grid nodes, discounted from the time at which each maturity is
+ *			observed. The summary only reports the widest standard error of the grid
+ * @param[in] full	Log every node instead of the summary
+ */
+void HestonFour::printGrid(bool full) {
+
+	if(gridStats.empty())
+		return;
+
+	size_t strikes = settings.strikes.size();
+	double widest = 0.0;
+
+	HestonFourier pricer(S0, r, V0, rho, kappa, theta, xi);
+	std::vector<double> references(strikes, 0.0);
+
+	double horizon = settings.pathTime(T);
+
+	for(size_t m = 0; m < settings.maturities.size(); m++){
+		int step = HestonSettings::maturityStep(settings.maturities[m], horizon, DISCRETIZATION);
+		double discount = exp( -(r) * (horizon * step / DISCRETIZATION) );
+
+		if(full && settings.european())
+			pricer.callGrid(settings.maturities[m], settings.strikes, references);
+
+		for(size_t k = 0; k < strikes; k++){
+			HestonStats const & node = gridStats[m * strikes + k];
+			double price = node.mean * discount;
+			double error = node.stdError() * discount;
+			widest = std::max(widest, error);
+
+			if(full)
+				logger->Warn("Grid T = %f, K = %f: price = %f, standard error = %f, %.1f%% confidence interval: [%f, %f], Fourier price = %f",
+					settings.maturities[m], settings.strikes[k], price, error, 100.0 * settings.confidence,
+					price - zScore * error, price + zScore * error, references[k]);
+		}
+	}
+
+	if(!full)
+		logger->Warn("ON_MONITOR: Grid of %d nodes, widest standard error: %f", (int) gridStats.size(), widest);
+}
+
+/**
+ * @brief		Return the current price estimate and its standard error. In Monte Carlo mode the error comes
+ *			from the merged running statistics of the workers, or from the regression residuals when the
+ *			control variates are on. In QMC mode it comes from the spread of the randomized replications,
+ *			thus only the complete rounds of blocks (one per replication) are used
+ * @param[out] price	The discounted price
+ * @param[out] error	The standard error of the price, 0 when it cannot be estimated yet
+ */
+void HestonFour::estimate(double & price, double & error) {
+
+	double discount = exp( -(r) * (T) );
+
+	// Longstaff-Schwartz: the independent paths, already discounted, or the training ones until they exist
+	if(settings.exercises > 0){
+		price = americanStats.count > 0 ? americanStats.mean : (american != NULL && americanTrained ? american->price() : 0.0);
+		error = americanStats.stdError();
+		return;
+	}
+
+	// Multilevel Monte Carlo: telescoping sum of the level means, the levels are independent
+	if(settings.mlmcLevels > 0){
+		double variance = 0.0;
+		price = 0.0;
+		for(size_t l = 0; l < levelStats.size(); l++){
+			price += levelStats[l].mean;
+			if(levelStats[l].count > 1)
+				variance += levelStats[l].variance() / levelStats[l].count;
+		}
+		price *= discount;
+		error = sqrt(variance) * discount;
+		return;
+	}
+
+	price = workersStats.mean * discount;
+	error = workersStats.stdError() * discount;
+
+	if(settings.controlVariates && controlStats.count > 0){
+		controlStats.estimate(controlExpected, price, error);
+		price *= discount;
+		error *= discount;
+	}
+
+	if(!settings.qmc)
+		return;
+
+	int replications = settings.replications;
+	int rounds = computedPricesIndex / replications;
+	error = 0.0;
+	if(rounds == 0)
+		return;
+
+	double mean = 0.0;
+	double squares = 0.0;
+
+	for(int j=0; j < replications; j++){
+		double replicationPrice = 0.0;
+		for(int i=j; i < rounds * replications; i += replications){
+			replicationPrice += computedPrices[i];
+		}
+		replicationPrice /= rounds;
+
+		mean += replicationPrice;
+		squares += replicationPrice * replicationPrice;
+	}
+
+	mean /= replications;
+	price = mean;
+	error = sqrt(std::max(0.0, (squares - replications * mean * mean) / (replications - 1)) / replications);
+}
+
 /**
  * @brief	Called when the application is closing itself. This method does all the closing operations, such as the deallocation
  *		of the dynamic memory
@@ -214,15 +1178,77 @@ RTLIB_ExitCode_t HestonFour::onRelease() {
 
 	logger->Warn("HestonFour::onRelease()  : exit");
 	
-	for(int i=0; i < this->pricesToCompute; i++){
+	for(int i=0; i < this->computedPricesIndex; i++){
 		
 		logger->Warn("Price %d = %f", i, computedPrices[i]);		
 	} 
 
+	double price, error;
+	estimate(price, error);
+	logger->Warn("Final price = %f, standard error = %f, %.1f%% confidence interval: [%f, %f] (%d simulations%s)",
+		price, error, 100.0 * settings.confidence, price - zScore * error, price + zScore * error,
+		DONE_SIMULATIONS, settings.qmc ? ", QMC" : "");
+
+	// The Monte Carlo engine validates the Fourier one on the payoffs both can price
+	if(settings.european()){
+		HestonFourier pricer(S0, r, V0, rho, kappa, theta, xi);
+		double reference = pricer.call(K, T);
+		logger->Warn("Fourier price = %f, Monte Carlo difference = %f (%.2f standard errors)",
+			reference, price - reference, (error > 0.0) ? (price - reference) / error : 0.0);
+	}
+
+	printGrid(true);
+	printGreeks(true);
+	printPrecision(error);
+
+	if(settings.mlmcLevels > 0)
+		printLevels();
+
+	// The in-sample price is biased high and the independent one low, the European put bounds both below
+	if(american != NULL){
+		HestonFourier pricer(S0, r, V0, rho, kappa, theta, xi);
+		double european = pricer.call(K, T) - S0 + K * exp(-r * T);
+		logger->Warn("LSM: in-sample price = %f, independent (lower bound) price = %f, European put = %f, early exercise premium = %f",
+			americanTrained ? american->price() : 0.0, price, european, price - european);
+		logger->Warn("LSM: arena of %.1f MB (%zu bytes, %ld paths x %d dates), regression time %.1f ms",
+			american->getBytes() / 1048576.0, american->getBytes(), american->getPaths(), american->getDates(),
+			1000.0 * regressionTime);
+		delete american;
+		american = NULL;
+	}
+
+	if(imbalanceStats.count > 0)
+		logger->Warn("Scheduler: mean load imbalance %.1f%% over %ld cycles, %ld chunks stolen",
+			100.0 * imbalanceStats.mean, imbalanceStats.count, steals);
+
+	if(preemptionStats.count > 0)
+		logger->Warn("Preemption: %ld cycles preempted, stop latency mean %.3f ms, max %.3f ms",
+			preemptionStats.count, preemptionStats.mean, preemptionMax);
+
+	if(checkpoint != NULL){
+		writeCheckpoint();
+		logger->Warn("Checkpoint [%s]: %ld saves, mean %.3f ms, last record %lu (%zu bytes mapped)",
+			checkpoint->getPath().c_str(), checkpointStats.count, checkpointStats.mean,
+			(unsigned long) checkpoint->getSequence(), checkpoint->getBytes());
+		delete checkpoint;
+		checkpoint = NULL;
+	}
+
+	// The endpoint reads the counters of the workers, it stops before they are deleted
+	if(metrics != NULL){
+		metrics->estimate(price, error);
+		writeMetrics();
+		metrics->close();
+		delete metrics;
+		metrics = NULL;
+	}
+
+	delete scheduler;
 	for(int i=0; i<NUM_PROC; i++){
 		delete workers[i];
 	}
 	delete[] workers;
+	delete pool;
 
 	return RTLIB_OK;
 }
@@ -14,11 +14,20 @@
  * =====================================================================================
  */
 
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <csignal>
 #include <cstdio>
+#include <cstdlib>
 #include <iostream>
 #include <random>
 #include <cstring>
+#include <fstream>
 #include <memory>
+#include <sstream>
+#include <thread>
+#include <vector>
 
 #include <libgen.h>
 
@@ -27,7 +36,10 @@
 #include <boost/program_options/variables_map.hpp>
 
 #include "version.h"
+#include "HestonBatch_exc.h"
 #include "HestonFour_exc.h"
+#include "HestonFourier.h"
+#include "HestonCalibration.h"
 #include <bbque/utils/utility.h>
 #include <bbque/utils/logging/logger.h>
 
@@ -95,6 +107,173 @@ double xi;
 int N_SIM;
 int DISCR;
 
+/**
+ * @brief Settings of the simulation engine, filled from the command line
+ */
+HestonSettings settings;
+std::string kernel;
+std::string normal;
+uint64_t seed;
+
+std::string strikes;
+std::string maturities;
+std::string engine;
+std::string scheme;
+std::string payoff;
+std::string precision;
+std::string floatAwms;
+std::string awmFile;
+
+#ifdef HESTON_REPLAY
+/**
+ * @brief The trace of working modes and resources replayed by the RTLib stand-in, and its report
+ */
+std::string trace;
+std::string report;
+#endif
+
+/**
+ * @brief The source of the requests of the batch pricing mode, their format and the requests of a cycle
+ */
+std::string serve;
+std::string serveFormat;
+int serveBatch;
+
+std::string surface;
+std::string calibrationError;
+int calibrationIterations;
+
+/**
+ * @brief		Parse a comma separated list of positive values, the invalid entries are skipped
+ */
+std::vector<double> ParseList(std::string const & list) {
+	std::vector<double> values;
+	std::stringstream stream(list);
+	std::string item;
+
+	while (std::getline(stream, item, ',')) {
+		char *end;
+		double value = strtod(item.c_str(), &end);
+		if (end != item.c_str() && value > 0.0)
+			values.push_back(value);
+		else if (!item.empty())
+			std::cout << "Skipping invalid grid value: " << item << std::endl;
+	}
+
+	return values;
+}
+
+/**
+ * @brief		Parse a comma separated list of AWM ids, the invalid entries are skipped
+ */
+std::vector<int> ParseAwms(std::string const & list) {
+	std::vector<int> values;
+	std::stringstream stream(list);
+	std::string item;
+
+	while (std::getline(stream, item, ',')) {
+		char *end;
+		long value = strtol(item.c_str(), &end, 10);
+		if (end != item.c_str() && value >= 0 && value < 256)
+			values.push_back((int) value);
+		else if (!item.empty())
+			std::cout << "Skipping invalid AWM id: " << item << std::endl;
+	}
+
+	return values;
+}
+
+/**
+ * @brief		Return the options given on the command line which only the Monte Carlo engine applies, comma
+ *			separated (empty when there is none)
+ */
+std::string MonteCarloOptions() {
+	static char const * const options[] = { "sims", "discr", "kernel", "normal", "seed", "scheme", "precision",
+		"float-awms", "awm-file", "qmc", "control-variates", "target-error", "mlmc-levels", "cycle-ms",
+		"checkpoint", "resume" };
+	std::string given;
+
+	for (size_t o = 0; o < sizeof(options) / sizeof(options[0]); o++) {
+		if (opts_vm.count(options[o]) && !opts_vm[options[o]].defaulted())
+			given += (given.empty() ? "--" : ", --") + std::string(options[o]);
+	}
+
+	return given;
+}
+
+/**
+ * @brief		Price the option (and the grid) with the Fourier engine, no RTRM resources are needed
+ */
+int RunFourier() {
+	HestonFourier pricer(S0, r, V0, rho, kappa, theta, xi);
+
+	logger->Info("Fourier engine: S0 = %f, r = %f, V0 = %f, rho = %f, kappa = %f, theta = %f, xi = %f",
+		S0, r, V0, rho, kappa, theta, xi);
+	logger->Warn("Final price = %f (K = %f, T = %f, Fourier)", pricer.call(K, T), K, T);
+
+	if (settings.greeks) {
+		double greeks[HESTON_GREEKS];
+		pricer.callGreeks(K, T, greeks);
+		logger->Warn("Delta = %f, Gamma = %f, Vega = %f, Rho = %f (Fourier)",
+			greeks[GREEK_DELTA], greeks[GREEK_GAMMA], greeks[GREEK_VEGA], greeks[GREEK_RHO]);
+	}
+
+	if (!settings.grid())
+		return EXIT_SUCCESS;
+
+	std::vector<double> prices;
+	for (size_t m = 0; m < settings.maturities.size(); m++) {
+		pricer.callGrid(settings.maturities[m], settings.strikes, prices);
+		for (size_t k = 0; k < prices.size(); k++) {
+			logger->Warn("Grid T = %f, K = %f: price = %f",
+				settings.maturities[m], settings.strikes[k], prices[k]);
+		}
+	}
+
+	return EXIT_SUCCESS;
+}
+
+/**
+ * @brief		Fit V0, kappa, theta, xi and rho to the surface file, the fit replaces the command line
+ *			parameters of the pricing which follows. The pool is used only for the calibration
+ */
+int RunCalibration() {
+	HestonPool pool(std::max(1u, std::thread::hardware_concurrency()));
+	HestonCalibration calibration(S0, r, &pool);
+	HestonCalibration::Error error = HestonCalibration::parseError(calibrationError);
+
+	int quotes = calibration.load(surface);
+	if (quotes < 0) {
+		logger->Error("Unable to read the surface file [%s]", surface.c_str());
+		return EXIT_FAILURE;
+	}
+	if (quotes < HESTON_PARAMETERS) {
+		logger->Error("The surface [%s] has %d quotes, at least %d are needed", surface.c_str(), quotes, HESTON_PARAMETERS);
+		return EXIT_FAILURE;
+	}
+
+	double parameters[HESTON_PARAMETERS] = { V0, kappa, theta, xi, rho };
+
+	auto start = std::chrono::steady_clock::now();
+	calibration.calibrate(parameters, error, calibrationIterations);
+	double elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+	V0 = parameters[0];
+	kappa = parameters[1];
+	theta = parameters[2];
+	xi = parameters[3];
+	rho = parameters[4];
+
+	logger->Warn("Calibration to %d quotes (%s error, %d threads): %d iterations in %.1f ms",
+		quotes, HestonCalibration::errorName(error), pool.size(), calibration.getIterations(), elapsed);
+	logger->Warn("Calibrated V0 = %f, kappa = %f, theta = %f, xi = %f, rho = %f%s",
+		V0, kappa, theta, xi, rho, (2.0 * kappa * theta > xi * xi) ? "" : " (Feller condition violated)");
+	logger->Warn("Calibration RMSE: price = %f, implied volatility = %f",
+		calibration.getPriceRmse(), calibration.getVolatilityRmse());
+
+	return EXIT_SUCCESS;
+}
+
 void ParseCommandLine(int argc, char *argv[]) {
 	// Parse command line params
 	try {
@@ -180,6 +359,105 @@ int main(int argc, char *argv[]) {
 		("xi,x", po::value<double>(&xi)->
 			default_value(1.0),
 			"Volatility of volatility")
+
+		("engine", po::value<std::string>(&engine)->
+			default_value("auto"),
+			"Pricing engine [auto, fourier, mc], auto prices the European calls with the Fourier engine unless a Monte Carlo option is given")
+		("kernel", po::value<std::string>(&kernel)->
+			default_value("auto"),
+			"Path kernel [auto, scalar, sse2, avx2, avx512]")
+		("precision", po::value<std::string>(&precision)->
+			default_value("double"),
+			"Path evolution precision [double, float], float runs on the --float-awms once a sample shows its bias is negligible")
+		("float-awms", po::value<std::string>(&floatAwms)->
+			default_value("2"),
+			"Comma separated AWMs of the recipe which evolve the paths in single precision")
+		("awm-file", po::value<std::string>(&awmFile),
+			"Operating points written by hestonfour_profile: the discretization, scheme, precision and target error of the paths of each AWM of its recipe")
+		("payoff", po::value<std::string>(&payoff)->
+			default_value("call"),
+			"Payoff [call, asian, geometric, upout, upin, downout, downin, lookback]")
+		("barrier,B", po::value<double>(&settings.barrier)->
+			default_value(0.0),
+			"Barrier level of the upout, upin, downout and downin calls")
+		("american", po::value<int>(&settings.exercises)->
+			default_value(0),
+			"Price an American put with this number of exercise dates by Longstaff-Schwartz (0: disabled)")
+		("scheme", po::value<std::string>(&scheme)->
+			default_value("euler"),
+			"Variance discretization [euler (full truncation), logeuler, qe (Andersen)]")
+		("normal", po::value<std::string>(&normal)->
+			default_value("boxmuller"),
+			"Normal generator [boxmuller, ziggurat, as241, legacy]")
+		("seed", po::value<uint64_t>(&seed),
+			"Random seed, a given seed always gives the same price (default: random)")
+		("qmc", "quasi-Monte Carlo mode: scrambled Sobol points with Brownian bridge")
+		("qmc-replications", po::value<int>(&settings.replications)->
+			default_value(16),
+			"Number of randomized QMC replications, used for the error estimate")
+		("target-error", po::value<double>(&settings.targetError)->
+			default_value(0.0),
+			"Stop when the confidence interval half-width is below this value (0: disabled)")
+		("confidence", po::value<double>(&settings.confidence)->
+			default_value(0.95),
+			"Confidence level of the reported interval")
+		("mlmc-levels", po::value<int>(&settings.mlmcLevels)->
+			default_value(0),
+			"Multilevel Monte Carlo with levels of discr / 2^l steps (0: disabled)")
+		("mlmc-rmse", po::value<double>(&settings.mlmcRmse)->
+			default_value(0.05),
+			"Root mean square error requested to the multilevel Monte Carlo engine")
+		("cycle-ms", po::value<double>(&settings.cycleTime)->
+			default_value(200.0),
+			"Longest duration of a Monte Carlo cycle in ms, a resource change waits at most this long (0: one cycle per block of each worker)")
+		("serve", po::value<std::string>(&serve),
+			"Batch pricing mode: price the requests of - (standard input), a file or unix:PATH (a local socket) until the stream ends, --sims and --discr are the defaults of a request")
+		("serve-format", po::value<std::string>(&serveFormat)->
+			default_value("csv"),
+			"Format of the requests and of the replies [csv, binary]")
+		("serve-batch", po::value<int>(&serveBatch)->
+			default_value(64),
+			"Largest number of requests priced in a cycle")
+		("cache", po::value<std::string>(&settings.cache),
+			"Result cache of the batch pricing mode: a request goes on from the paths of its cached entry, which needs a fixed --seed")
+		("cache-size", po::value<int>(&settings.cacheSize)->
+			default_value(100000),
+			"Largest number of entries of the result cache")
+		("metrics", po::value<std::string>(&settings.metrics),
+			"JSON file of the metrics of the workers and of the cycles, rewritten periodically")
+		("metrics-listen", po::value<std::string>(&settings.metricsListen),
+			"Serve the metrics in the Prometheus text format on unix:PATH or on a TCP port of the loopback interface")
+		("metrics-interval", po::value<double>(&settings.metricsInterval)->
+			default_value(1000.0),
+			"Time between two writes of the --metrics file in ms")
+		("checkpoint", po::value<std::string>(&settings.checkpoint),
+			"State file of the Monte Carlo run, saved periodically: a killed run can be resumed from it")
+		("checkpoint-interval", po::value<double>(&settings.checkpointInterval)->
+			default_value(1000.0),
+			"Time between two saves of the state file in ms")
+		("resume", "continue the run saved in the --checkpoint file, with its seed")
+		("greeks", "estimate delta, gamma, vega (w.r.t. V0) and rho of the European call on the paths of the price")
+		("control-variates", "regress the payoff on the terminal spot and on a Black-Scholes companion call")
+		("strikes", po::value<std::string>(&strikes),
+			"Comma separated strikes of the grid, priced on the same paths as --strike")
+		("maturities", po::value<std::string>(&maturities),
+			"Comma separated maturities of the grid, the paths are simulated up to the longest one")
+		("calibrate", po::value<std::string>(&surface),
+			"Calibrate V0, kappa, theta, xi and rho to a surface file (lines of maturity, strike, implied volatility and optional weight) before pricing, the parameters on the command line are the initial guess")
+		("calibrate-error", po::value<std::string>(&calibrationError)->
+			default_value("price"),
+			"Calibration error [price, vol (vega weighted price error)]")
+		("calibrate-iterations", po::value<int>(&calibrationIterations)->
+			default_value(100),
+			"Maximum number of Levenberg-Marquardt iterations")
+#ifdef HESTON_REPLAY
+		("trace", po::value<std::string>(&trace),
+			"Trace of the replayed grants, lines of time (ms), AWM id, PROC_NR, PROC_ELEMENT and optional MEMORY (default: all the CPUs in AWM 0)")
+		("replay-report", po::value<std::string>(&report),
+			"JSON report of the replayed phases (default: standard output)")
+		("replay-log", "print the application log, not only its errors")
+#endif
+		("bench-normal", "print speed and accuracy of the normal generators and exit")
 	;
 	;
 
@@ -189,6 +467,243 @@ int main(int argc, char *argv[]) {
 
 	ParseCommandLine(argc, argv);
 
+	// The widest kernel supported by the host, unless asked otherwise
+	settings.kernel = HestonKernel::parse(kernel);
+	settings.scheme = HestonKernel::parseScheme(scheme);
+	settings.payoff = HestonKernel::parsePayoff(payoff);
+	if (settings.payoff >= HestonKernel::UP_AND_OUT && settings.payoff <= HestonKernel::DOWN_AND_IN && settings.barrier <= 0.0) {
+		std::cout << "A barrier call needs a positive --barrier, pricing the European call" << std::endl;
+		settings.payoff = HestonKernel::EUROPEAN;
+	}
+	settings.normal = HestonNormal::parse(normal);
+	settings.qmc = opts_vm.count("qmc") > 0;
+	settings.controlVariates = opts_vm.count("control-variates") > 0;
+	if (settings.qmc && settings.controlVariates) {
+		std::cout << "Control variates are not supported in QMC mode, disabled" << std::endl;
+		settings.controlVariates = false;
+	}
+	if (engine == "fourier")
+		settings.engine = HestonSettings::ENGINE_FOURIER;
+	else if (engine == "mc")
+		settings.engine = HestonSettings::ENGINE_MONTECARLO;
+	else
+		settings.engine = HestonSettings::ENGINE_AUTO;
+	if (settings.engine == HestonSettings::ENGINE_FOURIER && !settings.european()) {
+		std::cout << "The Fourier engine only prices European calls, using the Monte Carlo one" << std::endl;
+		settings.engine = HestonSettings::ENGINE_MONTECARLO;
+	}
+
+	// The options of the paths ask for the Monte Carlo engine, the Fourier one has nothing to apply them to
+	std::string pathOptions = MonteCarloOptions();
+	if (settings.fourier() && !pathOptions.empty()) {
+		if (settings.engine == HestonSettings::ENGINE_AUTO) {
+			std::cout << "Monte Carlo options given (" << pathOptions << "), using the Monte Carlo engine" << std::endl;
+			settings.engine = HestonSettings::ENGINE_MONTECARLO;
+		} else {
+			std::cout << "The Fourier engine ignores the Monte Carlo options: " << pathOptions << std::endl;
+		}
+	}
+	if (settings.replications < 2)
+		settings.replications = 2;
+	if (settings.confidence <= 0.0 || settings.confidence >= 1.0)
+		settings.confidence = 0.95;
+	settings.cycleTime = std::max(0.0, settings.cycleTime);
+
+	// The American put has its own path store and payoff: the other modes are turned off, and every
+	// exercise date must fall at the end of a step
+	settings.exercises = std::max(0, settings.exercises);
+	if (settings.exercises > 0) {
+		if (settings.qmc || settings.controlVariates || settings.mlmcLevels > 0 || settings.payoff != HestonKernel::EUROPEAN
+				|| opts_vm.count("strikes") || opts_vm.count("maturities")) {
+			std::cout << "QMC, control variates, MLMC, grids and payoffs are not supported by the American mode, disabled" << std::endl;
+			settings.qmc = false;
+			settings.controlVariates = false;
+			settings.mlmcLevels = 0;
+			settings.payoff = HestonKernel::EUROPEAN;
+			opts_vm.erase("strikes");
+			opts_vm.erase("maturities");
+		}
+		DISCR = std::max(1, (DISCR + settings.exercises - 1) / settings.exercises) * settings.exercises;
+	}
+
+	// The Greeks are carried by the scalar paths of the European call, their errors come from the plain
+	// Monte Carlo statistics
+	settings.greeks = opts_vm.count("greeks") > 0;
+	if (settings.greeks && (!settings.european() || settings.qmc || settings.mlmcLevels > 0)) {
+		std::cout << "Greeks are only supported for the European call in Monte Carlo mode, disabled" << std::endl;
+		settings.greeks = false;
+	}
+
+	// The grid and the MLMC coupling are written for the European call: the path-dependent payoffs would
+	// be monitored up to the longest maturity of the grid
+	if (!settings.european() && (settings.mlmcLevels > 0 || opts_vm.count("strikes") || opts_vm.count("maturities"))) {
+		std::cout << "Grids and MLMC are only supported for the European call, disabled" << std::endl;
+		settings.mlmcLevels = 0;
+		opts_vm.erase("strikes");
+		opts_vm.erase("maturities");
+	}
+
+	// A grid needs both lists, a missing one defaults to the single option value. The option maturity is
+	// always in the grid: the paths carry the main price at T on the way to the longest maturity
+	if (settings.mlmcLevels == 0 && (opts_vm.count("strikes") || opts_vm.count("maturities"))) {
+		settings.strikes = opts_vm.count("strikes") ? ParseList(strikes) : std::vector<double>(1, K);
+		settings.maturities = opts_vm.count("maturities") ? ParseList(maturities) : std::vector<double>();
+		settings.maturities.erase(std::remove(settings.maturities.begin(), settings.maturities.end(), T),
+			settings.maturities.end());
+
+		std::sort(settings.maturities.begin(), settings.maturities.end());
+		settings.maturities.erase(std::unique(settings.maturities.begin(), settings.maturities.end()),
+			settings.maturities.end());
+		if (settings.maturities.size() >= HESTON_MAX_MATURITIES) {
+			std::cout << "Too many maturities. Maximum is: " << HESTON_MAX_MATURITIES << std::endl;
+			settings.maturities.resize(HESTON_MAX_MATURITIES - 1);
+		}
+		settings.maturities.insert(std::upper_bound(settings.maturities.begin(), settings.maturities.end(), T), T);
+
+		// The paths reach the longest maturity, the discretization step stays T / discr
+		if (settings.grid()) {
+			settings.horizon = settings.maturities.back();
+			DISCR = std::max(1, (int) ceil(DISCR * settings.horizon / T));
+		}
+	}
+
+	// The Monte Carlo Greeks are carried to the end of the paths, past the maturity of the option
+	if (settings.greeks && settings.grid() && !settings.fourier()) {
+		std::cout << "Greeks are not supported with grids by the Monte Carlo engine, disabled" << std::endl;
+		settings.greeks = false;
+	}
+
+	// The finest level has discr steps and every level halves them
+	if (settings.mlmcLevels > 0) {
+		if (settings.qmc || settings.controlVariates || opts_vm.count("strikes") || opts_vm.count("maturities")) {
+			std::cout << "QMC, control variates and grids are not supported by the MLMC engine, disabled" << std::endl;
+			settings.qmc = false;
+			settings.controlVariates = false;
+		}
+		settings.mlmcLevels = std::min(settings.mlmcLevels, 16);
+		if (settings.mlmcRmse <= 0.0)
+			settings.mlmcRmse = 0.05;
+		int coarsest = 1 << (settings.mlmcLevels - 1);
+		DISCR = std::max(1, (DISCR + coarsest - 1) / coarsest) * coarsest;
+	}
+
+	// The state file holds the chunks of the plain Monte Carlo engine
+	settings.resume = opts_vm.count("resume") > 0;
+	if (settings.resume && settings.checkpoint.empty()) {
+		std::cout << "Resuming needs a --checkpoint file, ignored" << std::endl;
+		settings.resume = false;
+	}
+	if (!settings.checkpoint.empty() && (settings.mlmcLevels > 0 || settings.exercises > 0)) {
+		std::cout << "Checkpoints are not supported by the MLMC and American modes, disabled" << std::endl;
+		settings.checkpoint.clear();
+		settings.resume = false;
+	}
+
+	// A request of the batch pricing mode is a plain option, the modes which need more than its price are
+	// turned off
+	if (opts_vm.count("serve") && (settings.qmc || settings.controlVariates || settings.mlmcLevels > 0 || settings.exercises > 0
+			|| settings.greeks || settings.grid() || !settings.checkpoint.empty())) {
+		std::cout << "QMC, control variates, MLMC, American, Greeks, grids and checkpoints are not supported by the batch pricing mode, disabled" << std::endl;
+		settings.qmc = false;
+		settings.controlVariates = false;
+		settings.mlmcLevels = 0;
+		settings.exercises = 0;
+		settings.greeks = false;
+		settings.strikes.clear();
+		settings.maturities.clear();
+		settings.checkpoint.clear();
+		settings.resume = false;
+	}
+
+	// The operating points change the paths between two cycles, only the plain Monte Carlo run mixes
+	// them: the other modes keep the knobs of the command line
+	if (opts_vm.count("awm-file")) {
+		if (HestonProfile::load(awmFile, settings.operatingPoints) < 0) {
+			logger->Error("Unable to read the operating points file [%s]", awmFile.c_str());
+			return EXIT_FAILURE;
+		}
+		if (settings.qmc || settings.grid() || settings.greeks || settings.mlmcLevels > 0 || settings.exercises > 0
+				|| opts_vm.count("serve")) {
+			std::cout << "Operating points are not supported by QMC, grids, Greeks, MLMC, American and batch pricing, disabled" << std::endl;
+			settings.operatingPoints.clear();
+		}
+	}
+
+	// The single precision kernels evolve plain Euler and log-Euler paths on a SIMD instruction set, a
+	// batch request is always priced in double. The operating points select the AWMs on their own
+	settings.precision = HestonKernel::parsePrecision(precision);
+	settings.floatAwms = ParseAwms(floatAwms);
+	if (!settings.operatingPoints.empty()) {
+		settings.floatAwms.clear();
+		for (size_t p = 0; p < settings.operatingPoints.size(); p++) {
+			if (settings.operatingPoints[p].precision == HestonKernel::FLOAT)
+				settings.floatAwms.push_back(settings.operatingPoints[p].awm);
+		}
+		settings.precision = settings.floatAwms.empty() ? HestonKernel::DOUBLE : HestonKernel::FLOAT;
+	}
+	if (settings.precision == HestonKernel::FLOAT && (settings.kernel == HestonKernel::SCALAR
+			|| (settings.scheme == HestonKernel::QUADRATIC_EXPONENTIAL && settings.operatingPoints.empty()) || settings.greeks || settings.mlmcLevels > 0
+			|| settings.exercises > 0 || opts_vm.count("serve"))) {
+		std::cout << "Single precision needs a SIMD kernel and the euler or logeuler scheme, and is not supported by Greeks, MLMC, American and batch pricing, disabled" << std::endl;
+		settings.precision = HestonKernel::DOUBLE;
+	}
+
+	// A cached entry is only found again with the same random streams
+	if (!settings.cache.empty() && (!opts_vm.count("serve") || !opts_vm.count("seed"))) {
+		std::cout << "The result cache needs the batch pricing mode and a fixed --seed, disabled" << std::endl;
+		settings.cache.clear();
+	}
+
+	if (opts_vm.count("seed")) {
+		settings.seed = seed;
+	} else {
+		std::random_device device;
+		settings.seed = ((uint64_t) device() << 32) | device();
+	}
+
+	if (opts_vm.count("bench-normal")) {
+		HestonNormal::benchmark(settings.kernel, std::cout);
+		return EXIT_SUCCESS;
+	}
+
+	if (opts_vm.count("calibrate") && RunCalibration() != EXIT_SUCCESS)
+		return EXIT_FAILURE;
+
+	// The option of the command line is checked as a request of the batch pricing mode
+	if (!opts_vm.count("serve")) {
+		HestonJob option = HestonJob();
+		option.S0 = S0;
+		option.K = K;
+		option.r = r;
+		option.T = T;
+		option.V0 = V0;
+		option.rho = rho;
+		option.kappa = kappa;
+		option.theta = theta;
+		option.xi = xi;
+		HestonServer::validate(option);
+		if (!option.invalid.empty()) {
+			logger->Error("Invalid option: %s", option.invalid.c_str());
+			return EXIT_FAILURE;
+		}
+	}
+
+	// Closed-form payoffs take microseconds, the RTRM is only involved for the Monte Carlo engine
+	if (settings.fourier() && !opts_vm.count("serve"))
+		return RunFourier();
+
+	// The requests are read as soon as the stream is open, they wait in its queue for the EXC
+	std::unique_ptr<HestonServer> server;
+	if (opts_vm.count("serve")) {
+		server.reset(new HestonServer(HestonServer::parseFormat(serveFormat), std::max(1, N_SIM), std::max(1, DISCR)));
+		if (!server->open(serve)) {
+			logger->Fatal("Unable to open the request stream [%s]", serve.c_str());
+			return EXIT_FAILURE;
+		}
+		signal(SIGINT, HestonServer::interrupt);
+		signal(SIGTERM, HestonServer::interrupt);
+	}
+
 	// Welcome screen
 	logger->Info(".:: HestonFour (ver. %s) ::.", g_git_version);
 	logger->Info("Built: " __DATE__  " " __TIME__);
@@ -198,6 +713,15 @@ int main(int argc, char *argv[]) {
 	logger->Info("STEP 0. Initializing RTLib, application [%s]...",
 			::basename(argv[0]));
 
+#ifdef HESTON_REPLAY
+	if (!opts_vm.count("replay-log"))
+		bu::Logger::SetLevel(bu::Logger::ERROR);
+	if (opts_vm.count("trace") && bbque::rtlib::Replay::Load(trace) < 0) {
+		logger->Fatal("Unable to read the trace [%s]", trace.c_str());
+		return EXIT_FAILURE;
+	}
+#endif
+
 	if ( RTLIB_Init(::basename(argv[0]), &rtlib) != RTLIB_OK) {
 		logger->Fatal("Unable to init RTLib (Did you start the BarbequeRTRM daemon?)");
 		return RTLIB_ERROR;
@@ -207,13 +731,26 @@ int main(int argc, char *argv[]) {
 
 	logger->Info("STEP 1. Registering EXC using [%s] recipe...",
 			recipe.c_str());
-	pexc = pBbqueEXC_t(new HestonFour("HestonFour", recipe, rtlib, S0, K, r, T, V0, rho, kappa, theta, xi, N_SIM, DISCR));
+	if (server)
+		pexc = pBbqueEXC_t(new HestonBatch("HestonFour", recipe, rtlib, settings, server.get(), serveBatch));
+	else
+		pexc = pBbqueEXC_t(new HestonFour("HestonFour", recipe, rtlib, S0, K, r, T, V0, rho, kappa, theta, xi, N_SIM, DISCR, settings));
 	if (!pexc->isRegistered()) {
 		logger->Fatal("Registering failure.");
 		return RTLIB_ERROR;
 	}
 
 
+#ifdef HESTON_REPLAY
+	if (server) {
+		HestonBatch* batch = static_cast<HestonBatch*>(pexc.get());
+		bbque::rtlib::Replay::SetProgress([batch]() { return batch->getRequestsDone(); });
+	} else {
+		HestonFour* heston = static_cast<HestonFour*>(pexc.get());
+		bbque::rtlib::Replay::SetProgress([heston]() { return (long) heston->getSimulationsDone(); });
+	}
+#endif
+
 	logger->Info("STEP 2. Starting EXC control thread...");
 	pexc->Start();
 
@@ -222,6 +759,15 @@ int main(int argc, char *argv[]) {
 	pexc->WaitCompletion();
 
 
+#ifdef HESTON_REPLAY
+	if (opts_vm.count("replay-report")) {
+		std::ofstream file(report.c_str());
+		bbque::rtlib::Replay::Report(file);
+	} else {
+		bbque::rtlib::Replay::Report(std::cout);
+	}
+#endif
+
 	logger->Info("STEP 4. Disabling EXC...");
 	pexc = NULL;
 
@@ -0,0 +1,344 @@
+/**
+ *       @file  HestonFour_profile.cc
+ *      @brief  The HestonFour BarbequeRTRM application
+ *
+ * Description: Profiler of the operating points, without the RTLib. Every combination of discretization,
+ *		variance scheme and precision prices the European call of the option on one core: the paths per
+ *		second give its cost, the difference from the Fourier price gives its discretization bias and
+ *		the spread of the samples its statistical error. For every CPU quota the combination with the
+ *		smallest root mean square error within the time budget becomes an AWM, whose value is its
+ *		accuracy relative to the best AWM. The profiler writes the recipe and the operating points file
+ *		which hestonfour reads with --awm-file.
+ *
+ *     @author  Luca Napoletano luca.napoletano@mail.polimi.it, Claudio Montanari claudio1.montanari@mail.polimi.it
+ *
+ *     Company  Politecnico di Milano
+ *   Copyright  Copyright (c) 2017, Luca Napoletano, Claudio Montanari
+ *
+ * This source code is released for free distribution under the terms of the
+ * GNU General Public License as published by the Free Software Foundation.
+ * =====================================================================================
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <boost/program_options/options_description.hpp>
+#include <boost/program_options/parsers.hpp>
+#include <boost/program_options/variables_map.hpp>
+
+#include "version.h"
+#include "HestonFourier.h"
+#include "HestonPool.h"
+#include "HestonProfile.h"
+#include "HestonSettings.h"
+#include "HestonStats.h"
+#include "HestonWorker.h"
+
+namespace po = boost::program_options;
+
+/**
+ * @brief Model and option of the profile, the defaults of hestonfour
+ */
+double S0;
+double K;
+double r;
+double T;
+
+double V0;
+double rho;
+double kappa;
+double theta;
+double xi;
+
+int N_SIM;
+double BUDGET;
+
+HestonSettings settings;
+
+/**
+ * @brief		Paths of a block, as in a cycle of hestonfour
+ */
+const int BLOCK_SIM = 10000;
+
+/**
+ * @brief		A measured combination of the knobs
+ */
+struct Combination {
+	HestonOperatingPoint point;
+	double sigma;
+	double biasError;
+	double squaredBias;
+};
+
+/**
+ * @brief		Parse a comma separated list of positive integers, the invalid entries are skipped
+ */
+std::vector<int> ParseInts(std::string const & list) {
+	std::vector<int> values;
+	std::stringstream stream(list);
+	std::string item;
+
+	while (std::getline(stream, item, ',')) {
+		char *end;
+		long value = strtol(item.c_str(), &end, 10);
+		if (end != item.c_str() && value > 0)
+			values.push_back((int) value);
+		else if (!item.empty())
+			std::cout << "Skipping invalid value: " << item << std::endl;
+	}
+
+	return values;
+}
+
+/**
+ * @brief		Parse a comma separated list of names
+ */
+std::vector<std::string> ParseNames(std::string const & list) {
+	std::vector<std::string> names;
+	std::stringstream stream(list);
+	std::string item;
+
+	while (std::getline(stream, item, ','))
+		if (!item.empty())
+			names.push_back(item);
+
+	return names;
+}
+
+/**
+ * @brief		Price the call with a combination on one worker, one block after the other, after a discarded
+ *			warmup block. The squared bias is corrected for the noise of the difference from the Fourier
+ *			price, a bias within the noise counts as none
+ */
+Combination Measure(int discretization, HestonKernel::Scheme scheme, HestonKernel::Precision precision, double reference) {
+	Combination combination;
+	HestonOperatingPoint & point = combination.point;
+	double discount = exp(-r * T);
+
+	point.discretization = discretization;
+	point.scheme = scheme;
+	point.precision = precision;
+
+	settings.scheme = scheme;
+	settings.precision = precision;
+
+	HestonPool pool(1);
+	HestonWorker worker(&pool, 0, settings, S0, K, r, T, V0, rho, kappa, theta, xi);
+	worker.setPrecision(precision);
+
+	int block = 0;
+	worker.start(BLOCK_SIM, discretization, block++);
+	worker.join();
+
+	HestonStats stats;
+	auto start = std::chrono::steady_clock::now();
+	for (int done = 0; done < N_SIM; done += BLOCK_SIM) {
+		worker.start(BLOCK_SIM, discretization, block++);
+		worker.join();
+		stats.merge(worker.getStats());
+	}
+	double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	point.throughput = stats.count / elapsed;
+	point.bias = stats.mean * discount - reference;
+	combination.sigma = sqrt(stats.variance()) * discount;
+	combination.biasError = stats.stdError() * discount;
+	combination.squaredBias = std::max(0.0, point.bias * point.bias - combination.biasError * combination.biasError);
+
+	return combination;
+}
+
+void ParseCommandLine(int argc, char *argv[], po::options_description & opts_desc, po::variables_map & opts_vm) {
+	try {
+		po::store(po::parse_command_line(argc, argv, opts_desc), opts_vm);
+	} catch(...) {
+		std::cout << "Usage: " << argv[0] << " [options]\n";
+		std::cout << opts_desc << std::endl;
+		::exit(EXIT_FAILURE);
+	}
+	po::notify(opts_vm);
+
+	if (opts_vm.count("help")) {
+		std::cout << "Usage: " << argv[0] << " [options]\n";
+		std::cout << opts_desc << std::endl;
+		::exit(EXIT_SUCCESS);
+	}
+}
+
+int main(int argc, char *argv[]) {
+	po::options_description opts_desc("HestonFour Profiler Options");
+	po::variables_map opts_vm;
+	std::string kernel;
+	std::string discretizations;
+	std::string schemes;
+	std::string precision;
+	std::string quotas;
+	std::string recipe;
+	std::string awmFile;
+	double confidence;
+	uint64_t seed;
+
+	opts_desc.add_options()
+		("help,h", "print this help message")
+		("spot", po::value<double>(&S0)->default_value(100.0), "Option Spot Price")
+		("strike", po::value<double>(&K)->default_value(100.0), "Option Strike Price")
+		("risk", po::value<double>(&r)->default_value(0.05), "Risk-Free Rate")
+		("time", po::value<double>(&T)->default_value(5.0), "Maturity Time [In Years]")
+		("vol", po::value<double>(&V0)->default_value(0.09), "Volatility")
+		("rho", po::value<double>(&rho)->default_value(-0.30), "Correlation Coefficient")
+		("kappa", po::value<double>(&kappa)->default_value(2.0), "Mean Reversion")
+		("theta", po::value<double>(&theta)->default_value(0.09), "Long-Term volatility")
+		("xi", po::value<double>(&xi)->default_value(1.0), "Volatility of volatility")
+		("sims,n", po::value<int>(&N_SIM)->
+			default_value(100000),
+			"Number of paths of each combination, their spread resolves the bias")
+		("discr-list", po::value<std::string>(&discretizations)->
+			default_value("25,50,100,200,300"),
+			"Comma separated discretizations")
+		("schemes", po::value<std::string>(&schemes)->
+			default_value("euler,logeuler,qe"),
+			"Comma separated variance discretizations [euler, logeuler, qe]")
+		("precision", po::value<std::string>(&precision)->
+			default_value("all"),
+			"Path evolution precision [all, double, float], float needs a SIMD kernel and is not built for qe")
+		("kernel", po::value<std::string>(&kernel)->
+			default_value("auto"),
+			"Path kernel [auto, scalar, sse2, avx2, avx512]")
+		("quotas", po::value<std::string>(&quotas)->
+			default_value("25,50,75,100"),
+			"Comma separated CPU quotas (% of a processing element), one AWM each")
+		("budget", po::value<double>(&BUDGET)->
+			default_value(1.0),
+			"Time budget of a price in seconds, the error of an AWM is the one of the paths it simulates in it")
+		("confidence", po::value<double>(&confidence)->
+			default_value(0.95),
+			"Confidence level of the target errors")
+		("seed", po::value<uint64_t>(&seed)->
+			default_value(42),
+			"Random seed")
+		("recipe,o", po::value<std::string>(&recipe)->
+			default_value("HestonFour.recipe"),
+			"Recipe file to write")
+		("awm-file", po::value<std::string>(&awmFile)->
+			default_value("HestonFour.awm"),
+			"Operating points file to write, the --awm-file of hestonfour")
+	;
+
+	ParseCommandLine(argc, argv, opts_desc, opts_vm);
+
+	N_SIM = std::max(BLOCK_SIM, N_SIM);
+	BUDGET = std::max(1e-3, BUDGET);
+
+	settings.kernel = HestonKernel::parse(kernel);
+	settings.seed = seed;
+
+	double zScore = HestonNormal::inverse(0.5 + 0.5 * confidence);
+	double reference = HestonFourier(S0, r, V0, rho, kappa, theta, xi).call(K, T);
+
+	std::vector<int> steps = ParseInts(discretizations);
+	std::vector<int> cpu = ParseInts(quotas);
+	std::vector<std::string> names = ParseNames(schemes);
+	std::sort(cpu.begin(), cpu.end());
+	cpu.erase(std::unique(cpu.begin(), cpu.end()), cpu.end());
+	if (steps.empty() || cpu.empty() || names.empty()) {
+		std::cerr << "Nothing to profile" << std::endl;
+		return EXIT_FAILURE;
+	}
+	if (cpu.size() > 256)
+		cpu.resize(256);
+
+	std::cout << "HestonFour profiler " << g_git_version << ", kernel " << HestonKernel::name(settings.kernel)
+		<< ", " << N_SIM << " paths per combination, Fourier price " << reference << std::endl;
+
+	// Every combination, the scalar code and the QE scheme only run in double
+	std::vector<Combination> combinations;
+	for (size_t s = 0; s < names.size(); s++) {
+		HestonKernel::Scheme scheme = HestonKernel::parseScheme(names[s]);
+		for (size_t d = 0; d < steps.size(); d++) {
+			for (int p = HestonKernel::DOUBLE; p <= HestonKernel::FLOAT; p++) {
+				HestonKernel::Precision candidate = (HestonKernel::Precision) p;
+				if (precision != "all" && precision != HestonKernel::precisionName(candidate))
+					continue;
+				if (candidate == HestonKernel::FLOAT && (settings.kernel == HestonKernel::SCALAR
+						|| scheme == HestonKernel::QUADRATIC_EXPONENTIAL))
+					continue;
+
+				Combination combination = Measure(steps[d], scheme, candidate, reference);
+				combinations.push_back(combination);
+
+				char text[256];
+				snprintf(text, sizeof(text), "%-8s %5d steps %-6s: %10.0f paths/s, bias %+.5f (standard error %.5f), sample deviation %.4f",
+					HestonKernel::schemeName(scheme), steps[d], HestonKernel::precisionName(candidate),
+					combination.point.throughput, combination.point.bias, combination.biasError, combination.sigma);
+				std::cout << text << std::endl;
+			}
+		}
+	}
+
+	if (combinations.empty()) {
+		std::cerr << "Nothing to profile" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	// The AWM of a quota is the combination with the smallest error within the budget: bias and spread of
+	// the mean of the paths the quota simulates in it
+	std::vector<HestonOperatingPoint> points;
+	for (size_t q = 0; q < cpu.size(); q++) {
+		int best = -1;
+		double bestError = 0.0;
+		for (size_t c = 0; c < combinations.size(); c++) {
+			double paths = std::max(1.0, combinations[c].point.throughput * cpu[q] / 100.0 * BUDGET);
+			double error = sqrt(combinations[c].squaredBias + combinations[c].sigma * combinations[c].sigma / paths);
+			if (best < 0 || error < bestError) {
+				best = (int) c;
+				bestError = error;
+			}
+		}
+
+		HestonOperatingPoint point = combinations[best].point;
+		point.awm = (int) q;
+		point.quota = cpu[q];
+		point.rmse = bestError;
+		// Below the bias more paths do not make the price more accurate
+		point.targetError = zScore * sqrt(combinations[best].squaredBias);
+		points.push_back(point);
+	}
+
+	double smallest = points[0].rmse;
+	for (size_t p = 0; p < points.size(); p++)
+		smallest = std::min(smallest, points[p].rmse);
+	for (size_t p = 0; p < points.size(); p++)
+		points[p].value = std::max(1, (int) floor(100.0 * smallest / points[p].rmse + 0.5));
+
+	std::ofstream file(recipe.c_str(), std::ios::trunc);
+	HestonProfile::writeRecipe(file, points);
+	if (!file.good()) {
+		std::cerr << "Unable to write the recipe [" << recipe << "]" << std::endl;
+		return EXIT_FAILURE;
+	}
+	if (!HestonProfile::save(awmFile, points)) {
+		std::cerr << "Unable to write the operating points [" << awmFile << "]" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	for (size_t p = 0; p < points.size(); p++) {
+		HestonOperatingPoint const & point = points[p];
+		char text[256];
+		snprintf(text, sizeof(text), "AWM %d: %3d%% PE, %s %d steps %s, RMS error %.5f, target error %.5f, value %d",
+			point.awm, point.quota, HestonKernel::schemeName(point.scheme), point.discretization,
+			HestonKernel::precisionName(point.precision), point.rmse, point.targetError, point.value);
+		std::cout << text << std::endl;
+	}
+	std::cout << "Recipe [" << recipe << "], operating points [" << awmFile << "]" << std::endl;
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,420 @@
+/**
+ *       @file  HestonFourier.cc
+ *
+ * Description: Heston characteristic function in the "little trap" form of Albrecher et al. (2007), which has
+ *		no branch cut discontinuity of the complex logarithm for any maturity. A single call is priced
+ *		with the two probabilities of Heston (1993) merged in one integral and a Gauss-Laguerre
+ *		quadrature, a strike chain with the damped call transform of Carr and Madan (1999) on a radix-2
+ *		FFT with Simpson weights.
+ *
+ *     @author  Luca Napoletano luca.napoletano@mail.polimi.it, Claudio Montanari claudio1.montanari@mail.polimi.it
+ *
+ *     Company  Politecnico di Milano
+ *   Copyright  Copyright (c) 2017, Luca Napoletano, Claudio Montanari
+ *
+ * This source code is released for free distribution under the terms of the
+ * GNU General Public License as published by the Free Software Foundation.
+ * =====================================================================================
+ */
+#include "HestonFourier.h"
+#include "HestonNormal.h"
+
+#include <algorithm>
+#include <cmath>
+
+/**
+ * Number of Gauss-Laguerre nodes of the single call integral
+ */
+#define LAGUERRE_NODES 64
+
+/**
+ * Carr-Madan FFT: number of points, spacing of the frequencies and damping of the call
+ */
+#define FFT_POINTS 4096
+#define FFT_ETA 0.25
+#define FFT_ALPHA 1.5
+
+typedef std::complex<double> complex;
+
+namespace {
+
+/**
+ * @brief		In-place iterative radix-2 FFT, x[k] = sum_j x[j] exp(-2 pi i j k / n), n a power of 2
+ */
+void fft(std::vector<complex> & x){
+
+	int n = (int) x.size();
+
+	for (int i = 1, j = 0; i < n; i++) {
+		int bit = n >> 1;
+		for (; j & bit; bit >>= 1)
+			j ^= bit;
+		j ^= bit;
+		if (i < j)
+			std::swap(x[i], x[j]);
+	}
+
+	for (int length = 2; length <= n; length <<= 1) {
+		double angle = -2.0 * M_PI / length;
+		complex root(cos(angle), sin(angle));
+		for (int i = 0; i < n; i += length) {
+			complex w(1.0, 0.0);
+			for (int j = 0; j < length / 2; j++) {
+				complex even = x[i + j];
+				complex odd = x[i + j + length / 2] * w;
+				x[i + j] = even + odd;
+				x[i + j + length / 2] = even - odd;
+				w *= root;
+			}
+		}
+	}
+}
+
+}
+
+/**
+ * @brief		Build the pricer of an option on a given spot and Heston dynamics
+ * @param[in] S0	The spot price of the option
+ * @param[in] r		The risk-free rate of the option
+ * @param[in] V0	The initial variance
+ * @param[in] rho	The correlation between the spot and the variance
+ * @param[in] kappa	The mean reversion rate of the variance
+ * @param[in] theta	The long-term variance
+ * @param[in] xi	The volatility of the variance
+ */
+HestonFourier::HestonFourier(double S0, double r, double V0, double rho, double kappa, double theta, double xi){
+
+	this->S0 = S0;
+	this->r = r;
+	this->V0 = V0;
+	this->rho = rho;
+	this->kappa = kappa;
+	this->theta = theta;
+	this->xi = xi;
+
+	initQuadrature(LAGUERRE_NODES);
+}
+
+/**
+ * @brief		Change the model parameters and keep the quadrature
+ * @param[in] parameters The HESTON_PARAMETERS values, in the order V0, kappa, theta, xi, rho
+ */
+void HestonFourier::setParameters(double const * parameters){
+
+	V0 = parameters[0];
+	kappa = parameters[1];
+	theta = parameters[2];
+	xi = parameters[3];
+	rho = parameters[4];
+}
+
+/**
+ * @brief		Compute the Gauss-Laguerre nodes (Newton iterations on the Laguerre polynomials, with the
+ *			initial guesses of Numerical Recipes) and the weights multiplied by exp(node)
+ * @param[in] n		The number of nodes
+ */
+void HestonFourier::initQuadrature(int n){
+
+	nodes.assign(n, 0.0);
+	weights.assign(n, 0.0);
+
+	double z = 0.0;
+
+	for (int i = 0; i < n; i++) {
+
+		if (i == 0)
+			z = 3.0 / (1.0 + 2.4 * n);
+		else if (i == 1)
+			z += 15.0 / (1.0 + 2.5 * n);
+		else
+			z += (1.0 + 2.55 * (i - 1)) / (1.9 * (i - 1)) * (z - nodes[i - 2]);
+
+		double p1 = 1.0, p2 = 0.0, derivative = 1.0;
+
+		for (int iteration = 0; iteration < 100; iteration++) {
+			p1 = 1.0;
+			p2 = 0.0;
+			for (int j = 1; j <= n; j++) {
+				double p3 = p2;
+				p2 = p1;
+				p1 = ((2 * j - 1 - z) * p2 - (j - 1) * p3) / j;
+			}
+			derivative = n * (p1 - p2) / z;
+
+			double previous = z;
+			z = previous - p1 / derivative;
+			if (fabs(z - previous) <= 1e-14 * fabs(z))
+				break;
+		}
+
+		nodes[i] = z;
+		weights[i] = -exp(z) / (derivative * n * p2);
+	}
+}
+
+/**
+ * @brief		The characteristic function E[exp(i u ln S_T)] of the log spot at maturity
+ * @param[in] u		The (complex) frequency
+ * @param[in] T		The maturity (in years)
+ */
+complex HestonFourier::characteristic(complex u, double T) const {
+
+	complex i(0.0, 1.0);
+	double xi2 = xi * xi;
+
+	complex beta = kappa - rho * xi * i * u;
+	complex d = sqrt(beta * beta + xi2 * (i * u + u * u));
+	complex g = (beta - d) / (beta + d);
+	complex e = exp(-d * T);
+
+	complex C = (kappa * theta / xi2) * ((beta - d) * T - 2.0 * log((1.0 - g * e) / (1.0 - g)));
+	complex D = ((beta - d) / xi2) * (1.0 - e) / (1.0 - g * e);
+
+	return exp(i * u * (log(S0) + r * T) + C + D * V0);
+}
+
+/**
+ * @brief		The characteristic function and its gradient with respect to the model parameters, by the
+ *			chain rule through the little trap formulation (forward mode, one direction per parameter)
+ * @param[in] u		The (complex) frequency
+ * @param[in] T		The maturity (in years)
+ * @param[out] gradient	The HESTON_PARAMETERS derivatives, in the order V0, kappa, theta, xi, rho
+ */
+complex HestonFourier::characteristic(complex u, double T, complex * gradient) const {
+
+	complex i(0.0, 1.0);
+	double xi2 = xi * xi;
+	double xi3 = xi2 * xi;
+
+	complex beta = kappa - rho * xi * i * u;
+	complex d = sqrt(beta * beta + xi2 * (i * u + u * u));
+	complex g = (beta - d) / (beta + d);
+	complex e = exp(-d * T);
+	complex L = log((1.0 - g * e) / (1.0 - g));
+
+	double A = kappa * theta / xi2;
+	complex X = (beta - d) * T - 2.0 * L;
+	complex B = (beta - d) / xi2;
+	complex F = (1.0 - e) / (1.0 - g * e);
+
+	complex C = A * X;
+	complex D = B * F;
+	complex phi = exp(i * u * (log(S0) + r * T) + C + D * V0);
+
+	// Partial derivatives of beta, xi, A and 1 / xi^2 along each parameter
+	complex dBeta[HESTON_PARAMETERS] = { 0.0, 1.0, 0.0, -rho * i * u, -xi * i * u };
+	double dXi[HESTON_PARAMETERS] = { 0.0, 0.0, 0.0, 1.0, 0.0 };
+	double dA[HESTON_PARAMETERS] = { 0.0, theta / xi2, kappa / xi2, -2.0 * kappa * theta / xi3, 0.0 };
+	double dInverseXi2[HESTON_PARAMETERS] = { 0.0, 0.0, 0.0, -2.0 / xi3, 0.0 };
+
+	for (int p = 0; p < HESTON_PARAMETERS; p++) {
+		complex dd = (beta * dBeta[p] + xi * dXi[p] * (i * u + u * u)) / d;
+		complex dg = 2.0 * (d * dBeta[p] - beta * dd) / ((beta + d) * (beta + d));
+		complex de = -T * e * dd;
+		complex dL = -(dg * e + g * de) / (1.0 - g * e) + dg / (1.0 - g);
+
+		complex dC = dA[p] * X + A * ((dBeta[p] - dd) * T - 2.0 * dL);
+		complex dB = (dBeta[p] - dd) / xi2 + (beta - d) * dInverseXi2[p];
+		complex dF = (-de * (1.0 - g * e) + (1.0 - e) * (dg * e + g * de)) / ((1.0 - g * e) * (1.0 - g * e));
+		complex dLogPhi = dC + (dB * F + B * dF) * V0 + ((p == 0) ? D : complex(0.0, 0.0));
+
+		gradient[p] = phi * dLogPhi;
+	}
+
+	return phi;
+}
+
+/**
+ * @brief		Price a European call, C = S0 P1 - K exp(-rT) P2, with both probabilities in one integral
+ * @param[in] K		The strike price
+ * @param[in] T		The maturity (in years)
+ */
+double HestonFourier::call(double K, double T) const {
+
+	complex i(0.0, 1.0);
+	double k = log(K);
+	double integral = 0.0;
+
+	for (size_t j = 0; j < nodes.size(); j++) {
+		double u = nodes[j];
+		complex f = exp(-i * u * k) * (characteristic(u - i, T) - K * characteristic(u, T)) / (i * u);
+		integral += weights[j] * f.real();
+	}
+
+	double discount = exp(-r * T);
+	double price = 0.5 * (S0 - K * discount) + discount * integral / M_PI;
+
+	// The quadrature error can only push a deep out of the money call below its bounds
+	return std::max(price, std::max(0.0, S0 - K * discount));
+}
+
+/**
+ * @brief		Price the European calls of a strike chain with one FFT of the damped call transform, the
+ *			prices between the points of the log strike grid are interpolated with cubic polynomials
+ * @param[in] T		The maturity (in years)
+ * @param[in] strikes	The strike prices
+ * @param[out] prices	The call prices, one for each strike
+ */
+void HestonFourier::callGrid(double T, std::vector<double> const & strikes, std::vector<double> & prices) const {
+
+	complex i(0.0, 1.0);
+	double alpha = FFT_ALPHA;
+	double eta = FFT_ETA;
+	double lambda = 2.0 * M_PI / (FFT_POINTS * eta);
+	double discount = exp(-r * T);
+
+	// The log strike grid is centered on the spot
+	double lowest = log(S0) - 0.5 * FFT_POINTS * lambda;
+
+	std::vector<complex> x(FFT_POINTS);
+
+	for (int j = 0; j < FFT_POINTS; j++) {
+		double v = j * eta;
+		complex psi = discount * characteristic(v - (alpha + 1.0) * i, T) /
+			(alpha * alpha + alpha - v * v + i * (2.0 * alpha + 1.0) * v);
+		double simpson = (j == 0) ? 1.0 : ((j % 2) ? 4.0 : 2.0);
+		x[j] = exp(-i * lowest * v) * psi * (eta * simpson / 3.0);
+	}
+
+	fft(x);
+
+	prices.resize(strikes.size());
+
+	for (size_t s = 0; s < strikes.size(); s++) {
+		double position = (log(strikes[s]) - lowest) / lambda;
+		int index = std::max(1, std::min((int) floor(position), FFT_POINTS - 3));
+		double t = position - index;
+
+		// Cubic Lagrange interpolation on the four closest points of the log strike grid
+		double price = 0.0;
+		for (int j = -1; j <= 2; j++) {
+			double weight = 1.0;
+			for (int m = -1; m <= 2; m++) {
+				if (m != j)
+					weight *= (t - m) / (j - m);
+			}
+			int point = index + j;
+			price += weight * exp(-alpha * (lowest + point * lambda)) * x[point].real() / M_PI;
+		}
+
+		prices[s] = std::max(price, std::max(0.0, S0 - strikes[s] * discount));
+	}
+}
+
+/**
+ * @brief		Price the European calls of some strikes of one maturity and their gradients with respect to
+ *			the model parameters, with the Gauss-Laguerre integral of call(). The characteristic function
+ *			does not depend on the strike, it is evaluated once for all the strikes
+ * @param[in] T		The maturity (in years)
+ * @param[in] strikes	The strike prices
+ * @param[in] count	The number of strikes
+ * @param[out] prices	The call prices, one for each strike
+ * @param[out] gradients The gradients, stored as [strike][parameter]
+ */
+void HestonFourier::callGradients(double T, double const * strikes, int count, double * prices, double * gradients) const {
+
+	complex i(0.0, 1.0);
+	int n = (int) nodes.size();
+	double discount = exp(-r * T);
+
+	std::vector<complex> shifted(n), plain(n);
+	std::vector<complex> shiftedGradient(n * HESTON_PARAMETERS), plainGradient(n * HESTON_PARAMETERS);
+
+	for (int j = 0; j < n; j++) {
+		shifted[j] = characteristic(nodes[j] - i, T, &shiftedGradient[j * HESTON_PARAMETERS]);
+		plain[j] = characteristic(nodes[j], T, &plainGradient[j * HESTON_PARAMETERS]);
+	}
+
+	for (int s = 0; s < count; s++) {
+		double K = strikes[s];
+		double k = log(K);
+		double integral = 0.0;
+		double dIntegral[HESTON_PARAMETERS] = { 0.0, 0.0, 0.0, 0.0, 0.0 };
+
+		for (int j = 0; j < n; j++) {
+			double u = nodes[j];
+			complex kernel = exp(-i * u * k) / (i * u);
+			integral += weights[j] * (kernel * (shifted[j] - K * plain[j])).real();
+			for (int p = 0; p < HESTON_PARAMETERS; p++) {
+				dIntegral[p] += weights[j] * (kernel * (shiftedGradient[j * HESTON_PARAMETERS + p]
+					- K * plainGradient[j * HESTON_PARAMETERS + p])).real();
+			}
+		}
+
+		double price = 0.5 * (S0 - K * discount) + discount * integral / M_PI;
+		prices[s] = std::max(price, std::max(0.0, S0 - K * discount));
+		for (int p = 0; p < HESTON_PARAMETERS; p++)
+			gradients[s * HESTON_PARAMETERS + p] = discount * dIntegral[p] / M_PI;
+	}
+}
+
+/**
+ * @brief		Sensitivities of a European call by central differences of the semi-analytic price, the
+ *			quadrature is smooth in the parameters so the differences are accurate to many digits
+ * @param[in] K		The strike price
+ * @param[in] T		The maturity (in years)
+ * @param[out] greeks	Delta, gamma, vega (w.r.t. V0) and rho, in the order of HestonGreek
+ */
+void HestonFourier::callGreeks(double K, double T, double * greeks) const {
+
+	double hS = 1e-3 * S0;
+	double hV = 1e-4 * std::max(V0, 1e-2);
+	double hR = 1e-5;
+
+	double price = call(K, T);
+	double up = HestonFourier(S0 + hS, r, V0, rho, kappa, theta, xi).call(K, T);
+	double down = HestonFourier(S0 - hS, r, V0, rho, kappa, theta, xi).call(K, T);
+
+	greeks[0] = (up - down) / (2.0 * hS);
+	greeks[1] = (up - 2.0 * price + down) / (hS * hS);
+	greeks[2] = (HestonFourier(S0, r, V0 + hV, rho, kappa, theta, xi).call(K, T) -
+		HestonFourier(S0, r, std::max(V0 - hV, 0.0), rho, kappa, theta, xi).call(K, T)) / (V0 + hV - std::max(V0 - hV, 0.0));
+	greeks[3] = (HestonFourier(S0, r + hR, V0, rho, kappa, theta, xi).call(K, T) -
+		HestonFourier(S0, r - hR, V0, rho, kappa, theta, xi).call(K, T)) / (2.0 * hR);
+}
+
+/**
+ * @brief		Black-Scholes price of a European call
+ * @param[in] variance	The constant variance of the log returns (volatility squared)
+ */
+double HestonFourier::blackScholesCall(double S0, double K, double r, double T, double variance){
+
+	double discount = exp(-r * T);
+	double deviation = sqrt(variance * T);
+
+	if (deviation <= 0.0)
+		return std::max(0.0, S0 - K * discount);
+
+	double d1 = (log(S0 / K) + r * T) / deviation + 0.5 * deviation;
+	double d2 = d1 - deviation;
+
+	return S0 * HestonNormal::cdf(d1) - K * discount * HestonNormal::cdf(d2);
+}
+
+/**
+ * @brief		Black-Scholes vega of a European call, the derivative of the price with respect to the
+ *			volatility
+ * @param[in] variance	The constant variance of the log returns (volatility squared)
+ */
+double HestonFourier::blackScholesVega(double S0, double K, double r, double T, double variance){
+
+	double deviation = sqrt(variance * T);
+
+	if (deviation <= 0.0)
+		return 0.0;
+
+	double d1 = (log(S0 / K) + r * T) / deviation + 0.5 * deviation;
+
+	return S0 * sqrt(T) * exp(-0.5 * d1 * d1) / sqrt(2.0 * M_PI);
+}
+
+/**
+ * @brief		The expected average variance over [0, T], E[(1/T) int V dt] of the CIR variance process
+ */
+double HestonFourier::meanVariance(double V0, double kappa, double theta, double T){
+
+	if (kappa * T < 1e-8)
+		return V0;
+
+	return theta + (V0 - theta) * (1.0 - exp(-kappa * T)) / (kappa * T);
+}
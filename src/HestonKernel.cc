@@ -0,0 +1,248 @@
+/**
+ *       @file  HestonKernel.cc
+ *
+ * Description: Runtime selection of the batched path kernel. The instruction sets supported by the host are
+ *		read from cpuid, so that the same binary runs the widest kernel available on every machine.
+ *
+ *     @author  Luca Napoletano luca.napoletano@mail.polimi.it, Claudio Montanari claudio1.montanari@mail.polimi.it
+ *
+ *     Company  Politecnico di Milano
+ *   Copyright  Copyright (c) 2017, Luca Napoletano, Claudio Montanari
+ *
+ * This source code is released for free distribution under the terms of the
+ * GNU General Public License as published by the Free Software Foundation.
+ * =====================================================================================
+ */
+#include "HestonKernel.h"
+
+#include <math.h>
+
+/**
+ * @brief		Return the widest instruction set supported by both the build and the host
+ */
+HestonKernel::Isa HestonKernel::detect(){
+
+#ifdef HESTON_KERNEL_X86
+	__builtin_cpu_init();
+
+	if (__builtin_cpu_supports("avx512f"))
+		return AVX512;
+	if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+		return AVX2;
+	if (__builtin_cpu_supports("sse2"))
+		return SSE2;
+#endif
+
+	return SCALAR;
+}
+
+/**
+ * @brief		Convert the name given on the command line to an instruction set. Unknown names and
+ *			instruction sets not supported by the host fall back to the detected one
+ * @param[in] name	One of auto, scalar, sse2, avx2 and avx512
+ */
+HestonKernel::Isa HestonKernel::parse(std::string const & name){
+
+	Isa best = detect();
+
+	if (name == "scalar")
+		return SCALAR;
+	if (name == "sse2" && best >= SSE2)
+		return SSE2;
+	if (name == "avx2" && best >= AVX2)
+		return AVX2;
+	if (name == "avx512" && best >= AVX512)
+		return AVX512;
+
+	return best;
+}
+
+/**
+ * @brief		Return the kernel of an instruction set specialized for a payoff, NULL for the scalar reference
+ *			code, which only runs in double precision
+ */
+HestonKernel::Function HestonKernel::select(Isa isa, Payoff payoff, Precision precision){
+
+#ifdef HESTON_KERNEL_X86
+	switch (isa) {
+	case SSE2:
+		return (precision == FLOAT) ? hestonKernelFloatSse2(payoff) : hestonKernelSse2(payoff);
+	case AVX2:
+		return (precision == FLOAT) ? hestonKernelFloatAvx2(payoff) : hestonKernelAvx2(payoff);
+	case AVX512:
+		return (precision == FLOAT) ? hestonKernelFloatAvx512(payoff) : hestonKernelAvx512(payoff);
+	default:
+		break;
+	}
+#endif
+
+	return NULL;
+}
+
+/**
+ * @brief		Return the Box-Muller transform of an instruction set, NULL for the scalar one of HestonNormal
+ */
+HestonKernel::Transform HestonKernel::boxMuller(Isa isa){
+
+#ifdef HESTON_KERNEL_X86
+	switch (isa) {
+	case SSE2:
+		return hestonBoxMullerSse2;
+	case AVX2:
+		return hestonBoxMullerAvx2;
+	case AVX512:
+		return hestonBoxMullerAvx512;
+	default:
+		break;
+	}
+#endif
+
+	return NULL;
+}
+
+/**
+ * @brief		Return the number of paths simulated by one call of the kernel, a single precision kernel fits
+ *			twice as many paths in its registers
+ */
+int HestonKernel::lanes(Isa isa, Precision precision){
+
+	int width = (precision == FLOAT && isa != SCALAR) ? 2 : 1;
+
+	switch (isa) {
+	case SSE2:
+		return 4 * width;
+	case AVX2:
+		return 8 * width;
+	case AVX512:
+		return 16 * width;
+	default:
+		return 1;
+	}
+}
+
+const char* HestonKernel::name(Isa isa){
+
+	switch (isa) {
+	case SSE2:
+		return "sse2";
+	case AVX2:
+		return "avx2";
+	case AVX512:
+		return "avx512";
+	default:
+		return "scalar";
+	}
+}
+
+/**
+ * @brief		Convert the name given on the command line to a precision, unknown names give DOUBLE
+ * @param[in] name	One of double and float
+ */
+HestonKernel::Precision HestonKernel::parsePrecision(std::string const & name){
+
+	if (name == "float")
+		return FLOAT;
+
+	return DOUBLE;
+}
+
+const char* HestonKernel::precisionName(Precision precision){
+
+	return (precision == FLOAT) ? "float" : "double";
+}
+
+/**
+ * @brief		Convert the name given on the command line to a discretization scheme, unknown names give the
+ *			full-truncation Euler scheme
+ * @param[in] name	One of euler, logeuler and qe
+ */
+HestonKernel::Scheme HestonKernel::parseScheme(std::string const & name){
+
+	if (name == "logeuler")
+		return LOG_EULER;
+	if (name == "qe")
+		return QUADRATIC_EXPONENTIAL;
+
+	return FULL_TRUNCATION;
+}
+
+const char* HestonKernel::schemeName(Scheme scheme){
+
+	switch (scheme) {
+	case LOG_EULER:
+		return "logeuler";
+	case QUADRATIC_EXPONENTIAL:
+		return "qe";
+	default:
+		return "euler";
+	}
+}
+
+/**
+ * @brief		Set the scheme of the kernel arguments and compute its per-step constants, which only depend
+ *			on the model and on the time step (central discretization of the integrated variance)
+ * @param[in,out] args	The arguments, the model parameters and the discretization must be already set
+ * @param[in] scheme	The variance discretization scheme
+ */
+void HestonKernel::prepare(HestonKernelArgs & args, Scheme scheme){
+
+	double deltaT = args.T / ((double) args.discretization);
+	double xi2 = args.xi * args.xi;
+	double decay = exp(-args.kappa * deltaT);
+	double drift = 0.5 * deltaT * (args.kappa * args.rho / args.xi - 0.5);
+
+	args.scheme = scheme;
+	args.qeDecay = decay;
+	args.qeSlope = xi2 * decay * (1.0 - decay) / args.kappa;
+	args.qeConstant = args.theta * xi2 * (1.0 - decay) * (1.0 - decay) / (2.0 * args.kappa);
+	args.qeK1 = drift - args.rho / args.xi;
+	args.qeK2 = drift + args.rho / args.xi;
+	args.qeK3 = 0.5 * deltaT * (1.0 - args.rho * args.rho);
+	args.qeK4 = args.qeK3;
+}
+
+/**
+ * @brief		Convert the name given on the command line to a payoff, unknown names give the European call
+ * @param[in] name	One of call, asian, geometric, upout, upin, downout, downin and lookback
+ */
+HestonKernel::Payoff HestonKernel::parsePayoff(std::string const & name){
+
+	if (name == "asian")
+		return ASIAN_ARITHMETIC;
+	if (name == "geometric")
+		return ASIAN_GEOMETRIC;
+	if (name == "upout")
+		return UP_AND_OUT;
+	if (name == "upin")
+		return UP_AND_IN;
+	if (name == "downout")
+		return DOWN_AND_OUT;
+	if (name == "downin")
+		return DOWN_AND_IN;
+	if (name == "lookback")
+		return LOOKBACK;
+
+	return EUROPEAN;
+}
+
+const char* HestonKernel::payoffName(Payoff payoff){
+
+	switch (payoff) {
+	case ASIAN_ARITHMETIC:
+		return "asian";
+	case ASIAN_GEOMETRIC:
+		return "geometric";
+	case UP_AND_OUT:
+		return "upout";
+	case UP_AND_IN:
+		return "upin";
+	case DOWN_AND_OUT:
+		return "downout";
+	case DOWN_AND_IN:
+		return "downin";
+	case LOOKBACK:
+		return "lookback";
+	default:
+		return "call";
+	}
+}
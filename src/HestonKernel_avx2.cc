@@ -0,0 +1,23 @@
+/**
+ *       @file  HestonKernel_avx2.cc
+ *
+ * Description: The batched path kernels and Box-Muller transform built for AVX2, 8 paths per lane group in
+ *		double precision and 16 in single precision.
+ *
+ *     @author  Luca Napoletano luca.napoletano@mail.polimi.it, Claudio Montanari claudio1.montanari@mail.polimi.it
+ *
+ *     Company  Politecnico di Milano
+ *   Copyright  Copyright (c) 2017, Luca Napoletano, Claudio Montanari
+ *
+ * This source code is released for free distribution under the terms of the
+ * GNU General Public License as published by the Free Software Foundation.
+ * =====================================================================================
+ */
+
+#define HESTON_KERNEL_LANES 8
+#define HESTON_KERNEL_NAME hestonKernelAvx2
+#define HESTON_BOXMULLER_NAME hestonBoxMullerAvx2
+#define HESTON_KERNEL_FLOAT_NAME hestonKernelFloatAvx2
+
+#include "HestonKernel_simd.h"
+#include "HestonKernel_simd_float.h"
@@ -0,0 +1,522 @@
+/**
+ *       @file  HestonMetrics.cc
+ *
+ * Description: Metrics of the simulation engine. The endpoint thread answers every client of its socket with
+ *		the current metrics and closes the connection: a Prometheus server scrapes it over HTTP, a plain
+ *		client which sends nothing gets the same text after a short wait.
+ *
+ *     @author  Luca Napoletano luca.napoletano@mail.polimi.it, Claudio Montanari claudio1.montanari@mail.polimi.it
+ *
+ *     Company  Politecnico di Milano
+ *   Copyright  Copyright (c) 2017, Luca Napoletano, Claudio Montanari
+ *
+ * This source code is released for free distribution under the terms of the
+ * GNU General Public License as published by the Free Software Foundation.
+ * =====================================================================================
+ */
+#include "HestonMetrics.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace {
+
+/**
+ * The poll period of the endpoint thread, and the longest wait for the request of a client (ms)
+ */
+const int POLL_MS = 100;
+
+double Seconds(uint64_t nanoseconds) {
+	return nanoseconds * 1e-9;
+}
+
+uint64_t Nanoseconds(double seconds) {
+	return (uint64_t) std::max(0.0, seconds * 1e9);
+}
+
+/**
+ * @brief		The HELP and TYPE lines of a metric
+ */
+void Family(std::ostringstream & out, char const * name, char const * type, char const * help) {
+	out << "# HELP " << name << " " << help << "\n# TYPE " << name << " " << type << "\n";
+}
+
+}
+
+const double HestonMetrics::BOUNDS[HestonMetrics::BUCKETS - 1] = {
+	0.001, 0.002, 0.005, 0.01, 0.02, 0.05, 0.1, 0.2, 0.5, 1.0, 2.0, 5.0 };
+
+/**
+ * @brief		The metrics of an engine, the counters of the workers are attached by attach()
+ * @param[in] workers	The number of workers, one for each pool thread
+ */
+HestonMetrics::HestonMetrics(int workers) :
+	cycleTime(0),
+	waitTime(0),
+	steals(0),
+	AWM(-1),
+	ACTIVE(0),
+	price(NAN),
+	error(NAN),
+	REQUESTS(-1),
+	CLOSING(false) {
+
+	this->WORKERS = std::max(1, workers);
+	this->counters.assign(WORKERS, NULL);
+	this->busyTime = new std::atomic<uint64_t>[WORKERS];
+	this->idleTime = new std::atomic<uint64_t>[WORKERS];
+	this->chunks = new std::atomic<uint64_t>[WORKERS];
+	for (int w = 0; w < WORKERS; w++) {
+		busyTime[w] = 0;
+		idleTime[w] = 0;
+		chunks[w] = 0;
+	}
+
+	for (int b = 0; b < BUCKETS; b++)
+		cycleBuckets[b] = 0;
+	this->awmPaths = new std::atomic<uint64_t>[AWMS];
+	this->awmTime = new std::atomic<uint64_t>[AWMS];
+	for (int a = 0; a < AWMS; a++) {
+		awmPaths[a] = 0;
+		awmTime[a] = 0;
+	}
+	this->cyclePaths = 0;
+
+	this->lastTime = std::chrono::steady_clock::now();
+	this->lastPaths = 0;
+	this->lastSteps = 0;
+	this->listener = -1;
+}
+
+HestonMetrics::~HestonMetrics(){
+
+	close();
+	delete[] busyTime;
+	delete[] idleTime;
+	delete[] chunks;
+	delete[] awmPaths;
+	delete[] awmTime;
+}
+
+/**
+ * @brief		Read the counters of a worker, they must live until close()
+ */
+void HestonMetrics::attach(int worker, HestonCounters const * counters){
+
+	if (worker >= 0 && worker < WORKERS)
+		this->counters[worker] = counters;
+}
+
+/**
+ * @brief		The AWM and the number of workers granted by the last configuration
+ */
+void HestonMetrics::configure(int awm, int workers){
+
+	AWM = awm;
+	ACTIVE = workers;
+}
+
+/**
+ * @brief		Account a cycle of the EXC, from its start to the return of its last worker. The paths done
+ *			since the previous cycle go to the AWM of the last configuration
+ * @param[in] latency	The duration of the cycle (s)
+ * @param[in] wait	The time the EXC waited for the workers during the cycle (s)
+ * @param[in] scheduler	The scheduler which ran the cycle, NULL if it did not run on the scheduler
+ */
+void HestonMetrics::cycle(double latency, double wait, HestonScheduler const * scheduler){
+
+	int bucket = 0;
+	while (bucket < BUCKETS - 1 && latency > BOUNDS[bucket])
+		bucket++;
+	HestonCounters::add(cycleBuckets[bucket], 1);
+	HestonCounters::add(cycleTime, Nanoseconds(latency));
+	HestonCounters::add(waitTime, Nanoseconds(wait));
+
+	if (scheduler != NULL) {
+		for (int w = 0; w < std::min(WORKERS, scheduler->getWorkers()); w++) {
+			double busy = scheduler->getBusy(w);
+			HestonCounters::add(busyTime[w], Nanoseconds(busy));
+			HestonCounters::add(idleTime[w], Nanoseconds(latency - busy));
+			HestonCounters::add(chunks[w], (uint64_t) scheduler->getChunks(w));
+		}
+		HestonCounters::add(steals, (uint64_t) scheduler->getSteals());
+	}
+
+	int awm = AWM;
+	if (awm >= 0 && awm < AWMS) {
+		uint64_t paths = total(&HestonCounters::paths);
+		HestonCounters::add(awmPaths[awm], paths - cyclePaths);
+		HestonCounters::add(awmTime[awm], Nanoseconds(latency));
+		cyclePaths = paths;
+	}
+}
+
+/**
+ * @brief		The running estimate of the price and its standard error
+ */
+void HestonMetrics::estimate(double price, double error){
+
+	this->price = price;
+	this->error = error;
+}
+
+/**
+ * @brief		The requests replied by the batch pricing mode
+ */
+void HestonMetrics::requests(long done){
+
+	REQUESTS = done;
+}
+
+/**
+ * @brief		Serve the metrics on a local socket
+ * @param[in] address	unix:PATH for a Unix socket, or a TCP port of the loopback interface
+ * @return		false if the socket cannot be opened
+ */
+bool HestonMetrics::listen(std::string const & address){
+
+	if (address.compare(0, 5, "unix:") == 0) {
+		struct sockaddr_un local;
+		memset(&local, 0, sizeof(local));
+		local.sun_family = AF_UNIX;
+		socketPath = address.substr(5);
+		if (socketPath.empty() || socketPath.size() >= sizeof(local.sun_path))
+			return false;
+		strncpy(local.sun_path, socketPath.c_str(), sizeof(local.sun_path) - 1);
+
+		listener = socket(AF_UNIX, SOCK_STREAM, 0);
+		if (listener < 0)
+			return false;
+		unlink(socketPath.c_str());
+		if (bind(listener, (struct sockaddr *) &local, sizeof(local)) != 0 || ::listen(listener, 8) != 0) {
+			::close(listener);
+			listener = -1;
+			return false;
+		}
+	} else {
+		char* end = NULL;
+		long port = strtol(address.c_str(), &end, 10);
+		if (address.empty() || *end != '\0' || port <= 0 || port > 65535)
+			return false;
+
+		struct sockaddr_in local;
+		memset(&local, 0, sizeof(local));
+		local.sin_family = AF_INET;
+		local.sin_port = htons((uint16_t) port);
+		local.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+		listener = socket(AF_INET, SOCK_STREAM, 0);
+		if (listener < 0)
+			return false;
+		int reuse = 1;
+		setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+		if (bind(listener, (struct sockaddr *) &local, sizeof(local)) != 0 || ::listen(listener, 8) != 0) {
+			::close(listener);
+			listener = -1;
+			return false;
+		}
+	}
+
+	server = std::thread(&HestonMetrics::serveLoop, this);
+	return true;
+}
+
+/**
+ * @brief		Stop serving the metrics, the counters of the workers are not read anymore
+ */
+void HestonMetrics::close(){
+
+	CLOSING = true;
+	if (server.joinable())
+		server.join();
+
+	if (listener >= 0) {
+		::close(listener);
+		if (!socketPath.empty())
+			unlink(socketPath.c_str());
+		listener = -1;
+	}
+}
+
+/**
+ * @brief		Replace a file with the metrics in JSON, a reader never sees it half written
+ * @return		false if the file cannot be written
+ */
+bool HestonMetrics::write(std::string const & path){
+
+	std::string temporary = path + ".tmp";
+	{
+		std::ofstream file(temporary.c_str(), std::ios::trunc);
+		file << json();
+		if (!file.good())
+			return false;
+	}
+	return rename(temporary.c_str(), path.c_str()) == 0;
+}
+
+/**
+ * @brief		The metrics in the Prometheus text format
+ */
+std::string HestonMetrics::text() const {
+
+	std::ostringstream out;
+	out.precision(9);
+
+	Family(out, "heston_worker_paths_total", "counter", "Paths simulated by a worker, each with its antithetic twin");
+	for (int w = 0; w < WORKERS; w++)
+		if (counters[w] != NULL)
+			out << "heston_worker_paths_total{worker=\"" << w << "\"} " << counters[w]->paths.load() << "\n";
+
+	Family(out, "heston_worker_steps_total", "counter", "Time steps simulated by a worker");
+	for (int w = 0; w < WORKERS; w++)
+		if (counters[w] != NULL)
+			out << "heston_worker_steps_total{worker=\"" << w << "\"} " << counters[w]->steps.load() << "\n";
+
+	if (timers()) {
+		Family(out, "heston_worker_rng_seconds_total", "counter", "Time a worker spent drawing random numbers");
+		for (int w = 0; w < WORKERS; w++)
+			if (counters[w] != NULL)
+				out << "heston_worker_rng_seconds_total{worker=\"" << w << "\"} " << Seconds(counters[w]->rngTime) << "\n";
+
+		Family(out, "heston_worker_evolution_seconds_total", "counter", "Time a worker spent evolving the paths");
+		for (int w = 0; w < WORKERS; w++)
+			if (counters[w] != NULL)
+				out << "heston_worker_evolution_seconds_total{worker=\"" << w << "\"} " << Seconds(counters[w]->evolutionTime) << "\n";
+	}
+
+	Family(out, "heston_worker_busy_seconds_total", "counter", "Time a worker spent running chunks");
+	for (int w = 0; w < WORKERS; w++)
+		out << "heston_worker_busy_seconds_total{worker=\"" << w << "\"} " << Seconds(busyTime[w]) << "\n";
+
+	Family(out, "heston_worker_idle_seconds_total", "counter", "Time a worker of a cycle waited for the other workers");
+	for (int w = 0; w < WORKERS; w++)
+		out << "heston_worker_idle_seconds_total{worker=\"" << w << "\"} " << Seconds(idleTime[w]) << "\n";
+
+	Family(out, "heston_worker_chunks_total", "counter", "Chunks run by a worker");
+	for (int w = 0; w < WORKERS; w++)
+		out << "heston_worker_chunks_total{worker=\"" << w << "\"} " << chunks[w].load() << "\n";
+
+	Family(out, "heston_steals_total", "counter", "Chunks stolen from another worker");
+	out << "heston_steals_total " << steals.load() << "\n";
+
+	Family(out, "heston_wait_seconds_total", "counter", "Time the EXC waited for the workers");
+	out << "heston_wait_seconds_total " << Seconds(waitTime) << "\n";
+
+	Family(out, "heston_cycle_seconds", "histogram", "Latency of the cycles of the EXC");
+	uint64_t cumulative = 0;
+	for (int b = 0; b < BUCKETS; b++) {
+		cumulative += cycleBuckets[b];
+		if (b < BUCKETS - 1)
+			out << "heston_cycle_seconds_bucket{le=\"" << BOUNDS[b] << "\"} " << cumulative << "\n";
+		else
+			out << "heston_cycle_seconds_bucket{le=\"+Inf\"} " << cumulative << "\n";
+	}
+	out << "heston_cycle_seconds_sum " << Seconds(cycleTime) << "\n";
+	out << "heston_cycle_seconds_count " << cumulative << "\n";
+
+	Family(out, "heston_awm_paths_total", "counter", "Paths simulated in the cycles of an AWM");
+	for (int a = 0; a < AWMS; a++)
+		if (awmTime[a] > 0)
+			out << "heston_awm_paths_total{awm=\"" << a << "\"} " << awmPaths[a].load() << "\n";
+
+	Family(out, "heston_awm_seconds_total", "counter", "Duration of the cycles of an AWM");
+	for (int a = 0; a < AWMS; a++)
+		if (awmTime[a] > 0)
+			out << "heston_awm_seconds_total{awm=\"" << a << "\"} " << Seconds(awmTime[a]) << "\n";
+
+	Family(out, "heston_awm", "gauge", "AWM of the last configuration");
+	out << "heston_awm " << AWM.load() << "\n";
+
+	Family(out, "heston_workers", "gauge", "Workers of the last configuration");
+	out << "heston_workers " << ACTIVE.load() << "\n";
+
+	if (!std::isnan(price.load())) {
+		Family(out, "heston_price", "gauge", "Running estimate of the price");
+		out << "heston_price " << price.load() << "\n";
+		Family(out, "heston_price_error", "gauge", "Standard error of the running estimate of the price");
+		out << "heston_price_error " << error.load() << "\n";
+	}
+
+	if (REQUESTS >= 0) {
+		Family(out, "heston_requests_total", "counter", "Requests replied by the batch pricing mode");
+		out << "heston_requests_total " << REQUESTS.load() << "\n";
+	}
+
+	return out.str();
+}
+
+/**
+ * @brief		The metrics in JSON, with the paths and the steps per second since the previous call
+ */
+std::string HestonMetrics::json() {
+
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	double elapsed = std::chrono::duration<double>(now - lastTime).count();
+	uint64_t paths = total(&HestonCounters::paths);
+	uint64_t steps = total(&HestonCounters::steps);
+
+	std::ostringstream out;
+	char line[512];
+
+	snprintf(line, sizeof(line), "{\n  \"time\": %.3f,\n  \"awm\": %d,\n  \"workers\": %d,\n  \"timers\": %s,\n"
+		"  \"paths\": %llu,\n  \"steps\": %llu,\n  \"paths_per_sec\": %.1f,\n  \"steps_per_sec\": %.1f,\n"
+		"  \"wait_s\": %.6f,\n  \"steals\": %llu,\n",
+		std::chrono::duration<double>(std::chrono::system_clock::now().time_since_epoch()).count(),
+		AWM.load(), ACTIVE.load(), timers() ? "true" : "false",
+		(unsigned long long) paths, (unsigned long long) steps,
+		(elapsed > 0.0) ? (paths - lastPaths) / elapsed : 0.0, (elapsed > 0.0) ? (steps - lastSteps) / elapsed : 0.0,
+		Seconds(waitTime), (unsigned long long) steals.load());
+	out << line;
+
+	if (!std::isnan(price.load())) {
+		snprintf(line, sizeof(line), "  \"price\": %.10g,\n  \"error\": %.10g,\n", price.load(), error.load());
+		out << line;
+	}
+	if (REQUESTS >= 0)
+		out << "  \"requests\": " << REQUESTS.load() << ",\n";
+
+	out << "  \"per_worker\": [\n";
+	for (int w = 0; w < WORKERS; w++) {
+		HestonCounters const * worker = counters[w];
+		snprintf(line, sizeof(line), "    {\"worker\": %d, \"paths\": %llu, \"steps\": %llu, \"rng_s\": %.6f, "
+			"\"evolution_s\": %.6f, \"busy_s\": %.6f, \"idle_s\": %.6f, \"chunks\": %llu}%s\n", w,
+			(unsigned long long) (worker ? worker->paths.load() : 0), (unsigned long long) (worker ? worker->steps.load() : 0),
+			worker ? Seconds(worker->rngTime) : 0.0, worker ? Seconds(worker->evolutionTime) : 0.0,
+			Seconds(busyTime[w]), Seconds(idleTime[w]), (unsigned long long) chunks[w].load(),
+			(w + 1 < WORKERS) ? "," : "");
+		out << line;
+	}
+	out << "  ],\n";
+
+	uint64_t cycles = 0;
+	out << "  \"cycles\": {\"buckets\": [";
+	for (int b = 0; b < BUCKETS; b++) {
+		cycles += cycleBuckets[b];
+		if (b < BUCKETS - 1)
+			snprintf(line, sizeof(line), "{\"le_s\": %g, \"count\": %llu}, ", BOUNDS[b], (unsigned long long) cycles);
+		else
+			snprintf(line, sizeof(line), "{\"le_s\": null, \"count\": %llu}", (unsigned long long) cycles);
+		out << line;
+	}
+	snprintf(line, sizeof(line), "], \"count\": %llu, \"sum_s\": %.6f},\n", (unsigned long long) cycles, Seconds(cycleTime));
+	out << line;
+
+	out << "  \"per_awm\": [";
+	bool first = true;
+	for (int a = 0; a < AWMS; a++) {
+		if (awmTime[a] == 0)
+			continue;
+		double seconds = Seconds(awmTime[a]);
+		snprintf(line, sizeof(line), "%s\n    {\"awm\": %d, \"paths\": %llu, \"cycles_s\": %.6f, \"paths_per_sec\": %.1f}",
+			first ? "" : ",", a, (unsigned long long) awmPaths[a].load(), seconds, awmPaths[a] / seconds);
+		out << line;
+		first = false;
+	}
+	out << (first ? "]\n" : "\n  ]\n") << "}\n";
+
+	lastTime = now;
+	lastPaths = paths;
+	lastSteps = steps;
+	return out.str();
+}
+
+/**
+ * @brief		True when the workers time their random draws and their path evolution (HESTON_TIMERS)
+ */
+bool HestonMetrics::timers(){
+
+#ifdef HESTON_TIMERS
+	return true;
+#else
+	return false;
+#endif
+}
+
+/**
+ * @brief		The sum of a counter over the workers
+ */
+uint64_t HestonMetrics::total(std::atomic<uint64_t> HestonCounters::* counter) const {
+
+	uint64_t sum = 0;
+	for (int w = 0; w < WORKERS; w++)
+		if (counters[w] != NULL)
+			sum += (counters[w]->*counter).load(std::memory_order_relaxed);
+	return sum;
+}
+
+/**
+ * @brief		The endpoint thread, it serves the clients one after the other
+ */
+void HestonMetrics::serveLoop(){
+
+	while (!CLOSING) {
+		struct pollfd ready = { listener, POLLIN, 0 };
+		if (poll(&ready, 1, POLL_MS) <= 0)
+			continue;
+		int client = accept(listener, NULL, NULL);
+		if (client < 0)
+			continue;
+		serveClient(client);
+		::close(client);
+	}
+}
+
+/**
+ * @brief		Read the request of a client, if any, and reply with the metrics. An HTTP request gets an
+ *			HTTP reply, whatever its path
+ */
+void HestonMetrics::serveClient(int fd){
+
+	std::string request;
+	char chunk[1024];
+	while (request.find("\r\n\r\n") == std::string::npos && request.find("\n\n") == std::string::npos
+			&& request.size() < 8192) {
+		struct pollfd ready = { fd, POLLIN, 0 };
+		if (poll(&ready, 1, POLL_MS) <= 0)
+			break;
+		ssize_t bytes = read(fd, chunk, sizeof(chunk));
+		if (bytes < 0 && errno == EINTR)
+			continue;
+		if (bytes <= 0)
+			break;
+		request.append(chunk, bytes);
+	}
+
+	std::string body = text();
+	std::string reply;
+	if (request.compare(0, 4, "GET ") == 0 || request.compare(0, 5, "HEAD ") == 0) {
+		std::ostringstream header;
+		header << "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: " << body.size()
+			<< "\r\nConnection: close\r\n\r\n";
+		reply = header.str();
+		if (request.compare(0, 4, "GET ") == 0)
+			reply += body;
+	} else {
+		reply = body;
+	}
+
+	char const * data = reply.data();
+	size_t bytes = reply.size();
+	while (bytes > 0) {
+		ssize_t written = send(fd, data, bytes, MSG_NOSIGNAL);
+		if (written < 0 && errno == EINTR)
+			continue;
+		if (written <= 0)
+			break;
+		data += written;
+		bytes -= written;
+	}
+}
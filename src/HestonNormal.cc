@@ -0,0 +1,336 @@
+/**
+ *       @file  HestonNormal.cc
+ *
+ * Description: Block generator of N(0,1) draws used by the HestonWorkers. The uniforms of a whole buffer are
+ *		drawn first and then transformed in a tight loop (vectorized for Box-Muller), the result is read
+ *		by the path kernels without any per-draw function call.
+ *
+ *     @author  Luca Napoletano luca.napoletano@mail.polimi.it, Claudio Montanari claudio1.montanari@mail.polimi.it
+ *
+ *     Company  Politecnico di Milano
+ *   Copyright  Copyright (c) 2017, Luca Napoletano, Claudio Montanari
+ *
+ * This source code is released for free distribution under the terms of the
+ * GNU General Public License as published by the Free Software Foundation.
+ * =====================================================================================
+ */
+#include "HestonNormal.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+#define ZIGGURAT_R 3.442619855899
+#define ZIGGURAT_V 9.91256303526217e-3
+
+namespace {
+
+/**
+ * @brief		A uniform draw in (0, 1), 0 and 1 excluded
+ */
+inline double uniform(HestonRandom & generator){
+	return (((double) generator()) + 0.5) * (1.0 / 4294967296.0);
+}
+
+/**
+ * @brief		Wichura AS241 (PPND16) inverse of the standard normal CDF
+ */
+inline double ppnd16(double p){
+
+	double q = p - 0.5;
+	double r;
+	double value;
+
+	if (fabs(q) <= 0.425) {
+		r = 0.180625 - q * q;
+		return q * (((((((r * 2509.0809287301226727 + 33430.575583588128105) * r + 67265.770927008700853) * r
+			+ 45921.953931549871457) * r + 13731.693765509461125) * r + 1971.5909503065514427) * r
+			+ 133.14166789178437745) * r + 3.387132872796366608)
+			/ (((((((r * 5226.495278852545925 + 28729.085735721942674) * r + 39307.89580009271061) * r
+			+ 21213.794301586595867) * r + 5394.1960214247511077) * r + 687.1870074920579083) * r
+			+ 42.313330701600911252) * r + 1.0);
+	}
+
+	r = (q < 0) ? p : 1.0 - p;
+	r = sqrt(-log(r));
+
+	if (r <= 5.0) {
+		r -= 1.6;
+		value = (((((((r * 7.7454501427834140764e-4 + 0.0227238449892691845833) * r + 0.24178072517745061177) * r
+			+ 1.27045825245236838258) * r + 3.64784832476320460504) * r + 5.7694972214606914055) * r
+			+ 4.6303378461565452959) * r + 1.42343711074968357734)
+			/ (((((((r * 1.05075007164441684324e-9 + 5.475938084995344946e-4) * r + 0.0151986665636164571966) * r
+			+ 0.14810397642748007459) * r + 0.68976733498510000455) * r + 1.6763848301838038494) * r
+			+ 2.05319162663775882187) * r + 1.0);
+	}
+	else {
+		r -= 5.0;
+		value = (((((((r * 2.01033439929228813265e-7 + 2.71155556874348757815e-5) * r + 0.0012426609473880784386) * r
+			+ 0.026532189526576123093) * r + 0.29656057182850489123) * r + 1.7848265399172913358) * r
+			+ 5.4637849111641143699) * r + 6.6579046435011037772)
+			/ (((((((r * 2.04426310338993978564e-15 + 1.4215117583164458887e-7) * r + 1.8463183175100546818e-5) * r
+			+ 7.868691311456132591e-4) * r + 0.0148753612908506148525) * r + 0.13692988092273580531) * r
+			+ 0.59983220655588793769) * r + 1.0);
+	}
+
+	return (q < 0.0) ? -value : value;
+}
+
+/**
+ * @brief		Abramowitz and Stegun formula 26.2.23, the absolute error is less than 4.5e-4
+ */
+inline double abramowitzStegun(double p){
+
+	double c[] = {2.515517, 0.802853, 0.010328};
+	double d[] = {1.432788, 0.189269, 0.001308};
+	double t = (p < 0.5) ? sqrt(-2.0 * log(p)) : sqrt(-2.0 * log(1 - p));
+	double value = t - ((c[2] * t + c[1]) * t + c[0]) / (((d[2] * t + d[1]) * t + d[0]) * t + 1.0);
+
+	return (p < 0.5) ? -value : value;
+}
+
+}
+
+/**
+ * @brief		Build a generator
+ * @param[in] algorithm	The algorithm used to fill the buffers
+ * @param[in] isa	The instruction set used by the vectorized Box-Muller transform
+ */
+HestonNormal::HestonNormal(Algorithm algorithm, HestonKernel::Isa isa){
+
+	this->algorithm = algorithm;
+	this->transform = HestonKernel::boxMuller(isa);
+	this->GROUP = 2 * HestonKernel::lanes(isa);
+
+	// Ziggurat blocks, all of them with area ZIGGURAT_V
+	double f = exp(-0.5 * ZIGGURAT_R * ZIGGURAT_R);
+	zigguratX[0] = ZIGGURAT_V / f;
+	zigguratX[1] = ZIGGURAT_R;
+	zigguratX[128] = 0;
+
+	for (int i = 2; i < 128; i++) {
+		zigguratX[i] = sqrt(-2 * log(ZIGGURAT_V / zigguratX[i - 1] + f));
+		f = exp(-0.5 * zigguratX[i] * zigguratX[i]);
+	}
+
+	for (int i = 0; i < 128; i++) {
+		zigguratRatio[i] = zigguratX[i + 1] / zigguratX[i];
+	}
+}
+
+/**
+ * @brief		Fill a buffer with N(0,1) draws
+ * @param[in] generator	The source of the uniform draws
+ * @param[out] buffer	The buffer to fill
+ * @param[in] n		The number of draws
+ */
+void HestonNormal::fill(HestonRandom & generator, double * buffer, int n){
+
+	int i = 0;
+
+	switch (algorithm) {
+
+	case BOX_MULLER:
+		for (i = 0; i < n; i++) {
+			buffer[i] = uniform(generator);
+		}
+
+		i = 0;
+		if (transform != NULL) {
+			transform(buffer, n);
+			i = n - n % GROUP;
+		}
+
+		for (; i + 1 < n; i += 2) {
+			double radius = sqrt(-2.0 * log(buffer[i]));
+			double angle = 6.283185307179586 * buffer[i + 1];
+			buffer[i] = radius * cos(angle);
+			buffer[i + 1] = radius * sin(angle);
+		}
+
+		if (i < n) {
+			buffer[i] = sqrt(-2.0 * log(buffer[i])) * cos(6.283185307179586 * uniform(generator));
+		}
+		break;
+
+	case ZIGGURAT:
+		for (i = 0; i < n; i++) {
+			while (true) {
+				double u = 2 * uniform(generator) - 1;
+				int block = generator() & 0x7F;
+
+				// Inside the rectangle of the block: accepted without any exp()
+				if (fabs(u) < zigguratRatio[block]) {
+					buffer[i] = u * zigguratX[block];
+					break;
+				}
+
+				if (block == 0) {
+					buffer[i] = zigguratTail(generator, u < 0);
+					break;
+				}
+
+				double x = u * zigguratX[block];
+				double f0 = exp(-0.5 * (zigguratX[block] * zigguratX[block] - x * x));
+				double f1 = exp(-0.5 * (zigguratX[block + 1] * zigguratX[block + 1] - x * x));
+				if (f1 + uniform(generator) * (f0 - f1) < 1.0) {
+					buffer[i] = x;
+					break;
+				}
+			}
+		}
+		break;
+
+	case AS241:
+		for (i = 0; i < n; i++) {
+			buffer[i] = ppnd16(uniform(generator));
+		}
+		break;
+
+	case ABRAMOWITZ_STEGUN:
+		for (i = 0; i < n; i++) {
+			buffer[i] = abramowitzStegun(uniform(generator));
+		}
+		break;
+	}
+}
+
+/**
+ * @brief		Draw from the tail of the normal distribution beyond ZIGGURAT_R (Marsaglia)
+ */
+double HestonNormal::zigguratTail(HestonRandom & generator, bool negative){
+
+	double x;
+	double y;
+
+	do {
+		x = log(uniform(generator)) / ZIGGURAT_R;
+		y = log(uniform(generator));
+	} while (-2 * y < x * x);
+
+	return negative ? x - ZIGGURAT_R : ZIGGURAT_R - x;
+}
+
+/**
+ * @brief		Inverse of the standard normal CDF (Wichura AS241)
+ * @param[in] p		A value between 0 and 1 (excluded)
+ */
+double HestonNormal::inverse(double p){
+	return ppnd16(p);
+}
+
+/**
+ * @brief		Inverse of the standard normal CDF used by the original code (Abramowitz and Stegun 26.2.23)
+ * @param[in] p		A value between 0 and 1 (excluded)
+ */
+double HestonNormal::legacyInverse(double p){
+	return abramowitzStegun(p);
+}
+
+/**
+ * @brief		The standard normal CDF
+ */
+double HestonNormal::cdf(double x){
+	return 0.5 * erfc(-x * M_SQRT1_2);
+}
+
+HestonNormal::Algorithm HestonNormal::parse(std::string const & name){
+
+	if (name == "ziggurat")
+		return ZIGGURAT;
+	if (name == "as241")
+		return AS241;
+	if (name == "legacy")
+		return ABRAMOWITZ_STEGUN;
+
+	return BOX_MULLER;
+}
+
+const char* HestonNormal::name(Algorithm algorithm){
+
+	switch (algorithm) {
+	case ZIGGURAT:
+		return "ziggurat";
+	case AS241:
+		return "as241";
+	case ABRAMOWITZ_STEGUN:
+		return "legacy";
+	default:
+		return "boxmuller";
+	}
+}
+
+/**
+ * @brief		Measure speed and accuracy of every algorithm. The speed is given in ns per variate, the
+ *			accuracy as the error of the first four moments over the timed draws and, for the inversion
+ *			algorithms, as the largest error of the inverse CDF against a Newton refined reference
+ * @param[in] isa	The instruction set of the vectorized transforms
+ * @param[in] out	The stream where the report is printed
+ */
+void HestonNormal::benchmark(HestonKernel::Isa isa, std::ostream & out){
+
+	const int BUFFER = 1 << 16;
+	const int ROUNDS = 256;
+
+	std::vector<double> buffer(BUFFER);
+	HestonRandom generator(42);
+	char line[256];
+
+	snprintf(line, sizeof(line), "%-10s %12s %12s %12s %12s %12s %12s",
+		"algorithm", "ns/variate", "mean", "variance-1", "skewness", "kurtosis-3", "max|inv err|");
+	out << line << std::endl;
+
+	for (int a = BOX_MULLER; a <= ABRAMOWITZ_STEGUN; a++) {
+
+		HestonNormal normal((Algorithm) a, isa);
+		double m1 = 0, m2 = 0, m3 = 0, m4 = 0;
+		double elapsed = 0;
+
+		for (int round = 0; round < ROUNDS; round++) {
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			normal.fill(generator, buffer.data(), BUFFER);
+			elapsed += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+
+			for (int i = 0; i < BUFFER; i++) {
+				double x = buffer[i];
+				double x2 = x * x;
+				m1 += x;
+				m2 += x2;
+				m3 += x2 * x;
+				m4 += x2 * x2;
+			}
+		}
+
+		double draws = (double) BUFFER * ROUNDS;
+		m1 /= draws;
+		m2 /= draws;
+		m3 /= draws;
+		m4 /= draws;
+
+		double variance = m2 - m1 * m1;
+		double skewness = (m3 - 3 * m1 * m2 + 2 * m1 * m1 * m1) / pow(variance, 1.5);
+		double kurtosis = (m4 - 4 * m1 * m3 + 6 * m1 * m1 * m2 - 3 * m1 * m1 * m1 * m1) / (variance * variance);
+
+		char error[32] = "-";
+		if (a == AS241 || a == ABRAMOWITZ_STEGUN) {
+			double worst = 0;
+			for (int i = 1; i < 200000; i++) {
+				// Uniform grid in the body, geometric grid in the tails
+				double p = (i < 100000) ? i / 100000.0 : pow(10.0, -12.0 * (i - 100000) / 100000.0);
+				double x = (a == AS241) ? ppnd16(p) : abramowitzStegun(p);
+				double exact = ppnd16(p);
+				for (int k = 0; k < 2; k++) {
+					exact -= (cdf(exact) - p) * 2.5066282746310002 * exp(0.5 * exact * exact);
+				}
+				worst = std::max(worst, fabs(x - exact));
+			}
+			snprintf(error, sizeof(error), "%.3e", worst);
+		}
+
+		snprintf(line, sizeof(line), "%-10s %12.3f %12.3e %12.3e %12.3e %12.3e %12s",
+			name((Algorithm) a), elapsed / draws, m1, variance - 1, skewness, kurtosis - 3, error);
+		out << line << std::endl;
+	}
+}
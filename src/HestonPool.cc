@@ -0,0 +1,175 @@
+/**
+ *       @file  HestonPool.cc
+ *
+ * Description: Persistent worker threads used by the HestonWorkers. Each thread owns a mailbox (Slot): the
+ *		HestonWorker posts its simulation into the mailbox and joins it at the end of the cycle, so no
+ *		thread is created or destroyed while the application is running.
+ *
+ *     @author  Luca Napoletano luca.napoletano@mail.polimi.it, Claudio Montanari claudio1.montanari@mail.polimi.it
+ *
+ *     Company  Politecnico di Milano
+ *   Copyright  Copyright (c) 2017, Luca Napoletano, Claudio Montanari
+ *
+ * This source code is released for free distribution under the terms of the
+ * GNU General Public License as published by the Free Software Foundation.
+ * =====================================================================================
+ */
+#include "HestonPool.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+/**
+ * @brief		Create the pool threads, they are parked until a task is posted
+ * @param[in] threads	The number of threads of the pool
+ */
+HestonPool::HestonPool(int threads){
+
+	this->THREADS = threads;
+
+	slots = new Slot[THREADS];
+	for(int i = 0; i < THREADS; i++){
+		slots[i].busy = false;
+		slots[i].shutdown = false;
+	}
+
+	for(int i = 0; i < THREADS; i++){
+		this->threads.push_back(std::thread(&HestonPool::loop, this, i));
+	}
+}
+
+/**
+ * @brief		Wake up all the parked threads and wait for them to exit
+ */
+HestonPool::~HestonPool(){
+
+	for(int i = 0; i < THREADS; i++){
+		std::unique_lock<std::mutex> guard(slots[i].lock);
+		slots[i].shutdown = true;
+		slots[i].wakeup.notify_one();
+	}
+
+	for(int i = 0; i < THREADS; i++){
+		threads[i].join();
+	}
+
+	delete[] slots;
+}
+
+/**
+ * @brief		Main loop of a pool thread: sleep, run the posted task, signal its completion
+ * @param[in] slot	The mailbox of this thread
+ */
+void HestonPool::loop(int slot){
+
+	Slot & s = slots[slot];
+	std::unique_lock<std::mutex> guard(s.lock);
+
+	while(true) {
+		while(!s.busy && !s.shutdown)
+			s.wakeup.wait(guard);
+
+		if(!s.busy)
+			return;
+
+		// Run the task without holding the mailbox lock
+		guard.unlock();
+		s.task();
+		guard.lock();
+
+		s.busy = false;
+		s.done.notify_all();
+	}
+}
+
+/**
+ * @brief		Post a task to a thread of the pool, the call does not block
+ * @param[in] slot	The thread which has to run the task
+ * @param[in] task	The task to run
+ */
+void HestonPool::post(int slot, std::function<void()> const & task){
+
+	Slot & s = slots[slot];
+	std::unique_lock<std::mutex> guard(s.lock);
+
+	// A slot runs one task at a time
+	while(s.busy)
+		s.done.wait(guard);
+
+	s.task = task;
+	s.busy = true;
+	s.wakeup.notify_one();
+}
+
+/**
+ * @brief		Wait the end of the task posted to a thread
+ * @param[in] slot	The thread to wait for
+ */
+void HestonPool::join(int slot){
+
+	Slot & s = slots[slot];
+	std::unique_lock<std::mutex> guard(s.lock);
+
+	while(s.busy)
+		s.done.wait(guard);
+}
+
+/**
+ * @brief		Pin each thread of the pool to one of the given CPUs. Threads are assigned to the CPUs in a
+ *			round-robin way, so that the first workers used by onRun() get distinct CPUs
+ * @param[in] cpus	The CPUs where the pool can run
+ */
+void HestonPool::setAffinity(std::vector<int> const & cpus){
+
+	if(cpus.empty())
+		return;
+
+	for(int i = 0; i < THREADS; i++){
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		CPU_SET(cpus[i % cpus.size()], &set);
+		pthread_setaffinity_np(threads[i].native_handle(), sizeof(cpu_set_t), &set);
+	}
+}
+
+int HestonPool::size(){
+	return THREADS;
+}
+
+/**
+ * @brief		Return the CPUs the calling thread is allowed to run on. Under the BarbequeRTRM the cpuset of
+ *			the application is updated before onConfigure() is called, thus this is the set of CPUs
+ *			currently granted to the application
+ */
+std::vector<int> HestonPool::allowedCpus(){
+
+	std::vector<int> cpus;
+	cpu_set_t set;
+
+	CPU_ZERO(&set);
+	if(sched_getaffinity(0, sizeof(cpu_set_t), &set) != 0)
+		return cpus;
+
+	for(int i = 0; i < CPU_SETSIZE; i++){
+		if(CPU_ISSET(i, &set))
+			cpus.push_back(i);
+	}
+
+	return cpus;
+}
+
+/**
+ * @brief		Return the NUMA node of the CPU running the calling thread
+ */
+int HestonPool::currentNode(){
+
+	unsigned cpu = 0;
+	unsigned node = 0;
+
+	if(syscall(SYS_getcpu, &cpu, &node, NULL) != 0)
+		return 0;
+
+	return (int) node;
+}
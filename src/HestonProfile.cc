@@ -0,0 +1,146 @@
+/**
+ *       @file  HestonProfile.cc
+ *
+ * Description: The operating points file and the recipe generated from it. The file holds one AWM per line:
+ *		id, discretization, scheme, precision, target error, CPU quota, paths per second, bias, RMS error
+ *		and value, the lines starting with # are comments. Only the first five fields are knobs, the
+ *		others document the profile the recipe comes from.
+ *
+ *     @author  Luca Napoletano luca.napoletano@mail.polimi.it, Claudio Montanari claudio1.montanari@mail.polimi.it
+ *
+ *     Company  Politecnico di Milano
+ *   Copyright  Copyright (c) 2017, Luca Napoletano, Claudio Montanari
+ *
+ * This source code is released for free distribution under the terms of the
+ * GNU General Public License as published by the Free Software Foundation.
+ * =====================================================================================
+ */
+#include "HestonProfile.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+/**
+ * @brief		Load the operating points of a file, the invalid lines (an unknown scheme or precision among
+ *			them) and the repeated AWMs are skipped
+ * @param[in] path	The operating points file
+ * @param[out] points	The operating points, sorted by AWM
+ * @return		The number of operating points, -1 if the file cannot be read
+ */
+int HestonProfile::load(std::string const & path, std::vector<HestonOperatingPoint> & points){
+
+	std::ifstream file(path.c_str());
+	if (!file)
+		return -1;
+
+	points.clear();
+
+	std::string line;
+	while (std::getline(file, line)) {
+		size_t start = line.find_first_not_of(" \t\r");
+		if (start == std::string::npos || line[start] == '#')
+			continue;
+
+		std::stringstream stream(line);
+		HestonOperatingPoint point;
+		std::string scheme, precision;
+		bool valid = (stream >> point.awm >> point.discretization >> scheme >> precision >> point.targetError)
+			&& point.awm >= 0 && point.awm <= 255 && point.discretization >= 1 && point.targetError >= 0.0
+			&& find(points, point.awm) == NULL;
+		// The parsers map the unknown names to the defaults, a name is only valid if it comes back
+		point.scheme = HestonKernel::parseScheme(scheme);
+		point.precision = HestonKernel::parsePrecision(precision);
+		if (!valid || scheme != HestonKernel::schemeName(point.scheme) || precision != HestonKernel::precisionName(point.precision)) {
+			std::cout << "Skipping invalid operating point: " << line << std::endl;
+			continue;
+		}
+		// The measures are optional, a hand written file only has the knobs
+		HestonOperatingPoint measured = point;
+		if (stream >> measured.quota >> measured.throughput >> measured.bias >> measured.rmse >> measured.value)
+			point = measured;
+		points.push_back(point);
+	}
+
+	std::sort(points.begin(), points.end(), [](HestonOperatingPoint const & a, HestonOperatingPoint const & b) {
+		return a.awm < b.awm;
+	});
+
+	return (int) points.size();
+}
+
+/**
+ * @brief		Write the operating points file
+ * @return		false if the file cannot be written
+ */
+bool HestonProfile::save(std::string const & path, std::vector<HestonOperatingPoint> const & points){
+
+	std::ofstream file(path.c_str(), std::ios::trunc);
+
+	file << "# Operating points of the HestonFour AWMs, generated by hestonfour_profile" << std::endl;
+	file << "# awm discretization scheme precision target_error quota paths_per_sec bias rmse value" << std::endl;
+	for (size_t p = 0; p < points.size(); p++) {
+		HestonOperatingPoint const & point = points[p];
+		char text[256];
+		snprintf(text, sizeof(text), "%d %d %s %s %.6g %d %.6g %.6g %.6g %d", point.awm, point.discretization,
+			HestonKernel::schemeName(point.scheme), HestonKernel::precisionName(point.precision), point.targetError,
+			point.quota, point.throughput, point.bias, point.rmse, point.value);
+		file << text << std::endl;
+	}
+
+	return file.good();
+}
+
+/**
+ * @brief		Write the recipe of the operating points: one AWM of the Linux platform for each of them,
+ *			with its CPU quota and its value, and the knobs it selects as a comment
+ */
+void HestonProfile::writeRecipe(std::ostream & out, std::vector<HestonOperatingPoint> const & points){
+
+	out << "<?xml version=\"1.0\"?>" << std::endl;
+	out << "<BarbequeRTRM recipe_version=\"0.8\">" << std::endl;
+	out << "\t<application priority=\"4\">" << std::endl;
+	out << "\t\t<platform id=\"org.linux.cgroup\">" << std::endl;
+	out << "\t\t\t<awms>" << std::endl;
+
+	for (size_t p = 0; p < points.size(); p++) {
+		HestonOperatingPoint const & point = points[p];
+		char text[256];
+
+		snprintf(text, sizeof(text), "%d steps, %s, %s, target error %.3g: %.0f paths/s per core, RMS error %.3g",
+			point.discretization, HestonKernel::schemeName(point.scheme), HestonKernel::precisionName(point.precision),
+			point.targetError, point.throughput, point.rmse);
+		out << "\t\t\t\t<!-- " << text << " -->" << std::endl;
+		out << "\t\t\t\t<awm id=\"" << point.awm << "\" name=\"" << HestonKernel::schemeName(point.scheme)
+			<< point.discretization << (point.precision == HestonKernel::FLOAT ? "f" : "")
+			<< "\" value=\"" << point.value << "\">" << std::endl;
+		out << "\t\t\t\t\t<resources>" << std::endl;
+		out << "\t\t\t\t\t\t<cpu>" << std::endl;
+		out << "\t\t\t\t\t\t\t<pe qty=\"" << point.quota << "\"/>" << std::endl;
+		out << "\t\t\t\t\t\t\t<mem units=\"Mb\" qty=\"2\"/>" << std::endl;
+		out << "\t\t\t\t\t\t</cpu>" << std::endl;
+		out << "\t\t\t\t\t</resources>" << std::endl;
+		out << "\t\t\t\t</awm>" << std::endl;
+	}
+
+	out << "\t\t\t</awms>" << std::endl;
+	out << "\t\t</platform>" << std::endl;
+	out << "\t</application>" << std::endl;
+	out << "</BarbequeRTRM>" << std::endl;
+	out << "<!-- vim: set tabstop=4 filetype=xml : -->" << std::endl;
+}
+
+/**
+ * @brief		Return the operating point of an AWM, NULL if it has none
+ */
+HestonOperatingPoint const * HestonProfile::find(std::vector<HestonOperatingPoint> const & points, int awm){
+
+	for (size_t p = 0; p < points.size(); p++) {
+		if (points[p].awm == awm)
+			return &points[p];
+	}
+
+	return NULL;
+}
@@ -0,0 +1,189 @@
+/**
+ *       @file  HestonScheduler.cc
+ *
+ * Description: Work-stealing scheduler of the chunks of a cycle. A worker thread loops on its own deque and
+ *		then on the others, it returns to the pool when no deque has a chunk left: no chunk is added
+ *		during a cycle, so an empty scan means that the cycle is only waiting for the running chunks.
+ *
+ *     @author  Luca Napoletano luca.napoletano@mail.polimi.it, Claudio Montanari claudio1.montanari@mail.polimi.it
+ *
+ *     Company  Politecnico di Milano
+ *   Copyright  Copyright (c) 2017, Luca Napoletano, Claudio Montanari
+ *
+ * This source code is released for free distribution under the terms of the
+ * GNU General Public License as published by the Free Software Foundation.
+ * =====================================================================================
+ */
+#include "HestonScheduler.h"
+
+#include <algorithm>
+#include <chrono>
+
+/**
+ * @brief		The scheduler of the threads of a pool, at most one worker for each pool thread
+ */
+HestonScheduler::HestonScheduler(HestonPool* pool) :
+	CANCELLED(false),
+	steals(0) {
+
+	this->pool = pool;
+	this->queues = new Queue[pool->size()];
+	this->WORKERS = 0;
+	this->CHUNKS = 0;
+}
+
+HestonScheduler::~HestonScheduler(){
+
+	join();
+	delete[] queues;
+}
+
+/**
+ * @brief		Start a cycle: worker w owns the chunks [w * chunks / workers, (w + 1) * chunks / workers)
+ * @param[in] workers	The number of pool threads running the cycle
+ * @param[in] chunks	The number of chunks of the cycle
+ * @param[in] task	The function running a chunk
+ */
+void HestonScheduler::start(int workers, long chunks, Task const & task){
+
+	this->WORKERS = std::max(1, std::min(workers, pool->size()));
+	this->CHUNKS = chunks;
+	this->task = task;
+
+	done.assign(chunks, 0);
+	busy.assign(WORKERS, 0.0);
+	executed.assign(WORKERS, 0);
+	steals = 0;
+	CANCELLED = false;
+
+	for (int w = 0; w < WORKERS; w++) {
+		std::lock_guard<std::mutex> guard(queues[w].lock);
+		queues[w].chunks.clear();
+		for (long c = w * chunks / WORKERS; c < (w + 1) * chunks / WORKERS; c++)
+			queues[w].chunks.push_back(c);
+	}
+
+	for (int w = 0; w < WORKERS; w++)
+		pool->post(w, std::bind(&HestonScheduler::loop, this, w));
+}
+
+/**
+ * @brief		Wait for the end of a chunk of the running cycle
+ */
+void HestonScheduler::wait(long chunk){
+
+	std::unique_lock<std::mutex> guard(doneLock);
+	doneSignal.wait(guard, [this, chunk]() { return done[chunk] != 0; });
+}
+
+/**
+ * @brief		Wait for the end of a chunk of the running cycle, up to a deadline
+ * @return		false if the deadline expired first
+ */
+bool HestonScheduler::wait(long chunk, std::chrono::steady_clock::time_point deadline){
+
+	std::unique_lock<std::mutex> guard(doneLock);
+	return doneSignal.wait_until(guard, deadline, [this, chunk]() { return done[chunk] != 0; });
+}
+
+/**
+ * @brief		Stop dealing the chunks of the running cycle. The running chunks are not interrupted, this is
+ *			up to the task (see HestonWorker::stop())
+ */
+void HestonScheduler::cancel(){
+
+	CANCELLED = true;
+}
+
+/**
+ * @brief		Wait for the workers of the running cycle to return to the pool
+ */
+void HestonScheduler::join(){
+
+	for (int w = 0; w < WORKERS; w++)
+		pool->join(w);
+}
+
+bool HestonScheduler::pop(int worker, long & chunk){
+
+	std::lock_guard<std::mutex> guard(queues[worker].lock);
+	if (queues[worker].chunks.empty())
+		return false;
+
+	chunk = queues[worker].chunks.front();
+	queues[worker].chunks.pop_front();
+	return true;
+}
+
+/**
+ * @brief		Take the last chunk of another worker, the victims are visited starting from the next one
+ */
+bool HestonScheduler::steal(int worker, long & chunk){
+
+	for (int v = 1; v < WORKERS; v++) {
+		Queue & victim = queues[(worker + v) % WORKERS];
+		std::lock_guard<std::mutex> guard(victim.lock);
+		if (victim.chunks.empty())
+			continue;
+
+		chunk = victim.chunks.back();
+		victim.chunks.pop_back();
+		steals++;
+		return true;
+	}
+
+	return false;
+}
+
+/**
+ * @brief		The loop of a worker thread, it runs until all the deques are empty
+ */
+void HestonScheduler::loop(int worker){
+
+	long chunk;
+
+	while (!CANCELLED && (pop(worker, chunk) || steal(worker, chunk))) {
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		task(worker, chunk);
+		busy[worker] += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		executed[worker]++;
+
+		std::lock_guard<std::mutex> guard(doneLock);
+		done[chunk] = 1;
+		doneSignal.notify_all();
+	}
+}
+
+int HestonScheduler::getWorkers() const {
+	return WORKERS;
+}
+
+/**
+ * @brief		The time a worker spent running chunks in the last cycle (seconds)
+ */
+double HestonScheduler::getBusy(int worker) const {
+	return busy[worker];
+}
+
+long HestonScheduler::getChunks(int worker) const {
+	return executed[worker];
+}
+
+long HestonScheduler::getSteals() const {
+	return steals;
+}
+
+/**
+ * @brief		Load imbalance of the last cycle, the busiest worker over the mean busy time minus one (0 for
+ *			a perfect balance)
+ */
+double HestonScheduler::getImbalance() const {
+
+	double total = 0.0, busiest = 0.0;
+	for (int w = 0; w < WORKERS; w++) {
+		total += busy[w];
+		busiest = std::max(busiest, busy[w]);
+	}
+
+	return (total > 0.0) ? busiest * WORKERS / total - 1.0 : 0.0;
+}
@@ -0,0 +1,450 @@
+/**
+ *       @file  HestonServer.cc
+ *
+ * Description: Request stream of the batch pricing mode. The reader thread polls its stream, so that close()
+ *		never waits for a client which does not send anything. The queue of the requests is bounded,
+ *		a large request file is read as fast as the requests are priced.
+ *
+ *     @author  Luca Napoletano luca.napoletano@mail.polimi.it, Claudio Montanari claudio1.montanari@mail.polimi.it
+ *
+ *     Company  Politecnico di Milano
+ *   Copyright  Copyright (c) 2017, Luca Napoletano, Claudio Montanari
+ *
+ * This source code is released for free distribution under the terms of the
+ * GNU General Public License as published by the Free Software Foundation.
+ * =====================================================================================
+ */
+#include "HestonServer.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace {
+
+/**
+ * Requests read ahead of the EXC, and the poll period of the reader thread (ms)
+ */
+const size_t QUEUE = 4096;
+const int POLL_MS = 100;
+
+/**
+ * @brief		A stream of replies, the descriptor is closed with the last reply which uses it
+ */
+std::shared_ptr<int> Stream(int fd) {
+	return std::shared_ptr<int>(new int(fd), [](int * fd) {
+		if (*fd > 2)
+			::close(*fd);
+		delete fd;
+	});
+}
+
+}
+
+volatile sig_atomic_t HestonServer::INTERRUPTED = 0;
+
+/**
+ * @brief			The request stream, nothing is read until open()
+ * @param[in] format		The format of the requests and of the replies
+ * @param[in] simulations	The simulations of a request which does not give them
+ * @param[in] discretization	The discretization of a request which does not give it
+ */
+HestonServer::HestonServer(Format format, int simulations, int discretization) :
+	CLOSING(false) {
+
+	this->FORMAT = format;
+	this->SIMULATIONS = simulations;
+	this->DISCRETIZATION = discretization;
+	this->input = -1;
+	this->listener = -1;
+	this->ENDED = false;
+	this->REPLIES = 0;
+	this->STARTED = false;
+}
+
+HestonServer::~HestonServer(){
+
+	close();
+}
+
+/**
+ * @brief		Open the source of the requests and start reading it
+ * @param[in] source	"-" for the standard input, unix:PATH for a local socket, or the path of a file. The
+ *			replies of the standard input and of a file go to the standard output
+ * @return		false if the source cannot be opened
+ */
+bool HestonServer::open(std::string const & source){
+
+	if (source == "-") {
+		input = 0;
+	} else if (source.compare(0, 5, "unix:") == 0) {
+		struct sockaddr_un address;
+		memset(&address, 0, sizeof(address));
+		address.sun_family = AF_UNIX;
+		socketPath = source.substr(5);
+		if (socketPath.empty() || socketPath.size() >= sizeof(address.sun_path))
+			return false;
+		strncpy(address.sun_path, socketPath.c_str(), sizeof(address.sun_path) - 1);
+
+		listener = socket(AF_UNIX, SOCK_STREAM, 0);
+		if (listener < 0)
+			return false;
+		unlink(socketPath.c_str());
+		if (bind(listener, (struct sockaddr *) &address, sizeof(address)) != 0 || listen(listener, 8) != 0) {
+			::close(listener);
+			listener = -1;
+			return false;
+		}
+	} else {
+		input = ::open(source.c_str(), O_RDONLY);
+		if (input < 0)
+			return false;
+	}
+
+	reader = std::thread(&HestonServer::readLoop, this);
+	return true;
+}
+
+/**
+ * @brief		Take the requests queued, waiting for the first one up to a timeout
+ * @param[out] batch	The requests, in the order of arrival
+ * @param[in] count	The largest number of requests to take
+ * @param[in] timeout	The longest wait for a request (ms)
+ * @return		false when no more requests will come
+ */
+bool HestonServer::take(std::vector<HestonJob> & batch, size_t count, double timeout){
+
+	batch.clear();
+
+	std::unique_lock<std::mutex> guard(lock);
+	signal.wait_for(guard, std::chrono::duration<double, std::milli>(timeout),
+		[this]() { return !pending.empty() || ENDED; });
+
+	while (!pending.empty() && batch.size() < count) {
+		batch.push_back(pending.front());
+		pending.pop_front();
+	}
+	signal.notify_all();
+
+	return !(batch.empty() && ENDED);
+}
+
+/**
+ * @brief		Send the reply of a request on its stream. A client which left loses its replies
+ */
+void HestonServer::reply(HestonJob const & job){
+
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	double elapsed = std::chrono::duration<double, std::milli>(now - job.arrival).count();
+
+	if (FORMAT == BINARY) {
+		HestonReplyRecord record;
+		record.id = strtoull(job.id.c_str(), NULL, 10);
+		record.price = job.invalid.empty() ? job.price : NAN;
+		record.error = job.invalid.empty() ? job.error : NAN;
+		record.simulations = job.invalid.empty() ? job.done : -1;
+		writeAll(*job.output, reinterpret_cast<char const *>(&record), sizeof(record));
+	} else {
+		char line[512];
+		if (job.invalid.empty())
+			snprintf(line, sizeof(line), "%s,%.10g,%.10g,%ld,%.3f\n", job.id.c_str(), job.price, job.error,
+				job.done, elapsed);
+		else
+			snprintf(line, sizeof(line), "%s,error,%s\n", job.id.c_str(), job.invalid.c_str());
+		writeAll(*job.output, line, strlen(line));
+	}
+
+	REPLIES++;
+	latency.add(elapsed);
+}
+
+/**
+ * @brief		Stop reading, the requests not taken yet are dropped
+ */
+void HestonServer::close(){
+
+	CLOSING = true;
+	signal.notify_all();
+	if (reader.joinable())
+		reader.join();
+
+	if (listener >= 0) {
+		::close(listener);
+		unlink(socketPath.c_str());
+		listener = -1;
+	}
+	if (input > 2)
+		::close(input);
+	input = -1;
+}
+
+/**
+ * @brief		The number of replies sent
+ */
+long HestonServer::getRequests() const {
+	return REPLIES;
+}
+
+/**
+ * @brief		Replies per second since the first request
+ */
+double HestonServer::getThroughput() const {
+
+	if (!STARTED || REPLIES == 0)
+		return 0.0;
+
+	double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - first).count();
+	return (elapsed > 0.0) ? REPLIES / elapsed : 0.0;
+}
+
+/**
+ * @brief		Statistics of the latency of the replies (ms from the arrival of the request)
+ */
+HestonStats const & HestonServer::getLatency() const {
+	return latency;
+}
+
+/**
+ * @brief		Signal handler which ends the request streams, a server on a socket has no other end
+ */
+void HestonServer::interrupt(int signal){
+
+	(void) signal;
+	INTERRUPTED = 1;
+}
+
+HestonServer::Format HestonServer::parseFormat(std::string const & name){
+
+	if (name == "binary")
+		return BINARY;
+	return CSV;
+}
+
+const char* HestonServer::formatName(Format format){
+
+	return (format == BINARY) ? "binary" : "csv";
+}
+
+/**
+ * @brief		The reader thread: the input stream, or the clients of the socket one after the other
+ */
+void HestonServer::readLoop(){
+
+	if (listener < 0) {
+		readStream(input, Stream(1));
+	} else {
+		while (!CLOSING && !INTERRUPTED) {
+			struct pollfd ready = { listener, POLLIN, 0 };
+			if (poll(&ready, 1, POLL_MS) <= 0)
+				continue;
+			int client = accept(listener, NULL, NULL);
+			if (client < 0)
+				continue;
+			readStream(client, Stream(client));
+		}
+	}
+
+	std::lock_guard<std::mutex> guard(lock);
+	ENDED = true;
+	signal.notify_all();
+}
+
+/**
+ * @brief		Read the requests of a stream up to its end
+ * @param[in] fd	The descriptor of the stream
+ * @param[in] output	The stream of the replies
+ */
+void HestonServer::readStream(int fd, std::shared_ptr<int> const & output){
+
+	std::string buffer;
+	char chunk[65536];
+	bool open = true;
+
+	while (open && !CLOSING && !INTERRUPTED) {
+		struct pollfd ready = { fd, POLLIN, 0 };
+		int events = poll(&ready, 1, POLL_MS);
+		if (events < 0 && errno != EINTR)
+			break;
+		if (events <= 0)
+			continue;
+
+		ssize_t bytes = read(fd, chunk, sizeof(chunk));
+		if (bytes < 0 && errno == EINTR)
+			continue;
+		if (bytes <= 0) {
+			// The last CSV line may have no line feed
+			open = false;
+			if (FORMAT == CSV && !buffer.empty())
+				buffer.push_back('\n');
+		} else {
+			buffer.append(chunk, bytes);
+		}
+
+		size_t start = 0;
+		if (FORMAT == CSV) {
+			size_t end;
+			while ((end = buffer.find('\n', start)) != std::string::npos) {
+				HestonJob job;
+				if (parseLine(buffer.substr(start, end - start), job)) {
+					job.output = output;
+					queue(job);
+				}
+				start = end + 1;
+			}
+		} else {
+			while (buffer.size() - start >= sizeof(HestonRequestRecord)) {
+				HestonRequestRecord record;
+				memcpy(&record, buffer.data() + start, sizeof(record));
+				HestonJob job;
+				parseRecord(record, job);
+				job.output = output;
+				queue(job);
+				start += sizeof(record);
+			}
+		}
+		buffer.erase(0, start);
+	}
+}
+
+/**
+ * @brief		Queue a request, waiting while the queue is full
+ */
+void HestonServer::queue(HestonJob & job){
+
+	std::unique_lock<std::mutex> guard(lock);
+	signal.wait(guard, [this]() { return pending.size() < QUEUE || CLOSING; });
+
+	job.arrival = std::chrono::steady_clock::now();
+	if (!STARTED) {
+		first = job.arrival;
+		STARTED = true;
+	}
+	pending.push_back(job);
+	signal.notify_all();
+}
+
+/**
+ * @brief		Parse a CSV request, an invalid one is kept with the reason of the error
+ * @return		false for the empty lines and the comments, which are not requests
+ */
+bool HestonServer::parseLine(std::string const & line, HestonJob & job){
+
+	size_t start = line.find_first_not_of(" \t\r");
+	if (start == std::string::npos || line[start] == '#')
+		return false;
+
+	std::vector<std::string> fields;
+	std::stringstream stream(line.substr(start));
+	std::string field;
+	while (std::getline(stream, field, ','))
+		fields.push_back(field);
+	if (!fields.empty() && !fields.back().empty() && fields.back()[fields.back().size() - 1] == '\r')
+		fields.back().erase(fields.back().size() - 1);
+
+	job.id = fields[0];
+	job.simulations = SIMULATIONS;
+	job.discretization = DISCRETIZATION;
+
+	if (fields.size() < 10 || fields.size() > 12) {
+		job.invalid = "expected id,S0,K,r,T,V0,rho,kappa,theta,xi[,simulations[,discretization]]";
+		return true;
+	}
+
+	double values[11];
+	for (size_t f = 1; f < fields.size(); f++) {
+		char * end;
+		values[f - 1] = strtod(fields[f].c_str(), &end);
+		if (end == fields[f].c_str() || *end != '\0') {
+			job.invalid = "invalid field " + fields[f];
+			return true;
+		}
+	}
+
+	job.S0 = values[0];
+	job.K = values[1];
+	job.r = values[2];
+	job.T = values[3];
+	job.V0 = values[4];
+	job.rho = values[5];
+	job.kappa = values[6];
+	job.theta = values[7];
+	job.xi = values[8];
+	if (fields.size() > 10 && values[9] > 0.0)
+		job.simulations = (int) std::min(values[9], 2e9);
+	if (fields.size() > 11 && values[10] > 0.0)
+		job.discretization = (int) std::min(values[10], 1e6);
+
+	validate(job);
+	return true;
+}
+
+/**
+ * @brief		Read a binary request
+ */
+void HestonServer::parseRecord(HestonRequestRecord const & record, HestonJob & job){
+
+	std::ostringstream id;
+	id << record.id;
+	job.id = id.str();
+
+	job.S0 = record.parameters[0];
+	job.K = record.parameters[1];
+	job.r = record.parameters[2];
+	job.T = record.parameters[3];
+	job.V0 = record.parameters[4];
+	job.rho = record.parameters[5];
+	job.kappa = record.parameters[6];
+	job.theta = record.parameters[7];
+	job.xi = record.parameters[8];
+	job.simulations = (record.simulations > 0) ? record.simulations : SIMULATIONS;
+	job.discretization = (record.discretization > 0) ? record.discretization : DISCRETIZATION;
+
+	validate(job);
+}
+
+/**
+ * @brief		Check the parameters of a request. The Fourier pricer and the QE scheme divide by kappa and xi,
+ *			which must then be positive
+ */
+void HestonServer::validate(HestonJob & job){
+
+	if (!(job.S0 > 0.0 && job.K > 0.0 && job.T > 0.0))
+		job.invalid = "S0, K and T must be positive";
+	else if (!(job.kappa > 0.0 && job.xi > 0.0))
+		job.invalid = "kappa and xi must be positive";
+	else if (!(job.V0 >= 0.0 && job.theta >= 0.0))
+		job.invalid = "V0 and theta must not be negative";
+	else if (!(job.rho >= -1.0 && job.rho <= 1.0))
+		job.invalid = "rho must be in [-1, 1]";
+	else if (!std::isfinite(job.r))
+		job.invalid = "r must be finite";
+}
+
+/**
+ * @brief		Write a buffer, a socket closed by its peer does not raise SIGPIPE
+ */
+bool HestonServer::writeAll(int fd, char const * data, size_t bytes){
+
+	while (bytes > 0) {
+		ssize_t written = send(fd, data, bytes, MSG_NOSIGNAL);
+		if (written < 0 && errno == ENOTSOCK)
+			written = write(fd, data, bytes);
+		if (written < 0 && errno == EINTR)
+			continue;
+		if (written <= 0)
+			return false;
+		data += written;
+		bytes -= written;
+	}
+	return true;
+}
@@ -0,0 +1,322 @@
+/**
+ *       @file  HestonSobol.cc
+ *
+ * Description: Owen-scrambled Sobol points with Brownian bridge ordering. The direction numbers are built from
+ *		the primitive polynomials over GF(2) in increasing degree, with initial direction numbers drawn
+ *		once from a fixed generator (Jaeckel initialization), so any number of dimensions is available.
+ *		Each randomized replication uses an independent nested uniform scrambling (the hash-based Owen
+ *		scrambling of Laine-Karras and Burley), which keeps every replication an unbiased estimator and
+ *		makes the spread between replications a valid error estimate.
+ *
+ *     @author  Luca Napoletano luca.napoletano@mail.polimi.it, Claudio Montanari claudio1.montanari@mail.polimi.it
+ *
+ *     Company  Politecnico di Milano
+ *   Copyright  Copyright (c) 2017, Luca Napoletano, Claudio Montanari
+ *
+ * This source code is released for free distribution under the terms of the
+ * GNU General Public License as published by the Free Software Foundation.
+ * =====================================================================================
+ */
+#include "HestonSobol.h"
+#include "HestonNormal.h"
+
+#include <cmath>
+
+namespace {
+
+/**
+ * @brief		Product of two polynomials over GF(2) modulo a polynomial of the given degree
+ */
+uint64_t polyMulMod(uint64_t a, uint64_t b, uint64_t modulus, int degree){
+
+	uint64_t result = 0;
+
+	while (b) {
+		if (b & 1)
+			result ^= a;
+		b >>= 1;
+		a <<= 1;
+		if (a & (1ULL << degree))
+			a ^= modulus;
+	}
+
+	return result;
+}
+
+/**
+ * @brief		x^e modulo a polynomial over GF(2)
+ */
+uint64_t polyPowMod(uint64_t e, uint64_t modulus, int degree){
+
+	uint64_t result = 1;
+	uint64_t base = (degree == 1) ? (2 ^ modulus) : 2;
+
+	while (e) {
+		if (e & 1)
+			result = polyMulMod(result, base, modulus, degree);
+		base = polyMulMod(base, base, modulus, degree);
+		e >>= 1;
+	}
+
+	return result;
+}
+
+/**
+ * @brief		A polynomial of degree d is primitive when x has order 2^d - 1 modulo it
+ */
+bool isPrimitive(uint64_t polynomial, int degree){
+
+	uint64_t order = (1ULL << degree) - 1;
+
+	if (polyPowMod(order, polynomial, degree) != 1)
+		return false;
+
+	uint64_t rest = order;
+	for (uint64_t q = 2; q * q <= rest; q++) {
+		if (rest % q)
+			continue;
+		if (polyPowMod(order / q, polynomial, degree) == 1)
+			return false;
+		while (rest % q == 0)
+			rest /= q;
+	}
+
+	if (rest > 1 && polyPowMod(order / rest, polynomial, degree) == 1)
+		return false;
+
+	return true;
+}
+
+uint64_t splitMix(uint64_t & state){
+
+	uint64_t z = (state += 0x9E3779B97F4A7C15ULL);
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+	return z ^ (z >> 31);
+}
+
+uint32_t reverseBits(uint32_t x){
+
+	x = ((x >> 1) & 0x55555555) | ((x & 0x55555555) << 1);
+	x = ((x >> 2) & 0x33333333) | ((x & 0x33333333) << 2);
+	x = ((x >> 4) & 0x0F0F0F0F) | ((x & 0x0F0F0F0F) << 4);
+	x = ((x >> 8) & 0x00FF00FF) | ((x & 0x00FF00FF) << 8);
+	return (x >> 16) | (x << 16);
+}
+
+/**
+ * @brief		Nested uniform (Owen) scrambling of a 32 bit coordinate: a hash which only propagates
+ *			from the high bits to the low bits, applied on the reversed bits (Burley, 2020)
+ */
+uint32_t owenScramble(uint32_t x, uint32_t seed){
+
+	x = reverseBits(x);
+	x ^= x * 0x3d20adea;
+	x += seed;
+	x *= (seed >> 16) | 1;
+	x ^= x * 0x05526c56;
+	x ^= x * 0x53a22864;
+	return reverseBits(x);
+}
+
+}
+
+/**
+ * @brief		Build the generator of the paths of a given discretization
+ * @param[in] steps	The number of time steps of a path, the sequence has 2 x steps dimensions
+ * @param[in] seed	The job seed, it selects the scrambling of each replication
+ */
+HestonSobol::HestonSobol(int steps, uint64_t seed){
+
+	this->STEPS = steps;
+	this->DIMENSIONS = 2 * steps;
+	this->SEED = seed;
+	this->INDEX = 0;
+	this->VALID = false;
+
+	point.resize(DIMENSIONS);
+	normal.resize(DIMENSIONS);
+	ordered.resize(STEPS);
+	increments.resize(STEPS);
+	brownian.resize(STEPS);
+
+	initDirections();
+	initBridge();
+}
+
+int HestonSobol::getSteps(){
+	return STEPS;
+}
+
+/**
+ * @brief		Compute the 32 direction numbers of each dimension
+ */
+void HestonSobol::initDirections(){
+
+	directions.assign(DIMENSIONS * 32, 0);
+
+	// First dimension: van der Corput sequence
+	for (int k = 0; k < 32; k++) {
+		directions[k] = 1U << (31 - k);
+	}
+
+	uint64_t state = 0x5EED5EED5EED5EEDULL;
+	int dimension = 1;
+
+	for (int degree = 1; dimension < DIMENSIONS; degree++) {
+		for (uint64_t polynomial = (1ULL << degree) | 1; polynomial < (2ULL << degree) && dimension < DIMENSIONS; polynomial += 2) {
+
+			if (!isPrimitive(polynomial, degree))
+				continue;
+
+			uint64_t m[33];
+			for (int k = 1; k <= degree && k <= 32; k++) {
+				// Random odd initial numbers, m_k < 2^k
+				m[k] = (degree == 1) ? 1 : ((splitMix(state) & ((1ULL << k) - 1)) | 1);
+			}
+
+			for (int k = degree + 1; k <= 32; k++) {
+				m[k] = m[k - degree] ^ (m[k - degree] << degree);
+				for (int i = 1; i < degree; i++) {
+					if ((polynomial >> (degree - i)) & 1)
+						m[k] ^= m[k - i] << i;
+				}
+			}
+
+			for (int k = 1; k <= 32; k++) {
+				directions[dimension * 32 + k - 1] = (uint32_t) (m[k] << (32 - k));
+			}
+
+			dimension++;
+		}
+	}
+}
+
+/**
+ * @brief		Compute the Brownian bridge construction over STEPS unit time steps: the first normal fixes
+ *			the end of the path, the next ones the midpoints of the widest unfilled intervals
+ */
+void HestonSobol::initBridge(){
+
+	std::vector<int> map(STEPS, 0);
+
+	bridgeIndex.assign(STEPS, 0);
+	leftIndex.assign(STEPS, 0);
+	rightIndex.assign(STEPS, 0);
+	leftWeight.assign(STEPS, 0.0);
+	rightWeight.assign(STEPS, 0.0);
+	stdDev.assign(STEPS, 0.0);
+
+	map[STEPS - 1] = 1;
+	bridgeIndex[0] = STEPS - 1;
+	stdDev[0] = sqrt((double) STEPS);
+
+	int j = 0;
+	for (int i = 1; i < STEPS; i++) {
+
+		while (map[j])
+			j++;
+		int k = j;
+		while (!map[k])
+			k++;
+
+		// Points j..k-1 are free, k is the next filled one: fill the middle of the interval
+		int l = j + ((k - 1 - j) >> 1);
+		map[l] = i;
+
+		bridgeIndex[i] = l;
+		leftIndex[i] = j;
+		rightIndex[i] = k;
+
+		// Times are t_i = i + 1, time 0 is the start of the path
+		double tLeft = j;
+		double tMiddle = l + 1;
+		double tRight = k + 1;
+		leftWeight[i] = (tRight - tMiddle) / (tRight - tLeft);
+		rightWeight[i] = (tMiddle - tLeft) / (tRight - tLeft);
+		stdDev[i] = sqrt((tMiddle - tLeft) * (tRight - tMiddle) / (tRight - tLeft));
+
+		j = k + 1;
+		if (j >= STEPS)
+			j = 0;
+	}
+}
+
+/**
+ * @brief		Build a Brownian path from the normals in bridge order and return its increments, which
+ *			are N(0,1) draws ordered by time
+ */
+void HestonSobol::bridge(double const * z, double * out){
+
+	brownian[STEPS - 1] = stdDev[0] * z[0];
+
+	for (int i = 1; i < STEPS; i++) {
+		int j = leftIndex[i];
+		int k = rightIndex[i];
+		int l = bridgeIndex[i];
+		double left = (j != 0) ? brownian[j - 1] : 0.0;
+		brownian[l] = leftWeight[i] * left + rightWeight[i] * brownian[k] + stdDev[i] * z[i];
+	}
+
+	out[0] = brownian[0];
+	for (int i = 1; i < STEPS; i++) {
+		out[i] = brownian[i] - brownian[i - 1];
+	}
+}
+
+/**
+ * @brief		Move the generator to a point of the sequence. Consecutive indexes cost one XOR per
+ *			dimension (Gray code order), any other index is computed directly
+ */
+void HestonSobol::moveTo(uint32_t index){
+
+	if (VALID && index == INDEX + 1) {
+		int bit = __builtin_ctz(~INDEX);
+		for (int d = 0; d < DIMENSIONS; d++) {
+			point[d] ^= directions[d * 32 + bit];
+		}
+	}
+	else {
+		uint32_t gray = index ^ (index >> 1);
+		for (int d = 0; d < DIMENSIONS; d++) {
+			uint32_t x = 0;
+			for (int bit = 0; bit < 32; bit++) {
+				if ((gray >> bit) & 1)
+					x ^= directions[d * 32 + bit];
+			}
+			point[d] = x;
+		}
+	}
+
+	INDEX = index;
+	VALID = true;
+}
+
+/**
+ * @brief			Write the normals of a path, stored as [step][spot, volatility] with the given stride
+ * @param[in] replication	The randomized replication, it selects the scrambling
+ * @param[in] index		The index of the point in the sequence
+ * @param[out] normals		The N(0,1) draws of the path
+ * @param[in] stride		The distance between two consecutive draws of the path (the lanes of a kernel)
+ */
+void HestonSobol::path(int replication, uint32_t index, double * normals, int stride){
+
+	moveTo(index);
+
+	for (int d = 0; d < DIMENSIONS; d++) {
+		uint64_t state = SEED ^ (((uint64_t) replication << 32) | (uint64_t) d);
+		uint32_t scrambled = owenScramble(point[d], (uint32_t) splitMix(state));
+		normal[d] = HestonNormal::inverse((scrambled + 0.5) * (1.0 / 4294967296.0));
+	}
+
+	// Even dimensions drive the spot, odd ones the volatility: both get the best dimensions first
+	for (int c = 0; c < 2; c++) {
+		for (int i = 0; i < STEPS; i++) {
+			ordered[i] = normal[2 * i + c];
+		}
+		bridge(ordered.data(), increments.data());
+		for (int j = 0; j < STEPS; j++) {
+			normals[(2 * j + c) * stride] = increments[j];
+		}
+	}
+}
@@ -16,14 +16,20 @@
 #include "HestonWorker.h"
 
 #include <cstdio>
-#include <bbque/utils/utility.h>
 
+#include <algorithm>
 #include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <new>
 
 
 /**
  * @brief		The constructor of the HestonWorker class
  *
+ * @param[in] pool	The pool of threads which runs the simulations
+ * @param[in] slot	The pool thread reserved to this worker
+ * @param[in] settings	The settings of the simulation engine
  * @param[in] S0	The spot price of the option
  * @param[in] K		The strike price of the option
  * @param[in] r		The risk-free rate of the option
@@ -34,60 +40,337 @@
  * @param[in] theta	The long-term volatility value
  * @param[in] xi	The volatility of volatility (V0)
  */
-HestonWorker::HestonWorker(double S0, double K, double r, double T, double V0, double rho, double kappa, double theta, double xi){
+HestonWorker::HestonWorker(HestonPool* pool, int slot, HestonSettings const & settings, double S0, double K, double r, double T, double V0, double rho, double kappa, double theta, double xi) :
+	normal(settings.normal, settings.kernel) {
+
+	this->pool = pool;
+	this->slot = slot;
+
+	this->HASTOWORK = true;
+	this->normals = NULL;
+	this->BUFFERSIZE = 0;
+	this->BUFFERNODE = -1;
+
+	// The derivatives of the paths are only carried by the scalar reference code
+	this->GREEKS = settings.greeks;
+	this->kernel = GREEKS ? NULL : HestonKernel::select(settings.kernel, settings.payoff);
+	this->LANES = GREEKS ? 1 : HestonKernel::lanes(settings.kernel);
+
+	// The single precision kernel is only built when the run may use it, the EXC turns it on per AWM
+	bool mixed = settings.precision == HestonKernel::FLOAT && kernel != NULL;
+	this->floatKernel = mixed ? HestonKernel::select(settings.kernel, settings.payoff, HestonKernel::FLOAT) : NULL;
+	this->FLOATLANES = mixed ? HestonKernel::lanes(settings.kernel, HestonKernel::FLOAT) : LANES;
+	this->FLOAT = false;
+	this->check = NULL;
+	this->totalSum = 0;
+	this->totalCompensation = 0;
 
 	this->S0 = S0;
 	this->K = K;
 	this->r = r;
 	this->T = T;
+	this->HORIZON = settings.pathTime(T);
 	this->V0 = V0;
 	this->rho = rho;
 	this->kappa = kappa;
 	this->theta = theta;
 	this->xi = xi;
 
-	//SetUp the Random Number Generator and the Normal extractor 
-	std::random_device device;
-	
-	generator.seed(device());
+	//SetUp the Random Number Generator, all the workers share the same key
+	generator = HestonRandom(settings.seed);
+
+	this->sobol = NULL;
+	this->QMC = settings.qmc;
+	this->REPLICATIONS = settings.replications;
+	this->SEED = settings.seed;
+
+	// The controls are the terminal spot and the Black-Scholes companion call, whose variance is the
+	// expected mean variance of the Heston path
+	this->SCHEME = settings.scheme;
+	this->LEVEL = 0;
+	this->american = NULL;
+	this->TRAINING = false;
+
+	this->PAYOFF = settings.payoff;
+	this->BARRIER = settings.barrier;
+
+	switch (PAYOFF) {
+	case HestonKernel::ASIAN_ARITHMETIC:
+		path = &HestonWorker::hestonPath<HestonAsianArithmetic<HestonScalarMath> >;
+		break;
+	case HestonKernel::ASIAN_GEOMETRIC:
+		path = &HestonWorker::hestonPath<HestonAsianGeometric<HestonScalarMath> >;
+		break;
+	case HestonKernel::UP_AND_OUT:
+		path = &HestonWorker::hestonPath<HestonBarrierCall<HestonScalarMath, true, false> >;
+		break;
+	case HestonKernel::UP_AND_IN:
+		path = &HestonWorker::hestonPath<HestonBarrierCall<HestonScalarMath, true, true> >;
+		break;
+	case HestonKernel::DOWN_AND_OUT:
+		path = &HestonWorker::hestonPath<HestonBarrierCall<HestonScalarMath, false, false> >;
+		break;
+	case HestonKernel::DOWN_AND_IN:
+		path = &HestonWorker::hestonPath<HestonBarrierCall<HestonScalarMath, false, true> >;
+		break;
+	case HestonKernel::LOOKBACK:
+		path = &HestonWorker::hestonPath<HestonLookbackCall<HestonScalarMath> >;
+		break;
+	default:
+		path = &HestonWorker::hestonPath<HestonEuropeanCall<HestonScalarMath> >;
+		break;
+	}
+
+	// The path-dependent payoffs are also regressed on the European call, priced by the Fourier engine
+	this->CONTROL = settings.controlVariates;
+	this->companionVariance = HestonFourier::meanVariance(V0, kappa, theta, HORIZON);
+	this->control.controls = CONTROL ? (settings.european() ? 2 : 3) : 0;
+
+	// In grid mode the paths reach the longest maturity, the others (T among them) are observed on the way
+	this->GRID = settings.grid();
+	this->OPTIONMATURITY = 0;
+	if (GRID) {
+		strikes = settings.strikes;
+		maturities = settings.maturities;
+		OPTIONMATURITY = std::find(maturities.begin(), maturities.end(), T) - maturities.begin();
+		gridPayoffs.resize(strikes.size());
+		gridSums.resize(strikes.size() * maturities.size());
+		gridSquares.resize(strikes.size() * maturities.size());
+	}
+
+}
+
+/**
+ * @brief		The destructor of the HestonWorker class, it releases the path buffer
+ */
+HestonWorker::~HestonWorker(){
 
+	free(normals);
+	delete sobol;
+}
+
+/**
+ * @brief		Allocate the path buffer. It is called by the pool thread, after it has been pinned, thus the
+ *			buffer is first touched (and then placed) on the NUMA node of the worker. The buffer is
+ *			reallocated only when it is too small or when the RTRM moved the worker to another node. The
+ *			same holds for the tables of the quasi-Monte Carlo generator
+ */
+void HestonWorker::allocateBuffers(){
+
+	int size = 2 * DISCRETIZATION * std::max(LANES, FLOATLANES);
+	int node = HestonPool::currentNode();
+
+	if (QMC && (sobol == NULL || sobol->getSteps() != DISCRETIZATION || node != BUFFERNODE)) {
+		delete sobol;
+		sobol = new HestonSobol(DISCRETIZATION, SEED);
+	}
+
+	// Each maturity is observed at the end of the closest step
+	if (GRID) {
+		maturitySteps.clear();
+		for (size_t m = 0; m < maturities.size(); m++) {
+			maturitySteps.push_back(HestonSettings::maturityStep(maturities[m], HORIZON, DISCRETIZATION));
+		}
+	}
+
+	if(normals != NULL && size <= BUFFERSIZE && node == BUFFERNODE)
+		return;
+
+	free(normals);
+	normals = NULL;
+	BUFFERSIZE = 0;
+	if(posix_memalign((void**) &normals, 64, size * sizeof(double)) != 0) {
+		normals = NULL;
+		throw std::bad_alloc();
+	}
+
+	memset(normals, 0, size * sizeof(double));
+	BUFFERSIZE = size;
+	BUFFERNODE = node;
+}
+
+/**
+ * @brief		Price another option with the same settings, the next simulations use the new parameters.
+ *			It must not be called while the worker runs, nor in grid mode
+ */
+void HestonWorker::setOption(double S0, double K, double r, double T, double V0, double rho, double kappa, double theta, double xi){
+
+	this->S0 = S0;
+	this->K = K;
+	this->r = r;
+	this->T = T;
+	this->HORIZON = T;
+	this->V0 = V0;
+	this->rho = rho;
+	this->kappa = kappa;
+	this->theta = theta;
+	this->xi = xi;
+	this->companionVariance = HestonFourier::meanVariance(V0, kappa, theta, T);
 }
 
 /**
  * @brief			Method used to start a simulation
  * @param[in] simulationToDo	The number of the simulations that a single worker has to do
  * @param[in] discretization	The value of discretization of the simulation
+ * @param[in] block		The index of the block of paths, it selects the random streams
  */
-void HestonWorker::start(int simulationToDo, int discretization){
+void HestonWorker::start(int simulationToDo, int discretization, int block){
 	
 	//Set the number of simulations and the discretization level
 	this->SIMULATIONSTODO = simulationToDo;
 	this->DISCRETIZATION = discretization;
+	this->BLOCK = block;
+	this->FIRSTPATH = 0;
+	this->BLOCKSIZE = simulationToDo;
 	this->SIMULATIONSDONE = 0;
 	this->totalSum = 0;
-	//Start the Worker	
-	worker = std::thread(&HestonWorker::hestonSimulation, this);
+	this->totalCompensation = 0;
+	this->stats.reset();
+	std::fill(gridSums.begin(), gridSums.end(), 0.0);
+	std::fill(gridSquares.begin(), gridSquares.end(), 0.0);
+	this->control.reset();
+	for (int g = 0; g < HESTON_GREEKS; g++)
+		this->greekStats[g].reset();
+	//Wake up the Worker thread
+	pool->post(slot, std::bind(&HestonWorker::hestonSimulation, this));
 
 }
 
 /**
  * @brief			Method used to start a simulation with a fixed number of simulations
  * @param[in] discretization	The value of discretization of the simulation
+ * @param[in] block		The index of the block of paths, it selects the random streams
  */
-void HestonWorker::start(int discretization){
+void HestonWorker::start(int discretization, int block){
 	
 	//Set the number of simulations and the discretization level
 	this->SIMULATIONSTODO = DEFAULT_SIMULATIONS;
 	this->DISCRETIZATION = discretization;
+	this->BLOCK = block;
+	this->FIRSTPATH = 0;
+	this->BLOCKSIZE = DEFAULT_SIMULATIONS;
 	this->SIMULATIONSDONE = 0;
 	this->totalSum = 0;
-	//Start the Worker	
-	worker = std::thread(&HestonWorker::hestonSimulation, this);
+	this->totalCompensation = 0;
+	this->stats.reset();
+	std::fill(gridSums.begin(), gridSums.end(), 0.0);
+	std::fill(gridSquares.begin(), gridSquares.end(), 0.0);
+	this->control.reset();
+	for (int g = 0; g < HESTON_GREEKS; g++)
+		this->greekStats[g].reset();
+	//Wake up the Worker thread
+	pool->post(slot, std::bind(&HestonWorker::hestonSimulation, this));
+
+}
+
+/**
+ * @brief			Simulate a chunk of a block on the calling thread, which must be the pool thread of the
+ *				worker (the buffers are placed on its NUMA node). A block split in chunks gives the same
+ *				paths as a whole one. A chunk preempted by stop() is resumed by passing back its partial
+ *				results: the accumulation goes on in the same order, as if it was never stopped
+ * @param[in] firstPath		The first path of the chunk inside the block
+ * @param[in] simulationToDo	The number of paths of the chunk
+ * @param[in] blockSize		The number of paths of the block
+ * @param[in] discretization	The value of discretization of the simulation
+ * @param[in] block		The index of the block of paths, it selects the random streams
+ * @param[in] from		The partial results of the chunk, the first from.paths paths are already done
+ */
+void HestonWorker::simulate(int firstPath, int simulationToDo, int blockSize, int discretization, int block, HestonPartial const & from){
+
+	this->SIMULATIONSTODO = simulationToDo - from.paths;
+	this->DISCRETIZATION = discretization;
+	this->BLOCK = block;
+	this->FIRSTPATH = firstPath + from.paths;
+	this->BLOCKSIZE = blockSize;
+
+	if (from.paths == 0) {
+		this->SIMULATIONSDONE = 0;
+		this->totalSum = 0;
+		this->totalCompensation = 0;
+		this->stats.reset();
+		std::fill(gridSums.begin(), gridSums.end(), 0.0);
+		std::fill(gridSquares.begin(), gridSquares.end(), 0.0);
+		this->control.reset();
+		for (int g = 0; g < HESTON_GREEKS; g++)
+			this->greekStats[g].reset();
+	} else {
+		this->SIMULATIONSDONE = from.paths;
+		this->totalSum = from.sum;
+		this->totalCompensation = from.compensation;
+		this->stats = from.stats;
+		this->gridSums = from.gridSums;
+		this->gridSquares = from.gridSquares;
+		this->control = from.control;
+		for (int g = 0; g < HESTON_GREEKS; g++)
+			this->greekStats[g] = from.greeks[g];
+	}
+
+	hestonSimulation();
+}
+
+/**
+ * @brief			Copy the accumulators of the last chunk
+ */
+void HestonWorker::collect(HestonPartial & partial){
+
+	partial.paths = SIMULATIONSDONE;
+	partial.sum = totalSum;
+	partial.compensation = totalCompensation;
+	partial.stats = stats;
+	partial.control = control;
+	for (int g = 0; g < HESTON_GREEKS; g++)
+		partial.greeks[g] = greekStats[g];
+	partial.gridSums = gridSums;
+	partial.gridSquares = gridSquares;
+}
+
+/**
+ * @brief			Evolve the paths of the next simulations with the single precision kernel, or with the double
+ *				one. It is ignored when the worker has no single precision kernel, and it must be called by
+ *				the pool thread of the worker, or while the worker does not run
+ */
+void HestonWorker::setPrecision(HestonKernel::Precision precision){
+
+	this->FLOAT = (precision == HestonKernel::FLOAT && floatKernel != NULL);
+}
+
+/**
+ * @brief			Evolve the variance of the next simulations with another scheme. It must be called by the
+ *				pool thread of the worker, or while the worker does not run
+ */
+void HestonWorker::setScheme(HestonKernel::Scheme scheme){
+
+	this->SCHEME = scheme;
+}
 
+/**
+ * @brief			Run the same paths through the single and the double precision kernels and compare their
+ *				samples, on the pool thread of the worker. It returns when the check is done
+ * @param[in] simulations	The number of paths of the sample, rounded down to whole single precision lane groups
+ * @param[in] discretization	The value of discretization of the simulation
+ * @param[in] block		The index of the block of paths, it selects the random streams
+ * @param[out] check		The statistics of the comparison, added to the ones it holds
+ */
+void HestonWorker::checkPrecision(int simulations, int discretization, int block, HestonPrecisionCheck & check){
+
+	if (floatKernel == NULL)
+		return;
+
+	this->SIMULATIONSTODO = simulations;
+	this->DISCRETIZATION = discretization;
+	this->BLOCK = block;
+	this->FIRSTPATH = 0;
+	this->BLOCKSIZE = simulations;
+	this->SIMULATIONSDONE = 0;
+	this->check = &check;
+	pool->post(slot, std::bind(&HestonWorker::precisionSimulation, this));
+	pool->join(slot);
+	this->check = NULL;
 }
 
 /**
- * @brief			Method used to stop a worker
+ * @brief			Method used to stop a worker: the running simulation returns at its next checkpoint, the
+ *				worker does nothing until resume()
  */
 int HestonWorker::stop(){
 
@@ -100,20 +383,501 @@ int HestonWorker::stop(){
 
 }
 
+/**
+ * @brief			Let the worker run again after a stop()
+ */
+void HestonWorker::resume(){
+
+	this->HASTOWORK = true;
+}
+
+/**
+ * @brief			Method used to start a block of a multilevel Monte Carlo level
+ * @param[in] level		The level, level 0 has no coarse path
+ * @param[in] simulationToDo	The number of coupled paths of the block
+ * @param[in] discretization	The number of steps of the fine paths, the coarse ones have half of them
+ * @param[in] block		The index of the block of paths, it selects the random streams
+ */
+void HestonWorker::startLevel(int level, int simulationToDo, int discretization, int block){
+
+	this->LEVEL = level;
+	this->SIMULATIONSTODO = simulationToDo;
+	this->DISCRETIZATION = discretization;
+	this->BLOCK = block;
+	this->FIRSTPATH = 0;
+	this->BLOCKSIZE = simulationToDo;
+	this->SIMULATIONSDONE = 0;
+	this->totalSum = 0;
+	this->stats.reset();
+	//Wake up the Worker thread
+	pool->post(slot, std::bind(&HestonWorker::levelSimulation, this));
+
+}
+
+/**
+ * @brief			Method used to start a block of Longstaff-Schwartz paths
+ * @param[in] american		The path store and the exercise rule
+ * @param[in] training		True to store the paths of the block, false to price them with the exercise rule
+ * @param[in] simulationToDo	The number of paths of the block, each one with its antithetic twin
+ * @param[in] discretization	The value of discretization of the simulation
+ * @param[in] block		The index of the block of paths, it selects the random streams and, for the
+ *				training set, the rows of the store
+ */
+void HestonWorker::startAmerican(HestonAmerican* american, bool training, int simulationToDo, int discretization, int block){
+
+	this->american = american;
+	this->TRAINING = training;
+	this->SIMULATIONSTODO = simulationToDo;
+	this->DISCRETIZATION = discretization;
+	this->BLOCK = block;
+	this->FIRSTPATH = 0;
+	this->BLOCKSIZE = simulationToDo;
+	this->SIMULATIONSDONE = 0;
+	this->totalSum = 0;
+	this->stats.reset();
+	//Wake up the Worker thread
+	pool->post(slot, std::bind(&HestonWorker::americanSimulation, this));
+
+}
+
 /**
  * @brief			Method used to wait a computation of a worker
  */
 void HestonWorker::join(){
 
-	worker.join();
+	pool->join(slot);
 }
 
 /**
- * @brief			Method used to do an Heston Simulation. It is used for the thread function
+ * @brief			The kernel arguments of the option, with the constants of the variance scheme, and without
+ *				observation dates nor controls
+ * @param[in] pathTime		The time up to which the paths are simulated
+ * @param[in] discretization	The number of steps of the paths
+ */
+HestonKernelArgs HestonWorker::kernelArgs(double pathTime, int discretization) const{
+
+	HestonKernelArgs a = HestonKernelArgs();
+	a.S0 = S0;
+	a.K = K;
+	a.r = r;
+	a.T = pathTime;
+	a.V0 = V0;
+	a.rho = rho;
+	a.kappa = kappa;
+	a.theta = theta;
+	a.xi = xi;
+	a.discretization = discretization;
+	a.companionVariance = companionVariance;
+	a.barrier = BARRIER;
+	HestonKernel::prepare(a, SCHEME);
+
+	return a;
+}
+
+/**
+ * @brief			Method used to do an Heston Simulation. It is used for the thread function. Whole lane groups
+ *				of paths are simulated by the batched kernel, the remaining paths by the scalar reference code.
+ *				The partial sum is accumulated in path order, so a block always gives the same result
  */
 void HestonWorker::hestonSimulation(){
 
-	double deltaT = (T / ((double) DISCRETIZATION));
+	allocateBuffers();
+
+	// A resumed chunk goes on with its own sum
+	double sum = totalSum;
+	int i = 0;
+	int resumed = SIMULATIONSDONE;
+
+	args = kernelArgs(HORIZON, DISCRETIZATION);
+	args.observations = (int) maturitySteps.size();
+	args.observationSteps = maturitySteps.data();
+	args.observed = observed;
+	args.controls = CONTROL ? controlValues : NULL;
+
+	// In single precision the wider lane groups come first, the double kernel takes the paths left
+	HestonKernel::Function stages[] = { (FLOAT && SCHEME != HestonKernel::QUADRATIC_EXPONENTIAL) ? floatKernel : NULL, kernel };
+	int stageLanes[] = { FLOATLANES, LANES };
+	double compensation = totalCompensation;
+
+	for (int stage = 0; stage < 2; stage++) {
+
+		HestonKernel::Function batch = stages[stage];
+		int lanes = stageLanes[stage];
+
+		if (batch == NULL)
+			continue;
+
+		for (; i + lanes <= SIMULATIONSTODO; i += lanes) {
+
+			// Preemption checkpoint, between two lane groups
+			if (!HASTOWORK.load(std::memory_order_relaxed))
+				break;
+
+			{
+				HESTON_TIMED(counters.rngTime);
+				drawNormals(i, lanes);
+			}
+			{
+				HESTON_TIMED(counters.evolutionTime);
+				batch(args, normals, payoffs);
+			}
+			if (GRID)
+				optionPayoffs(lanes);
+
+			for (int l = 0; l < lanes; l++) {
+				if (FLOAT) {
+					// Kahan summation, the sum of many small payoffs keeps their low order bits
+					double y = payoffs[l] - compensation;
+					double t = sum + y;
+					compensation = (t - sum) - y;
+					sum = t;
+				}
+				else
+					sum = sum + payoffs[l];
+				stats.add(0.5 * payoffs[l]);
+			}
+			if (GRID)
+				evaluateGrid(lanes);
+			if (CONTROL)
+				addControls(lanes);
+			SIMULATIONSDONE += lanes;
+		}
+	}
+
+	for (; i < SIMULATIONSTODO; i++) {
+
+		if (!HASTOWORK.load(std::memory_order_relaxed))
+			break;
+
+		{
+			HESTON_TIMED(counters.rngTime);
+			drawNormals(i, 1);
+		}
+
+		double payoff;
+		{
+			HESTON_TIMED(counters.evolutionTime);
+			payoff = (this->*path)(normals, observed, controlValues);
+		}
+		payoffs[0] = payoff;
+		if (GRID) {
+			optionPayoffs(1);
+			payoff = payoffs[0];
+		}
+
+		SIMULATIONSDONE++;
+		if (FLOAT) {
+			double y = payoff - compensation;
+			double t = sum + y;
+			compensation = (t - sum) - y;
+			sum = t;
+		}
+		else
+			sum = sum + payoff;
+		stats.add(0.5 * payoff);
+		if (GRID)
+			evaluateGrid(1);
+		if (CONTROL)
+			addControls(1);
+	}
+
+	totalSum = sum;
+	totalCompensation = compensation;
+
+	HestonCounters::add(counters.paths, SIMULATIONSDONE - resumed);
+	HestonCounters::add(counters.steps, (uint64_t) (SIMULATIONSDONE - resumed) * DISCRETIZATION);
+}
+
+/**
+ * @brief			Compare the kernels: every single precision lane group is simulated, then its normals are
+ *				split in double lane groups and simulated again by the double kernel, so that both kernels
+ *				evolve the very same paths and the differences of their samples are only due to rounding.
+ *				The QE scheme has no single precision kernel, there is nothing to compare
+ */
+void HestonWorker::precisionSimulation(){
+
+	if (SCHEME == HestonKernel::QUADRATIC_EXPONENTIAL)
+		return;
+
+	allocateBuffers();
+
+	args = kernelArgs(HORIZON, DISCRETIZATION);
+
+	std::vector<double> split(2 * DISCRETIZATION * LANES);
+	double floatPayoffs[HESTON_MAX_LANES];
+
+	for (int i = 0; i + FLOATLANES <= SIMULATIONSTODO; i += FLOATLANES) {
+
+		drawNormals(i, FLOATLANES);
+		floatKernel(args, normals, floatPayoffs);
+
+		for (int h = 0; h < FLOATLANES; h += LANES) {
+			for (int k = 0; k < 2 * DISCRETIZATION; k++) {
+				memcpy(split.data() + k * LANES, normals + k * FLOATLANES + h, LANES * sizeof(double));
+			}
+			kernel(args, split.data(), payoffs);
+
+			for (int l = 0; l < LANES; l++) {
+				double difference = 0.5 * (floatPayoffs[h + l] - payoffs[l]);
+				check->reference.add(0.5 * payoffs[l]);
+				check->difference.add(difference);
+				check->largest = std::max(check->largest, fabs(difference));
+			}
+		}
+		SIMULATIONSDONE += FLOATLANES;
+	}
+}
+
+/**
+ * @brief			Simulate a block of a multilevel Monte Carlo level. A sample is the difference between the
+ *				payoff of a fine path and the one of the coarse path driven by the same Brownian increments,
+ *				each averaged with its antithetic twin
+ */
+void HestonWorker::levelSimulation(){
+
+	allocateBuffers();
+
+	args = kernelArgs(T, DISCRETIZATION);
+	coarseArgs = kernelArgs(T, std::max(1, DISCRETIZATION / 2));
+
+	double sum = 0;
+
+	for (int i = 0; i < SIMULATIONSTODO; i++) {
+
+		{
+			HESTON_TIMED(counters.rngTime);
+			drawNormals(i, 1);
+		}
+
+		double coarse = 0.0;
+		double fine;
+		{
+			HESTON_TIMED(counters.evolutionTime);
+			fine = coupledPath(normals, coarse);
+		}
+
+		SIMULATIONSDONE++;
+		sum = sum + (fine - coarse);
+		stats.add(0.5 * (fine - coarse));
+	}
+
+	totalSum += sum;
+
+	HestonCounters::add(counters.paths, SIMULATIONSTODO);
+	HestonCounters::add(counters.steps, (uint64_t) SIMULATIONSTODO * DISCRETIZATION);
+}
+
+/**
+ * @brief			Simulate a block of Longstaff-Schwartz paths. A training block stores the state of every path
+ *				and of its antithetic twin at the exercise dates into the rows 2 (BLOCK * SIMULATIONSTODO + i)
+ *				and 2 (BLOCK * SIMULATIONSTODO + i) + 1, with the payoff at maturity as initial cashflow.
+ *				Otherwise the exercise rule is applied along the path, a sample is the mean of the two
+ *				discounted cashflows
+ */
+void HestonWorker::americanSimulation(){
+
+	allocateBuffers();
+
+	args = kernelArgs(T, DISCRETIZATION);
+
+	int dates = american->getDates();
+	std::vector<int> exerciseSteps(dates);
+	for (int d = 0; d < dates; d++) {
+		exerciseSteps[d] = HestonSettings::maturityStep(american->exerciseTime(d), T, DISCRETIZATION);
+	}
+
+	double sum = 0;
+
+	for (int i = 0; i < SIMULATIONSTODO; i++) {
+
+		{
+			HESTON_TIMED(counters.rngTime);
+			drawNormals(i, 1);
+		}
+
+		long row = 2 * ((long) BLOCK * SIMULATIONSTODO + i);
+		double volatility = V0, spot_price = S0;
+		double antithetic_volatility = V0, antithetic_spot_price = S0;
+		double value = 0.0, antithetic_value = 0.0;
+		bool alive = true, antithetic_alive = true;
+		int date = 0;
+
+		for (int j = 0; j < DISCRETIZATION && (TRAINING || alive || antithetic_alive); j++) {
+
+			double random_spot = normals[2 * j];
+			double random_volatility = normals[2 * j + 1];
+
+			schemeStep(args, volatility, spot_price, random_spot, random_volatility);
+			schemeStep(args, antithetic_volatility, antithetic_spot_price, -random_spot, -random_volatility);
+
+			while (date < dates && exerciseSteps[date] == j + 1) {
+				if (TRAINING) {
+					american->store(row, date, spot_price, volatility);
+					american->store(row + 1, date, antithetic_spot_price, antithetic_volatility);
+				}
+				else {
+					if (alive && american->exercises(date, spot_price, volatility)) {
+						value = american->payoff(date, spot_price);
+						alive = false;
+					}
+					if (antithetic_alive && american->exercises(date, antithetic_spot_price, antithetic_volatility)) {
+						antithetic_value = american->payoff(date, antithetic_spot_price);
+						antithetic_alive = false;
+					}
+				}
+				date++;
+			}
+		}
+
+		if (TRAINING) {
+			value = american->payoff(dates - 1, spot_price);
+			antithetic_value = american->payoff(dates - 1, antithetic_spot_price);
+			american->setCashflow(row, value);
+			american->setCashflow(row + 1, antithetic_value);
+		}
+
+		SIMULATIONSDONE++;
+		sum = sum + value + antithetic_value;
+		stats.add(0.5 * (value + antithetic_value));
+	}
+
+	totalSum += sum;
+
+	HestonCounters::add(counters.paths, SIMULATIONSTODO);
+	HestonCounters::add(counters.steps, (uint64_t) SIMULATIONSTODO * DISCRETIZATION);
+}
+
+/**
+ * @brief			Simulate a fine path and its antithetic twin and, above level 0, the coarse paths with
+ *				twice the time step: every coarse draw is the normalized sum of two consecutive fine draws
+ * @param[in] normals		The N(0,1) draws of the fine path, stored as [step][spot, volatility]
+ * @param[out] coarse		The sum of the payoffs of the coarse path and of its antithetic twin, 0 at level 0
+ * @return			The sum of the payoffs of the fine path and of its antithetic twin
+ */
+double HestonWorker::coupledPath(double const * normals, double & coarse){
+
+	double volatility = V0, spot_price = S0;
+	double antithetic_volatility = V0, antithetic_spot_price = S0;
+	double coarse_volatility = V0, coarse_spot_price = S0;
+	double antithetic_coarse_volatility = V0, antithetic_coarse_spot_price = S0;
+
+	for (int j = 0; j < DISCRETIZATION; j++) {
+
+		double random_spot = normals[2 * j];
+		double random_volatility = normals[2 * j + 1];
+
+		schemeStep(args, volatility, spot_price, random_spot, random_volatility);
+		schemeStep(args, antithetic_volatility, antithetic_spot_price, -random_spot, -random_volatility);
+
+		if (LEVEL > 0 && (j % 2) == 1) {
+			double coarse_random_spot = (normals[2 * j - 2] + random_spot) * M_SQRT1_2;
+			double coarse_random_volatility = (normals[2 * j - 1] + random_volatility) * M_SQRT1_2;
+
+			schemeStep(coarseArgs, coarse_volatility, coarse_spot_price, coarse_random_spot, coarse_random_volatility);
+			schemeStep(coarseArgs, antithetic_coarse_volatility, antithetic_coarse_spot_price, -coarse_random_spot, -coarse_random_volatility);
+		}
+	}
+
+	coarse = (LEVEL > 0) ? europeanCall(coarse_spot_price, K) + europeanCall(antithetic_coarse_spot_price, K) : 0.0;
+
+	return europeanCall(spot_price, K) + europeanCall(antithetic_spot_price, K);
+}
+
+/**
+ * @brief			Add the payoffs of all the grid nodes for the spots observed by a lane group. The strikes are
+ *				the inner loop, so the payoffs of a maturity are computed in a single vectorized loop
+ * @param[in] lanes		The number of paths of the group
+ */
+void HestonWorker::evaluateGrid(int lanes){
+
+	int nStrikes = (int) strikes.size();
+	double const * strike = strikes.data();
+	double * payoff = gridPayoffs.data();
+
+	for (size_t m = 0; m < maturitySteps.size(); m++) {
+		double * sums = gridSums.data() + m * nStrikes;
+		double * squares = gridSquares.data() + m * nStrikes;
+
+		for (int l = 0; l < lanes; l++) {
+			double spot = observed[(2 * m) * lanes + l];
+			double antithetic_spot = observed[(2 * m + 1) * lanes + l];
+
+			for (int k = 0; k < nStrikes; k++) {
+				payoff[k] = 0.5 * (std::max(spot - strike[k], 0.0) + std::max(antithetic_spot - strike[k], 0.0));
+			}
+			for (int k = 0; k < nStrikes; k++) {
+				sums[k] += payoff[k];
+				squares[k] += payoff[k] * payoff[k];
+			}
+		}
+	}
+}
+
+/**
+ * @brief			Replace the payoffs of a lane group, which the kernels evaluate at the end of the paths, with
+ *				the ones of the option at its maturity, observed on the way to the longest maturity of the grid
+ * @param[in] lanes		The number of paths of the group
+ */
+void HestonWorker::optionPayoffs(int lanes){
+
+	size_t m = OPTIONMATURITY;
+
+	for (int l = 0; l < lanes; l++) {
+		payoffs[l] = std::max(observed[(2 * m) * lanes + l] - K, 0.0) + std::max(observed[(2 * m + 1) * lanes + l] - K, 0.0);
+	}
+}
+
+/**
+ * @brief			Add the payoffs of a lane group and the values of their controls to the regression sums.
+ *				Every sample is the mean over a path and its antithetic twin
+ * @param[in] lanes		The number of paths of the group
+ */
+void HestonWorker::addControls(int lanes){
+
+	double x[HESTON_MAX_CONTROLS];
+
+	for (int l = 0; l < lanes; l++) {
+		for (int c = 0; c < control.controls; c++) {
+			x[c] = 0.5 * controlValues[c * lanes + l];
+		}
+		control.add(0.5 * payoffs[l], x);
+	}
+}
+
+/**
+ * @brief			Fill the path buffer with the N(0,1) draws of a lane group, stored as [step][spot, volatility][lane]
+ * @param[in] path		The index of the first path of the group inside the block
+ * @param[in] lanes		The number of paths of the group
+ */
+void HestonWorker::drawNormals(int path, int lanes){
+
+	if (QMC) {
+		int replication = BLOCK % REPLICATIONS;
+		uint32_t offset = (uint32_t) (BLOCK / REPLICATIONS) * BLOCKSIZE + FIRSTPATH;
+
+		for (int l = 0; l < lanes; l++) {
+			sobol->path(replication, offset + path + l, normals + l, lanes);
+		}
+		return;
+	}
+
+	generator.seek(BLOCK, FIRSTPATH + path);
+	normal.fill(generator, normals, 2 * DISCRETIZATION * lanes);	/**<Random Numbers with normal distribution*/
+}
+
+/**
+ * @brief			The scalar reference kernel: it simulates a single path and its antithetic twin and returns
+ *				the sum of their payoffs
+ * @param P			The payoff policy, instantiated on doubles
+ * @param[in] normals		The N(0,1) draws of the path, stored as [step][spot, volatility]
+ * @param[out] observed		The spots at the grid maturities, stored as [maturity][spot, antithetic]
+ * @param[out] controls		The sums over the path and its antithetic twin of the terminal spot, of the
+ *				payoff of the Black-Scholes companion path and of the European call, in control variate mode only
+ */
+template <class P>
+double HestonWorker::hestonPath(double const * normals, double * observed, double * controls){
+
+	double deltaT = (HORIZON / ((double) DISCRETIZATION));
 
     	double random_spot;
     	double random_volatility;
@@ -123,107 +887,237 @@ void HestonWorker::hestonSimulation(){
 	double antithetic_random_volatility;
     	double antithetic_correlated_random_spot;
 	
-    	double correct_volatility;
     	double volatility;
     	double spot_price;
 
-    	double antithetic_correct_volatility;
     	double antithetic_volatility;
     	double antithetic_spot_price;
 
-    	double sum = 0;
-
-	for (int i = 0; i < SIMULATIONSTODO; i++) {
+        volatility = V0;
+        spot_price = S0;
 	
-        	volatility = V0;
-        	spot_price = S0;
-	
-		antithetic_volatility = volatility;
-		antithetic_spot_price = spot_price;
+	antithetic_volatility = volatility;
+	antithetic_spot_price = spot_price;
+
+	double companion_spot_price = spot_price;
+	double antithetic_companion_spot_price = spot_price;
 
-		for (int j = 0; j < DISCRETIZATION; j++) {
+	size_t observation = 0;
 
-			random_spot = normalCDFInverse((((double)generator())+ 0.5)*(1.0/4294967296.0));             				/**<Random Number with uniform distribution*/
-			random_volatility = normalCDFInverse((((double)generator()) + 0.5)*(1.0/4294967296.0));  					/**<Random Number with uniform distribution*/
+	P payoff(args);
+	P antithetic_payoff(args);
 
-			antithetic_random_spot = -random_spot;					/**<Antithetic Random Number with uniform distribution*/
-			antithetic_random_volatility = -random_volatility;			/**<Antithetic Random Number with uniform distribution*/ 		
-			correlated_random_spot = (rho * random_volatility) + (random_spot * sqrt(1 - rho * rho));       
-				/**<Correlation between the two Normal Distribution*/
-			antithetic_correlated_random_spot = (rho * antithetic_random_volatility) + (antithetic_random_spot * sqrt(1 - rho * rho));
-				/**<Correlation between the two Antithetic Normal Distribution*/
-		 	
-			correct_volatility = maxValue(volatility, 0.0);     	/**<Value for sqrt use, then it must be positive*/
-			antithetic_correct_volatility = maxValue(antithetic_volatility , 0.0);	
+	// Greeks: the Gaussian part of the log spot given the variance path and its variance, on the path and
+	// on the paths driven by the same draws from V0 bumped up and down (vega)
+	double conditional[2] = { 0.0, 0.0 };
+	double antithetic_conditional[2] = { 0.0, 0.0 };
+	double bump = VEGA_BUMP * maxValue(V0, 1e-4);
+	double bumped_volatility[2] = { V0 + bump, maxValue(V0 - bump, 0.0) };
+	double antithetic_bumped_volatility[2] = { bumped_volatility[0], bumped_volatility[1] };
+	double bumped_spot_price[2] = { S0, S0 };
+	double antithetic_bumped_spot_price[2] = { S0, S0 };
+	double bumped_conditional[2][2] = { { 0.0, 0.0 }, { 0.0, 0.0 } };
+	double antithetic_bumped_conditional[2][2] = { { 0.0, 0.0 }, { 0.0, 0.0 } };
 
-			volatility = volatility +  kappa * deltaT * (theta - correct_volatility) + xi * sqrt(correct_volatility * deltaT) * random_volatility;
-			    /**<Calculating volatility value in time using Euler discretization*/
+	for (int j = 0; j < DISCRETIZATION; j++) {
 
-			spot_price = spot_price * exp( (r - 0.5 * correct_volatility) * deltaT + sqrt(correct_volatility * deltaT) * correlated_random_spot);
-			    /**<Calculating spot price value in time using Euler discretization*/
+		double step_variance = maxValue(volatility, 0.0);
+		double antithetic_step_variance = maxValue(antithetic_volatility, 0.0);
 
+		random_spot = normals[2 * j];
+		random_volatility = normals[2 * j + 1];
 
-			antithetic_volatility = antithetic_volatility +  kappa * deltaT * (theta - antithetic_correct_volatility) + xi * sqrt(antithetic_correct_volatility * deltaT) * antithetic_random_volatility;
-			    /**<Calculating antithetic volatility value in time using Euler discretization*/
+		antithetic_random_spot = -random_spot;					/**<Antithetic Random Number with uniform distribution*/
+		antithetic_random_volatility = -random_volatility;			/**<Antithetic Random Number with uniform distribution*/ 		
+		correlated_random_spot = (rho * random_volatility) + (random_spot * sqrt(1 - rho * rho));       
+			/**<Correlation between the two Normal Distribution*/
+		antithetic_correlated_random_spot = (rho * antithetic_random_volatility) + (antithetic_random_spot * sqrt(1 - rho * rho));
+			/**<Correlation between the two Antithetic Normal Distribution*/
 
-			antithetic_spot_price = antithetic_spot_price * exp( (r - 0.5 * antithetic_correct_volatility) * deltaT + sqrt(antithetic_correct_volatility * deltaT) * antithetic_correlated_random_spot);
-			    /**<Calculating antithetic spot price value in time using Euler discretization*/
+		schemeStep(args, volatility, spot_price, random_spot, random_volatility, GREEKS ? conditional : NULL);
+		    /**<Calculating volatility and spot price values in time using the selected discretization*/
 
+		schemeStep(args, antithetic_volatility, antithetic_spot_price, antithetic_random_spot, antithetic_random_volatility,
+			GREEKS ? antithetic_conditional : NULL);
+		    /**<Calculating antithetic volatility and spot price values in time using the selected discretization*/
+
+		if (GREEKS) {
+			for (int b = 0; b < 2; b++) {
+				schemeStep(args, bumped_volatility[b], bumped_spot_price[b], random_spot, random_volatility, bumped_conditional[b]);
+				schemeStep(args, antithetic_bumped_volatility[b], antithetic_bumped_spot_price[b], antithetic_random_spot,
+					antithetic_random_volatility, antithetic_bumped_conditional[b]);
 			}
-	
-	    SIMULATIONSDONE++;		
-	    sum = sum + europeanCall(spot_price, K) + europeanCall(antithetic_spot_price, K);   
-								/** This line aims to calculate the simulated option value using a Option function, 
-		                                                *   in this way we can personalize the option payoff.
-		                                                */
-	    }
+		}
 
-	    totalSum += sum;
+		payoff.step(P::LOG ? log(spot_price / S0) : 0.0, spot_price, step_variance);
+		antithetic_payoff.step(P::LOG ? log(antithetic_spot_price / S0) : 0.0, antithetic_spot_price, antithetic_step_variance);
+		    /**<Streaming state of the payoff, the log spot is only computed for the policies which read it*/
 
+		if (CONTROL) {
+			companion_spot_price = companion_spot_price * exp( (r - 0.5 * companionVariance) * deltaT + sqrt(companionVariance * deltaT) * correlated_random_spot);
+			antithetic_companion_spot_price = antithetic_companion_spot_price * exp( (r - 0.5 * companionVariance) * deltaT + sqrt(companionVariance * deltaT) * antithetic_correlated_random_spot);
+			    /**<Black-Scholes companion paths, driven by the same spot draws*/
+		}
+
+		while (observation < maturitySteps.size() && maturitySteps[observation] == j + 1) {
+			observed[2 * observation] = spot_price;
+			observed[2 * observation + 1] = antithetic_spot_price;
+			observation++;
+		}
+	}
+
+	if (CONTROL) {
+		controls[0] = spot_price + antithetic_spot_price;
+		controls[1] = europeanCall(companion_spot_price, K) + europeanCall(antithetic_companion_spot_price, K);
+		controls[2] = europeanCall(spot_price, K) + europeanCall(antithetic_spot_price, K);
+	}
+
+	if (GREEKS) {
+		double samples[HESTON_GREEKS], antithetic_samples[HESTON_GREEKS];
+		double width = V0 + bump - maxValue(V0 - bump, 0.0);
+		greekSamples(spot_price, conditional, bumped_spot_price, bumped_conditional, width, samples);
+		greekSamples(antithetic_spot_price, antithetic_conditional, antithetic_bumped_spot_price, antithetic_bumped_conditional, width,
+			antithetic_samples);
+		for (int g = 0; g < HESTON_GREEKS; g++)
+			greekStats[g].add(0.5 * (samples[g] + antithetic_samples[g]));
+	}
+
+	return payoff.payoff(P::LOG ? log(spot_price / S0) : 0.0, spot_price)
+		+ antithetic_payoff.payoff(P::LOG ? log(antithetic_spot_price / S0) : 0.0, antithetic_spot_price);
+							/** This line aims to calculate the simulated option value using the payoff policy,
+	                                                *   in this way we can personalize the option payoff.
+	                                                */
 }
 
 
 /**
- * @brief		Method used to calculate an approximation of the passed value
- * @param[in] t		The number to approximate	
+ * @brief			The discounted Greek samples of a European call path. Delta and rho are pathwise, S_T is
+ *				linear in S0 and its log is linear in r. Gamma is the mixed estimator: the likelihood ratio
+ *				of the pathwise delta, with the score of the log spot given the variance path (a Gaussian
+ *				of variance conditional[1]), which stays bounded as the step shrinks. Vega is mixed too: the
+ *				call is first priced in closed form given the variance path (conditionalCall), which is
+ *				smooth in V0, then differentiated by the central difference of the paths from V0 + h and
+ *				V0 - h (floored at 0), driven by the same draws, with h = VEGA_BUMP max(V0, 1e-4)
+ * @param[in] spot_price		The spot at maturity
+ * @param[in] conditional		The Gaussian part of the log spot given the variance path and its variance
+ * @param[in] bumped_spot_price		The spots at maturity of the paths from the bumped V0, up and down
+ * @param[in] bumped_conditional	The Gaussian parts of the log spot of the bumped paths and their variances
+ * @param[in] width			The distance between the bumped V0
+ * @param[out] samples			The samples, indexed by HestonGreek
  */
-double HestonWorker::rationalApproximation(double t){
+void HestonWorker::greekSamples(double spot_price, double const * conditional, double const * bumped_spot_price,
+	double const (* bumped_conditional)[2], double width, double * samples){
 
-   // Abramowitz and Stegun formula 26.2.23.
-    // The absolute value of the error should be less than 4.5 e-4.
-    double c[] = {2.515517, 0.802853, 0.010328};
-    double d[] = {1.432788, 0.189269, 0.001308};
-    return t - ((c[2]*t + c[1])*t + c[0]) /
-                (((d[2]*t + d[1])*t + d[0])*t + 1.0);
+	double discount = exp(-r * T);
+	double exercised = (spot_price > K) ? 1.0 : 0.0;
+
+	samples[GREEK_DELTA] = discount * exercised * spot_price / S0;
+	samples[GREEK_GAMMA] = (conditional[1] > 0.0) ?
+		discount * exercised * spot_price * (conditional[0] / conditional[1] - 1.0) / (S0 * S0) : 0.0;
+	samples[GREEK_VEGA] = discount * (conditionalCall(bumped_spot_price[0], bumped_conditional[0])
+		- conditionalCall(bumped_spot_price[1], bumped_conditional[1])) / width;
+	samples[GREEK_RHO] = discount * exercised * K * T;
 }
 
 /**
- * @brief		Method used to calculate the inverse of the standard normal function
- * @param[in] p		A value between 0 and 1 (exclused) that represents a value of a standard normal distribution
+ * @brief			The undiscounted call price given the variance path: the log spot at maturity is the one
+ *				of the path minus its Gaussian part, plus a Gaussian of variance conditional[1], thus the
+ *				price is the Black-Scholes one on the forward spot_price exp(conditional[1] / 2 - conditional[0])
+ * @param[in] spot_price	The spot at maturity
+ * @param[in] conditional	The Gaussian part of the log spot given the variance path and its variance
  */
-double HestonWorker::normalCDFInverse(double p){
+double HestonWorker::conditionalCall(double spot_price, double const * conditional){
+
+	if (conditional[1] <= 0.0)
+		return europeanCall(spot_price, K);
 
-    if (p <= 0.0 || p >= 1.0)
-    {
-/*
-        stringstream os;
-        os << "Invalid input argument (" << p
-        << "); must be larger than 0 but less than 1.";
-        throw invalid_argument( os.str() );
-*/
-	return -1;
-    }
- 
-    if (p < 0.5)
-    {
-        // F^-1(p) = - G^-1(p)
-        return -rationalApproximation( sqrt(-2.0*log(p)) );
-    }
-    else
-    {
-        // F^-1(p) = G^-1(1-p)
-        return rationalApproximation( sqrt(-2.0*log(1-p)) );
-    }
+	double deviation = sqrt(conditional[1]);
+	double forward = spot_price * exp(0.5 * conditional[1] - conditional[0]);
+	double d1 = (log(forward / K) + 0.5 * conditional[1]) / deviation;
+
+	return forward * HestonNormal::cdf(d1) - K * HestonNormal::cdf(d1 - deviation);
+}
+
+/**
+ * @brief			Advance the variance and the spot of a path by one time step
+ * @param[in] step		The kernel arguments of the discretization, with the scheme constants
+ * @param[in,out] volatility	The variance of the path
+ * @param[in,out] spot_price	The spot price of the path
+ * @param[in] random_spot	The N(0,1) draw of the spot, independent of the variance one
+ * @param[in] random_volatility	The N(0,1) draw of the variance
+ * @param[in,out] conditional	When not NULL, the part of the log spot increment driven by random_spot, which is
+ *				Gaussian given the variance path, and its variance are added to conditional[0, 1]
+ */
+void HestonWorker::schemeStep(HestonKernelArgs const & step, double & volatility, double & spot_price, double random_spot, double random_volatility,
+	double * conditional){
+
+	double deltaT = step.T / ((double) step.discretization);
+
+	double correlated_random_spot = (rho * random_volatility) + (random_spot * sqrt(1 - rho * rho));
+
+	if (step.scheme == HestonKernel::LOG_EULER) {
+
+		// The variance is lognormal with the exact conditional mean and variance of the CIR step, it stays
+		// positive and, unlike an Euler step on log(v), is not absorbed near 0 when 2 kappa theta < xi^2
+		if (conditional != NULL) {
+			conditional[0] += sqrt((1 - rho * rho) * volatility * deltaT) * random_spot;
+			conditional[1] += (1 - rho * rho) * volatility * deltaT;
+		}
+		spot_price = spot_price * exp( (r - 0.5 * volatility) * deltaT + sqrt(volatility * deltaT) * correlated_random_spot);
+		double mean = theta + (volatility - theta) * step.qeDecay;
+		double spread = log(1.0 + (step.qeSlope * volatility + step.qeConstant) / (mean * mean));
+		volatility = mean * exp(-0.5 * spread + sqrt(spread) * random_volatility);
+	}
+	else if (step.scheme == HestonKernel::QUADRATIC_EXPONENTIAL) {
+
+		// Match the first two conditional moments of the variance, then correct the drift of the log spot
+		double m = theta + (volatility - theta) * step.qeDecay;
+		double s2 = step.qeSlope * volatility + step.qeConstant;
+		double psi = s2 / (m * m);
+		double A = step.qeK2 + 0.5 * step.qeK4;
+		double next, martingale;
+
+		if (psi <= QE_CRITICAL_PSI) {
+			double inverse = 2.0 / psi;
+			double b2 = inverse - 1.0 + sqrt(inverse) * sqrt(inverse - 1.0);
+			double a = m / (1.0 + b2);
+			double b = sqrt(b2);
+			next = a * (b + random_volatility) * (b + random_volatility);
+			martingale = exp(A * b2 * a / (1.0 - 2.0 * A * a)) / sqrt(1.0 - 2.0 * A * a);
+		}
+		else {
+			double p = (psi - 1.0) / (psi + 1.0);
+			double beta = (1.0 - p) / m;
+			double u = HestonNormal::cdf(random_volatility);
+			next = (u <= p) ? 0.0 : log((1.0 - p) / (1.0 - u)) / beta;
+			martingale = p + beta * (1.0 - p) / (beta - A);
+		}
+
+		if (conditional != NULL) {
+			conditional[0] += sqrt(step.qeK3 * volatility + step.qeK4 * next) * random_spot;
+			conditional[1] += step.qeK3 * volatility + step.qeK4 * next;
+		}
+
+		double K0 = -log(martingale) - (step.qeK1 + 0.5 * step.qeK3) * volatility;
+		spot_price = spot_price * exp( r * deltaT + K0 + step.qeK1 * volatility + step.qeK2 * next
+			+ sqrt(step.qeK3 * volatility + step.qeK4 * next) * random_spot);
+		volatility = next;
+	}
+	else {
+
+		double correct_volatility = maxValue(volatility, 0.0);     	/**<Value for sqrt use, then it must be positive*/
+
+		if (conditional != NULL) {
+			conditional[0] += sqrt((1 - rho * rho) * correct_volatility * deltaT) * random_spot;
+			conditional[1] += (1 - rho * rho) * correct_volatility * deltaT;
+		}
+
+		volatility = volatility +  kappa * deltaT * (theta - correct_volatility) + xi * sqrt(correct_volatility * deltaT) * random_volatility;
+		    /**<Calculating volatility value in time using Euler discretization*/
+
+		spot_price = spot_price * exp( (r - 0.5 * correct_volatility) * deltaT + sqrt(correct_volatility * deltaT) * correlated_random_spot);
+		    /**<Calculating spot price value in time using Euler discretization*/
+	}
 }
 
 /**
@@ -244,6 +1138,33 @@ double HestonWorker::getCalculus(){
 	return totalSum;
 }
 
+HestonStats const & HestonWorker::getStats(){
+	return stats;
+}
+
+/**
+ * @brief		Return the control variate sums of the last block
+ */
+HestonControl const & HestonWorker::getControl(){
+	return control;
+}
+
+/**
+ * @brief		Return the statistics of the samples of a Greek in the last block, already discounted
+ * @param[in] greek	The sensitivity, see HestonGreek
+ */
+HestonStats const & HestonWorker::getGreekStats(int greek){
+	return greekStats[greek];
+}
+
+/**
+ * @brief		Return the statistics of a grid node of the last block
+ * @param[in] node	The node index, maturity * strikes + strike
+ */
+HestonStats HestonWorker::getGridStats(int node){
+	return HestonStats::fromSums(SIMULATIONSDONE, gridSums[node], gridSquares[node]);
+}
+
 int HestonWorker::getSimulationsDone(){
 	return SIMULATIONSDONE;
 }
@@ -252,5 +1173,12 @@ int HestonWorker::getDefSimulations(){
 	return DEFAULT_SIMULATIONS;
 }
 
+/**
+ * @brief			The counters of the worker, they are only written by its pool thread
+ */
+HestonCounters const & HestonWorker::getCounters(){
+	return counters;
+}
+
 
 